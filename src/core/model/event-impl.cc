@@ -20,18 +20,288 @@
 
 #include "event-impl.h"
 #include "log.h"
+#include "global-value.h"
+#include "boolean.h"
+#include "ns3/core-config.h"
+#include <new>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
 
 NS_LOG_COMPONENT_DEFINE ("EventImpl");
 
 namespace ns3 {
 
+static GlobalValue g_eventPool ("EventPool",
+                                "Whether events are allocated from free lists rather than with "
+                                "operator new. Read when the first event is created.",
+                                BooleanValue (true),
+                                MakeBooleanChecker ());
+
+#ifdef HAVE_TLS
+// objects up to POOL_MAX_SIZE bytes are pooled, by size classes of
+// POOL_GRANULARITY bytes, and a free list is refilled by a chunk at a time
+static const uint32_t POOL_GRANULARITY = 16;
+static const uint32_t POOL_MAX_SIZE = 256;
+static const uint32_t POOL_CLASSES = POOL_MAX_SIZE / POOL_GRANULARITY;
+static const uint32_t POOL_CHUNK_SIZE = 16384;
+// a thread which has freed this many bytes of a size class since its
+// free list was last refilled hands the list over to the other threads
+static const uint32_t POOL_SPILL_SIZE = 2 * POOL_CHUNK_SIZE;
+
+struct PoolBlock
+{
+  PoolBlock *next;
+  // links the first blocks of the batches of the overflow lists
+  PoolBlock *nextBatch;
+};
+
+struct FreeList
+{
+  PoolBlock *head;
+  uint32_t freed;
+};
+
+// A block joins the free list of the thread which deletes the event,
+// which need not be the one which created it. Threads which free more
+// than they allocate move their lists to the shared overflow lists, from
+// which the threads which allocate more than they free refill theirs.
+static __thread FreeList g_freeLists[POOL_CLASSES];
+
+// The overflow lists, the chunks and the block counts are shared by all
+// threads, under g_poolLock. Chunks are linked by their first word so
+// that the memory of the pool stays reachable for leak checkers.
+static PoolBlock *g_overflow[POOL_CLASSES];
+static void *g_chunks = 0;
+static uint32_t g_poolBlocks[POOL_CLASSES];
+static volatile uint32_t g_poolLock = 0;
+
+static void
+LockPool (void)
+{
+  while (!__sync_bool_compare_and_swap (&g_poolLock, 0, 1))
+    {
+    }
+}
+
+static void
+UnlockPool (void)
+{
+  __sync_bool_compare_and_swap (&g_poolLock, 1, 0);
+}
+
+// with g_poolLock held
+static void
+SpillFreeList (uint32_t sizeClass)
+{
+  FreeList &list = g_freeLists[sizeClass];
+  if (list.head != 0)
+    {
+      list.head->nextBatch = g_overflow[sizeClass];
+      g_overflow[sizeClass] = list.head;
+    }
+  list.head = 0;
+  list.freed = 0;
+}
+
+#ifdef HAVE_PTHREAD_H
+// gives the free lists of an exiting thread to the other threads
+static pthread_key_t g_threadKey;
+static pthread_once_t g_threadKeyOnce = PTHREAD_ONCE_INIT;
+static __thread bool g_threadAttached = false;
+
+static void
+DetachThread (void *)
+{
+  LockPool ();
+  for (uint32_t sizeClass = 0; sizeClass < POOL_CLASSES; sizeClass++)
+    {
+      SpillFreeList (sizeClass);
+    }
+  UnlockPool ();
+}
+
+static void
+CreateThreadKey (void)
+{
+  pthread_key_create (&g_threadKey, &DetachThread);
+}
+
+static void
+AttachThread (void)
+{
+  if (!g_threadAttached)
+    {
+      g_threadAttached = true;
+      pthread_once (&g_threadKeyOnce, &CreateThreadKey);
+      pthread_setspecific (g_threadKey, &g_threadAttached);
+    }
+}
+#else /* HAVE_PTHREAD_H */
+static void
+AttachThread (void)
+{
+}
+#endif /* HAVE_PTHREAD_H */
+
+static void
+RefillFreeList (uint32_t sizeClass)
+{
+  AttachThread ();
+  FreeList &list = g_freeLists[sizeClass];
+  list.freed = 0;
+  LockPool ();
+  PoolBlock *batch = g_overflow[sizeClass];
+  if (batch != 0)
+    {
+      g_overflow[sizeClass] = batch->nextBatch;
+      UnlockPool ();
+      list.head = batch;
+      return;
+    }
+  UnlockPool ();
+
+  char *chunk = static_cast<char *> (::operator new (POOL_CHUNK_SIZE));
+  uint32_t blockSize = (sizeClass + 1) * POOL_GRANULARITY;
+  uint32_t blocks = 0;
+  PoolBlock *head = 0;
+  // the first granule holds the link to the next chunk
+  for (uint32_t offset = POOL_GRANULARITY; offset + blockSize <= POOL_CHUNK_SIZE; offset += blockSize)
+    {
+      PoolBlock *block = reinterpret_cast<PoolBlock *> (chunk + offset);
+      block->next = head;
+      head = block;
+      blocks++;
+    }
+  LockPool ();
+  *reinterpret_cast<void **> (chunk) = g_chunks;
+  g_chunks = chunk;
+  g_poolBlocks[sizeClass] += blocks;
+  UnlockPool ();
+  list.head = head;
+}
+
+enum PoolState
+{
+  POOL_UNKNOWN,
+  POOL_ENABLED,
+  POOL_DISABLED
+};
+
+// latched by the first event, so that every event is deleted the way it
+// was allocated
+static volatile uint32_t g_poolState = POOL_UNKNOWN;
+
+static bool
+IsPoolEnabled (void)
+{
+  uint32_t state = g_poolState;
+  if (state == POOL_UNKNOWN)
+    {
+      BooleanValue enabled;
+      g_eventPool.GetValue (enabled);
+      // the first thread to get here decides for all of them
+      __sync_bool_compare_and_swap (&g_poolState, POOL_UNKNOWN,
+                                    enabled.Get () ? POOL_ENABLED : POOL_DISABLED);
+      state = g_poolState;
+    }
+  return state == POOL_ENABLED;
+}
+#endif /* HAVE_TLS */
+
+void *
+EventImpl::operator new (size_t size)
+{
+#ifdef HAVE_TLS
+  if (size <= POOL_MAX_SIZE && IsPoolEnabled ())
+    {
+      uint32_t sizeClass = (size - 1) / POOL_GRANULARITY;
+      FreeList &list = g_freeLists[sizeClass];
+      if (list.head == 0)
+        {
+          RefillFreeList (sizeClass);
+        }
+      PoolBlock *block = list.head;
+      list.head = block->next;
+      return block;
+    }
+#endif /* HAVE_TLS */
+  return ::operator new (size);
+}
+
+void
+EventImpl::operator delete (void *p, size_t size)
+{
+#ifdef HAVE_TLS
+  if (size <= POOL_MAX_SIZE && IsPoolEnabled ())
+    {
+      uint32_t sizeClass = (size - 1) / POOL_GRANULARITY;
+      FreeList &list = g_freeLists[sizeClass];
+      PoolBlock *block = static_cast<PoolBlock *> (p);
+      block->next = list.head;
+      list.head = block;
+      list.freed += (sizeClass + 1) * POOL_GRANULARITY;
+      if (list.freed >= POOL_SPILL_SIZE)
+        {
+          AttachThread ();
+          LockPool ();
+          SpillFreeList (sizeClass);
+          UnlockPool ();
+        }
+      return;
+    }
+#endif /* HAVE_TLS */
+  ::operator delete (p);
+}
+
+void
+EventImpl::DestroyPool (void)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+#ifdef HAVE_TLS
+  LockPool ();
+  bool allFree = true;
+  for (uint32_t sizeClass = 0; sizeClass < POOL_CLASSES; sizeClass++)
+    {
+      SpillFreeList (sizeClass);
+      uint32_t blocks = 0;
+      for (PoolBlock *batch = g_overflow[sizeClass]; batch != 0; batch = batch->nextBatch)
+        {
+          for (PoolBlock *block = batch; block != 0; block = block->next)
+            {
+              blocks++;
+            }
+        }
+      allFree = allFree && blocks == g_poolBlocks[sizeClass];
+    }
+  // events still referenced, from another thread's free list or by an
+  // EventId which outlives the simulator, keep the pool alive
+  if (allFree)
+    {
+      while (g_chunks != 0)
+        {
+          void *chunk = g_chunks;
+          g_chunks = *reinterpret_cast<void **> (chunk);
+          ::operator delete (chunk);
+        }
+      for (uint32_t sizeClass = 0; sizeClass < POOL_CLASSES; sizeClass++)
+        {
+          g_overflow[sizeClass] = 0;
+          g_poolBlocks[sizeClass] = 0;
+        }
+    }
+  UnlockPool ();
+#endif /* HAVE_TLS */
+}
+
 EventImpl::~EventImpl ()
 {
   NS_LOG_FUNCTION (this);
 }
 
 EventImpl::EventImpl ()
-  : m_cancel (false)
+  : m_slot (0),
+    m_cancel (false)
 {
   NS_LOG_FUNCTION (this);
 }
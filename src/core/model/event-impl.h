@@ -21,6 +21,7 @@
 #define EVENT_IMPL_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include "simple-ref-count.h"
 
 namespace ns3 {
@@ -35,6 +36,14 @@ namespace ns3 {
  * obviously (there are Ref and Unref methods) reference-counted and
  * most subclasses are usually created by one of the many Simulator::Schedule
  * methods.
+ *
+ * Events are allocated from per-thread free lists of a few size classes
+ * rather than with the global operator new, which keeps malloc and free
+ * out of Simulator::Schedule and of the event loop. Threads which delete
+ * more events than they create, and threads which exit, hand their free
+ * lists over to the other threads. Set the "EventPool"
+ * global value to false, with NS_GLOBAL_VALUE="EventPool=false" for
+ * example, to give every event its own allocation for memory debuggers.
  */
 class EventImpl : public SimpleRefCount<EventImpl>
 {
@@ -57,14 +66,56 @@ public:
    * Invoked by the simulation engine before calling Invoke.
    */
   bool IsCancelled (void);
+  /**
+   * \param slot position of the event in the event list
+   *
+   * Reserved to the scheduler which holds the event, so that it can
+   * find the event without a search.
+   */
+  void SetSchedulerSlot (uint32_t slot);
+  /**
+   * \returns the position last given to SetSchedulerSlot
+   */
+  uint32_t GetSchedulerSlot (void) const;
+
+  /**
+   * \param size size of the event object
+   * \returns memory from the free list of the size class of the object
+   */
+  void *operator new (size_t size);
+  /**
+   * \param p memory returned by operator new
+   * \param size size of the event object, the same as given to operator new
+   */
+  void operator delete (void *p, size_t size);
+  /**
+   * Give the memory of the free lists back to the system, provided that
+   * no event allocated from them is alive any more.
+   *
+   * Called by Simulator::Destroy.
+   */
+  static void DestroyPool (void);
 
 protected:
   virtual void Notify (void) = 0;
 
 private:
+  uint32_t m_slot;
   bool m_cancel;
 };
 
+inline void
+EventImpl::SetSchedulerSlot (uint32_t slot)
+{
+  m_slot = slot;
+}
+
+inline uint32_t
+EventImpl::GetSchedulerSlot (void) const
+{
+  return m_slot;
+}
+
 } // namespace ns3
 
 #endif /* EVENT_IMPL_H */
@@ -0,0 +1,169 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "indexed-heap-scheduler.h"
+#include "event-impl.h"
+#include "assert.h"
+#include "log.h"
+#include <algorithm>
+
+NS_LOG_COMPONENT_DEFINE ("IndexedHeapScheduler");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (IndexedHeapScheduler);
+
+// number of children of a node
+static const uint32_t ARITY = 4;
+
+TypeId
+IndexedHeapScheduler::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IndexedHeapScheduler")
+    .SetParent<Scheduler> ()
+    .AddConstructor<IndexedHeapScheduler> ()
+  ;
+  return tid;
+}
+
+IndexedHeapScheduler::IndexedHeapScheduler ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+IndexedHeapScheduler::~IndexedHeapScheduler ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+IndexedHeapScheduler::Place (uint32_t slot, const Event &ev)
+{
+  m_heap[slot] = ev;
+  ev.impl->SetSchedulerSlot (slot);
+}
+
+void
+IndexedHeapScheduler::SiftUp (uint32_t slot, const Event &ev)
+{
+  while (slot > 0)
+    {
+      uint32_t parent = (slot - 1) / ARITY;
+      if (!(ev.key < m_heap[parent].key))
+        {
+          break;
+        }
+      Place (slot, m_heap[parent]);
+      slot = parent;
+    }
+  Place (slot, ev);
+}
+
+void
+IndexedHeapScheduler::SiftDown (uint32_t slot, const Event &ev)
+{
+  uint32_t size = m_heap.size ();
+  while (true)
+    {
+      uint32_t first = slot * ARITY + 1;
+      if (first >= size)
+        {
+          break;
+        }
+      uint32_t end = std::min (first + ARITY, size);
+      uint32_t smallest = first;
+      for (uint32_t child = first + 1; child < end; child++)
+        {
+          if (m_heap[child].key < m_heap[smallest].key)
+            {
+              smallest = child;
+            }
+        }
+      if (!(m_heap[smallest].key < ev.key))
+        {
+          break;
+        }
+      Place (slot, m_heap[smallest]);
+      slot = smallest;
+    }
+  Place (slot, ev);
+}
+
+void
+IndexedHeapScheduler::Insert (const Event &ev)
+{
+  NS_LOG_FUNCTION (this << ev.impl << ev.key.m_ts << ev.key.m_uid);
+  m_heap.push_back (ev);
+  SiftUp (m_heap.size () - 1, ev);
+}
+
+bool
+IndexedHeapScheduler::IsEmpty (void) const
+{
+  NS_LOG_FUNCTION (this);
+  return m_heap.empty ();
+}
+
+Scheduler::Event
+IndexedHeapScheduler::PeekNext (void) const
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT (!IsEmpty ());
+  return m_heap.front ();
+}
+
+Scheduler::Event
+IndexedHeapScheduler::RemoveNext (void)
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT (!IsEmpty ());
+  Event next = m_heap.front ();
+  Event last = m_heap.back ();
+  m_heap.pop_back ();
+  if (!m_heap.empty ())
+    {
+      SiftDown (0, last);
+    }
+  return next;
+}
+
+void
+IndexedHeapScheduler::Remove (const Event &ev)
+{
+  NS_LOG_FUNCTION (this << ev.impl << ev.key.m_ts << ev.key.m_uid);
+  NS_ASSERT (!IsEmpty ());
+  uint32_t slot = ev.impl->GetSchedulerSlot ();
+  NS_ASSERT (slot < m_heap.size () && m_heap[slot].impl == ev.impl
+             && m_heap[slot].key.m_uid == ev.key.m_uid);
+  Event last = m_heap.back ();
+  m_heap.pop_back ();
+  if (slot == m_heap.size ())
+    {
+      return;
+    }
+  // the last event may belong above the hole as well as below it
+  if (slot > 0 && last.key < m_heap[(slot - 1) / ARITY].key)
+    {
+      SiftUp (slot, last);
+    }
+  else
+    {
+      SiftDown (slot, last);
+    }
+}
+
+} // namespace ns3
@@ -0,0 +1,69 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef INDEXED_HEAP_SCHEDULER_H
+#define INDEXED_HEAP_SCHEDULER_H
+
+#include "scheduler.h"
+#include <stdint.h>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \ingroup scheduler
+ * \brief a 4-ary heap event scheduler with indexed removal
+ *
+ * Every event records its position in the heap with
+ * EventImpl::SetSchedulerSlot, so that Remove finds it without the
+ * linear search of HeapScheduler and costs O(log n), like Insert and
+ * RemoveNext. Simulator::Remove of a pending timer, as done when a
+ * retransmission or route timeout is rescheduled, thus stays cheap in
+ * large event lists.
+ *
+ * Each node has four children, which all fit in one or two cache lines,
+ * so the heap is half as deep as a binary heap for a few more
+ * comparisons per level. Events are moved into the hole left on the way
+ * up or down instead of being exchanged.
+ */
+class IndexedHeapScheduler : public Scheduler
+{
+public:
+  static TypeId GetTypeId (void);
+
+  IndexedHeapScheduler ();
+  virtual ~IndexedHeapScheduler ();
+
+  virtual void Insert (const Event &ev);
+  virtual bool IsEmpty (void) const;
+  virtual Event PeekNext (void) const;
+  virtual Event RemoveNext (void);
+  virtual void Remove (const Event &ev);
+
+private:
+  inline void Place (uint32_t slot, const Event &ev);
+  /* Move ev from the hole at slot up to its place */
+  void SiftUp (uint32_t slot, const Event &ev);
+  /* Move ev from the hole at slot down to its place */
+  void SiftDown (uint32_t slot, const Event &ev);
+
+  std::vector<Event> m_heap;
+};
+
+} // namespace ns3
+
+#endif /* INDEXED_HEAP_SCHEDULER_H */
@@ -0,0 +1,388 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ladder-scheduler.h"
+#include "event-impl.h"
+#include "assert.h"
+#include "log.h"
+#include <algorithm>
+
+NS_LOG_COMPONENT_DEFINE ("LadderScheduler");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (LadderScheduler);
+
+// a bucket with more events than this is spread over a finer rung
+static const uint32_t THRESHOLD = 50;
+static const uint32_t MAX_RUNGS = 8;
+static const uint32_t NO_NODE = 0xffffffff;
+
+TypeId
+LadderScheduler::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::LadderScheduler")
+    .SetParent<Scheduler> ()
+    .AddConstructor<LadderScheduler> ()
+  ;
+  return tid;
+}
+
+LadderScheduler::LadderScheduler ()
+  : m_freeNodes (NO_NODE),
+    m_top (NO_NODE),
+    m_nTop (0),
+    m_topStart (0),
+    m_topMin (0),
+    m_topMax (0),
+    m_rungs (MAX_RUNGS),
+    m_nRungs (0),
+    m_bottomFirst (0),
+    m_bottomLimit (THRESHOLD),
+    m_size (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+LadderScheduler::~LadderScheduler ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+LadderScheduler::Insert (const Event &ev)
+{
+  NS_LOG_FUNCTION (this << ev.impl << ev.key.m_ts << ev.key.m_uid);
+  uint64_t ts = ev.key.m_ts;
+  m_size++;
+  if (ts >= m_topStart)
+    {
+      uint32_t node = AllocateNode (ev);
+      m_nodes[node].next = m_top;
+      m_top = node;
+      if (m_nTop == 0)
+        {
+          m_topMin = ts;
+          m_topMax = ts;
+        }
+      m_topMin = std::min (m_topMin, ts);
+      m_topMax = std::max (m_topMax, ts);
+      m_nTop++;
+      return;
+    }
+  int32_t rung = FindRung (ts);
+  if (rung >= 0)
+    {
+      InsertInRung (m_rungs[rung], AllocateNode (ev));
+      return;
+    }
+  std::vector<Event>::iterator i = std::lower_bound (m_bottom.begin () + m_bottomFirst, m_bottom.end (), ev);
+  m_bottom.insert (i, ev);
+  if (m_bottom.size () - m_bottomFirst > m_bottomLimit && m_nRungs < MAX_RUNGS)
+    {
+      SpreadBottom ();
+    }
+}
+
+bool
+LadderScheduler::IsEmpty (void) const
+{
+  NS_LOG_FUNCTION (this);
+  return m_size == 0;
+}
+
+Scheduler::Event
+LadderScheduler::PeekNext (void) const
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT (!IsEmpty ());
+  if (m_bottomFirst == m_bottom.size ())
+    {
+      // moving events down the ladder does not change the order of the queue
+      const_cast<LadderScheduler *> (this)->FillBottom ();
+    }
+  return m_bottom[m_bottomFirst];
+}
+
+Scheduler::Event
+LadderScheduler::RemoveNext (void)
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT (!IsEmpty ());
+  if (m_bottomFirst == m_bottom.size ())
+    {
+      FillBottom ();
+    }
+  Event ev = m_bottom[m_bottomFirst];
+  m_bottomFirst++;
+  if (m_bottomFirst == m_bottom.size ())
+    {
+      m_bottom.clear ();
+      m_bottomFirst = 0;
+    }
+  m_size--;
+  NS_LOG_LOGIC ("remove ts=" << ev.key.m_ts << ", key=" << ev.key.m_uid);
+  return ev;
+}
+
+void
+LadderScheduler::Remove (const Event &ev)
+{
+  NS_LOG_FUNCTION (this << ev.impl << ev.key.m_ts << ev.key.m_uid);
+  NS_ASSERT (!IsEmpty ());
+  uint64_t ts = ev.key.m_ts;
+  m_size--;
+  if (ts >= m_topStart)
+    {
+      // finding it would take a walk of the top list
+      m_cancelled.insert (ev.key.m_uid);
+      return;
+    }
+  int32_t r = FindRung (ts);
+  if (r >= 0)
+    {
+      Rung &rung = m_rungs[r];
+      uint32_t *link = &rung.buckets[(ts - rung.start) / rung.width];
+      while (*link != NO_NODE)
+        {
+          uint32_t node = *link;
+          if (m_nodes[node].event.key.m_uid == ev.key.m_uid)
+            {
+              NS_ASSERT (m_nodes[node].event.impl == ev.impl);
+              *link = m_nodes[node].next;
+              FreeNode (node);
+              rung.nEvents--;
+              return;
+            }
+          link = &m_nodes[node].next;
+        }
+      NS_ASSERT (false);
+    }
+  std::vector<Event>::iterator i = std::lower_bound (m_bottom.begin () + m_bottomFirst, m_bottom.end (), ev);
+  NS_ASSERT (i != m_bottom.end () && i->key.m_uid == ev.key.m_uid);
+  m_bottom.erase (i);
+  if (m_bottomFirst == m_bottom.size ())
+    {
+      m_bottom.clear ();
+      m_bottomFirst = 0;
+    }
+}
+
+uint32_t
+LadderScheduler::AllocateNode (const Event &ev)
+{
+  uint32_t node = m_freeNodes;
+  if (node == NO_NODE)
+    {
+      node = m_nodes.size ();
+      m_nodes.push_back (Node ());
+    }
+  else
+    {
+      m_freeNodes = m_nodes[node].next;
+    }
+  m_nodes[node].event = ev;
+  return node;
+}
+
+void
+LadderScheduler::FreeNode (uint32_t node)
+{
+  m_nodes[node].next = m_freeNodes;
+  m_freeNodes = node;
+}
+
+void
+LadderScheduler::InsertInRung (Rung &rung, uint32_t node)
+{
+  uint64_t bucket = (m_nodes[node].event.key.m_ts - rung.start) / rung.width;
+  NS_ASSERT (bucket >= rung.current && bucket < rung.buckets.size ());
+  m_nodes[node].next = rung.buckets[bucket];
+  rung.buckets[bucket] = node;
+  rung.nEvents++;
+}
+
+uint64_t
+LadderScheduler::GetCurrentStart (const Rung &rung) const
+{
+  return rung.start + rung.current * rung.width;
+}
+
+int32_t
+LadderScheduler::FindRung (uint64_t ts) const
+{
+  // every rung covers the time between its current bucket and the current
+  // bucket of the rung above it
+  for (uint32_t i = 0; i < m_nRungs; i++)
+    {
+      if (ts >= GetCurrentStart (m_rungs[i]))
+        {
+          return i;
+        }
+    }
+  return -1;
+}
+
+void
+LadderScheduler::SpreadTop (void)
+{
+  NS_LOG_FUNCTION (this << m_nTop << m_topMin << m_topMax);
+  NS_ASSERT (m_nRungs == 0);
+  Rung &rung = m_rungs[0];
+  rung.start = m_topMin;
+  rung.width = (m_topMax - m_topMin) / m_nTop + 1;
+  rung.current = 0;
+  rung.nEvents = 0;
+  rung.buckets.assign (m_nTop, NO_NODE);
+  m_nRungs = 1;
+  m_topStart = rung.start + m_nTop * rung.width;
+
+  uint32_t node = m_top;
+  while (node != NO_NODE)
+    {
+      uint32_t next = m_nodes[node].next;
+      if (!m_cancelled.empty () && m_cancelled.erase (m_nodes[node].event.key.m_uid) != 0)
+        {
+          FreeNode (node);
+        }
+      else
+        {
+          InsertInRung (rung, node);
+        }
+      node = next;
+    }
+  m_top = NO_NODE;
+  m_nTop = 0;
+}
+
+void
+LadderScheduler::SpreadBucket (uint32_t head, uint64_t start, uint64_t width)
+{
+  NS_LOG_FUNCTION (this << start << width);
+  Rung &rung = m_rungs[m_nRungs];
+  rung.start = start;
+  rung.width = (width + THRESHOLD - 1) / THRESHOLD;
+  rung.current = 0;
+  rung.nEvents = 0;
+  rung.buckets.assign ((width + rung.width - 1) / rung.width, NO_NODE);
+  m_nRungs++;
+  while (head != NO_NODE)
+    {
+      uint32_t next = m_nodes[head].next;
+      InsertInRung (rung, head);
+      head = next;
+    }
+}
+
+void
+LadderScheduler::SortIntoBottom (uint32_t head)
+{
+  NS_ASSERT (m_bottom.empty ());
+  while (head != NO_NODE)
+    {
+      if (m_cancelled.empty () || m_cancelled.erase (m_nodes[head].event.key.m_uid) == 0)
+        {
+          m_bottom.push_back (m_nodes[head].event);
+        }
+      uint32_t next = m_nodes[head].next;
+      FreeNode (head);
+      head = next;
+    }
+  std::sort (m_bottom.begin (), m_bottom.end ());
+  // the bottom list is spread again once it doubles, so that a bucket that
+  // could not be split is not spread and sorted back over and over
+  m_bottomLimit = std::max (THRESHOLD, 2 * (uint32_t)m_bottom.size ());
+}
+
+void
+LadderScheduler::SpreadBottom (void)
+{
+  NS_LOG_FUNCTION (this << m_bottom.size () - m_bottomFirst);
+  // a rung under the others, up to the current bucket of the lowest one
+  uint64_t start = m_bottom[m_bottomFirst].key.m_ts;
+  uint64_t end = m_nRungs > 0 ? GetCurrentStart (m_rungs[m_nRungs - 1]) : m_topStart;
+  uint32_t n = m_bottom.size () - m_bottomFirst;
+  Rung &rung = m_rungs[m_nRungs];
+  rung.start = start;
+  rung.width = (end - start) / n + 1;
+  rung.current = 0;
+  rung.nEvents = 0;
+  rung.buckets.assign (n, NO_NODE);
+  m_nRungs++;
+  for (std::vector<Event>::const_iterator i = m_bottom.begin () + m_bottomFirst; i != m_bottom.end (); i++)
+    {
+      InsertInRung (rung, AllocateNode (*i));
+    }
+  m_bottom.clear ();
+  m_bottomFirst = 0;
+}
+
+void
+LadderScheduler::FillBottom (void)
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT (m_bottom.empty () && m_size > 0);
+  while (m_bottom.empty ())
+    {
+      if (m_nRungs == 0)
+        {
+          NS_ASSERT (m_nTop > 0);
+          if (m_nTop > THRESHOLD)
+            {
+              SpreadTop ();
+              continue;
+            }
+          // few enough to be sorted at once
+          uint32_t head = m_top;
+          m_top = NO_NODE;
+          m_nTop = 0;
+          m_topStart = m_topMax + 1;
+          SortIntoBottom (head);
+          continue;
+        }
+      Rung &rung = m_rungs[m_nRungs - 1];
+      if (rung.nEvents == 0)
+        {
+          m_nRungs--;
+          continue;
+        }
+      while (rung.buckets[rung.current] == NO_NODE)
+        {
+          rung.current++;
+        }
+      uint32_t head = rung.buckets[rung.current];
+      rung.buckets[rung.current] = NO_NODE;
+      uint32_t count = 0;
+      for (uint32_t node = head; node != NO_NODE; node = m_nodes[node].next)
+        {
+          count++;
+        }
+      rung.nEvents -= count;
+      uint64_t start = GetCurrentStart (rung);
+      uint64_t width = rung.width;
+      rung.current++;
+      if (count > THRESHOLD && width > 1 && m_nRungs < MAX_RUNGS)
+        {
+          SpreadBucket (head, start, width);
+        }
+      else
+        {
+          SortIntoBottom (head);
+        }
+    }
+}
+
+} // namespace ns3
@@ -1,15 +1,22 @@
 #include "rng-seed-manager.h"
+#include "ns3/core-config.h"
 #include "global-value.h"
 #include "attribute-helper.h"
 #include "integer.h"
 #include "config.h"
 #include "log.h"
+#include "fatal-error.h"
 
 NS_LOG_COMPONENT_DEFINE ("RngSeedManager");
 
 namespace ns3 {
 
 static uint64_t g_nextStreamIndex = 0;
+#ifdef HAVE_TLS
+// the stream indices of a thread which assigns its own
+static __thread bool g_threadAssignsStreams = false;
+static __thread uint64_t g_threadNextStreamIndex = 0;
+#endif
 static ns3::GlobalValue g_rngSeed ("RngSeed", 
                                    "The global seed of all rng streams",
                                    ns3::IntegerValue(1),
@@ -52,9 +59,38 @@ uint64_t RngSeedManager::GetRun ()
 uint64_t RngSeedManager::GetNextStreamIndex (void)
 {
   NS_LOG_FUNCTION_NOARGS ();
+#ifdef HAVE_TLS
+  if (g_threadAssignsStreams)
+    {
+      return g_threadNextStreamIndex++;
+    }
+#endif
   uint64_t next = g_nextStreamIndex;
   g_nextStreamIndex++;
   return next;
 }
 
+void RngSeedManager::SetThreadStreamIndex (uint64_t next)
+{
+  NS_LOG_FUNCTION (next);
+#ifdef HAVE_TLS
+  g_threadAssignsStreams = true;
+  g_threadNextStreamIndex = next;
+#else
+  NS_FATAL_ERROR ("Threads cannot assign their own stream indices without thread local storage");
+#endif
+}
+
+uint64_t RngSeedManager::GetThreadStreamIndex (void)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+#ifdef HAVE_TLS
+  if (g_threadAssignsStreams)
+    {
+      return g_threadNextStreamIndex;
+    }
+#endif
+  return g_nextStreamIndex;
+}
+
 } // namespace ns3
@@ -62,6 +62,21 @@ public:
 
   static uint64_t GetNextStreamIndex(void);
 
+  /**
+   * \brief Make the calling thread assign stream indices of its own
+   * \param next the index GetNextStreamIndex returns next on this thread
+   *
+   * A multithreaded simulator starts the thread of each system id at
+   * the index that system id was left at, so that the indices do not
+   * depend on how the threads interleave.
+   */
+  static void SetThreadStreamIndex (uint64_t next);
+  /**
+   * \returns the index GetNextStreamIndex returns next on the calling
+   * thread
+   */
+  static uint64_t GetThreadStreamIndex (void);
+
 };
 
 // for compatibility
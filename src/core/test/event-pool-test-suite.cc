@@ -0,0 +1,243 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/core-config.h"
+#include "ns3/test.h"
+#include "ns3/event-impl.h"
+#include "ns3/global-value.h"
+#include "ns3/boolean.h"
+#include "ns3/system-thread.h"
+#include "ns3/callback.h"
+
+#include <set>
+#include <vector>
+
+using namespace ns3;
+
+// Every test case uses events of its own size class, so that the blocks
+// left over by one case do not show up in the next one
+template <uint32_t SIZE>
+class PoolTestEvent : public EventImpl
+{
+private:
+  virtual void Notify (void)
+  {
+  }
+  char m_padding[SIZE];
+};
+
+typedef std::vector<EventImpl *> Events;
+
+// the events which a thread creates
+struct Round
+{
+  Round (uint32_t n);
+  uint32_t n;
+  Events events;
+};
+
+Round::Round (uint32_t n)
+  : n (n)
+{
+}
+
+template <uint32_t SIZE>
+static void
+CreateEvents (Round *round)
+{
+  for (uint32_t i = 0; i < round->n; i++)
+    {
+      round->events.push_back (new PoolTestEvent<SIZE> ());
+    }
+}
+
+static void
+DeleteEvents (Events events)
+{
+  for (Events::iterator i = events.begin (); i != events.end (); ++i)
+    {
+      (*i)->Unref ();
+    }
+}
+
+template <uint32_t SIZE>
+static void
+CreateAndDeleteEvents (Round *round)
+{
+  CreateEvents<SIZE> (round);
+  DeleteEvents (round->events);
+}
+
+// how many of the events of b reuse the memory of the events of a
+static uint32_t
+CountReused (const Events &a, const Events &b)
+{
+  std::set<EventImpl *> addresses (a.begin (), a.end ());
+  uint32_t reused = 0;
+  for (Events::const_iterator i = b.begin (); i != b.end (); ++i)
+    {
+      if (addresses.find (*i) != addresses.end ())
+        {
+          reused++;
+        }
+    }
+  return reused;
+}
+
+static bool
+IsPoolEnabled (void)
+{
+#ifdef HAVE_TLS
+  BooleanValue enabled;
+  GlobalValue::GetValueByName ("EventPool", enabled);
+  return enabled.Get ();
+#else /* HAVE_TLS */
+  return false;
+#endif /* HAVE_TLS */
+}
+
+// A deleted event is handed out again by the next allocation of the same
+// size class on the same thread
+class EventPoolReuseTestCase : public TestCase
+{
+public:
+  EventPoolReuseTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+EventPoolReuseTestCase::EventPoolReuseTestCase ()
+  : TestCase ("Check that deleted events are reused by their thread")
+{
+}
+
+void
+EventPoolReuseTestCase::DoRun (void)
+{
+  if (!IsPoolEnabled ())
+    {
+      return;
+    }
+  Round first (10);
+  CreateAndDeleteEvents<40> (&first);
+  Round second (10);
+  CreateEvents<40> (&second);
+  NS_TEST_ASSERT_MSG_EQ (CountReused (first.events, second.events), 10, "deleted events not reused");
+  // an event of another size class does not get the same memory
+  Round other (10);
+  CreateEvents<120> (&other);
+  NS_TEST_ASSERT_MSG_EQ (CountReused (second.events, other.events), 0, "size classes mixed up");
+  DeleteEvents (second.events);
+  DeleteEvents (other.events);
+}
+
+// Events created by one thread and deleted by another find their way back
+// to the threads which create events, which would otherwise keep taking
+// new chunks
+class EventPoolCrossThreadTestCase : public TestCase
+{
+public:
+  EventPoolCrossThreadTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+EventPoolCrossThreadTestCase::EventPoolCrossThreadTestCase ()
+  : TestCase ("Check that events deleted by another thread are reused")
+{
+}
+
+void
+EventPoolCrossThreadTestCase::DoRun (void)
+{
+  if (!IsPoolEnabled ())
+    {
+      return;
+    }
+  Round created (20000);
+  Ptr<SystemThread> producer = Create<SystemThread> (MakeBoundCallback (&CreateEvents<56>, &created));
+  producer->Start ();
+  producer->Join ();
+  // this thread deletes what the producer created, and a second producer
+  // creates as many events again
+  DeleteEvents (created.events);
+  Round recreated (20000);
+  producer = Create<SystemThread> (MakeBoundCallback (&CreateEvents<56>, &recreated));
+  producer->Start ();
+  producer->Join ();
+  NS_TEST_ASSERT_MSG_GT (CountReused (created.events, recreated.events), created.n / 2,
+                         "events deleted by another thread not reused");
+  DeleteEvents (recreated.events);
+}
+
+// The free list of a thread which exits goes to the other threads
+class EventPoolThreadExitTestCase : public TestCase
+{
+public:
+  EventPoolThreadExitTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+EventPoolThreadExitTestCase::EventPoolThreadExitTestCase ()
+  : TestCase ("Check that the events of an exited thread are reused")
+{
+}
+
+void
+EventPoolThreadExitTestCase::DoRun (void)
+{
+  if (!IsPoolEnabled ())
+    {
+      return;
+    }
+  // few enough events that the thread keeps them on its own free list
+  // until it exits
+  Round exited (100);
+  Ptr<SystemThread> thread = Create<SystemThread> (MakeBoundCallback (&CreateAndDeleteEvents<88>, &exited));
+  thread->Start ();
+  thread->Join ();
+  Round created (100);
+  thread = Create<SystemThread> (MakeBoundCallback (&CreateEvents<88>, &created));
+  thread->Start ();
+  thread->Join ();
+  NS_TEST_ASSERT_MSG_EQ (CountReused (exited.events, created.events), created.n,
+                         "events of an exited thread not reused");
+  DeleteEvents (created.events);
+  // every event is gone, so the pool can be released and then used again
+  EventImpl::DestroyPool ();
+  Round fresh (100);
+  CreateAndDeleteEvents<88> (&fresh);
+}
+
+class EventPoolTestSuite : public TestSuite
+{
+public:
+  EventPoolTestSuite ();
+};
+
+EventPoolTestSuite::EventPoolTestSuite ()
+  : TestSuite ("event-pool", UNIT)
+{
+  AddTestCase (new EventPoolReuseTestCase);
+  AddTestCase (new EventPoolCrossThreadTestCase);
+  AddTestCase (new EventPoolThreadExitTestCase);
+}
+
+static EventPoolTestSuite eventPoolTestSuite;
@@ -23,6 +23,10 @@
 #include "ns3/heap-scheduler.h"
 #include "ns3/map-scheduler.h"
 #include "ns3/calendar-scheduler.h"
+#include "ns3/ladder-scheduler.h"
+#include "ns3/indexed-heap-scheduler.h"
+
+#include <vector>
 
 using namespace ns3;
 
@@ -168,6 +172,142 @@ SimulatorEventsTestCase::DoRun (void)
   NS_TEST_EXPECT_MSG_EQ (m_destroy, true, "Event should have run");
 }
 
+class SimulatorOrderTestCase : public TestCase
+{
+public:
+  SimulatorOrderTestCase (ObjectFactory schedulerFactory);
+private:
+  virtual void DoRun (void);
+  uint32_t Random (uint32_t range);
+  void ScheduleOne (uint64_t delay);
+  void Run (uint32_t seq);
+
+  enum State
+  {
+    PENDING,
+    RAN,
+    REMOVED
+  };
+  ObjectFactory m_schedulerFactory;
+  uint32_t m_random;
+  std::vector<EventId> m_ids;
+  std::vector<uint64_t> m_times;
+  std::vector<uint8_t> m_states;
+  uint64_t m_lastTime;
+  uint32_t m_lastSeq;
+  uint32_t m_nRan;
+  uint32_t m_nRemoved;
+  bool m_inOrder;
+};
+
+SimulatorOrderTestCase::SimulatorOrderTestCase (ObjectFactory schedulerFactory)
+  : TestCase ("Check the order of many events, some removed or cancelled, with " +
+              schedulerFactory.GetTypeId ().GetName ()),
+    m_schedulerFactory (schedulerFactory)
+{
+}
+
+uint32_t
+SimulatorOrderTestCase::Random (uint32_t range)
+{
+  m_random = m_random * 1103515245 + 12345;
+  return (m_random >> 8) % range;
+}
+
+void
+SimulatorOrderTestCase::ScheduleOne (uint64_t delay)
+{
+  uint32_t seq = m_ids.size ();
+  m_times.push_back (Simulator::Now ().GetNanoSeconds () + delay);
+  m_states.push_back (PENDING);
+  m_ids.push_back (Simulator::Schedule (NanoSeconds (delay), &SimulatorOrderTestCase::Run, this, seq));
+}
+
+void
+SimulatorOrderTestCase::Run (uint32_t seq)
+{
+  uint64_t now = Simulator::Now ().GetNanoSeconds ();
+  // events of the same time run in the order they were scheduled in
+  if (m_states[seq] != PENDING || now != m_times[seq] || now < m_lastTime
+      || (now == m_lastTime && seq < m_lastSeq))
+    {
+      m_inOrder = false;
+    }
+  m_states[seq] = RAN;
+  m_lastTime = now;
+  m_lastSeq = seq;
+  m_nRan++;
+
+  // timers close by, far away and at the same time
+  if (m_ids.size () < 20000)
+    {
+      switch (Random (4))
+        {
+        case 0:
+          ScheduleOne (Random (10));
+          break;
+        case 1:
+          ScheduleOne (Random (10000000));
+          break;
+        case 2:
+          ScheduleOne (0);
+          ScheduleOne (Random (1000));
+          break;
+        default:
+          break;
+        }
+    }
+  // and timers stopped before they expire
+  uint32_t victim = Random (m_ids.size ());
+  if (m_states[victim] == PENDING && Random (3) == 0)
+    {
+      if (Random (2) == 0)
+        {
+          Simulator::Remove (m_ids[victim]);
+        }
+      else
+        {
+          // stays in the scheduler but does not run
+          Simulator::Cancel (m_ids[victim]);
+        }
+      m_states[victim] = REMOVED;
+      m_nRemoved++;
+    }
+}
+
+void
+SimulatorOrderTestCase::DoRun (void)
+{
+  m_random = 1;
+  m_lastTime = 0;
+  m_lastSeq = 0;
+  m_nRan = 0;
+  m_nRemoved = 0;
+  m_inOrder = true;
+  Simulator::SetScheduler (m_schedulerFactory);
+
+  for (uint32_t i = 0; i < 5000; i++)
+    {
+      // a cluster of events at the same few times and a spread
+      ScheduleOne (Random (2) == 0 ? Random (4) * 1000 : Random (100000000));
+    }
+  for (uint32_t i = 0; i < 500; i++)
+    {
+      uint32_t victim = Random (m_ids.size ());
+      if (m_states[victim] == PENDING)
+        {
+          Simulator::Remove (m_ids[victim]);
+          m_states[victim] = REMOVED;
+          m_nRemoved++;
+        }
+    }
+  Simulator::Run ();
+
+  NS_TEST_EXPECT_MSG_EQ (m_inOrder, true, "events ran out of order, twice or after removal");
+  NS_TEST_EXPECT_MSG_EQ (m_nRan + m_nRemoved, m_ids.size (), "events lost");
+  Simulator::Destroy ();
+}
+
 class SimulatorTemplateTestCase : public TestCase
 {
 public:
@@ -469,11 +609,21 @@ public:
     factory.SetTypeId (ListScheduler::GetTypeId ());
 
     AddTestCase (new SimulatorEventsTestCase (factory));
+    AddTestCase (new SimulatorOrderTestCase (factory));
     factory.SetTypeId (MapScheduler::GetTypeId ());
     AddTestCase (new SimulatorEventsTestCase (factory));
+    AddTestCase (new SimulatorOrderTestCase (factory));
     factory.SetTypeId (HeapScheduler::GetTypeId ());
     AddTestCase (new SimulatorEventsTestCase (factory));
+    AddTestCase (new SimulatorOrderTestCase (factory));
     factory.SetTypeId (CalendarScheduler::GetTypeId ());
     AddTestCase (new SimulatorEventsTestCase (factory));
+    AddTestCase (new SimulatorOrderTestCase (factory));
+    factory.SetTypeId (LadderScheduler::GetTypeId ());
+    AddTestCase (new SimulatorEventsTestCase (factory));
+    AddTestCase (new SimulatorOrderTestCase (factory));
+    factory.SetTypeId (IndexedHeapScheduler::GetTypeId ());
+    AddTestCase (new SimulatorEventsTestCase (factory));
+    AddTestCase (new SimulatorOrderTestCase (factory));
   }
 } g_simulatorTestSuite;
@@ -309,6 +309,10 @@ Ipv4FlowProbe::DropLogger (const Ipv4Header &ipHeader, Ptr<const Packet> ipPaylo
           myReason = DROP_FRAGMENT_TIMEOUT;
           NS_LOG_DEBUG ("DROP_FRAGMENT_TIMEOUT");
           break;
+        case Ipv4L3Protocol::DROP_NETFILTER:
+          myReason = DROP_NETFILTER;
+          NS_LOG_DEBUG ("DROP_NETFILTER");
+          break;
 
         default:
           myReason = DROP_INVALID_REASON;
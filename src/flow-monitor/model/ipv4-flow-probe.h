@@ -64,6 +64,7 @@ public:
     DROP_INTERFACE_DOWN,   /**< Interface is down so can not send packet */
     DROP_ROUTE_ERROR,   /**< Route error */
     DROP_FRAGMENT_TIMEOUT, /**< Fragment timeout exceeded */
+    DROP_NETFILTER, /**< Not accepted by a netfilter hook */
 
     DROP_INVALID_REASON,
   };
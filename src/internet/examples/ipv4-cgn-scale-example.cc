@@ -0,0 +1,284 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// A carrier-grade NAT node serving a million subscribers of the shared
+// address space 100.64.0.0/10 (RFC 6598) behind addresses of 198.18.128.0/17,
+// each subscriber owning a deterministic block of 64 ports.
+//
+// Subscribers are visited round robin, a slice every 100 ms, so that each
+// one is visited once per round. On a visit a subscriber sends a packet
+// on each of its flows and receives a reply on the first one. Flows live
+// for a few rounds each, chosen per flow, and are then replaced by a flow
+// from another port; the translations of replaced flows idle out of the
+// NAT. Packets are walked through the netfilter hooks of the NAT node,
+// without devices or routing.
+//
+// Memory budget: the translations of the NAT, shards and indices
+// included, must take at most 96 bytes each, and the process at most
+// 1 kB per subscriber. A translation takes 16 bytes and its slots in the
+// two indices 16 to 32 bytes; the rest is room left by growth and by the
+// translations that idled out. The program prints the figures and exits
+// with 1 when the budget is exceeded.
+//
+// ./waf --run "ipv4-cgn-scale-example --subscribers=1000000 --rounds=6"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/simple-net-device.h"
+#include "ns3/simple-channel.h"
+#include "ns3/ipv4-nat.h"
+#include "ns3/ipv4-nat-helper.h"
+#include "ns3/ipv4-netfilter.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("Ipv4CgnScaleExample");
+
+static const uint32_t BYTES_PER_TRANSLATION = 96;
+static const uint32_t BYTES_PER_SUBSCRIBER = 1024;
+
+static const Ipv4Address g_server ("198.51.100.7");
+
+struct Scenario
+{
+  Ptr<Ipv4Nat> nat;
+  Ptr<Ipv4Netfilter> netfilter;
+  Ptr<NetDevice> insideDev;
+  Ptr<NetDevice> outsideDev;
+  uint32_t subscribers;
+  uint32_t flows;
+  uint32_t slices;       //!< slices per round
+  uint32_t slice;        //!< next slice
+  uint32_t round;
+  uint64_t packets;
+  uint32_t peakTranslations;
+  uint64_t peakTableBytes;
+};
+
+/* Kilobytes from a line of /proc/self/status, 0 where there is none */
+static uint32_t
+ReadProcStatus (const char *field)
+{
+  std::ifstream status ("/proc/self/status");
+  std::string line;
+  while (std::getline (status, line))
+    {
+      if (line.compare (0, strlen (field), field) == 0)
+        {
+          return atoi (line.c_str () + strlen (field));
+        }
+    }
+  return 0;
+}
+
+static Ptr<SimpleNetDevice>
+AddInterface (Ptr<Node> node, Ipv4Address address, Ipv4Mask mask)
+{
+  Ptr<SimpleNetDevice> dev = CreateObject<SimpleNetDevice> ();
+  dev->SetAddress (Mac48Address::Allocate ());
+  dev->SetChannel (CreateObject<SimpleChannel> ());
+  node->AddDevice (dev);
+  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+  uint32_t i = ipv4->AddInterface (dev);
+  ipv4->AddAddress (i, Ipv4InterfaceAddress (address, mask));
+  ipv4->SetUp (i);
+  return dev;
+}
+
+// Run a UDP packet through the hooks of a forwarded packet and return its
+// headers as it leaves
+static void
+Forward (Scenario &s, Ptr<NetDevice> in, Ptr<NetDevice> out, Ipv4Address src, uint16_t sport,
+         Ipv4Address dst, uint16_t dport, Ipv4Header &ip, UdpHeader &udp)
+{
+  Ptr<Packet> p = Create<Packet> (32);
+  udp.SetSourcePort (sport);
+  udp.SetDestinationPort (dport);
+  p->AddHeader (udp);
+  ip.SetSource (src);
+  ip.SetDestination (dst);
+  ip.SetProtocol (UdpL4Protocol::PROT_NUMBER);
+  ip.SetPayloadSize (p->GetSize ());
+  ip.SetTtl (64);
+  p->AddHeader (ip);
+
+  s.netfilter->ProcessHook (PF_INET, NF_INET_PRE_ROUTING, p, in, 0);
+  ContinueCallback confirm = MakeCallback (&Ipv4Netfilter::NetfilterConntrackConfirm, s.netfilter);
+  s.netfilter->ProcessHook (PF_INET, NF_INET_POST_ROUTING, p, 0, out, confirm);
+  p->RemoveHeader (ip);
+  p->PeekHeader (udp);
+  s.packets++;
+}
+
+// Port of flow f of a subscriber in the given round: a flow lives 1 to 4
+// rounds, picked from a hash of the subscriber and the flow, and its
+// replacement takes the next port
+static uint16_t
+GetFlowPort (uint32_t subscriber, uint32_t flow, uint32_t round)
+{
+  uint32_t h = subscriber * 2654435761U + flow * 40503U;
+  uint32_t lifetime = 1 + (h >> 28) % 4;
+  uint32_t generation = (round + (h >> 8) % lifetime) / lifetime;
+  return 10000 + flow * 1000 + generation % 1000;
+}
+
+static void
+VisitSlice (Scenario *scenario)
+{
+  Scenario &s = *scenario;
+  uint32_t first = (uint64_t)s.subscribers * s.slice / s.slices;
+  uint32_t last = (uint64_t)s.subscribers * (s.slice + 1) / s.slices;
+  Ipv4Header ip;
+  UdpHeader udp;
+  for (uint32_t n = first; n < last; n++)
+    {
+      Ipv4Address subscriber (Ipv4Address ("100.64.0.0").Get () + n);
+      for (uint32_t f = 0; f < s.flows; f++)
+        {
+          uint16_t port = GetFlowPort (n, f, s.round);
+          Forward (s, s.insideDev, s.outsideDev, subscriber, port, g_server, 53, ip, udp);
+          if (f == 0)
+            {
+              Forward (s, s.outsideDev, s.insideDev, g_server, 53, ip.GetSource (), udp.GetSourcePort (),
+                       ip, udp);
+              NS_ASSERT (ip.GetDestination () == subscriber && udp.GetDestinationPort () == port);
+            }
+        }
+    }
+
+  const Ipv4NatBindingTable &table = s.nat->GetCarrierGradeTable ();
+  if (table.GetNBindings () > s.peakTranslations)
+    {
+      s.peakTranslations = table.GetNBindings ();
+      s.peakTableBytes = table.GetMemoryUsage ();
+    }
+  if (++s.slice == s.slices)
+    {
+      s.slice = 0;
+      s.round++;
+      NS_LOG_INFO ("Round " << s.round << " at " << Simulator::Now ().GetSeconds () << "s: "
+                            << table.GetNBindings () << " translations, "
+                            << s.nat->GetNEvictions () << " evicted");
+    }
+  Simulator::Schedule (MilliSeconds (100), &VisitSlice, scenario);
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t subscribers = 1000000;
+  uint32_t flows = 2;
+  uint32_t rounds = 6;
+  double roundTime = 10.0;
+  uint32_t blockSize = 64;
+
+  CommandLine cmd;
+  cmd.AddValue ("subscribers", "Number of subscribers", subscribers);
+  cmd.AddValue ("flows", "Number of concurrent UDP flows per subscriber", flows);
+  cmd.AddValue ("rounds", "Number of times every subscriber is visited", rounds);
+  cmd.AddValue ("roundTime", "Seconds between two visits of a subscriber", roundTime);
+  cmd.AddValue ("blockSize", "Number of ports per subscriber", blockSize);
+  cmd.Parse (argc, argv);
+
+  // The smallest prefixes holding the subscribers and their port blocks
+  uint32_t prefix = 1;
+  while (prefix < subscribers)
+    {
+      prefix <<= 1;
+    }
+  uint32_t blocksPerAddress = (65535 - 1024 + 1) / blockSize;
+  uint32_t pool = 4;
+  while (pool - 2 < (prefix + blocksPerAddress - 1) / blocksPerAddress)
+    {
+      pool <<= 1;
+    }
+
+  Ptr<Node> node = CreateObject<Node> ();
+  InternetStackHelper stack;
+  stack.Install (node);
+  Scenario s;
+  s.outsideDev = AddInterface (node, Ipv4Address ("198.18.0.1"), Ipv4Mask ("255.254.0.0"));
+  s.insideDev = AddInterface (node, Ipv4Address ("100.64.0.1"), Ipv4Mask ("255.192.0.0"));
+  s.netfilter = node->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  // conntrack keeps the flows of the last few slices only
+  s.netfilter->SetAttribute ("UdpTimeout", TimeValue (Seconds (1)));
+
+  Ipv4NatHelper natHelper;
+  s.nat = natHelper.Install (node);
+  s.nat->SetOutside (1);
+  s.nat->SetInside (2);
+  s.nat->SetAttribute ("UdpTimeout", TimeValue (Seconds (roundTime * 1.5)));
+  s.nat->SetAttribute ("PortBlockSize", UintegerValue (blockSize));
+  s.nat->AddAddressPool (Ipv4Address ("198.18.128.0"), Ipv4Mask (~(pool - 1)));
+  s.nat->AddPortPool (1024, 65535);
+  s.nat->EnableCarrierGradeNat (Ipv4Address ("100.64.0.0"), Ipv4Mask (~(prefix - 1)));
+
+  s.subscribers = subscribers;
+  s.flows = flows;
+  s.slices = std::max (1, (int)(roundTime * 10));
+  s.slice = 0;
+  s.round = 0;
+  s.packets = 0;
+  s.peakTranslations = 0;
+  s.peakTableBytes = 0;
+
+  SystemWallClockMs clock;
+  clock.Start ();
+  Simulator::Schedule (Seconds (0), &VisitSlice, &s);
+  Simulator::Stop (Seconds (roundTime * rounds));
+  Simulator::Run ();
+  double elapsed = clock.End () / 1000.0;
+
+  const Ipv4NatBindingTable &table = s.nat->GetCarrierGradeTable ();
+  uint64_t bytesPerTranslation = s.peakTranslations > 0 ? s.peakTableBytes / s.peakTranslations : 0;
+  uint64_t peakRss = ReadProcStatus ("VmHWM:");
+  uint64_t bytesPerSubscriber = peakRss * 1024 / subscribers;
+  std::cout << "subscribers=" << subscribers
+            << " shards=" << table.GetNAllocatedShards () << "/" << table.GetNShards ()
+            << " translations=" << table.GetNBindings ()
+            << " peak=" << s.peakTranslations
+            << " new=" << s.nat->GetNNewBindings ()
+            << " evicted=" << s.nat->GetNEvictions ()
+            << " failures=" << s.nat->GetNPortAllocationFailures ()
+            << " packets=" << s.packets
+            << " wall=" << elapsed << "s"
+            << std::endl;
+  std::cout << "table=" << s.peakTableBytes / 1024 << "kB"
+            << " (" << bytesPerTranslation << " B/translation, budget " << BYTES_PER_TRANSLATION << ")"
+            << " peakrss=" << peakRss << "kB"
+            << " (" << bytesPerSubscriber << " B/subscriber, budget " << BYTES_PER_SUBSCRIBER << ")"
+            << std::endl;
+
+  Simulator::Destroy ();
+
+  // the process budget only means something for large runs, a small one
+  // is dominated by the size of the program
+  if (bytesPerTranslation > BYTES_PER_TRANSLATION
+      || (subscribers >= 100000 && peakRss > 0 && bytesPerSubscriber > BYTES_PER_SUBSCRIBER))
+    {
+      std::cout << "memory budget exceeded" << std::endl;
+      return 1;
+    }
+  return 0;
+}
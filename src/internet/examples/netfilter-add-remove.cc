@@ -29,27 +29,27 @@ using namespace ns3;
 NS_LOG_COMPONENT_DEFINE ("NetfilterExample");
 
 static uint32_t 
-HookPriority1(Hooks_t hook, Ptr<Packet> packet, Ptr<NetDevice> in,
-    Ptr<NetDevice> out, ContinueCallback& ccb)
+HookPriority1(Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+    const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
 {
   NS_LOG_UNCOND("**********First Hook Priority***********");
-  return 0;
+  return NF_ACCEPT;
 }
 
 static uint32_t 
-HookPriority2(Hooks_t hook, Ptr<Packet> packet, Ptr<NetDevice> in,
-    Ptr<NetDevice> out, ContinueCallback& ccb)
+HookPriority2(Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+    const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
 {
   NS_LOG_UNCOND("*********Medium Hook Priority***********");
-  return 0;
+  return NF_ACCEPT;
 }
 
 static uint32_t
-HookPriority3(Hooks_t hook, Ptr<Packet> packet, Ptr<NetDevice> in,
-    Ptr<NetDevice> out, ContinueCallback& ccb)
+HookPriority3(Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+    const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
 {
   NS_LOG_UNCOND("**********Last Hook Priority************");
-  return 0;
+  return NF_ACCEPT;
 }
 
 int
@@ -29,47 +29,39 @@ using namespace ns3;
 NS_LOG_COMPONENT_DEFINE ("NetfilterExample");
 
 static uint32_t
-TtlMangle1(Hooks_t hook, Ptr<Packet> packet, Ptr<NetDevice> in,
-               Ptr<NetDevice> out, ContinueCallback& ccb)
+TtlMangle1(Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+               const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
 { 
     NS_LOG_UNCOND("***********TTL Mangling 1 Callback*************");
  
+    // write back changes of earlier hooks before looking at the bytes
+    ctx.Flush ();
     //Packet::EnablePrinting ();
     packet->Print (std::cout);
     std::cout << std::endl;
 
-    Ipv4Header ipHeader;
+    ctx.GetIpv4Header ().SetTtl (0);
+    ctx.SetIpv4HeaderDirty ();
 
-    packet->RemoveHeader (ipHeader);
-    packet->AddHeader (ipHeader);
-
-    packet->RemoveHeader (ipHeader);
-    ipHeader.SetTtl (0);
-    packet->AddHeader (ipHeader);
-
-    return 0;
+    return NF_ACCEPT;
 }
 
 static uint32_t
-TtlMangle2(Hooks_t hook, Ptr<Packet> packet, Ptr<NetDevice> in,
-               Ptr<NetDevice> out, ContinueCallback& ccb)
+TtlMangle2(Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+               const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
 { 
     NS_LOG_UNCOND("***********TTL Mangling 2 Callback*************");
     
+    // write back changes of earlier hooks before looking at the bytes
+    ctx.Flush ();
     //Packet::EnablePrinting ();
     packet->Print (std::cout);
     std::cout << std::endl;
 
-    Ipv4Header ipHeader;
-
-    packet->RemoveHeader (ipHeader);
-    packet->AddHeader (ipHeader);
-
-    packet->RemoveHeader (ipHeader);
-    ipHeader.SetTtl (64);
-    packet->AddHeader (ipHeader);
+    ctx.GetIpv4Header ().SetTtl (64);
+    ctx.SetIpv4HeaderDirty ();
 
-    return 0;
+    return NF_ACCEPT;
 }
 
 int
@@ -29,8 +29,8 @@ using namespace ns3;
 NS_LOG_COMPONENT_DEFINE ("NetfilterExample");
 
 static uint32_t
-HookRegistered(Hooks_t hook, Ptr<Packet> packet, Ptr<NetDevice> in,
-               Ptr<NetDevice> out, ContinueCallback& ccb)
+HookRegistered(Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+               const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
 { 
   const char* hooknames[] = {"NF_INET_PRE_ROUTING","NF_INET_LOCAL_IN","NF_INET_FORWARD","NF_INET_LOCAL_OUT","NF_INET_POST_ROUTING","NF_INET_NUMHOOKS"};
 
@@ -42,7 +42,7 @@ HookRegistered(Hooks_t hook, Ptr<Packet> packet, Ptr<NetDevice> in,
     else
       if(out!=0 && in == 0) 
         std::cout<<"********On Node "<<out->GetNode()->GetId()<<" "<<hooknames[hook]<<" hit***********"<<std::endl;
-    return 0;
+    return NF_ACCEPT;
 
   
 }
@@ -0,0 +1,180 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "conntrack-tag.h"
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (ConntrackTag);
+NS_OBJECT_ENSURE_REGISTERED (Ipv6ConntrackTag);
+
+ConntrackTag::ConntrackTag ()
+  : m_info (0)
+{
+}
+
+ConntrackTag::ConntrackTag (const NetfilterConntrackTuple& tuple, uint8_t info)
+  : m_tuple (tuple),
+    m_info (info)
+{
+}
+
+void
+ConntrackTag::SetTuple (const NetfilterConntrackTuple& tuple)
+{
+  m_tuple = tuple;
+}
+
+NetfilterConntrackTuple
+ConntrackTag::GetTuple (void) const
+{
+  return m_tuple;
+}
+
+void
+ConntrackTag::SetConntrack (uint8_t info)
+{
+  m_info = info;
+}
+
+uint8_t
+ConntrackTag::GetConntrack (void) const
+{
+  return m_info;
+}
+
+TypeId
+ConntrackTag::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::ConntrackTag")
+    .SetParent<Tag> ()
+    .AddConstructor<ConntrackTag> ()
+  ;
+  return tid;
+}
+
+TypeId
+ConntrackTag::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+ConntrackTag::GetSerializedSize (void) const
+{
+  return 4 + 2 + 4 + 2 + 2 + 1 + 1 + 1;
+}
+
+void
+ConntrackTag::Serialize (TagBuffer i) const
+{
+  NetfilterConntrackTuple tuple = m_tuple;
+  i.WriteU32 (tuple.GetSource ().Get ());
+  i.WriteU16 (tuple.GetSourcePort ());
+  i.WriteU32 (tuple.GetDestination ().Get ());
+  i.WriteU16 (tuple.GetDestinationPort ());
+  i.WriteU16 (tuple.GetProtocol ());
+  i.WriteU8 (tuple.GetDestinationProtocol ());
+  i.WriteU8 (tuple.GetDirection ());
+  i.WriteU8 (m_info);
+}
+
+void
+ConntrackTag::Deserialize (TagBuffer i)
+{
+  m_tuple.SetSource (Ipv4Address (i.ReadU32 ()));
+  m_tuple.SetSourcePort (i.ReadU16 ());
+  m_tuple.SetDestination (Ipv4Address (i.ReadU32 ()));
+  m_tuple.SetDestinationPort (i.ReadU16 ());
+  m_tuple.SetProtocol (i.ReadU16 ());
+  m_tuple.SetDestinationProtocol (i.ReadU8 ());
+  m_tuple.SetDirection ((ConntrackDirection_t)i.ReadU8 ());
+  m_info = i.ReadU8 ();
+}
+
+void
+ConntrackTag::Print (std::ostream &os) const
+{
+  os << "Conntrack [" << m_tuple << ", info " << (uint32_t)m_info << "]";
+}
+
+Ipv6ConntrackTag::Ipv6ConntrackTag ()
+  : m_id (0),
+    m_info (0)
+{
+}
+
+Ipv6ConntrackTag::Ipv6ConntrackTag (uint32_t id, uint8_t info)
+  : m_id (id),
+    m_info (info)
+{
+}
+
+uint32_t
+Ipv6ConntrackTag::GetId (void) const
+{
+  return m_id;
+}
+
+uint8_t
+Ipv6ConntrackTag::GetConntrack (void) const
+{
+  return m_info;
+}
+
+TypeId
+Ipv6ConntrackTag::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::Ipv6ConntrackTag")
+    .SetParent<Tag> ()
+    .AddConstructor<Ipv6ConntrackTag> ()
+  ;
+  return tid;
+}
+
+TypeId
+Ipv6ConntrackTag::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+Ipv6ConntrackTag::GetSerializedSize (void) const
+{
+  return 4 + 1;
+}
+
+void
+Ipv6ConntrackTag::Serialize (TagBuffer i) const
+{
+  i.WriteU32 (m_id);
+  i.WriteU8 (m_info);
+}
+
+void
+Ipv6ConntrackTag::Deserialize (TagBuffer i)
+{
+  m_id = i.ReadU32 ();
+  m_info = i.ReadU8 ();
+}
+
+void
+Ipv6ConntrackTag::Print (std::ostream &os) const
+{
+  os << "Conntrack [id " << m_id << ", info " << (uint32_t)m_info << "]";
+}
+
+} // namespace ns3
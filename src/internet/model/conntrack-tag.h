@@ -0,0 +1,98 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef CONNTRACK_TAG_H
+#define CONNTRACK_TAG_H
+
+#include <stdint.h>
+#include "ns3/tag.h"
+#include "netfilter-conntrack-tuple.h"
+
+namespace ns3 {
+
+/**
+  * \brief Connection tracking state carried by a packet between hooks
+  *
+  * Ipv4Netfilter::NetfilterConntrackIn () resolves the connection of a
+  * packet when it enters the stack (PRE_ROUTING or LOCAL_OUT) and tags
+  * the packet with the tuple of its direction and its conntrack info.
+  * NetfilterConntrackConfirm () takes the tag off when the packet leaves
+  * (POST_ROUTING or LOCAL_IN) instead of resolving the connection again.
+  */
+class ConntrackTag : public Tag
+{
+public:
+  ConntrackTag ();
+
+  /**
+    * \param tuple Tuple of the packet, in its own direction
+    * \param info Conntrack info e.g., IP_CT_NEW
+    */
+  ConntrackTag (const NetfilterConntrackTuple& tuple, uint8_t info);
+
+  void SetTuple (const NetfilterConntrackTuple& tuple);
+  NetfilterConntrackTuple GetTuple (void) const;
+  void SetConntrack (uint8_t info);
+  uint8_t GetConntrack (void) const;
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (TagBuffer i) const;
+  virtual void Deserialize (TagBuffer i);
+  virtual void Print (std::ostream &os) const;
+
+private:
+  NetfilterConntrackTuple m_tuple;
+  uint8_t m_info;
+};
+
+/**
+  * \brief Connection tracking state of an IPv6 packet carried between hooks
+  *
+  * An IPv6 tuple does not fit into a packet tag, so Ipv6Netfilter tags a
+  * packet with the conntrack info and, for a new connection, the number
+  * under which the tuple waits for its confirmation.
+  */
+class Ipv6ConntrackTag : public Tag
+{
+public:
+  Ipv6ConntrackTag ();
+
+  /**
+    * \param id Number of the unconfirmed connection, 0 if the connection
+    * is confirmed already
+    * \param info Conntrack info e.g., IP_CT_NEW
+    */
+  Ipv6ConntrackTag (uint32_t id, uint8_t info);
+
+  uint32_t GetId (void) const;
+  uint8_t GetConntrack (void) const;
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (TagBuffer i) const;
+  virtual void Deserialize (TagBuffer i);
+  virtual void Print (std::ostream &os) const;
+
+private:
+  uint32_t m_id;
+  uint8_t m_info;
+};
+
+} // namespace ns3
+
+#endif /* CONNTRACK_TAG_H */
@@ -17,7 +17,7 @@
  * 
  * Author: Qasim Javed <qasim@utdallas.edu>
  */
-#include "icmpv4.h"
+#include "netfilter-packet-context.h"
 #include "icmpv4-conntrack-l4-protocol.h"
 
 NS_LOG_COMPONENT_DEFINE ("Icmpv4ConntrackL4Protocol");
@@ -30,14 +30,9 @@ Icmpv4ConntrackL4Protocol::Icmpv4ConntrackL4Protocol ()
 }
 
 bool 
-Icmpv4ConntrackL4Protocol::PacketToTuple (Ptr<Packet> p, NetfilterConntrackTuple& tuple)
+Icmpv4ConntrackL4Protocol::PacketToTuple (NetfilterPacketContext& ctx, NetfilterConntrackTuple& tuple)
 {
-  NS_LOG_FUNCTION ( this << p );
-  Icmpv4Header icmpHeader;
-  bool found = p->PeekHeader (icmpHeader);
-
-  if (!found)
-    NS_LOG_DEBUG (":: Errrr, No ICMP Header :: ");
+  NS_LOG_FUNCTION ( this << ctx.GetPacket () );
 
   //TODO: Add ICMP specific fields to the NetfilterConntrackTuple class, such as request ID
 
@@ -34,7 +34,7 @@ class NetDevice;
   class Icmpv4ConntrackL4Protocol : public NetfilterConntrackL4Protocol {
     public:
       Icmpv4ConntrackL4Protocol ();
-      bool PacketToTuple (Ptr<Packet> p, NetfilterConntrackTuple& tuple);
+      bool PacketToTuple (NetfilterPacketContext& ctx, NetfilterConntrackTuple& tuple);
       bool InvertTuple (NetfilterConntrackTuple& inverse, NetfilterConntrackTuple& orig);
 
     private:
@@ -24,11 +24,13 @@ namespace ns3 {
 IpConntrackInfo::IpConntrackInfo ()
 {
   m_status = 0;
+  m_info = 0;
 }
 
 IpConntrackInfo::IpConntrackInfo (uint32_t status)
 {
   m_status = status;
+  m_info = 0;
 }
 
 void
@@ -55,6 +57,18 @@ IpConntrackInfo::GetInfo ()
   return m_info;
 }
 
+void
+IpConntrackInfo::SetExpires (Time expires)
+{
+  m_expires = expires;
+}
+
+Time
+IpConntrackInfo::GetExpires () const
+{
+  return m_expires;
+}
+
 bool
 IpConntrackInfo::IsConfirmed ()
 {
@@ -21,6 +21,7 @@
 #define IP_CONNTRACK_INFO
 
 #include <stdint.h>
+#include "ns3/nstime.h"
 
 
 namespace ns3 {
@@ -111,6 +112,10 @@ public:
   void SetInfo (uint8_t info);
   /*Get the info field of Conntrack*/
   uint8_t GetInfo ();
+  /*Set the simulation time at which the idle connection expires*/
+  void SetExpires (Time expires);
+  /*Get the simulation time at which the idle connection expires*/
+  Time GetExpires () const;
 
   ConntrackDirection_t ConntrackInfoToDirection (ConntrackInfo_t ctinfo);
 
@@ -119,6 +124,8 @@ private:
   uint32_t m_status;
   /*Information on connection */
   uint8_t m_info;
+  /*Expiry deadline, pushed back by every packet of the connection*/
+  Time m_expires;
 };
 
 }
@@ -22,6 +22,7 @@
 #include "ns3/callback.h"
 //#include "ns3/conntrack-tag.h"
 #include "ipv4-conntrack-l3-protocol.h"
+#include "netfilter-packet-context.h"
 
 NS_LOG_COMPONENT_DEFINE ("Ipv4ConntrackL3Protocol");
 
@@ -32,8 +33,8 @@ Ipv4ConntrackL3Protocol::Ipv4ConntrackL3Protocol ()
 }
 
 uint32_t 
-Ipv4ConntrackL3Protocol::Ipv4Confirm (Hooks_t hookNumber, Ptr<Packet> packet, Ptr<NetDevice> in,
-                      Ptr<NetDevice> out, ContinueCallback& ccb)
+Ipv4ConntrackL3Protocol::Ipv4Confirm (Hooks_t hookNumber, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                      const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
 {
   NS_LOG_DEBUG (":: Executing hook function Ipv4Confirm ::");
   /*ConntrackTag ctinfo;
@@ -42,7 +43,7 @@ Ipv4ConntrackL3Protocol::Ipv4Confirm (Hooks_t hookNumber, Ptr<Packet> packet, Pt
   if (!tagFound || ctinfo.GetConntrack () == IP_CT_RELATED + IP_CT_IS_REPLY)
   {
     NS_LOG_DEBUG ("Conntrack tag not found");
-    return 0;
+    return NF_ACCEPT;
   }*/
 
   // Call conntrack helper here
@@ -50,33 +51,34 @@ Ipv4ConntrackL3Protocol::Ipv4Confirm (Hooks_t hookNumber, Ptr<Packet> packet, Pt
   NS_ASSERT (!ccb.IsNull ());
   // NetfilterConntrackConfirm
   NS_LOG_DEBUG ("Invoking the ContinueCallback");
+  ctx.Flush ();
   ccb (packet);
 
-  return 0;
+  return NF_ACCEPT;
 }
 
 uint32_t 
-Ipv4ConntrackL3Protocol::Ipv4ConntrackPreRoutingHook (Hooks_t hookNumber, Ptr<Packet> p, Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback& ccb)
+Ipv4ConntrackL3Protocol::Ipv4ConntrackPreRoutingHook (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in, const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
 {
-  return 0;
+  return NF_ACCEPT;
 }
 
 uint32_t 
-Ipv4ConntrackL3Protocol::Ipv4ConntrackInHook (Hooks_t hookNumber, Ptr<Packet> p, Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback& ccb)
+Ipv4ConntrackL3Protocol::Ipv4ConntrackInHook (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in, const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
 {
-  return 0;
+  return NF_ACCEPT;
 }
 
 uint32_t 
-Ipv4ConntrackL3Protocol::Ipv4ConntrackOutHook (Hooks_t hookNumber, Ptr<Packet> p, Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback& ccb)
+Ipv4ConntrackL3Protocol::Ipv4ConntrackOutHook (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in, const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
 {
-  return 0;
+  return NF_ACCEPT;
 }
 
 uint32_t 
-Ipv4ConntrackL3Protocol::Ipv4ConntrackPostRoutingHook (Hooks_t hookNumber, Ptr<Packet> p, Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback& ccb)
+Ipv4ConntrackL3Protocol::Ipv4ConntrackPostRoutingHook (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in, const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
 {
-  return 0;
+  return NF_ACCEPT;
 }
 
 uint16_t 
@@ -104,11 +106,9 @@ Ipv4ConntrackL3Protocol::RegisterPostRoutingHook ()
 }
 
 bool 
-Ipv4ConntrackL3Protocol::PacketToTuple (Ptr<Packet> packet, NetfilterConntrackTuple& tuple)
+Ipv4ConntrackL3Protocol::PacketToTuple (NetfilterPacketContext& ctx, NetfilterConntrackTuple& tuple)
 {
-  Ipv4Header ipHeader;
-
-  packet->PeekHeader (ipHeader);
+  const Ipv4Header &ipHeader = ctx.GetIpv4Header ();
 
   tuple.SetSource (ipHeader.GetSource ());
   tuple.SetDestination (ipHeader.GetDestination ());
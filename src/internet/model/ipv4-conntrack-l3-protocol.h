@@ -38,18 +38,18 @@ class NetDevice;
       uint16_t RegisterOutHook ();
       uint16_t RegisterPostRoutingHook ();
 
-      uint32_t Ipv4Confirm (Hooks_t hookNumber, Ptr<Packet> packet, Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback& ccb);
+      uint32_t Ipv4Confirm (Hooks_t hookNumber, const Ptr<Packet>& packet, const Ptr<NetDevice>& in, const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
 
     private:
       NetfilterHookCallback Ipv4ConntrackIn;
       NetfilterHookCallback Ipv4ConntrackLocal;
       NetfilterHookCallback Ipv4ConntrackConfirm;
 
-      uint32_t Ipv4ConntrackPreRoutingHook (Hooks_t hookNumber, Ptr<Packet> p, Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback& ccb);
-      uint32_t Ipv4ConntrackInHook (Hooks_t hookNumber, Ptr<Packet> p, Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback& ccb);
-      uint32_t Ipv4ConntrackOutHook (Hooks_t hookNumber, Ptr<Packet> p, Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback& ccb);
-      uint32_t Ipv4ConntrackPostRoutingHook (Hooks_t hookNumber, Ptr<Packet> p, Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback& ccb);
-      bool PacketToTuple (Ptr<Packet> packet, NetfilterConntrackTuple& tuple);
+      uint32_t Ipv4ConntrackPreRoutingHook (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in, const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+      uint32_t Ipv4ConntrackInHook (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in, const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+      uint32_t Ipv4ConntrackOutHook (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in, const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+      uint32_t Ipv4ConntrackPostRoutingHook (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in, const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+      bool PacketToTuple (NetfilterPacketContext& ctx, NetfilterConntrackTuple& tuple);
       bool InvertTuple (NetfilterConntrackTuple& inverse, NetfilterConntrackTuple& orig);
 
   };
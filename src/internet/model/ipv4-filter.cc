@@ -0,0 +1,478 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ns3/node.h"
+#include "ipv4-filter.h"
+#include "ipv4-netfilter.h"
+#include "netfilter-packet-context.h"
+#include "conntrack-tag.h"
+#include "ip-conntrack-info.h"
+
+NS_LOG_COMPONENT_DEFINE ("Ipv4Filter");
+
+namespace ns3 {
+
+Ipv4FilterRule::Ipv4FilterRule (Verdicts_t verdict)
+  : m_source (Ipv4Address::GetAny ()),
+    m_sourceMask (Ipv4Mask::GetZero ()),
+    m_destination (Ipv4Address::GetAny ()),
+    m_destinationMask (Ipv4Mask::GetZero ()),
+    m_sourcePortFirst (0),
+    m_sourcePortLast (65535),
+    m_destinationPortFirst (0),
+    m_destinationPortLast (65535),
+    m_protocol (0),
+    m_state (STATE_ANY),
+    m_verdict (verdict)
+{
+  NS_ASSERT_MSG (verdict == NF_ACCEPT || verdict == NF_DROP, "Filter rules accept or drop");
+}
+
+void
+Ipv4FilterRule::SetSource (Ipv4Address address, Ipv4Mask mask)
+{
+  m_source = address.CombineMask (mask);
+  m_sourceMask = mask;
+}
+
+void
+Ipv4FilterRule::SetDestination (Ipv4Address address, Ipv4Mask mask)
+{
+  m_destination = address.CombineMask (mask);
+  m_destinationMask = mask;
+}
+
+void
+Ipv4FilterRule::SetProtocol (uint8_t protocol)
+{
+  m_protocol = protocol;
+}
+
+void
+Ipv4FilterRule::SetSourcePortRange (uint16_t first, uint16_t last)
+{
+  NS_ASSERT (first <= last);
+  m_sourcePortFirst = first;
+  m_sourcePortLast = last;
+}
+
+void
+Ipv4FilterRule::SetDestinationPortRange (uint16_t first, uint16_t last)
+{
+  NS_ASSERT (first <= last);
+  m_destinationPortFirst = first;
+  m_destinationPortLast = last;
+}
+
+void
+Ipv4FilterRule::SetState (uint8_t states)
+{
+  m_state = states & STATE_ANY;
+}
+
+Ipv4Address
+Ipv4FilterRule::GetSource () const
+{
+  return m_source;
+}
+
+Ipv4Mask
+Ipv4FilterRule::GetSourceMask () const
+{
+  return m_sourceMask;
+}
+
+Ipv4Address
+Ipv4FilterRule::GetDestination () const
+{
+  return m_destination;
+}
+
+Ipv4Mask
+Ipv4FilterRule::GetDestinationMask () const
+{
+  return m_destinationMask;
+}
+
+uint8_t
+Ipv4FilterRule::GetProtocol () const
+{
+  return m_protocol;
+}
+
+uint16_t
+Ipv4FilterRule::GetSourcePortFirst () const
+{
+  return m_sourcePortFirst;
+}
+
+uint16_t
+Ipv4FilterRule::GetSourcePortLast () const
+{
+  return m_sourcePortLast;
+}
+
+uint16_t
+Ipv4FilterRule::GetDestinationPortFirst () const
+{
+  return m_destinationPortFirst;
+}
+
+uint16_t
+Ipv4FilterRule::GetDestinationPortLast () const
+{
+  return m_destinationPortLast;
+}
+
+uint8_t
+Ipv4FilterRule::GetState () const
+{
+  return m_state;
+}
+
+Verdicts_t
+Ipv4FilterRule::GetVerdict () const
+{
+  return m_verdict;
+}
+
+bool
+Ipv4FilterRule::HasPorts () const
+{
+  return m_sourcePortFirst != 0 || m_sourcePortLast != 65535
+         || m_destinationPortFirst != 0 || m_destinationPortLast != 65535;
+}
+
+bool
+Ipv4FilterRule::Matches (Ipv4Address source, Ipv4Address destination, uint8_t protocol, bool hasPorts,
+                         uint16_t sourcePort, uint16_t destinationPort, uint8_t state) const
+{
+  if (!m_sourceMask.IsMatch (source, m_source)
+      || !m_destinationMask.IsMatch (destination, m_destination)
+      || (m_protocol != 0 && m_protocol != protocol)
+      || (m_state & state) == 0)
+    {
+      return false;
+    }
+  if (!HasPorts ())
+    {
+      return true;
+    }
+  return hasPorts
+         && sourcePort >= m_sourcePortFirst && sourcePort <= m_sourcePortLast
+         && destinationPort >= m_destinationPortFirst && destinationPort <= m_destinationPortLast;
+}
+
+Ipv4FilterKey::Ipv4FilterKey ()
+  : m_source (0),
+    m_destination (0),
+    m_port (0),
+    m_protocol (0)
+{
+}
+
+Ipv4FilterKey::Ipv4FilterKey (uint32_t source, uint32_t destination, uint8_t protocol, uint16_t port)
+  : m_source (source),
+    m_destination (destination),
+    m_port (port),
+    m_protocol (protocol)
+{
+}
+
+bool
+Ipv4FilterKey::operator== (const Ipv4FilterKey& o) const
+{
+  return m_source == o.m_source && m_destination == o.m_destination
+         && m_port == o.m_port && m_protocol == o.m_protocol;
+}
+
+size_t
+Ipv4FilterKeyHash::operator() (const Ipv4FilterKey& key) const
+{
+  uint32_t h = key.m_source * 0x9e3779b1U;
+  h ^= key.m_destination;
+  h *= 0x85ebca6bU;
+  h ^= ((uint32_t)key.m_port << 8) | key.m_protocol;
+  h *= 0xc2b2ae35U;
+  return h ^ (h >> 16);
+}
+
+NS_OBJECT_ENSURE_REGISTERED (Ipv4Filter);
+
+TypeId
+Ipv4Filter::GetTypeId (void)
+{
+  static TypeId tId = TypeId ("ns3::Ipv4Filter")
+    .SetParent<Object> ()
+  ;
+  return tId;
+}
+
+Ipv4Filter::Ipv4Filter ()
+{
+  NS_LOG_FUNCTION (this);
+  for (uint32_t i = 0; i < NF_INET_NUMHOOKS; i++)
+    {
+      m_tables[i].policy = NF_ACCEPT;
+      m_tables[i].dirty = false;
+      m_tables[i].matchState = false;
+    }
+}
+
+void
+Ipv4Filter::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  for (uint32_t i = 0; i < NF_INET_NUMHOOKS; i++)
+    {
+      m_tables[i].rules.clear ();
+      m_tables[i].tuples.clear ();
+    }
+  m_ipv4 = 0;
+  Object::DoDispose ();
+}
+
+/*
+ * Hooks the filter into every chain of the Ipv4Netfilter of the node it is
+ * aggregated to
+ */
+void
+Ipv4Filter::NotifyNewAggregate ()
+{
+  NS_LOG_FUNCTION (this);
+  if (m_ipv4 != 0)
+    {
+      return;
+    }
+  Ptr<Node> node = this->GetObject<Node> ();
+  if (node != 0)
+    {
+      Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+      if (ipv4 != 0)
+        {
+          m_ipv4 = ipv4;
+          Ptr<Ipv4Netfilter> netfilter = ipv4->GetNetfilter ();
+          NetfilterHookCallback doFilter = MakeCallback (&Ipv4Filter::DoFilter, this);
+          for (uint32_t i = 0; i < NF_INET_NUMHOOKS; i++)
+            {
+              netfilter->RegisterHook (Ipv4NetfilterHook (1, (Hooks_t)i, NF_IP_PRI_FILTER, doFilter));
+            }
+        }
+    }
+  Object::NotifyNewAggregate ();
+}
+
+void
+Ipv4Filter::AddRule (Hooks_t hook, const Ipv4FilterRule& rule)
+{
+  NS_LOG_FUNCTION (this << hook);
+  NS_ASSERT (hook < NF_INET_NUMHOOKS);
+  m_tables[hook].rules.push_back (rule);
+  m_tables[hook].dirty = true;
+}
+
+void
+Ipv4Filter::RemoveRule (Hooks_t hook, uint32_t index)
+{
+  NS_LOG_FUNCTION (this << hook << index);
+  NS_ASSERT (hook < NF_INET_NUMHOOKS);
+  NS_ASSERT (index < m_tables[hook].rules.size ());
+  m_tables[hook].rules.erase (m_tables[hook].rules.begin () + index);
+  m_tables[hook].dirty = true;
+}
+
+uint32_t
+Ipv4Filter::GetNRules (Hooks_t hook) const
+{
+  NS_ASSERT (hook < NF_INET_NUMHOOKS);
+  return m_tables[hook].rules.size ();
+}
+
+Ipv4FilterRule
+Ipv4Filter::GetRule (Hooks_t hook, uint32_t index) const
+{
+  NS_ASSERT (hook < NF_INET_NUMHOOKS);
+  NS_ASSERT (index < m_tables[hook].rules.size ());
+  return m_tables[hook].rules[index];
+}
+
+void
+Ipv4Filter::SetPolicy (Hooks_t hook, Verdicts_t policy)
+{
+  NS_LOG_FUNCTION (this << hook << policy);
+  NS_ASSERT (hook < NF_INET_NUMHOOKS);
+  NS_ASSERT_MSG (policy == NF_ACCEPT || policy == NF_DROP, "Filter policies accept or drop");
+  m_tables[hook].policy = policy;
+}
+
+Verdicts_t
+Ipv4Filter::GetPolicy (Hooks_t hook) const
+{
+  NS_ASSERT (hook < NF_INET_NUMHOOKS);
+  return m_tables[hook].policy;
+}
+
+uint32_t
+Ipv4Filter::GetNTuples (Hooks_t hook)
+{
+  NS_ASSERT (hook < NF_INET_NUMHOOKS);
+  if (m_tables[hook].dirty)
+    {
+      Compile (m_tables[hook]);
+    }
+  return m_tables[hook].tuples.size ();
+}
+
+void
+Ipv4Filter::Compile (Table &table)
+{
+  NS_LOG_FUNCTION (this << table.rules.size ());
+  table.tuples.clear ();
+  table.matchState = false;
+  for (uint32_t i = 0; i < table.rules.size (); i++)
+    {
+      const Ipv4FilterRule &rule = table.rules[i];
+      uint32_t sourceMask = rule.GetSourceMask ().Get ();
+      uint32_t destinationMask = rule.GetDestinationMask ().Get ();
+      bool protocol = rule.GetProtocol () != 0;
+      bool port = protocol && rule.GetDestinationPortFirst () == rule.GetDestinationPortLast ();
+      table.matchState |= rule.GetState () != Ipv4FilterRule::STATE_ANY;
+
+      // the rules are visited in order, so the tuples are created in the
+      // order of their first rule
+      std::vector<Tuple>::iterator tuple = table.tuples.begin ();
+      for (; tuple != table.tuples.end (); tuple++)
+        {
+          if (tuple->sourceMask == sourceMask && tuple->destinationMask == destinationMask
+              && tuple->protocol == protocol && tuple->port == port)
+            {
+              break;
+            }
+        }
+      if (tuple == table.tuples.end ())
+        {
+          Tuple t;
+          t.sourceMask = sourceMask;
+          t.destinationMask = destinationMask;
+          t.protocol = protocol;
+          t.port = port;
+          t.first = i;
+          table.tuples.push_back (t);
+          tuple = table.tuples.end () - 1;
+        }
+      Ipv4FilterKey key (rule.GetSource ().Get (), rule.GetDestination ().Get (),
+                         rule.GetProtocol (), port ? rule.GetDestinationPortFirst () : 0);
+      tuple->rules[key].push_back (i);
+    }
+  table.dirty = false;
+  NS_LOG_LOGIC (table.rules.size () << " rules in " << table.tuples.size () << " tuples");
+}
+
+int32_t
+Ipv4Filter::Classify (Hooks_t hook, Ipv4Address source, Ipv4Address destination, uint8_t protocol,
+                      bool hasPorts, uint16_t sourcePort, uint16_t destinationPort, uint8_t state)
+{
+  NS_ASSERT (hook < NF_INET_NUMHOOKS);
+  Table &table = m_tables[hook];
+  if (table.dirty)
+    {
+      Compile (table);
+    }
+
+  uint32_t best = table.rules.size ();
+  for (std::vector<Tuple>::const_iterator tuple = table.tuples.begin ();
+       tuple != table.tuples.end () && tuple->first < best; tuple++)
+    {
+      if (tuple->port && !hasPorts)
+        {
+          continue;
+        }
+      Ipv4FilterKey key (source.Get () & tuple->sourceMask, destination.Get () & tuple->destinationMask,
+                         tuple->protocol ? protocol : 0, tuple->port ? destinationPort : 0);
+      RuleIndex::const_iterator found = tuple->rules.find (key);
+      if (found == tuple->rules.end ())
+        {
+          continue;
+        }
+      const std::vector<uint32_t> &candidates = found->second;
+      for (std::vector<uint32_t>::const_iterator i = candidates.begin ();
+           i != candidates.end () && *i < best; i++)
+        {
+          if (table.rules[*i].Matches (source, destination, protocol, hasPorts,
+                                       sourcePort, destinationPort, state))
+            {
+              best = *i;
+              break;
+            }
+        }
+    }
+  return best < table.rules.size () ? (int32_t)best : -1;
+}
+
+uint32_t
+Ipv4Filter::DoFilter (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                      const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  NS_LOG_FUNCTION (this << hookNumber << p);
+  Table &table = m_tables[hookNumber];
+  if (table.rules.empty ())
+    {
+      return table.policy;
+    }
+  if (table.dirty)
+    {
+      Compile (table);
+    }
+
+  uint8_t state = Ipv4FilterRule::STATE_ANY;
+  if (table.matchState)
+    {
+      ConntrackTag ctTag;
+      if (!p->PeekPacketTag (ctTag))
+        {
+          state = Ipv4FilterRule::STATE_UNTRACKED;
+        }
+      else
+        {
+          uint8_t info = ctTag.GetConntrack ();
+          if (info >= IP_CT_IS_REPLY)
+            {
+              info -= IP_CT_IS_REPLY;
+            }
+          state = info == IP_CT_NEW ? Ipv4FilterRule::STATE_NEW
+            : info == IP_CT_RELATED ? Ipv4FilterRule::STATE_RELATED
+            : Ipv4FilterRule::STATE_ESTABLISHED;
+        }
+    }
+
+  const Ipv4Header &ipHeader = ctx.GetIpv4Header ();
+  bool hasPorts = ctx.HasPorts ();
+  int32_t rule = Classify (hookNumber, ipHeader.GetSource (), ipHeader.GetDestination (),
+                           ipHeader.GetProtocol (), hasPorts,
+                           hasPorts ? ctx.GetSourcePort () : 0,
+                           hasPorts ? ctx.GetDestinationPort () : 0, state);
+  if (rule < 0)
+    {
+      NS_LOG_LOGIC ("No rule matches, policy " << table.policy);
+      return table.policy;
+    }
+  NS_LOG_LOGIC ("Rule " << rule << " matches, verdict " << table.rules[rule].GetVerdict ());
+  return table.rules[rule].GetVerdict ();
+}
+
+} // namespace ns3
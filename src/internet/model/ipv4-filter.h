@@ -0,0 +1,284 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef IPV4_FILTER_H
+#define IPV4_FILTER_H
+
+#include <stdint.h>
+#include <vector>
+#include "ns3/ptr.h"
+#include "ns3/object.h"
+#include "ns3/ipv4-address.h"
+#include "ipv4.h"
+#include "ipv4-netfilter-hook.h"
+#include "sgi-hashmap.h"
+
+namespace ns3 {
+
+class NetfilterPacketContext;
+
+/**
+  * \brief A rule of the packet filter
+  *
+  * A rule matches packets by source and destination prefix, protocol,
+  * source and destination port range and conntrack state. Every field
+  * matches any packet until it is set. A packet matched by the rule is
+  * accepted or dropped, as the verdict of the rule says.
+  */
+class Ipv4FilterRule
+{
+public:
+  /**
+    * Conntrack states of a packet, to be or'ed into the state mask
+    */
+  enum State
+  {
+    STATE_NEW = 1,
+    STATE_ESTABLISHED = 2,
+    STATE_RELATED = 4,
+    STATE_UNTRACKED = 8,
+    STATE_ANY = 15
+  };
+
+  /**
+    * \param verdict NF_ACCEPT or NF_DROP, for the packets the rule matches
+    */
+  Ipv4FilterRule (Verdicts_t verdict);
+
+  void SetSource (Ipv4Address address, Ipv4Mask mask);
+  void SetDestination (Ipv4Address address, Ipv4Mask mask);
+
+  /**
+    * \param protocol The protocol number packets must carry, 0 for any
+    */
+  void SetProtocol (uint8_t protocol);
+
+  /**
+    * \param first First source port of the range
+    * \param last Last source port of the range
+    *
+    * A rule with a port range only matches TCP and UDP packets.
+    */
+  void SetSourcePortRange (uint16_t first, uint16_t last);
+
+  /**
+    * \param first First destination port of the range
+    * \param last Last destination port of the range
+    *
+    * A rule with a port range only matches TCP and UDP packets.
+    */
+  void SetDestinationPortRange (uint16_t first, uint16_t last);
+
+  /**
+    * \param states Mask of the Ipv4FilterRule::State values to match
+    */
+  void SetState (uint8_t states);
+
+  Ipv4Address GetSource () const;
+  Ipv4Mask GetSourceMask () const;
+  Ipv4Address GetDestination () const;
+  Ipv4Mask GetDestinationMask () const;
+  uint8_t GetProtocol () const;
+  uint16_t GetSourcePortFirst () const;
+  uint16_t GetSourcePortLast () const;
+  uint16_t GetDestinationPortFirst () const;
+  uint16_t GetDestinationPortLast () const;
+  uint8_t GetState () const;
+  Verdicts_t GetVerdict () const;
+
+  /**
+    * \returns true if the rule matches ports, so that only packets that have
+    * ports can match it
+    */
+  bool HasPorts () const;
+
+  /**
+    * \param source Source address of the packet
+    * \param destination Destination address of the packet
+    * \param protocol Protocol of the packet
+    * \param hasPorts Whether the packet is TCP or UDP with its ports
+    * \param sourcePort Source port of the packet
+    * \param destinationPort Destination port of the packet
+    * \param state Ipv4FilterRule::State of the packet
+    * \returns true if the rule matches the packet
+    */
+  bool Matches (Ipv4Address source, Ipv4Address destination, uint8_t protocol, bool hasPorts,
+                uint16_t sourcePort, uint16_t destinationPort, uint8_t state) const;
+
+private:
+  Ipv4Address m_source;
+  Ipv4Mask m_sourceMask;
+  Ipv4Address m_destination;
+  Ipv4Mask m_destinationMask;
+  uint16_t m_sourcePortFirst;
+  uint16_t m_sourcePortLast;
+  uint16_t m_destinationPortFirst;
+  uint16_t m_destinationPortLast;
+  uint8_t m_protocol;
+  uint8_t m_state;
+  Verdicts_t m_verdict;
+};
+
+/**
+  * \brief Key of a rule in the tuple space of the packet filter
+  *
+  * The masked source and destination addresses, the protocol and the
+  * destination port, where the tuple of the rule specifies them.
+  */
+class Ipv4FilterKey
+{
+public:
+  Ipv4FilterKey ();
+  Ipv4FilterKey (uint32_t source, uint32_t destination, uint8_t protocol, uint16_t port);
+  bool operator== (const Ipv4FilterKey& o) const;
+
+  uint32_t m_source;
+  uint32_t m_destination;
+  uint16_t m_port;
+  uint8_t m_protocol;
+};
+
+/**
+  * \brief Hash functor for Ipv4FilterKey
+  */
+class Ipv4FilterKeyHash
+{
+public:
+  size_t operator() (const Ipv4FilterKey& key) const;
+};
+
+/**
+  * \brief Packet filter table over the Netfilter framework
+  *
+  * Like the filter table of iptables, this keeps an ordered list of rules
+  * for each hook. The first rule that matches a packet decides whether the
+  * packet is accepted or dropped. Packets that no rule matches get the
+  * policy of the hook, NF_ACCEPT unless changed.
+  *
+  * The rules are not tried one after the other. When the rules of a hook
+  * change, they are compiled into a tuple space: rules are grouped by the
+  * lengths of their address prefixes and by whether they name a protocol
+  * and a single destination port. Each group is a hash table keyed by
+  * these fields, so a packet costs one hash lookup per group, and groups
+  * that only hold rules behind the best match so far are skipped. Port
+  * ranges and states are checked on the few rules found in the tables.
+  */
+class Ipv4Filter : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+
+  Ipv4Filter ();
+
+  /**
+    * \param hook The hook whose list the rule is appended to
+    * \param rule The rule
+    */
+  void AddRule (Hooks_t hook, const Ipv4FilterRule& rule);
+
+  /**
+    * \param hook The hook
+    * \param index Position of the rule in the list of the hook
+    */
+  void RemoveRule (Hooks_t hook, uint32_t index);
+
+  /**
+    * \param hook The hook
+    * \returns The number of rules of the hook
+    */
+  uint32_t GetNRules (Hooks_t hook) const;
+
+  /**
+    * \param hook The hook
+    * \param index Position of the rule in the list of the hook
+    * \returns The rule
+    */
+  Ipv4FilterRule GetRule (Hooks_t hook, uint32_t index) const;
+
+  /**
+    * \param hook The hook
+    * \param policy NF_ACCEPT or NF_DROP, for the packets no rule matches
+    */
+  void SetPolicy (Hooks_t hook, Verdicts_t policy);
+
+  /**
+    * \param hook The hook
+    * \returns The verdict for the packets no rule matches
+    */
+  Verdicts_t GetPolicy (Hooks_t hook) const;
+
+  /**
+    * \param hook The hook whose rules are searched
+    * \param source Source address of the packet
+    * \param destination Destination address of the packet
+    * \param protocol Protocol of the packet
+    * \param hasPorts Whether the packet is TCP or UDP with its ports
+    * \param sourcePort Source port of the packet
+    * \param destinationPort Destination port of the packet
+    * \param state Ipv4FilterRule::State of the packet
+    * \returns The index of the first rule that matches the packet, -1 if
+    * none does
+    */
+  int32_t Classify (Hooks_t hook, Ipv4Address source, Ipv4Address destination, uint8_t protocol,
+                    bool hasPorts, uint16_t sourcePort, uint16_t destinationPort, uint8_t state);
+
+  /**
+    * \param hook The hook
+    * \returns The number of groups the rules of the hook are compiled into
+    */
+  uint32_t GetNTuples (Hooks_t hook);
+
+protected:
+  virtual void NotifyNewAggregate (void);
+  virtual void DoDispose (void);
+
+private:
+  typedef sgi::hash_map<Ipv4FilterKey, std::vector<uint32_t>, Ipv4FilterKeyHash> RuleIndex;
+
+  /* A group of rules with the same prefix lengths and specified fields */
+  struct Tuple
+  {
+    uint32_t sourceMask;
+    uint32_t destinationMask;
+    bool protocol;
+    bool port;
+    uint32_t first;   //!< Index of the first rule of the group
+    RuleIndex rules;  //!< Rule indices by key, in list order
+  };
+
+  struct Table
+  {
+    std::vector<Ipv4FilterRule> rules;
+    std::vector<Tuple> tuples;  //!< Ordered by their first rule
+    Verdicts_t policy;
+    bool dirty;
+    bool matchState;            //!< Whether any rule looks at the state
+  };
+
+  uint32_t DoFilter (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                     const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+
+  /**
+    * \brief Build the tuple space of the rules of a hook
+    */
+  void Compile (Table &table);
+
+  Table m_tables[NF_INET_NUMHOOKS];
+  Ptr<Ipv4> m_ipv4;
+};
+
+} // namespace ns3
+
+#endif /* IPV4_FILTER_H */
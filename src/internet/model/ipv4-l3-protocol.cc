@@ -47,6 +47,23 @@ namespace ns3 {
 
 const uint16_t Ipv4L3Protocol::PROT_NUMBER = 0x0800;
 
+/*
+ * LOCAL_OUT hooks run on a copy of the packet that carries the IPv4
+ * header, the packet itself is sent on. Moves the connection the hooks
+ * resolved over so that POST_ROUTING can confirm it.
+ */
+static void
+CopyConntrackTag (Ptr<Packet> from, Ptr<Packet> to)
+{
+  ConntrackTag ctTag;
+  if (from->PeekPacketTag (ctTag))
+    {
+      ConntrackTag old;
+      to->RemovePacketTag (old);
+      to->AddPacketTag (ctTag);
+    }
+}
+
 NS_OBJECT_ENSURE_REGISTERED (Ipv4L3Protocol);
 
 TypeId 
@@ -196,6 +213,12 @@ Ipv4L3Protocol::SetNetfilter (Ptr<Ipv4Netfilter> netfilter)
 {
   NS_LOG_FUNCTION (this << netfilter);
   m_netfilter = netfilter;
+  // built once, it is handed to the hooks of every packet
+  m_netfilterConfirm = MakeNullCallback<uint32_t, Ptr<Packet> > ();
+  if (netfilter != 0)
+    {
+      m_netfilterConfirm = MakeCallback (&Ipv4Netfilter::NetfilterConntrackConfirm, netfilter);
+    }
 }
 
 Ptr<Ipv4Netfilter>
@@ -239,6 +262,13 @@ Ipv4L3Protocol::DoDispose (void)
   m_fragments.clear ();
   m_fragmentsTimers.clear ();
 
+  if (m_netfilter != 0)
+    {
+      m_netfilter->Dispose ();
+      m_netfilter = 0;
+      m_netfilterConfirm = MakeNullCallback<uint32_t, Ptr<Packet> > ();
+    }
+
   Object::DoDispose ();
 }
 
@@ -465,10 +495,10 @@ Ipv4L3Protocol::Receive ( Ptr<NetDevice> device, Ptr<const Packet> p, uint16_t p
     {
       NS_LOG_DEBUG ("NF_INET_PRE_ROUTING Hook");
       Verdicts_t verdict = (Verdicts_t) m_netfilter->ProcessHook (PF_INET, NF_INET_PRE_ROUTING, packet, device, 0);
-      if (verdict == NF_DROP)
+      if (verdict != NF_ACCEPT)
         {
           NS_LOG_DEBUG ("NF_INET_PRE_ROUTING packet not accepted");
-          // Add drop trace here
+          NetfilterDrop (packet, device);
           return;
         }
     }
@@ -616,42 +646,24 @@ Ipv4L3Protocol::Send (Ptr<Packet> packet,
     {
       NS_LOG_LOGIC ("Ipv4L3Protocol::Send case 1:  limited broadcast");
       ipHeader = BuildHeader (source, destination, protocol, packet->GetSize (), ttl, tos, mayFragment);
+      // The hooks see the same packet and devices for every interface, so
+      // they run once per send. The interfaces are given copies of the
+      // result which share its bytes.
+      Ptr<Packet> filtered = packet->Copy ();
+      filtered->AddHeader (ipHeader);
+      if (!ProcessBroadcastHooks (filtered, device))
+        {
+          return;
+        }
       uint32_t ifaceIndex = 0;
       for (Ipv4InterfaceList::iterator ifaceIter = m_interfaces.begin ();
            ifaceIter != m_interfaces.end (); ifaceIter++, ifaceIndex++)
         {
           Ptr<Ipv4Interface> outInterface = *ifaceIter;
-          Ptr<Packet> packetCopy = packet->Copy ();
-
-          NS_ASSERT (packetCopy->GetSize () <= outInterface->GetDevice ()->GetMtu ());
-          m_sendOutgoingTrace (ipHeader, packetCopy, ifaceIndex);
-          packetCopy->AddHeader (ipHeader);
-          if (m_netfilter != 0)
-            {
-              NS_LOG_DEBUG ("NF_INET_LOCAL_OUT Hook");
-              Verdicts_t verdict = (Verdicts_t) m_netfilter->ProcessHook (PF_INET, NF_INET_LOCAL_OUT, packetCopy, 0, device);
-              if (verdict == NF_DROP)
-                {
-                  NS_LOG_DEBUG ("NF_INET_LOCAL_OUT packet not accepted");
-                  // Add drop trace here
-                  return;
-                }
-            }
-          // Do not call SendRealOut () (which requires passing in a route)
-          // instead, just send the packet on the interface 
-          if (m_netfilter != 0)
-            {
-              NS_LOG_DEBUG ("NF_INET_POST_ROUTING Hook");
-              Callback<uint32_t, Ptr<Packet> > ccb = MakeCallback (&Ipv4Netfilter::NetfilterConntrackConfirm, m_netfilter);
-              Verdicts_t verdict = (Verdicts_t) m_netfilter->ProcessHook (PF_INET, NF_INET_POST_ROUTING, packetCopy, 0, device, ccb);
-              if (verdict == NF_DROP)
-                {
-                  NS_LOG_DEBUG ("NF_INET_POST_ROUTING packet not accepted");
-                  // Add drop trace here
-                  return;
-                }
-            }
+          Ptr<Packet> packetCopy = filtered->Copy ();
 
+          NS_ASSERT (packet->GetSize () <= outInterface->GetDevice ()->GetMtu ());
+          m_sendOutgoingTrace (ipHeader, packet, ifaceIndex);
           m_txTrace (packetCopy, m_node->GetObject<Ipv4> (), ifaceIndex);
           outInterface->Send (packetCopy, destination);
         }
@@ -676,30 +688,9 @@ Ipv4L3Protocol::Send (Ptr<Packet> packet,
               Ptr<Packet> packetCopy = packet->Copy ();
               m_sendOutgoingTrace (ipHeader, packetCopy, ifaceIndex);
               packetCopy->AddHeader (ipHeader);
-              if (m_netfilter != 0)
+              if (!ProcessBroadcastHooks (packetCopy, device))
                 {
-                  NS_LOG_DEBUG ("NF_INET_LOCAL_OUT Hook");
-                  Verdicts_t verdict = (Verdicts_t) m_netfilter->ProcessHook (PF_INET, NF_INET_LOCAL_OUT, packetCopy, 0, device);
-                  if (verdict == NF_DROP)
-                    {
-                      NS_LOG_DEBUG ("NF_INET_LOCAL_OUT packet not accepted");
-                      // Add drop trace here
-                      return;
-                    }
-                }
-              // Do not call SendRealOut () (which requires passing in a route)
-              // instead, just send the packet on the interface 
-              if (m_netfilter != 0)
-                {
-                  NS_LOG_DEBUG ("NF_INET_POST_ROUTING Hook");
-                  Callback<uint32_t, Ptr<Packet> > ccb = MakeCallback (&Ipv4Netfilter::NetfilterConntrackConfirm, m_netfilter);
-                  Verdicts_t verdict = (Verdicts_t) m_netfilter->ProcessHook (PF_INET, NF_INET_POST_ROUTING, packetCopy, 0, device, ccb);
-                  if (verdict == NF_DROP)
-                    {
-                      NS_LOG_DEBUG ("NF_INET_POST_ROUTING packet not accepted");
-                      // Add drop trace here
-                      return;
-                    }
+                  return;
                 }
               m_txTrace (packetCopy, m_node->GetObject<Ipv4> (), ifaceIndex);
               outInterface->Send (packetCopy, destination);
@@ -723,12 +714,14 @@ Ipv4L3Protocol::Send (Ptr<Packet> packet,
           Ptr<Packet> packetCopy = packet->Copy (); 
           packetCopy->AddHeader (ipHeader);
           Verdicts_t verdict = (Verdicts_t) m_netfilter->ProcessHook (PF_INET, NF_INET_LOCAL_OUT, packetCopy, 0, device);
-          if (verdict == NF_DROP)
+          if (verdict != NF_ACCEPT)
             {
               NS_LOG_DEBUG ("NF_INET_LOCAL_OUT packet not accepted");
-              // Add drop trace here
+              NetfilterDrop (packetCopy, device);
               return;
             }
+          // the copy is dropped, keep its conntrack state for POST_ROUTING
+          CopyConntrackTag (packetCopy, packet);
         } 
       
       m_sendOutgoingTrace (ipHeader, packet, interface);
@@ -758,12 +751,13 @@ Ipv4L3Protocol::Send (Ptr<Packet> packet,
       Ptr<Packet> packetCopy = packet->Copy (); 
       packetCopy->AddHeader (ipHeader);
       Verdicts_t verdict = (Verdicts_t) m_netfilter->ProcessHook (PF_INET, NF_INET_LOCAL_OUT, packetCopy, 0, device);
-      if (verdict == NF_DROP)
+      if (verdict != NF_ACCEPT)
         {
           NS_LOG_DEBUG ("NF_INET_LOCAL_OUT packet not accepted");
-          // Add drop trace here
+          NetfilterDrop (packetCopy, device);
           return;
         }
+      CopyConntrackTag (packetCopy, packet);
     }
 
   if (m_routingProtocol != 0)
@@ -787,6 +781,35 @@ Ipv4L3Protocol::Send (Ptr<Packet> packet,
     }
 }
 
+bool
+Ipv4L3Protocol::ProcessBroadcastHooks (Ptr<Packet> packet, Ptr<NetDevice> device)
+{
+  NS_LOG_FUNCTION (this << packet << device);
+  if (m_netfilter == 0)
+    {
+      return true;
+    }
+  NS_LOG_DEBUG ("NF_INET_LOCAL_OUT Hook");
+  Verdicts_t verdict = (Verdicts_t) m_netfilter->ProcessHook (PF_INET, NF_INET_LOCAL_OUT, packet, 0, device);
+  if (verdict != NF_ACCEPT)
+    {
+      NS_LOG_DEBUG ("NF_INET_LOCAL_OUT packet not accepted");
+      NetfilterDrop (packet, device);
+      return false;
+    }
+  // Do not call SendRealOut () (which requires passing in a route)
+  // instead, the caller sends the packet on the interface
+  NS_LOG_DEBUG ("NF_INET_POST_ROUTING Hook");
+  verdict = (Verdicts_t) m_netfilter->ProcessHook (PF_INET, NF_INET_POST_ROUTING, packet, 0, device, m_netfilterConfirm);
+  if (verdict != NF_ACCEPT)
+    {
+      NS_LOG_DEBUG ("NF_INET_POST_ROUTING packet not accepted");
+      NetfilterDrop (packet, device);
+      return false;
+    }
+  return true;
+}
+
 // XXX when should we set ip_id?   check whether we are incrementing
 // m_identification on packets that may later be dropped in this stack
 // and whether that deviates from Linux
@@ -841,12 +864,11 @@ Ipv4L3Protocol::SendRealOut (Ptr<Ipv4Route> route,
   if (m_netfilter != 0)
     {
       NS_LOG_DEBUG ("NF_INET_POST_ROUTING Hook");
-      ContinueCallback ccb = MakeCallback (&Ipv4Netfilter::NetfilterConntrackConfirm, m_netfilter);
-      Verdicts_t verdict=(Verdicts_t) m_netfilter->ProcessHook (PF_INET, NF_INET_POST_ROUTING, packet, 0, device, ccb);
-      if (verdict == NF_DROP)
+      Verdicts_t verdict=(Verdicts_t) m_netfilter->ProcessHook (PF_INET, NF_INET_POST_ROUTING, packet, 0, device, m_netfilterConfirm);
+      if (verdict != NF_ACCEPT)
         {
           NS_LOG_DEBUG ("NF_INET_POST_ROUTING packet not accepted");
-          // Add drop trace here
+          NetfilterDrop (packet, device);
           return;
         }
       
@@ -989,13 +1011,16 @@ Ipv4L3Protocol::IpForward (Ptr<Ipv4Route> rtentry, Ptr<const Packet> p, const Ip
   if (m_netfilter != 0)
     {
       NS_LOG_DEBUG ("NF_INET_FORWARD Hook");
+      // the hooks expect the IP header on the packet and may change it
+      packet->AddHeader (ipHeader);
       Verdicts_t verdict = (Verdicts_t) m_netfilter->ProcessHook (PF_INET, NF_INET_FORWARD, packet, 0, device);
-      if (verdict == NF_DROP)
+      if (verdict != NF_ACCEPT)
         {
           NS_LOG_DEBUG ("NF_INET_FORWARD packet not accepted");
-          // Add drop trace here
+          NetfilterDrop (packet, device);
           return;
         }
+      packet->RemoveHeader (ipHeader);
     }
   SendRealOut (rtentry, packet, ipHeader);
 }
@@ -1011,17 +1036,22 @@ Ipv4L3Protocol::LocalDeliver (Ptr<const Packet> packet, Ipv4Header const&ip, uin
   if (m_netfilter != 0)
     {
       NS_LOG_DEBUG ("NF_INET_LOCAL_IN Hook");
-      Callback<uint32_t, Ptr<Packet> > ccb = MakeCallback (&Ipv4Netfilter::NetfilterConntrackConfirm, m_netfilter);
-      Verdicts_t verdict = (Verdicts_t) m_netfilter->ProcessHook (PF_INET, NF_INET_LOCAL_IN, pkt, 0, device, ccb);
-      if (verdict == NF_DROP)
+      Verdicts_t verdict = (Verdicts_t) m_netfilter->ProcessHook (PF_INET, NF_INET_LOCAL_IN, pkt, 0, device, m_netfilterConfirm);
+      if (verdict != NF_ACCEPT)
         {
           NS_LOG_DEBUG ("NF_INET_LOCAL_IN packet not accepted");
-          // Add drop trace here
+          NetfilterDrop (pkt, device);
           return;
         }
     }
 
   Ptr<Packet> p = packet->Copy ();     // need to pass a non-const packet up
+  if (m_netfilter != 0)
+    {
+      // conntrack state ends at LOCAL_IN, do not hand it to the sockets
+      ConntrackTag ctTag;
+      p->RemovePacketTag (ctTag);
+    }
   Ipv4Header ipHeader = ip;
 
   if ( !ipHeader.IsLastFragment () || ipHeader.GetFragmentOffset () != 0 )
@@ -1282,6 +1312,17 @@ Ipv4L3Protocol::GetWeakEsModel (void) const
   return m_weakEsModel;
 }
 
+void
+Ipv4L3Protocol::NetfilterDrop (Ptr<const Packet> packet, Ptr<NetDevice> device)
+{
+  NS_LOG_FUNCTION (this << packet << device);
+  Ptr<Packet> payload = packet->Copy ();
+  Ipv4Header ipHeader;
+  payload->RemoveHeader (ipHeader);
+  int32_t interface = device != 0 ? GetInterfaceForDevice (device) : -1;
+  m_dropTrace (ipHeader, payload, DROP_NETFILTER, m_node->GetObject<Ipv4> (), interface >= 0 ? interface : 0);
+}
+
 void
 Ipv4L3Protocol::RouteInputError (Ptr<const Packet> p, const Ipv4Header & ipHeader, Socket::SocketErrno sockErrno)
 {
@@ -95,7 +95,8 @@ public:
     DROP_BAD_CHECKSUM,   /**< Bad checksum */
     DROP_INTERFACE_DOWN,   /**< Interface is down so can not send packet */
     DROP_ROUTE_ERROR,   /**< Route error */
-    DROP_FRAGMENT_TIMEOUT /**< Fragment timeout exceeded */
+    DROP_FRAGMENT_TIMEOUT, /**< Fragment timeout exceeded */
+    DROP_NETFILTER /**< Not accepted by a netfilter hook */
   };
 
   void SetNode (Ptr<Node> node);
@@ -241,6 +242,15 @@ private:
     uint8_t tos,
     bool mayFragment);
 
+  /**
+   * \brief Run the LOCAL_OUT and POST_ROUTING hooks on a broadcast
+   *
+   * \param packet Packet with its IPv4 header, the hooks may change it
+   * \param device The output device the hooks are given
+   * \returns false if the packet was dropped
+   */
+  bool ProcessBroadcastHooks (Ptr<Packet> packet, Ptr<NetDevice> device);
+
   void
   SendRealOut (Ptr<Ipv4Route> route,
                Ptr<Packet> packet,
@@ -257,6 +267,13 @@ private:
                       const Ipv4Header &header);
 
   void LocalDeliver (Ptr<const Packet> p, Ipv4Header const&ip, uint32_t iif);
+
+  /**
+   * \brief Fire the drop trace for a packet a netfilter hook did not accept
+   * \param packet the packet, with its IPv4 header
+   * \param device the device the packet was received on or sent to
+   */
+  void NetfilterDrop (Ptr<const Packet> packet, Ptr<NetDevice> device);
   void RouteInputError (Ptr<const Packet> p, const Ipv4Header & ipHeader, Socket::SocketErrno sockErrno);
 
   uint32_t AddIpv4Interface (Ptr<Ipv4Interface> interface);
@@ -319,6 +336,7 @@ private:
 
   Ptr<Ipv4RoutingProtocol> m_routingProtocol;
   Ptr<Ipv4Netfilter> m_netfilter;
+  Callback<uint32_t, Ptr<Packet> > m_netfilterConfirm;
 
   SocketList m_sockets;
 
@@ -0,0 +1,515 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ns3/simulator.h"
+#include "ipv4-nat-binding-table.h"
+#include "netfilter-jhash.h"
+
+NS_LOG_COMPONENT_DEFINE ("Ipv4NatBindingTable");
+
+namespace ns3 {
+
+static const uint32_t EMPTY_SLOT = 0xffffffffU;
+static const uint32_t MIN_INDEX_SIZE = 16;
+
+Ipv4NatBindingTable::Ipv4NatBindingTable ()
+  : m_subscribers (0),
+    m_nSubscribers (0),
+    m_global (0),
+    m_nGlobal (0),
+    m_startPort (0),
+    m_blockSize (0),
+    m_blocksPerAddress (0),
+    m_shardShift (8),
+    m_nBindings (0),
+    m_nAllocatedShards (0),
+    m_sweepShard (0),
+    m_enabled (false),
+    m_granularity (Seconds (1))
+{
+}
+
+void
+Ipv4NatBindingTable::Configure (Ipv4Address subscribers, Ipv4Mask mask, Ipv4Address global, uint32_t nGlobal,
+                                uint16_t startPort, uint16_t endPort, uint16_t blockSize)
+{
+  NS_LOG_FUNCTION (this << subscribers << mask << global << nGlobal << startPort << endPort << blockSize);
+  NS_ASSERT_MSG (blockSize > 0 && startPort <= endPort, "Carrier-grade NAT needs a port block size");
+  Clear ();
+  m_subscribers = subscribers.Get () & mask.Get ();
+  m_nSubscribers = ~mask.Get () + 1;
+  m_global = global.Get ();
+  m_nGlobal = nGlobal;
+  m_startPort = startPort;
+  m_blockSize = blockSize;
+  m_blocksPerAddress = ((uint32_t)endPort - startPort + 1) / blockSize;
+  NS_ASSERT_MSG (m_nSubscribers != 0 && (uint64_t)m_nGlobal * m_blocksPerAddress >= m_nSubscribers,
+                 "The global addresses hold " << (uint64_t)m_nGlobal * m_blocksPerAddress
+                                              << " port blocks for " << m_nSubscribers << " subscribers");
+  m_shards.resize (((uint64_t)m_nSubscribers + (1U << m_shardShift) - 1) >> m_shardShift);
+  m_enabled = true;
+}
+
+bool
+Ipv4NatBindingTable::IsEnabled (void) const
+{
+  return m_enabled;
+}
+
+void
+Ipv4NatBindingTable::SetShardSize (uint32_t subscribers)
+{
+  NS_LOG_FUNCTION (this << subscribers);
+  NS_ASSERT_MSG (subscribers != 0 && (subscribers & (subscribers - 1)) == 0, "Shard size must be a power of two");
+  NS_ASSERT_MSG (!m_enabled, "Shard size changed after the table was configured");
+  m_shardShift = 0;
+  while ((1U << m_shardShift) < subscribers)
+    {
+      m_shardShift++;
+    }
+}
+
+uint32_t
+Ipv4NatBindingTable::GetShardSize (void) const
+{
+  return 1U << m_shardShift;
+}
+
+void
+Ipv4NatBindingTable::SetGranularity (Time granularity)
+{
+  NS_LOG_FUNCTION (this << granularity);
+  NS_ASSERT (granularity.IsStrictlyPositive ());
+  NS_ASSERT_MSG (m_nBindings == 0, "Granularity changed with translations in place");
+  m_granularity = granularity;
+}
+
+Time
+Ipv4NatBindingTable::GetGranularity (void) const
+{
+  return m_granularity;
+}
+
+void
+Ipv4NatBindingTable::SetExpireCallback (Callback<void, const Binding &> callback)
+{
+  m_expireCallback = callback;
+}
+
+bool
+Ipv4NatBindingTable::IsSubscriber (Ipv4Address address) const
+{
+  return m_enabled && address.Get () - m_subscribers < m_nSubscribers;
+}
+
+bool
+Ipv4NatBindingTable::IsGlobal (Ipv4Address address) const
+{
+  return m_enabled && address.Get () - m_global < m_nGlobal;
+}
+
+Ipv4Address
+Ipv4NatBindingTable::GetGlobalAddress (Ipv4Address subscriber) const
+{
+  NS_ASSERT (IsSubscriber (subscriber));
+  return Ipv4Address (m_global + (subscriber.Get () - m_subscribers) / m_blocksPerAddress);
+}
+
+uint16_t
+Ipv4NatBindingTable::GetBlockStart (Ipv4Address subscriber) const
+{
+  NS_ASSERT (IsSubscriber (subscriber));
+  return m_startPort + ((subscriber.Get () - m_subscribers) % m_blocksPerAddress) * m_blockSize;
+}
+
+Ipv4NatBindingTable::Binding*
+Ipv4NatBindingTable::Lookup (Ipv4Address local, uint16_t localPort, uint8_t protocol)
+{
+  if (!IsSubscriber (local))
+    {
+      return 0;
+    }
+  Shard &shard = m_shards[(local.Get () - m_subscribers) >> m_shardShift];
+  uint32_t position = Find (shard, shard.byLocal, false, local.Get (), localPort, protocol);
+  if (position == EMPTY_SLOT)
+    {
+      return 0;
+    }
+  if (IsExpired (shard.bindings[position]))
+    {
+      if (!m_expireCallback.IsNull ())
+        {
+          m_expireCallback (shard.bindings[position]);
+        }
+      Remove (shard, position);
+      return 0;
+    }
+  return &shard.bindings[position];
+}
+
+Ipv4NatBindingTable::Binding*
+Ipv4NatBindingTable::LookupGlobal (Ipv4Address global, uint16_t globalPort, uint8_t protocol)
+{
+  if (!IsGlobal (global) || globalPort < m_startPort)
+    {
+      return 0;
+    }
+  // the subscriber follows from the global address and the port block
+  uint32_t block = (globalPort - m_startPort) / m_blockSize;
+  if (block >= m_blocksPerAddress)
+    {
+      return 0;
+    }
+  uint32_t subscriber = (global.Get () - m_global) * m_blocksPerAddress + block;
+  if (subscriber >= m_nSubscribers)
+    {
+      return 0;
+    }
+  Shard &shard = m_shards[subscriber >> m_shardShift];
+  uint32_t position = Find (shard, shard.byGlobal, true, m_subscribers + subscriber, globalPort, protocol);
+  if (position == EMPTY_SLOT)
+    {
+      return 0;
+    }
+  if (IsExpired (shard.bindings[position]))
+    {
+      if (!m_expireCallback.IsNull ())
+        {
+          m_expireCallback (shard.bindings[position]);
+        }
+      Remove (shard, position);
+      return 0;
+    }
+  return &shard.bindings[position];
+}
+
+Ipv4NatBindingTable::Binding*
+Ipv4NatBindingTable::Add (Ipv4Address local, uint16_t localPort, uint8_t protocol)
+{
+  NS_LOG_FUNCTION (this << local << localPort << (uint16_t)protocol);
+  NS_ASSERT (IsSubscriber (local));
+  uint32_t subscriber = local.Get () - m_subscribers;
+  Shard &shard = GetShard (subscriber);
+  uint16_t start = GetBlockStart (local);
+  uint16_t offset = localPort % m_blockSize;
+  for (uint16_t i = 0; i < m_blockSize; i++)
+    {
+      Binding *binding = Bind (shard, local.Get (), localPort, start + (offset + i) % m_blockSize, protocol);
+      if (binding != 0)
+        {
+          return binding;
+        }
+    }
+  NS_LOG_LOGIC ("Port block of " << local << " is exhausted");
+  return 0;
+}
+
+Ipv4NatBindingTable::Binding*
+Ipv4NatBindingTable::Add (Ipv4Address local, uint16_t localPort, uint16_t globalPort, uint8_t protocol)
+{
+  NS_LOG_FUNCTION (this << local << localPort << globalPort << (uint16_t)protocol);
+  NS_ASSERT (IsSubscriber (local));
+  uint16_t start = GetBlockStart (local);
+  if (globalPort < start || globalPort - start >= m_blockSize)
+    {
+      return 0;
+    }
+  return Bind (GetShard (local.Get () - m_subscribers), local.Get (), localPort, globalPort, protocol);
+}
+
+void
+Ipv4NatBindingTable::SetExpires (Binding *binding, Time expires)
+{
+  binding->expires = GetTick (expires);
+}
+
+Time
+Ipv4NatBindingTable::GetExpires (const Binding &binding) const
+{
+  return TimeStep ((uint64_t)binding.expires * m_granularity.GetTimeStep ());
+}
+
+uint32_t
+Ipv4NatBindingTable::Sweep (uint32_t shards)
+{
+  uint32_t removed = 0;
+  for (uint32_t n = 0; n < shards && n < m_shards.size (); n++)
+    {
+      Shard &shard = m_shards[m_sweepShard];
+      m_sweepShard = (m_sweepShard + 1) % m_shards.size ();
+      uint32_t position = 0;
+      while (position < shard.bindings.size ())
+        {
+          if (!IsExpired (shard.bindings[position]))
+            {
+              position++;
+              continue;
+            }
+          if (!m_expireCallback.IsNull ())
+            {
+              m_expireCallback (shard.bindings[position]);
+            }
+          // the last translation moves into the position
+          Remove (shard, position);
+          removed++;
+        }
+    }
+  return removed;
+}
+
+const Ipv4NatBindingTable::Binding&
+Ipv4NatBindingTable::GetBinding (uint32_t index) const
+{
+  NS_ASSERT (index < m_nBindings);
+  std::vector<Shard>::const_iterator i = m_shards.begin ();
+  while (index >= i->bindings.size ())
+    {
+      index -= i->bindings.size ();
+      i++;
+    }
+  return i->bindings[index];
+}
+
+uint32_t
+Ipv4NatBindingTable::GetNBindings (void) const
+{
+  return m_nBindings;
+}
+
+uint32_t
+Ipv4NatBindingTable::GetNShards (void) const
+{
+  return m_shards.size ();
+}
+
+uint32_t
+Ipv4NatBindingTable::GetNAllocatedShards (void) const
+{
+  return m_nAllocatedShards;
+}
+
+uint64_t
+Ipv4NatBindingTable::GetMemoryUsage (void) const
+{
+  uint64_t bytes = m_shards.capacity () * sizeof (Shard);
+  for (std::vector<Shard>::const_iterator i = m_shards.begin (); i != m_shards.end (); i++)
+    {
+      bytes += i->bindings.capacity () * sizeof (Binding);
+      bytes += (i->byLocal.capacity () + i->byGlobal.capacity ()) * sizeof (uint32_t);
+    }
+  return bytes;
+}
+
+void
+Ipv4NatBindingTable::Clear (void)
+{
+  NS_LOG_FUNCTION (this);
+  // swap with empty vectors, clear () keeps the memory
+  std::vector<Shard> ().swap (m_shards);
+  m_nBindings = 0;
+  m_nAllocatedShards = 0;
+  m_sweepShard = 0;
+  m_enabled = false;
+}
+
+uint32_t
+Ipv4NatBindingTable::GetTick (Time time) const
+{
+  // rounded up, a translation never expires early
+  int64_t g = m_granularity.GetTimeStep ();
+  int64_t t = time.GetTimeStep ();
+  return t > 0 ? (uint32_t)((t + g - 1) / g) : 0;
+}
+
+bool
+Ipv4NatBindingTable::IsExpired (const Binding &binding) const
+{
+  return (uint64_t)(Simulator::Now ().GetTimeStep () / m_granularity.GetTimeStep ()) >= binding.expires;
+}
+
+Ipv4NatBindingTable::Shard&
+Ipv4NatBindingTable::GetShard (uint32_t subscriber)
+{
+  Shard &shard = m_shards[subscriber >> m_shardShift];
+  if (shard.byLocal.empty ())
+    {
+      m_nAllocatedShards++;
+    }
+  return shard;
+}
+
+Ipv4NatBindingTable::Binding*
+Ipv4NatBindingTable::Bind (Shard &shard, uint32_t local, uint16_t localPort, uint16_t port, uint8_t protocol)
+{
+  uint32_t position = Find (shard, shard.byGlobal, true, local, port, protocol);
+  if (position != EMPTY_SLOT)
+    {
+      if (!IsExpired (shard.bindings[position]))
+        {
+          return 0;
+        }
+      if (!m_expireCallback.IsNull ())
+        {
+          m_expireCallback (shard.bindings[position]);
+        }
+      Remove (shard, position);
+    }
+
+  Grow (shard);
+  Binding binding;
+  binding.local = local;
+  binding.expires = 0;
+  binding.localPort = localPort;
+  binding.globalPort = port;
+  binding.protocol = protocol;
+  binding.closing = 0;
+  binding.reserved = 0;
+  position = shard.bindings.size ();
+  shard.bindings.push_back (binding);
+  Insert (shard.byLocal, Hash (binding.local, localPort, protocol), position);
+  Insert (shard.byGlobal, Hash (binding.local, port, protocol), position);
+  m_nBindings++;
+  return &shard.bindings.back ();
+}
+
+uint32_t
+Ipv4NatBindingTable::Find (const Shard &shard, const std::vector<uint32_t> &index, bool global,
+                           uint32_t local, uint16_t port, uint8_t protocol) const
+{
+  if (index.empty ())
+    {
+      return EMPTY_SLOT;
+    }
+  uint32_t mask = index.size () - 1;
+  for (uint32_t slot = Hash (local, port, protocol) & mask;; slot = (slot + 1) & mask)
+    {
+      uint32_t position = index[slot];
+      if (position == EMPTY_SLOT)
+        {
+          return EMPTY_SLOT;
+        }
+      const Binding &binding = shard.bindings[position];
+      if (binding.local == local && binding.protocol == protocol
+          && (global ? binding.globalPort : binding.localPort) == port)
+        {
+          return position;
+        }
+    }
+}
+
+void
+Ipv4NatBindingTable::Insert (std::vector<uint32_t> &index, uint32_t hash, uint32_t position)
+{
+  uint32_t mask = index.size () - 1;
+  uint32_t slot = hash & mask;
+  while (index[slot] != EMPTY_SLOT)
+    {
+      slot = (slot + 1) & mask;
+    }
+  index[slot] = position;
+}
+
+void
+Ipv4NatBindingTable::Erase (Shard &shard, bool global, uint32_t position)
+{
+  std::vector<uint32_t> &index = global ? shard.byGlobal : shard.byLocal;
+  uint32_t mask = index.size () - 1;
+  uint32_t hole = Hash (shard.bindings[position], global) & mask;
+  while (index[hole] != position)
+    {
+      hole = (hole + 1) & mask;
+    }
+  // shift back the entries past the hole whose probe sequence crosses
+  // it, so that no lookup stops early at an empty slot
+  for (uint32_t next = (hole + 1) & mask; index[next] != EMPTY_SLOT; next = (next + 1) & mask)
+    {
+      uint32_t home = Hash (shard.bindings[index[next]], global) & mask;
+      if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+          index[hole] = index[next];
+          hole = next;
+        }
+    }
+  index[hole] = EMPTY_SLOT;
+}
+
+void
+Ipv4NatBindingTable::Replace (Shard &shard, bool global, uint32_t from, uint32_t to)
+{
+  std::vector<uint32_t> &index = global ? shard.byGlobal : shard.byLocal;
+  uint32_t mask = index.size () - 1;
+  uint32_t slot = Hash (shard.bindings[from], global) & mask;
+  while (index[slot] != from)
+    {
+      slot = (slot + 1) & mask;
+    }
+  index[slot] = to;
+}
+
+void
+Ipv4NatBindingTable::Grow (Shard &shard)
+{
+  // keep the indices at most half full
+  uint32_t size = shard.byLocal.size ();
+  if ((shard.bindings.size () + 1) * 2 <= size)
+    {
+      return;
+    }
+  size = size == 0 ? MIN_INDEX_SIZE : size * 2;
+  // room for as many translations as the indices take; the indices are
+  // a quarter full after growing, so a translation costs at most 64 bytes
+  // until translations are removed
+  shard.bindings.reserve (size / 2);
+  shard.byLocal.assign (size, EMPTY_SLOT);
+  shard.byGlobal.assign (size, EMPTY_SLOT);
+  for (uint32_t position = 0; position < shard.bindings.size (); position++)
+    {
+      Insert (shard.byLocal, Hash (shard.bindings[position], false), position);
+      Insert (shard.byGlobal, Hash (shard.bindings[position], true), position);
+    }
+}
+
+void
+Ipv4NatBindingTable::Remove (Shard &shard, uint32_t position)
+{
+  Erase (shard, false, position);
+  Erase (shard, true, position);
+  uint32_t last = shard.bindings.size () - 1;
+  if (position != last)
+    {
+      Replace (shard, false, last, position);
+      Replace (shard, true, last, position);
+      shard.bindings[position] = shard.bindings[last];
+    }
+  shard.bindings.pop_back ();
+  m_nBindings--;
+}
+
+uint32_t
+Ipv4NatBindingTable::Hash (uint32_t local, uint16_t port, uint8_t protocol)
+{
+  return JHash3Words (local, port, protocol, 0);
+}
+
+uint32_t
+Ipv4NatBindingTable::Hash (const Binding &binding, bool global)
+{
+  return Hash (binding.local, global ? binding.globalPort : binding.localPort, binding.protocol);
+}
+
+} // namespace ns3
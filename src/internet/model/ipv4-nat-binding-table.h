@@ -0,0 +1,271 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef IPV4_NAT_BINDING_TABLE_H
+#define IPV4_NAT_BINDING_TABLE_H
+
+#include <stdint.h>
+#include <vector>
+#include "ns3/nstime.h"
+#include "ns3/callback.h"
+#include "ns3/ipv4-address.h"
+
+namespace ns3 {
+
+/**
+  * \brief Compact table of the translations of a carrier-grade NAT
+  *
+  * Port blocks are assigned deterministically, RFC 7422: subscriber n of
+  * the subscriber prefix owns block n mod B of global address n / B, B
+  * being the number of blocks that fit in the port range. The global
+  * address and port block of a subscriber follow from its address and
+  * the subscriber from a global address and port, so a translation only
+  * stores the subscriber address, its port, the translated port, the
+  * protocol and the deadline, 16 bytes.
+  *
+  * Translations are sharded by subscriber prefix. The subscribers of an
+  * aligned group of shard size addresses share a shard, which keeps
+  * their translations in a dense array and finds them through two open
+  * addressing indices of 32 bit positions, one by subscriber port and one
+  * by translated port. A shard takes memory once one of its subscribers
+  * has a translation, and a lookup touches one shard only.
+  *
+  * Deadlines are counted in ticks of a granularity. An expired
+  * translation is removed when a lookup finds it or when Sweep () visits
+  * its shard; the table needs no timer per translation.
+  */
+class Ipv4NatBindingTable
+{
+public:
+  /**
+    * \brief A translation, 16 bytes
+    */
+  struct Binding
+  {
+    uint32_t local;       //!< subscriber address
+    uint32_t expires;     //!< deadline, in ticks
+    uint16_t localPort;   //!< port or ICMP query id of the subscriber
+    uint16_t globalPort;  //!< translated port or query id
+    uint8_t protocol;
+    uint8_t closing;      //!< a TCP FIN or RST has been seen
+    uint16_t reserved;
+  };
+
+  Ipv4NatBindingTable ();
+
+  /**
+    * \param subscribers Subscriber prefix
+    * \param mask Mask of the subscriber prefix
+    * \param global First global address
+    * \param nGlobal Number of consecutive global addresses
+    * \param startPort First port of the port range
+    * \param endPort Last port of the port range
+    * \param blockSize Number of ports per subscriber
+    *
+    * Empties the table. The global addresses and port range must hold a
+    * block for every subscriber of the prefix.
+    */
+  void Configure (Ipv4Address subscribers, Ipv4Mask mask, Ipv4Address global, uint32_t nGlobal,
+                  uint16_t startPort, uint16_t endPort, uint16_t blockSize);
+
+  /**
+    * \returns true once Configure () has been called
+    */
+  bool IsEnabled (void) const;
+
+  /**
+    * \param subscribers Number of subscribers per shard, a power of two
+    *
+    * Must be set before Configure ().
+    */
+  void SetShardSize (uint32_t subscribers);
+  uint32_t GetShardSize (void) const;
+
+  /**
+    * \param granularity Length of a deadline tick
+    *
+    * Must be set before translations are added.
+    */
+  void SetGranularity (Time granularity);
+  Time GetGranularity (void) const;
+
+  /**
+    * \param callback Called with every translation removed because it
+    * expired
+    */
+  void SetExpireCallback (Callback<void, const Binding &> callback);
+
+  /**
+    * \param address An inside address
+    * \returns true if the address is in the subscriber prefix
+    */
+  bool IsSubscriber (Ipv4Address address) const;
+
+  /**
+    * \param address A global address
+    * \returns true if the address is one of the global addresses
+    */
+  bool IsGlobal (Ipv4Address address) const;
+
+  /**
+    * \param subscriber Address in the subscriber prefix
+    * \returns The global address of the subscriber
+    */
+  Ipv4Address GetGlobalAddress (Ipv4Address subscriber) const;
+
+  /**
+    * \param subscriber Address in the subscriber prefix
+    * \returns The first port of the block of the subscriber
+    */
+  uint16_t GetBlockStart (Ipv4Address subscriber) const;
+
+  /**
+    * \param local Subscriber address
+    * \param localPort Port or ICMP query id of the subscriber
+    * \param protocol Protocol of the flow
+    * \returns The translation, 0 if there is none or it has expired
+    */
+  Binding* Lookup (Ipv4Address local, uint16_t localPort, uint8_t protocol);
+
+  /**
+    * \param global Global address
+    * \param globalPort Translated port or ICMP query id
+    * \param protocol Protocol of the flow
+    * \returns The translation, 0 if there is none or it has expired
+    */
+  Binding* LookupGlobal (Ipv4Address global, uint16_t globalPort, uint8_t protocol);
+
+  /**
+    * \param local Subscriber address
+    * \param localPort Port or ICMP query id of the subscriber
+    * \param protocol Protocol of the flow
+    * \returns The new translation, 0 if the block of the subscriber has
+    * no port left for the protocol
+    *
+    * The port is searched for in the block of the subscriber from the
+    * position of the subscriber port in it, so that the port is kept when
+    * the block is as large as the port range. The translation has to be
+    * given a deadline with SetExpires ().
+    */
+  Binding* Add (Ipv4Address local, uint16_t localPort, uint8_t protocol);
+
+  /**
+    * \param local Subscriber address
+    * \param localPort Port or ICMP query id of the subscriber
+    * \param globalPort Translated port the translation is to have
+    * \param protocol Protocol of the flow
+    * \returns The new translation, 0 if the port is not in the block of
+    * the subscriber or is taken
+    *
+    * Restores a translation of a snapshot. The translation has to be
+    * given a deadline with SetExpires ().
+    */
+  Binding* Add (Ipv4Address local, uint16_t localPort, uint16_t globalPort, uint8_t protocol);
+
+  /**
+    * \param binding A translation of the table
+    * \param expires Absolute time the translation expires at
+    */
+  void SetExpires (Binding *binding, Time expires);
+
+  /**
+    * \param binding A translation of the table
+    * \returns Absolute time the translation expires at
+    */
+  Time GetExpires (const Binding &binding) const;
+
+  /**
+    * \param shards Number of shards to visit
+    * \returns Number of translations removed
+    *
+    * Removes the expired translations of the next shards, round robin.
+    */
+  uint32_t Sweep (uint32_t shards);
+
+  /**
+    * \param index Position of a translation, less than GetNBindings ()
+    * \returns The translation, in no particular order
+    */
+  const Binding& GetBinding (uint32_t index) const;
+
+  /**
+    * \returns Number of translations, expired ones not yet removed
+    * included
+    */
+  uint32_t GetNBindings (void) const;
+
+  /**
+    * \returns Number of shards of the subscriber prefix
+    */
+  uint32_t GetNShards (void) const;
+
+  /**
+    * \returns Number of shards that have held a translation
+    */
+  uint32_t GetNAllocatedShards (void) const;
+
+  /**
+    * \returns Bytes allocated for the shards, their translations and
+    * their indices
+    */
+  uint64_t GetMemoryUsage (void) const;
+
+  /**
+    * \brief Remove every translation and release the shards
+    */
+  void Clear (void);
+
+private:
+  struct Shard
+  {
+    std::vector<Binding> bindings;
+    std::vector<uint32_t> byLocal;   //!< positions in bindings, by subscriber port
+    std::vector<uint32_t> byGlobal;  //!< positions in bindings, by translated port
+  };
+
+  uint32_t GetTick (Time time) const;
+  bool IsExpired (const Binding &binding) const;
+  Shard& GetShard (uint32_t subscriber);
+  Binding* Bind (Shard &shard, uint32_t local, uint16_t localPort, uint16_t port, uint8_t protocol);
+  uint32_t Find (const Shard &shard, const std::vector<uint32_t> &index, bool global,
+                 uint32_t local, uint16_t port, uint8_t protocol) const;
+  static void Insert (std::vector<uint32_t> &index, uint32_t hash, uint32_t position);
+  static void Erase (Shard &shard, bool global, uint32_t position);
+  static void Replace (Shard &shard, bool global, uint32_t from, uint32_t to);
+  static void Grow (Shard &shard);
+  void Remove (Shard &shard, uint32_t position);
+  static uint32_t Hash (uint32_t local, uint16_t port, uint8_t protocol);
+  static uint32_t Hash (const Binding &binding, bool global);
+
+  uint32_t m_subscribers;   //!< first address of the subscriber prefix
+  uint32_t m_nSubscribers;
+  uint32_t m_global;        //!< first global address
+  uint32_t m_nGlobal;
+  uint16_t m_startPort;
+  uint16_t m_blockSize;
+  uint32_t m_blocksPerAddress;
+  uint32_t m_shardShift;
+  uint32_t m_nBindings;
+  uint32_t m_nAllocatedShards;
+  uint32_t m_sweepShard;    //!< next shard Sweep () visits
+  bool m_enabled;
+  Time m_granularity;
+  std::vector<Shard> m_shards;
+  Callback<void, const Binding &> m_expireCallback;
+};
+
+} // namespace ns3
+
+#endif /* IPV4_NAT_BINDING_TABLE_H */
@@ -0,0 +1,363 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ns3/buffer.h"
+#include "ipv4-nat-l4-protocol.h"
+#include "netfilter-packet-context.h"
+#include "netfilter-header-mangle.h"
+
+NS_LOG_COMPONENT_DEFINE ("Ipv4NatL4Protocol");
+
+namespace ns3 {
+
+/* Offsets into the IPv4 header */
+static const uint32_t IPV4_HEADER_SIZE = 20;
+static const uint32_t IPV4_FRAGMENT = 6;
+static const uint32_t IPV4_PROTOCOL = 9;
+static const uint32_t IPV4_CHECKSUM = 10;
+static const uint32_t IPV4_SOURCE = 12;
+static const uint32_t IPV4_DESTINATION = 16;
+
+/* Offsets into the ICMP header */
+static const uint32_t ICMP_HEADER_SIZE = 8;
+static const uint32_t ICMP_CHECKSUM = 2;
+static const uint32_t ICMP_ID = 4;
+
+/* Transport bytes an ICMP error quotes at least */
+static const uint32_t QUOTED_L4_SIZE = 8;
+
+Ipv4NatL4Protocol::~Ipv4NatL4Protocol ()
+{
+}
+
+Ipv4NatPortL4Protocol::Ipv4NatPortL4Protocol (uint8_t protocol)
+  : m_protocol (protocol)
+{
+  NS_ASSERT (protocol == IPPROTO_TCP || protocol == IPPROTO_UDP);
+}
+
+uint8_t
+Ipv4NatPortL4Protocol::GetProtocol (void) const
+{
+  return m_protocol;
+}
+
+bool
+Ipv4NatPortL4Protocol::GetIds (NetfilterPacketContext& ctx, uint16_t& sourceId, uint16_t& destinationId)
+{
+  if (!ctx.HasPorts ())
+    {
+      return false;
+    }
+  sourceId = ctx.GetSourcePort ();
+  destinationId = ctx.GetDestinationPort ();
+  return true;
+}
+
+void
+Ipv4NatPortL4Protocol::SetSourceId (NetfilterPacketContext& ctx, uint16_t id)
+{
+  ctx.SetSourcePort (id);
+}
+
+void
+Ipv4NatPortL4Protocol::SetDestinationId (NetfilterPacketContext& ctx, uint16_t id)
+{
+  ctx.SetDestinationPort (id);
+}
+
+uint32_t
+Ipv4NatPortL4Protocol::GetSourceIdOffset (void) const
+{
+  return 0;
+}
+
+uint32_t
+Ipv4NatPortL4Protocol::GetDestinationIdOffset (void) const
+{
+  return 2;
+}
+
+uint32_t
+Ipv4NatPortL4Protocol::GetChecksumOffset (void) const
+{
+  return m_protocol == IPPROTO_TCP ? 16 : 6;
+}
+
+bool
+Ipv4NatPortL4Protocol::HasPseudoHeader (void) const
+{
+  return true;
+}
+
+Icmpv4NatL4Protocol::Icmpv4NatL4Protocol ()
+{
+}
+
+uint8_t
+Icmpv4NatL4Protocol::GetProtocol (void) const
+{
+  return IPPROTO_ICMP;
+}
+
+/* Queries are answered with the same identifier */
+static bool
+IsIcmpQuery (uint8_t type)
+{
+  switch (type)
+    {
+    case 0:   // echo reply
+    case 8:   // echo
+    case 13:  // timestamp
+    case 14:  // timestamp reply
+    case 15:  // information request
+    case 16:  // information reply
+    case 17:  // address mask request
+    case 18:  // address mask reply
+      return true;
+    default:
+      return false;
+    }
+}
+
+static bool
+IsIcmpError (uint8_t type)
+{
+  switch (type)
+    {
+    case 3:   // destination unreachable
+    case 4:   // source quench
+    case 5:   // redirect
+    case 11:  // time exceeded
+    case 12:  // parameter problem
+      return true;
+    default:
+      return false;
+    }
+}
+
+bool
+Icmpv4NatL4Protocol::GetIds (NetfilterPacketContext& ctx, uint16_t& sourceId, uint16_t& destinationId)
+{
+  const Ipv4Header &ipHeader = ctx.GetIpv4Header ();
+  if (ipHeader.GetFragmentOffset () != 0)
+    {
+      return false;
+    }
+  uint32_t offset = ipHeader.GetSerializedSize ();
+  uint8_t buffer[60 + ICMP_HEADER_SIZE];
+  if (ctx.GetPacket ()->CopyData (buffer, offset + ICMP_HEADER_SIZE) < offset + ICMP_HEADER_SIZE
+      || !IsIcmpQuery (buffer[offset]))
+    {
+      return false;
+    }
+  sourceId = (buffer[offset + ICMP_ID] << 8) | buffer[offset + ICMP_ID + 1];
+  destinationId = sourceId;
+  return true;
+}
+
+void
+Icmpv4NatL4Protocol::SetId (NetfilterPacketContext& ctx, uint16_t id)
+{
+  uint32_t offset = ctx.GetIpv4Header ().GetSerializedSize ();
+  // the identifier is written directly, pending header changes go first
+  ctx.Flush ();
+  Buffer::Iterator start = ctx.GetPacket ()->BeginWritable (offset + ICMP_HEADER_SIZE);
+  Buffer::Iterator i = start;
+  i.Next (offset + ICMP_ID);
+  uint16_t from = i.ReadNtohU16 ();
+  if (from == id)
+    {
+      return;
+    }
+  i.Prev (2);
+  i.WriteHtonU16 (id);
+  i = start;
+  i.Next (offset + ICMP_CHECKSUM);
+  uint16_t checksum = i.ReadNtohU16 ();
+  if (checksum != 0)
+    {
+      i.Prev (2);
+      i.WriteHtonU16 (NetfilterHeaderMangle::UpdateChecksum (checksum, from, id));
+    }
+}
+
+void
+Icmpv4NatL4Protocol::SetSourceId (NetfilterPacketContext& ctx, uint16_t id)
+{
+  SetId (ctx, id);
+}
+
+void
+Icmpv4NatL4Protocol::SetDestinationId (NetfilterPacketContext& ctx, uint16_t id)
+{
+  SetId (ctx, id);
+}
+
+uint32_t
+Icmpv4NatL4Protocol::GetSourceIdOffset (void) const
+{
+  return ICMP_ID;
+}
+
+uint32_t
+Icmpv4NatL4Protocol::GetDestinationIdOffset (void) const
+{
+  return ICMP_ID;
+}
+
+uint32_t
+Icmpv4NatL4Protocol::GetChecksumOffset (void) const
+{
+  return ICMP_CHECKSUM;
+}
+
+bool
+Icmpv4NatL4Protocol::HasPseudoHeader (void) const
+{
+  return false;
+}
+
+bool
+Icmpv4NatL4Protocol::GetQuotedPacket (NetfilterPacketContext& ctx, Ipv4Address& source, Ipv4Address& destination,
+                                      uint8_t& protocol, uint32_t& l4Offset)
+{
+  const Ipv4Header &ipHeader = ctx.GetIpv4Header ();
+  if (ipHeader.GetFragmentOffset () != 0)
+    {
+      return false;
+    }
+  uint32_t offset = ipHeader.GetSerializedSize ();
+  uint32_t quoted = offset + ICMP_HEADER_SIZE;
+  uint8_t buffer[60 + ICMP_HEADER_SIZE + IPV4_HEADER_SIZE];
+  if (ctx.GetPacket ()->CopyData (buffer, quoted + IPV4_HEADER_SIZE) < quoted + IPV4_HEADER_SIZE
+      || !IsIcmpError (buffer[offset]))
+    {
+      return false;
+    }
+  source = Ipv4Address::Deserialize (buffer + quoted + IPV4_SOURCE);
+  destination = Ipv4Address::Deserialize (buffer + quoted + IPV4_DESTINATION);
+  protocol = buffer[quoted + IPV4_PROTOCOL];
+  l4Offset = 0;
+  bool firstFragment = (((buffer[quoted + IPV4_FRAGMENT] << 8) | buffer[quoted + IPV4_FRAGMENT + 1]) & 0x1fff) == 0;
+  uint32_t l4 = quoted + (buffer[quoted] & 0x0f) * 4;
+  if (firstFragment && ctx.GetPacket ()->GetSize () >= l4 + QUOTED_L4_SIZE)
+    {
+      l4Offset = l4;
+    }
+  return true;
+}
+
+void
+Icmpv4NatL4Protocol::GetQuotedIds (Ptr<Packet> p, uint32_t l4Offset, Ptr<Ipv4NatL4Protocol> l4,
+                                   uint16_t& sourceId, uint16_t& destinationId)
+{
+  uint8_t buffer[60 + ICMP_HEADER_SIZE + 60 + QUOTED_L4_SIZE];
+  p->CopyData (buffer, l4Offset + QUOTED_L4_SIZE);
+  uint32_t offset = l4Offset + l4->GetSourceIdOffset ();
+  sourceId = (buffer[offset] << 8) | buffer[offset + 1];
+  offset = l4Offset + l4->GetDestinationIdOffset ();
+  destinationId = (buffer[offset] << 8) | buffer[offset + 1];
+}
+
+void
+Icmpv4NatL4Protocol::TranslateQuoted (Ptr<Packet> p, bool source, Ipv4Address address,
+                                      Ptr<Ipv4NatL4Protocol> l4, uint16_t id)
+{
+  NS_LOG_FUNCTION (p << source << address << id);
+  uint8_t buffer[60 + ICMP_HEADER_SIZE + IPV4_FRAGMENT + 2];
+  p->CopyData (buffer, 1);
+  uint32_t icmp = (buffer[0] & 0x0f) * 4;
+  uint32_t quoted = icmp + ICMP_HEADER_SIZE;
+  NS_ASSERT (p->GetSize () >= quoted + IPV4_HEADER_SIZE);
+  p->CopyData (buffer, quoted + IPV4_FRAGMENT + 2);
+  uint32_t l4Offset = quoted + (buffer[quoted] & 0x0f) * 4;
+  bool firstFragment = (((buffer[quoted + IPV4_FRAGMENT] << 8) | buffer[quoted + IPV4_FRAGMENT + 1]) & 0x1fff) == 0;
+  bool hasIds = l4 != 0 && firstFragment && p->GetSize () >= l4Offset + QUOTED_L4_SIZE;
+
+  Buffer::Iterator start = p->BeginWritable (hasIds ? l4Offset + QUOTED_L4_SIZE : quoted + IPV4_HEADER_SIZE);
+  Buffer::Iterator i = start;
+  i.Next (icmp + ICMP_CHECKSUM);
+  uint16_t icmpChecksum = i.ReadNtohU16 ();
+
+  // the quoted address and the checksum of the quoted IPv4 header
+  i = start;
+  i.Next (quoted + (source ? IPV4_SOURCE : IPV4_DESTINATION));
+  uint32_t from = i.ReadNtohU32 ();
+  uint32_t to = address.Get ();
+  i.Prev (4);
+  i.WriteHtonU32 (to);
+  icmpChecksum = NetfilterHeaderMangle::UpdateChecksum32 (icmpChecksum, from, to);
+  i = start;
+  i.Next (quoted + IPV4_CHECKSUM);
+  uint16_t checksum = i.ReadNtohU16 ();
+  if (checksum != 0)
+    {
+      uint16_t updated = NetfilterHeaderMangle::UpdateChecksum32 (checksum, from, to);
+      i.Prev (2);
+      i.WriteHtonU16 (updated);
+      icmpChecksum = NetfilterHeaderMangle::UpdateChecksum (icmpChecksum, checksum, updated);
+    }
+
+  // the quoted identifier and the quoted transport checksum, when the
+  // error quotes enough of the transport header to hold them
+  if (hasIds)
+    {
+      i = start;
+      i.Next (l4Offset + (source ? l4->GetSourceIdOffset () : l4->GetDestinationIdOffset ()));
+      uint16_t fromId = i.ReadNtohU16 ();
+      i.Prev (2);
+      i.WriteHtonU16 (id);
+      icmpChecksum = NetfilterHeaderMangle::UpdateChecksum (icmpChecksum, fromId, id);
+
+      uint32_t checksumOffset = l4->GetChecksumOffset ();
+      if (checksumOffset + 2 <= QUOTED_L4_SIZE)
+        {
+          i = start;
+          i.Next (l4Offset + checksumOffset);
+          checksum = i.ReadNtohU16 ();
+          if (checksum != 0)
+            {
+              uint16_t updated = NetfilterHeaderMangle::UpdateChecksum (checksum, fromId, id);
+              if (l4->HasPseudoHeader ())
+                {
+                  updated = NetfilterHeaderMangle::UpdateChecksum32 (updated, from, to);
+                }
+              if (updated == 0 && l4->GetProtocol () == IPPROTO_UDP)
+                {
+                  updated = 0xffff;
+                }
+              i.Prev (2);
+              i.WriteHtonU16 (updated);
+              icmpChecksum = NetfilterHeaderMangle::UpdateChecksum (icmpChecksum, checksum, updated);
+            }
+        }
+    }
+
+  i = start;
+  i.Next (icmp + ICMP_CHECKSUM);
+  if (i.ReadNtohU16 () != 0)
+    {
+      i.Prev (2);
+      i.WriteHtonU16 (icmpChecksum);
+    }
+}
+
+} // namespace ns3
@@ -0,0 +1,195 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef IPV4_NAT_L4_PROTOCOL_H
+#define IPV4_NAT_L4_PROTOCOL_H
+
+#include <stdint.h>
+#include "ns3/ptr.h"
+#include "ns3/packet.h"
+#include "ns3/simple-ref-count.h"
+#include "ns3/ipv4-address.h"
+
+namespace ns3 {
+
+class NetfilterPacketContext;
+
+/**
+  * \brief Layer 4 specific part of the IPv4 NAT
+  *
+  * Ipv4Nat keeps one handler per protocol number in a table and maps the
+  * identifier the handler finds in a packet, a TCP or UDP port or an ICMP
+  * query identifier, the same way for every protocol. The handler also
+  * knows where the identifiers and the checksum are in the first eight
+  * bytes of the transport header, which is all an ICMP error quotes of
+  * the packet it reports on.
+  */
+class Ipv4NatL4Protocol : public SimpleRefCount<Ipv4NatL4Protocol>
+{
+public:
+  virtual ~Ipv4NatL4Protocol ();
+
+  /**
+    * \returns The protocol number this handler translates
+    */
+  virtual uint8_t GetProtocol (void) const = 0;
+
+  /**
+    * \param ctx Headers of the packet
+    * \param sourceId Set to the identifier of the sending endpoint
+    * \param destinationId Set to the identifier of the receiving endpoint
+    * \returns false if the packet carries nothing the NAT can map
+    */
+  virtual bool GetIds (NetfilterPacketContext& ctx, uint16_t& sourceId, uint16_t& destinationId) = 0;
+
+  /**
+    * \param ctx Headers of the packet
+    * \param id Identifier to write over the one of the sending endpoint
+    */
+  virtual void SetSourceId (NetfilterPacketContext& ctx, uint16_t id) = 0;
+
+  /**
+    * \param ctx Headers of the packet
+    * \param id Identifier to write over the one of the receiving endpoint
+    */
+  virtual void SetDestinationId (NetfilterPacketContext& ctx, uint16_t id) = 0;
+
+  /**
+    * \returns Offset of the identifier of the sending endpoint in the
+    * transport header
+    */
+  virtual uint32_t GetSourceIdOffset (void) const = 0;
+
+  /**
+    * \returns Offset of the identifier of the receiving endpoint in the
+    * transport header
+    */
+  virtual uint32_t GetDestinationIdOffset (void) const = 0;
+
+  /**
+    * \returns Offset of the checksum in the transport header
+    */
+  virtual uint32_t GetChecksumOffset (void) const = 0;
+
+  /**
+    * \returns true if the checksum covers the IPv4 addresses through a
+    * pseudo header
+    */
+  virtual bool HasPseudoHeader (void) const = 0;
+};
+
+/**
+  * \brief NAT handler for the ports of TCP and UDP
+  *
+  * The ports are changed through the NetfilterPacketContext, which writes
+  * them back along with the IPv4 header at the end of the hook chain.
+  */
+class Ipv4NatPortL4Protocol : public Ipv4NatL4Protocol
+{
+public:
+  /**
+    * \param protocol IPPROTO_TCP or IPPROTO_UDP
+    */
+  Ipv4NatPortL4Protocol (uint8_t protocol);
+
+  virtual uint8_t GetProtocol (void) const;
+  virtual bool GetIds (NetfilterPacketContext& ctx, uint16_t& sourceId, uint16_t& destinationId);
+  virtual void SetSourceId (NetfilterPacketContext& ctx, uint16_t id);
+  virtual void SetDestinationId (NetfilterPacketContext& ctx, uint16_t id);
+  virtual uint32_t GetSourceIdOffset (void) const;
+  virtual uint32_t GetDestinationIdOffset (void) const;
+  virtual uint32_t GetChecksumOffset (void) const;
+  virtual bool HasPseudoHeader (void) const;
+
+private:
+  uint8_t m_protocol;
+};
+
+/**
+  * \brief NAT handler for ICMP
+  *
+  * Echo, timestamp, information and address mask messages are queries:
+  * their identifier is mapped like a port, the request and its reply
+  * carry the same identifier. Destination unreachable, source quench,
+  * redirect, time exceeded and parameter problem messages are errors
+  * about another packet, whose IPv4 header and first eight transport
+  * bytes they quote. A NAT must translate the quoted packet as the
+  * reverse of the packet the error travels against, or the host that
+  * receives the error can not match it to its flow; TranslateQuoted ()
+  * does this in place.
+  *
+  * The ICMP checksum is updated incrementally; a checksum of zero is
+  * taken as not computed and left alone, as for TCP and UDP.
+  */
+class Icmpv4NatL4Protocol : public Ipv4NatL4Protocol
+{
+public:
+  Icmpv4NatL4Protocol ();
+
+  virtual uint8_t GetProtocol (void) const;
+  virtual bool GetIds (NetfilterPacketContext& ctx, uint16_t& sourceId, uint16_t& destinationId);
+  virtual void SetSourceId (NetfilterPacketContext& ctx, uint16_t id);
+  virtual void SetDestinationId (NetfilterPacketContext& ctx, uint16_t id);
+  virtual uint32_t GetSourceIdOffset (void) const;
+  virtual uint32_t GetDestinationIdOffset (void) const;
+  virtual uint32_t GetChecksumOffset (void) const;
+  virtual bool HasPseudoHeader (void) const;
+
+  /**
+    * \param ctx Headers of an ICMP packet
+    * \param source Set to the source address of the quoted packet
+    * \param destination Set to the destination address of the quoted packet
+    * \param protocol Set to the protocol of the quoted packet
+    * \param l4Offset Set to the offset of the quoted transport header in
+    * the packet, 0 if the quoted packet is a fragment other than the first
+    * \returns true if the packet is an ICMP error quoting a packet
+    */
+  bool GetQuotedPacket (NetfilterPacketContext& ctx, Ipv4Address& source, Ipv4Address& destination,
+                        uint8_t& protocol, uint32_t& l4Offset);
+
+  /**
+    * \param p Packet starting with the IPv4 header of an ICMP error; the
+    * context of the packet must have been flushed
+    * \param l4Offset Offset of the quoted transport header in the packet
+    * \param sourceId Identifier of the sending endpoint of the quoted packet
+    * \param destinationId Identifier of the receiving endpoint
+    * \param l4 Handler of the quoted protocol
+    */
+  static void GetQuotedIds (Ptr<Packet> p, uint32_t l4Offset, Ptr<Ipv4NatL4Protocol> l4,
+                            uint16_t& sourceId, uint16_t& destinationId);
+
+  /**
+    * \param p Packet starting with the IPv4 header of an ICMP error; the
+    * context of the packet must have been flushed
+    * \param source true to translate the source of the quoted packet,
+    * false for its destination
+    * \param address New address of the quoted endpoint
+    * \param l4 Handler of the quoted protocol, 0 to leave its transport
+    * header alone
+    * \param id New identifier of the quoted endpoint
+    *
+    * Rewrites the quoted address and identifier and fixes the quoted IPv4
+    * and transport checksums and the checksum of the error itself.
+    */
+  static void TranslateQuoted (Ptr<Packet> p, bool source, Ipv4Address address,
+                               Ptr<Ipv4NatL4Protocol> l4, uint16_t id);
+
+private:
+  void SetId (NetfilterPacketContext& ctx, uint16_t id);
+};
+
+} // namespace ns3
+
+#endif /* IPV4_NAT_L4_PROTOCOL_H */
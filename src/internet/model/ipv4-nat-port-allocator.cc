@@ -0,0 +1,494 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ipv4-nat-port-allocator.h"
+
+NS_LOG_COMPONENT_DEFINE ("Ipv4NatPortAllocator");
+
+namespace ns3 {
+
+Ipv4NatPortAllocator::FreeList::FreeList ()
+  : m_size (0),
+    m_next (0),
+    m_allocated (0)
+{
+}
+
+void
+Ipv4NatPortAllocator::FreeList::Reset (uint32_t size)
+{
+  m_size = size;
+  m_next = 0;
+  m_allocated = 0;
+  m_free.clear ();
+  m_inUse.clear ();
+  m_queued.clear ();
+}
+
+bool
+Ipv4NatPortAllocator::FreeList::Allocate (uint32_t &id)
+{
+  while (!m_free.empty ())
+    {
+      uint32_t free = m_free.front ();
+      m_free.pop_front ();
+      m_queued[free] = false;
+      // skip the identifiers taken while they were waiting
+      if (!m_inUse[free])
+        {
+          id = free;
+          m_inUse[id] = true;
+          m_allocated++;
+          return true;
+        }
+    }
+  if (m_next < m_size)
+    {
+      id = m_next++;
+      m_inUse.push_back (true);
+      m_queued.push_back (false);
+      m_allocated++;
+      return true;
+    }
+  return false;
+}
+
+bool
+Ipv4NatPortAllocator::FreeList::Take (uint32_t id)
+{
+  if (id >= m_size)
+    {
+      return false;
+    }
+  if (id >= m_next)
+    {
+      // the identifiers skipped over become free ones
+      for (uint32_t skipped = m_next; skipped < id; skipped++)
+        {
+          m_free.push_back (skipped);
+          m_inUse.push_back (false);
+          m_queued.push_back (true);
+        }
+      m_inUse.push_back (true);
+      m_queued.push_back (false);
+      m_next = id + 1;
+    }
+  else if (m_inUse[id])
+    {
+      return false;
+    }
+  else
+    {
+      // left in m_free, Allocate () skips it
+      m_inUse[id] = true;
+    }
+  m_allocated++;
+  return true;
+}
+
+bool
+Ipv4NatPortAllocator::FreeList::Release (uint32_t id)
+{
+  if (id >= m_next || !m_inUse[id])
+    {
+      return false;
+    }
+  m_inUse[id] = false;
+  if (!m_queued[id])
+    {
+      m_free.push_back (id);
+      m_queued[id] = true;
+    }
+  NS_ASSERT (m_allocated > 0);
+  m_allocated--;
+  return true;
+}
+
+bool
+Ipv4NatPortAllocator::FreeList::IsAllocated (uint32_t id) const
+{
+  return id < m_next && m_inUse[id];
+}
+
+uint32_t
+Ipv4NatPortAllocator::FreeList::GetNAllocated (void) const
+{
+  return m_allocated;
+}
+
+Ipv4NatPortAllocator::Ipv4NatPortAllocator ()
+  : m_firstAddress (0),
+    m_nAddresses (0),
+    m_startPort (1024),
+    m_endPort (65535),
+    m_blockSize (0),
+    m_maxBlocks (0),
+    m_allocated (0),
+    m_failures (0)
+{
+  Reset ();
+}
+
+void
+Ipv4NatPortAllocator::SetAddressRange (Ipv4Address first, uint32_t count)
+{
+  NS_LOG_FUNCTION (this << first << count);
+  NS_ASSERT_MSG (count <= 65536, "NAT address pool too large");
+  m_firstAddress = first.Get ();
+  m_nAddresses = count;
+  Reset ();
+}
+
+void
+Ipv4NatPortAllocator::SetPortRange (uint16_t start, uint16_t end)
+{
+  NS_LOG_FUNCTION (this << start << end);
+  NS_ASSERT_MSG (start != 0 && start <= end, "invalid NAT port range");
+  m_startPort = start;
+  m_endPort = end;
+  Reset ();
+}
+
+void
+Ipv4NatPortAllocator::SetBlockSize (uint16_t size)
+{
+  NS_LOG_FUNCTION (this << size);
+  m_blockSize = size;
+  Reset ();
+}
+
+uint16_t
+Ipv4NatPortAllocator::GetBlockSize (void) const
+{
+  return m_blockSize;
+}
+
+void
+Ipv4NatPortAllocator::SetMaxBlocksPerSubscriber (uint32_t blocks)
+{
+  m_maxBlocks = blocks;
+}
+
+uint32_t
+Ipv4NatPortAllocator::GetMaxBlocksPerSubscriber (void) const
+{
+  return m_maxBlocks;
+}
+
+void
+Ipv4NatPortAllocator::Reset (void)
+{
+  NS_LOG_FUNCTION (this);
+  if (m_allocated != 0)
+    {
+      NS_LOG_WARN ("NAT port pool reconfigured while " << m_allocated << " ports are in use");
+    }
+  m_slots.Reset (m_nAddresses * GetNPorts ());
+  m_blocks.Reset (GetNBlocks ());
+  m_blockOwner.assign (GetNBlocks (), 0);
+  m_slotInUse.clear ();
+  m_slotQueued.clear ();
+  m_subscribers.clear ();
+  m_allocated = 0;
+  m_failures = 0;
+}
+
+uint32_t
+Ipv4NatPortAllocator::GetNPorts (void) const
+{
+  return (uint32_t)m_endPort - m_startPort + 1;
+}
+
+uint32_t
+Ipv4NatPortAllocator::GetNBlocks (void) const
+{
+  if (m_blockSize == 0)
+    {
+      return 0;
+    }
+  return m_nAddresses * (GetNPorts () / m_blockSize);
+}
+
+/* Slots interleave the addresses so that consecutive slots rotate over
+ * the whole address range: slot = port index * addresses + address index */
+bool
+Ipv4NatPortAllocator::FromSlot (uint32_t slot, Ipv4Address &address, uint16_t &port) const
+{
+  if (m_nAddresses == 0)
+    {
+      return false;
+    }
+  address = Ipv4Address (m_firstAddress + slot % m_nAddresses);
+  port = m_startPort + slot / m_nAddresses;
+  return true;
+}
+
+bool
+Ipv4NatPortAllocator::ToSlot (Ipv4Address address, uint16_t port, uint32_t &slot) const
+{
+  uint32_t index = address.Get () - m_firstAddress;
+  if (index >= m_nAddresses || port < m_startPort || port > m_endPort)
+    {
+      return false;
+    }
+  slot = (uint32_t)(port - m_startPort) * m_nAddresses + index;
+  return true;
+}
+
+uint32_t
+Ipv4NatPortAllocator::ToBlock (uint32_t slot) const
+{
+  return ((slot / m_nAddresses) / m_blockSize) * m_nAddresses + slot % m_nAddresses;
+}
+
+/* Cuts a block into the slots of its ports; the slot bitmaps grow with
+ * the blocks handed out */
+void
+Ipv4NatPortAllocator::AddBlock (Subscriber &s, uint32_t block)
+{
+  s.blocks.push_back (block);
+  uint32_t index = block % m_nAddresses;
+  uint32_t first = (block / m_nAddresses) * m_blockSize;
+  uint32_t last = (first + m_blockSize - 1) * m_nAddresses + index;
+  if (m_slotInUse.size () <= last)
+    {
+      m_slotInUse.resize (last + 1, false);
+      m_slotQueued.resize (last + 1, false);
+    }
+  for (uint32_t i = 0; i < m_blockSize; i++)
+    {
+      uint32_t slot = (first + i) * m_nAddresses + index;
+      s.free.push_back (slot);
+      m_slotQueued[slot] = true;
+    }
+}
+
+void
+Ipv4NatPortAllocator::ReleaseBlocks (Subscriber &s)
+{
+  for (std::deque<uint32_t>::const_iterator i = s.free.begin (); i != s.free.end (); i++)
+    {
+      m_slotQueued[*i] = false;
+    }
+  s.free.clear ();
+  for (std::vector<uint32_t>::const_iterator b = s.blocks.begin (); b != s.blocks.end (); b++)
+    {
+      m_blocks.Release (*b);
+    }
+  s.blocks.clear ();
+}
+
+bool
+Ipv4NatPortAllocator::PopFreeSlot (Subscriber &s, uint32_t &slot)
+{
+  while (!s.free.empty ())
+    {
+      uint32_t free = s.free.front ();
+      s.free.pop_front ();
+      m_slotQueued[free] = false;
+      if (!m_slotInUse[free])
+        {
+          slot = free;
+          return true;
+        }
+    }
+  return false;
+}
+
+void
+Ipv4NatPortAllocator::PushFreeSlot (Subscriber &s, uint32_t slot)
+{
+  if (!m_slotQueued[slot])
+    {
+      s.free.push_back (slot);
+      m_slotQueued[slot] = true;
+    }
+}
+
+bool
+Ipv4NatPortAllocator::Allocate (Ipv4Address subscriber, Ipv4Address &address, uint16_t &port)
+{
+  NS_LOG_FUNCTION (this << subscriber);
+  uint32_t slot;
+
+  if (m_blockSize == 0)
+    {
+      if (!m_slots.Allocate (slot))
+        {
+          NS_LOG_LOGIC ("NAT port pool exhausted");
+          m_failures++;
+          return false;
+        }
+      m_allocated++;
+      return FromSlot (slot, address, port);
+    }
+
+  Subscriber &s = m_subscribers[subscriber];
+  if (!PopFreeSlot (s, slot))
+    {
+      uint32_t block;
+      if ((m_maxBlocks != 0 && s.blocks.size () >= m_maxBlocks)
+          || !m_blocks.Allocate (block))
+        {
+          NS_LOG_LOGIC ("No port block left for " << subscriber);
+          if (s.blocks.empty ())
+            {
+              m_subscribers.erase (subscriber);
+            }
+          m_failures++;
+          return false;
+        }
+      m_blockOwner[block] = subscriber.Get ();
+      AddBlock (s, block);
+      NS_LOG_LOGIC ("Subscriber " << subscriber << " got port block " << block);
+      PopFreeSlot (s, slot);
+    }
+  m_slotInUse[slot] = true;
+  s.used++;
+  m_allocated++;
+  return FromSlot (slot, address, port);
+}
+
+void
+Ipv4NatPortAllocator::Release (Ipv4Address subscriber, Ipv4Address address, uint16_t port)
+{
+  NS_LOG_FUNCTION (this << subscriber << address << port);
+  uint32_t slot;
+  if (!ToSlot (address, port, slot))
+    {
+      NS_LOG_WARN ("Releasing " << address << ":" << port << " which is not in the pool");
+      return;
+    }
+
+  if (m_blockSize == 0)
+    {
+      if (!m_slots.Release (slot))
+        {
+          NS_LOG_WARN ("Releasing " << address << ":" << port << " which is not in use");
+          return;
+        }
+      m_allocated--;
+      return;
+    }
+
+  SubscriberMap::iterator i = m_subscribers.find (subscriber);
+  if (i == m_subscribers.end ())
+    {
+      NS_LOG_WARN ("Releasing a port of " << subscriber << " which holds no port block");
+      return;
+    }
+  uint32_t block = ToBlock (slot);
+  if (block >= GetNBlocks () || !m_blocks.IsAllocated (block)
+      || m_blockOwner[block] != subscriber.Get () || !m_slotInUse[slot])
+    {
+      NS_LOG_WARN ("Releasing " << address << ":" << port << " which " << subscriber << " does not use");
+      return;
+    }
+  Subscriber &s = i->second;
+  NS_ASSERT (s.used > 0);
+  m_slotInUse[slot] = false;
+  PushFreeSlot (s, slot);
+  s.used--;
+  m_allocated--;
+  if (s.used == 0)
+    {
+      NS_LOG_LOGIC ("Subscriber " << subscriber << " returns " << s.blocks.size () << " port blocks");
+      ReleaseBlocks (s);
+      m_subscribers.erase (i);
+    }
+}
+
+bool
+Ipv4NatPortAllocator::Reserve (Ipv4Address subscriber, Ipv4Address address, uint16_t port)
+{
+  NS_LOG_FUNCTION (this << subscriber << address << port);
+  uint32_t slot;
+  if (!ToSlot (address, port, slot))
+    {
+      return false;
+    }
+
+  if (m_blockSize == 0)
+    {
+      if (!m_slots.Take (slot))
+        {
+          return false;
+        }
+      m_allocated++;
+      return true;
+    }
+
+  // inverse of the slots a block is cut into by Allocate ()
+  if ((slot / m_nAddresses) / m_blockSize >= GetNPorts () / m_blockSize)
+    {
+      return false;
+    }
+  uint32_t block = ToBlock (slot);
+  if (m_blocks.IsAllocated (block))
+    {
+      if (m_blockOwner[block] != subscriber.Get () || m_slotInUse[slot])
+        {
+          return false;
+        }
+    }
+  else
+    {
+      if (!m_blocks.Take (block))
+        {
+          return false;
+        }
+      m_blockOwner[block] = subscriber.Get ();
+      AddBlock (m_subscribers[subscriber], block);
+    }
+  // left in the free list of the subscriber, Allocate () skips it
+  Subscriber &s = m_subscribers[subscriber];
+  m_slotInUse[slot] = true;
+  s.used++;
+  m_allocated++;
+  return true;
+}
+
+uint32_t
+Ipv4NatPortAllocator::GetCapacity (void) const
+{
+  if (m_blockSize == 0)
+    {
+      return m_nAddresses * GetNPorts ();
+    }
+  return GetNBlocks () * m_blockSize;
+}
+
+uint32_t
+Ipv4NatPortAllocator::GetNAllocated (void) const
+{
+  return m_allocated;
+}
+
+uint32_t
+Ipv4NatPortAllocator::GetNFailures (void) const
+{
+  return m_failures;
+}
+
+uint32_t
+Ipv4NatPortAllocator::GetNSubscribers (void) const
+{
+  return m_subscribers.size ();
+}
+
+} // namespace ns3
@@ -0,0 +1,199 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef IPV4_NAT_PORT_ALLOCATOR_H
+#define IPV4_NAT_PORT_ALLOCATOR_H
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "ns3/ipv4-address.h"
+#include "sgi-hashmap.h"
+
+namespace ns3 {
+
+/**
+  * \brief Hands out (global address, port) pairs to dynamic NAT translations
+  *
+  * The pool is the cross product of a range of consecutive global
+  * addresses and a port range. Allocation, release and reservation are
+  * O(1) amortized: pairs that were never used are taken from a high water
+  * mark, released pairs go to the back of a FIFO free list so the port
+  * that was freed longest ago is reused first. A bitmap of the pairs in
+  * use makes a reserved pair skipped in the free list, and a release of a
+  * pair that is not in use ignored.
+  *
+  * Without port blocks, consecutive allocations rotate over the global
+  * addresses. With a block size set, each inside host (subscriber) is
+  * given whole blocks of consecutive ports on one global address and all
+  * of its translations draw from them; the blocks go back to the pool once
+  * the subscriber has no translation left.
+  */
+class Ipv4NatPortAllocator
+{
+public:
+  Ipv4NatPortAllocator ();
+
+  /**
+    * \param first First global address of the pool
+    * \param count Number of consecutive addresses in the pool
+    *
+    * Resets the allocator; must not be called while ports are in use.
+    */
+  void SetAddressRange (Ipv4Address first, uint32_t count);
+
+  /**
+    * \param start First port of the pool
+    * \param end Last port of the pool
+    *
+    * Resets the allocator; must not be called while ports are in use.
+    */
+  void SetPortRange (uint16_t start, uint16_t end);
+
+  /**
+    * \param size Number of ports per subscriber block, 0 disables blocks
+    *
+    * Resets the allocator; must not be called while ports are in use.
+    */
+  void SetBlockSize (uint16_t size);
+  uint16_t GetBlockSize (void) const;
+
+  /**
+    * \param blocks Number of blocks a subscriber may hold, 0 for no limit
+    */
+  void SetMaxBlocksPerSubscriber (uint32_t blocks);
+  uint32_t GetMaxBlocksPerSubscriber (void) const;
+
+  /**
+    * \param subscriber Inside address the translation is made for
+    * \param address Set to the allocated global address
+    * \param port Set to the allocated port
+    * \returns false if the pool, or the share of the subscriber, is
+    * exhausted
+    */
+  bool Allocate (Ipv4Address subscriber, Ipv4Address &address, uint16_t &port);
+
+  /**
+    * \param subscriber Inside address the pair was allocated for
+    * \param address Global address returned by Allocate ()
+    * \param port Port returned by Allocate ()
+    *
+    * A pair that is not in use, or not in a block of the subscriber, is
+    * left alone with a warning.
+    */
+  void Release (Ipv4Address subscriber, Ipv4Address address, uint16_t port);
+
+  /**
+    * \param subscriber Inside address the pair is taken for
+    * \param address Global address of the pair
+    * \param port Port of the pair
+    * \returns false if the pair is not in the pool, is already in use or,
+    * with port blocks, its block belongs to another subscriber
+    *
+    * Takes a given pair out of the pool, as when translations are restored
+    * from a snapshot.
+    */
+  bool Reserve (Ipv4Address subscriber, Ipv4Address address, uint16_t port);
+
+  /**
+    * \returns Number of (address, port) pairs in the pool
+    */
+  uint32_t GetCapacity (void) const;
+
+  /**
+    * \returns Number of pairs currently handed out
+    */
+  uint32_t GetNAllocated (void) const;
+
+  /**
+    * \returns Number of allocations that failed since the last reset
+    */
+  uint32_t GetNFailures (void) const;
+
+  /**
+    * \returns Number of subscribers currently holding port blocks
+    */
+  uint32_t GetNSubscribers (void) const;
+
+private:
+  /**
+    * \brief O(1) pool of the identifiers [0, size)
+    *
+    * An identifier taken out of order stays in the free list and is
+    * skipped when it comes up; an identifier released while it is still
+    * there keeps its place rather than going to the back.
+    */
+  class FreeList
+  {
+  public:
+    FreeList ();
+    void Reset (uint32_t size);
+    bool Allocate (uint32_t &id);
+    bool Take (uint32_t id);
+    bool Release (uint32_t id);
+    bool IsAllocated (uint32_t id) const;
+    uint32_t GetNAllocated (void) const;
+
+  private:
+    uint32_t m_size;
+    uint32_t m_next;
+    uint32_t m_allocated;
+    std::deque<uint32_t> m_free;
+    std::vector<bool> m_inUse;  //!< allocation bitmap of [0, m_next)
+    std::vector<bool> m_queued; //!< identifiers in m_free
+  };
+
+  /* the free slots of a subscriber are kept like those of a FreeList,
+   * with the bitmaps in m_slotInUse and m_slotQueued */
+  struct Subscriber
+  {
+    Subscriber () : used (0) {}
+    std::vector<uint32_t> blocks;
+    std::deque<uint32_t> free;
+    uint32_t used;
+  };
+
+  typedef sgi::hash_map<Ipv4Address, Subscriber, Ipv4AddressHash> SubscriberMap;
+
+  void Reset (void);
+  uint32_t GetNPorts (void) const;
+  uint32_t GetNBlocks (void) const;
+  bool FromSlot (uint32_t slot, Ipv4Address &address, uint16_t &port) const;
+  bool ToSlot (Ipv4Address address, uint16_t port, uint32_t &slot) const;
+  uint32_t ToBlock (uint32_t slot) const;
+  void AddBlock (Subscriber &s, uint32_t block);
+  void ReleaseBlocks (Subscriber &s);
+  bool PopFreeSlot (Subscriber &s, uint32_t &slot);
+  void PushFreeSlot (Subscriber &s, uint32_t slot);
+
+  uint32_t m_firstAddress;
+  uint32_t m_nAddresses;
+  uint16_t m_startPort;
+  uint16_t m_endPort;
+  uint16_t m_blockSize;
+  uint32_t m_maxBlocks;
+  uint32_t m_allocated;
+  uint32_t m_failures;
+  FreeList m_slots;
+  FreeList m_blocks;
+  std::vector<uint32_t> m_blockOwner; //!< subscriber of each block in use
+  std::vector<bool> m_slotInUse;      //!< with port blocks, slots handed out
+  std::vector<bool> m_slotQueued;     //!< with port blocks, slots in a free list
+  SubscriberMap m_subscribers;
+};
+
+} // namespace ns3
+
+#endif /* IPV4_NAT_PORT_ALLOCATOR_H */
@@ -19,7 +19,12 @@
  */
 #include "ns3/log.h"
 #include "ns3/uinteger.h"
+#include "ns3/enum.h"
+#include "ns3/boolean.h"
+#include "ns3/simulator.h"
+#include "ns3/trace-source-accessor.h"
 #include "ipv4-netfilter.h"
+#include "netfilter-packet-context.h"
 
 #include "ip-conntrack-info.h"
 #include "ipv4-conntrack-l3-protocol.h"
@@ -28,14 +33,15 @@
 #include "icmpv4-conntrack-l4-protocol.h"
 
 #include "tcp-header.h"
-#include "udp-header.h"
 #include "ns3/node.h"
 #include "ns3/net-device.h"
 #include "ns3/output-stream-wrapper.h"
 #include "ipv4-nat.h"
 #include "ipv4.h"
+#include "netfilter-snapshot.h"
 
 #include <iomanip>
+#include <algorithm>
 
 NS_LOG_COMPONENT_DEFINE ("Ipv4Nat");
 
@@ -51,14 +57,140 @@ Ipv4Nat::GetTypeId (void)
 {
   static TypeId tId = TypeId ("ns3::Ipv4Nat")
     .SetParent<Object> ()
+    .AddAttribute ("TcpEstablishedTimeout",
+                   "Idle time after which the dynamic translation of a TCP connection is removed.",
+                   TimeValue (Seconds (7440)),
+                   MakeTimeAccessor (&Ipv4Nat::m_tcpEstablishedTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("TcpClosingTimeout",
+                   "Idle time after which the dynamic translation of a TCP connection that has seen a FIN or RST is removed.",
+                   TimeValue (Seconds (240)),
+                   MakeTimeAccessor (&Ipv4Nat::m_tcpClosingTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("UdpTimeout",
+                   "Idle time after which the dynamic translation of a UDP flow is removed.",
+                   TimeValue (Seconds (300)),
+                   MakeTimeAccessor (&Ipv4Nat::m_udpTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("IcmpTimeout",
+                   "Idle time after which the dynamic translation of an ICMP query identifier is removed.",
+                   TimeValue (Seconds (60)),
+                   MakeTimeAccessor (&Ipv4Nat::m_icmpTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("ExpiryGranularity",
+                   "Resolution of the timer wheel that expires idle translations.",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&Ipv4Nat::SetExpiryGranularity,
+                                     &Ipv4Nat::GetExpiryGranularity),
+                   MakeTimeChecker ())
+    .AddAttribute ("PortBlockSize",
+                   "Number of consecutive ports handed to an inside host at a time, 0 to allocate single ports.",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&Ipv4Nat::SetPortBlockSize,
+                                         &Ipv4Nat::GetPortBlockSize),
+                   MakeUintegerChecker<uint16_t> ())
+    .AddAttribute ("MaxPortBlocks",
+                   "Number of port blocks an inside host may hold, 0 for no limit.",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&Ipv4Nat::SetMaxPortBlocks,
+                                         &Ipv4Nat::GetMaxPortBlocks),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("CarrierGradeShardSize",
+                   "Number of subscribers whose carrier-grade translations share a shard, a power of two.",
+                   UintegerValue (256),
+                   MakeUintegerAccessor (&Ipv4Nat::SetCarrierGradeShardSize,
+                                         &Ipv4Nat::GetCarrierGradeShardSize),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("MappingBehavior",
+                   "Which outbound flows of an inside endpoint share a dynamic translation (RFC 4787 section 4.1).",
+                   EnumValue (Ipv4Nat::ENDPOINT_INDEPENDENT),
+                   MakeEnumAccessor (&Ipv4Nat::SetMappingBehavior,
+                                     &Ipv4Nat::GetMappingBehavior),
+                   MakeEnumChecker (Ipv4Nat::ENDPOINT_INDEPENDENT, "EndpointIndependent",
+                                    Ipv4Nat::ADDRESS_DEPENDENT, "AddressDependent",
+                                    Ipv4Nat::ADDRESS_AND_PORT_DEPENDENT, "AddressAndPortDependent"))
+    .AddAttribute ("FilteringBehavior",
+                   "Which remote endpoints may send in through a dynamic translation (RFC 4787 section 5).",
+                   EnumValue (Ipv4Nat::ENDPOINT_INDEPENDENT),
+                   MakeEnumAccessor (&Ipv4Nat::SetFilteringBehavior,
+                                     &Ipv4Nat::GetFilteringBehavior),
+                   MakeEnumChecker (Ipv4Nat::ENDPOINT_INDEPENDENT, "EndpointIndependent",
+                                    Ipv4Nat::ADDRESS_DEPENDENT, "AddressDependent",
+                                    Ipv4Nat::ADDRESS_AND_PORT_DEPENDENT, "AddressAndPortDependent"))
+    .AddAttribute ("Hairpinning",
+                   "Translate packets from an inside interface to a translated address back to the inside (RFC 4787 section 6).",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&Ipv4Nat::m_hairpinning),
+                   MakeBooleanChecker ())
+    .AddAttribute ("Lookups",
+                   "Number of packets looked up in the dynamic translations.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&Ipv4Nat::GetNLookups),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("Hits",
+                   "Number of lookups that found a dynamic translation.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&Ipv4Nat::GetNHits),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("Misses",
+                   "Number of lookups that found no dynamic translation.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&Ipv4Nat::GetNMisses),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("NewBindings",
+                   "Number of dynamic translations created.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&Ipv4Nat::GetNNewBindings),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("PortAllocationFailures",
+                   "Number of new flows left untranslated because the port pool was exhausted.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&Ipv4Nat::GetNPortAllocationFailures),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("Evictions",
+                   "Number of idle dynamic translations removed.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&Ipv4Nat::GetNEvictions),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("Filtered",
+                   "Number of inbound packets dropped by the filtering behavior.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&Ipv4Nat::GetNFiltered),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddTraceSource ("BindingEviction",
+                     "An idle dynamic translation has been removed.",
+                     MakeTraceSourceAccessor (&Ipv4Nat::m_evictionTrace))
+    .AddTraceSource ("BindingCreated",
+                     "A dynamic translation has been created for a new flow.",
+                     MakeTraceSourceAccessor (&Ipv4Nat::m_newBindingTrace))
+    .AddTraceSource ("PortPoolExhausted",
+                     "No global port was left for a new flow; its inside address, port and protocol are passed along.",
+                     MakeTraceSourceAccessor (&Ipv4Nat::m_exhaustionTrace))
   ;
 
   return tId;
 }
 
 Ipv4Nat::Ipv4Nat ()
-  : m_insideInterface (-1),
-    m_outsideInterface (-1)
+  : m_staticIndexDirty (false),
+    m_mapping (ENDPOINT_INDEPENDENT),
+    m_filtering (ENDPOINT_INDEPENDENT),
+    m_hairpinning (true),
+    m_startport (1024),
+    m_endport (65535),
+    m_nLookups (0),
+    m_nHits (0),
+    m_nNewBindings (0),
+    m_nEvictions (0),
+    m_nFiltered (0),
+    m_nCgnFailures (0)
 {
   NS_LOG_FUNCTION (this);
 
@@ -68,6 +200,41 @@ Ipv4Nat::Ipv4Nat ()
   natCallback1 = Ipv4NetfilterHook (1, NF_INET_POST_ROUTING, NF_IP_PRI_NAT_SRC, doNatPostRouting);
   natCallback2 = Ipv4NetfilterHook (1, NF_INET_PRE_ROUTING, NF_IP_PRI_NAT_DST, doNatPreRouting);
 
+  m_bindingTimers.SetExpireCallback (MakeCallback (&Ipv4Nat::ExpireDynamicTuple, this));
+
+  m_icmp = Create<Icmpv4NatL4Protocol> ();
+  RegisterL4Protocol (Create<Ipv4NatPortL4Protocol> (IPPROTO_TCP));
+  RegisterL4Protocol (Create<Ipv4NatPortL4Protocol> (IPPROTO_UDP));
+  RegisterL4Protocol (m_icmp);
+}
+
+void
+Ipv4Nat::RegisterL4Protocol (Ptr<Ipv4NatL4Protocol> protocol)
+{
+  NS_LOG_FUNCTION (this << (uint16_t)protocol->GetProtocol ());
+  m_l4Protocols[protocol->GetProtocol ()] = protocol;
+}
+
+void
+Ipv4Nat::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_bindingTimers.Clear ();
+  m_insideIndex.clear ();
+  m_outsideIndex.clear ();
+  m_permissions.clear ();
+  m_dynatuple.clear ();
+  m_interfaceRoles.clear ();
+  m_deviceInterfaces.clear ();
+  m_cgnSweep.Cancel ();
+  m_cgn.Clear ();
+  for (uint32_t i = 0; i < 256; i++)
+    {
+      m_l4Protocols[i] = 0;
+    }
+  m_icmp = 0;
+  m_ipv4 = 0;
+  Object::DoDispose ();
 }
 
 /*
@@ -154,6 +321,10 @@ Ipv4DynamicNatTuple
 Ipv4Nat::GetDynamicTuple (uint32_t index) const
 {
   NS_LOG_FUNCTION (this << index);
+  if (index >= m_dynatuple.size () && index - m_dynatuple.size () < m_cgn.GetNBindings ())
+    {
+      return GetCarrierGradeTuple (m_cgn.GetBinding (index - m_dynatuple.size ()));
+    }
   uint32_t tmp = 0;
   for (DynamicNatTuple::const_iterator i = m_dynatuple.begin ();
        i != m_dynatuple.end ();
@@ -182,7 +353,7 @@ uint32_t
 Ipv4Nat::GetNDynamicTuples (void) const
 {
   NS_LOG_FUNCTION (this);
-  return m_dynatuple.size ();
+  return m_dynatuple.size () + m_cgn.GetNBindings ();
 }
 
 void
@@ -198,6 +369,7 @@ Ipv4Nat::RemoveStaticRule (uint32_t index)
       if (tmp == index)
         {
           m_statictable.erase (i);
+          m_staticIndexDirty = true;
           return;
         }
     }
@@ -223,6 +395,27 @@ Ipv4Nat::RemoveDynamicRule (uint32_t index)
 }
 
 
+/* One row of the current dynamic translations */
+static void
+PrintDynamicTuple (std::ostream *os, const Ipv4DynamicNatTuple &tup)
+{
+  std::ostringstream locip,locprt,gloip,prt;
+
+  locip << tup.GetLocalAddress ();
+  *os << std::setiosflags (std::ios::left) << std::setw (16) << locip.str ();
+
+  locprt << tup.GetLocalPort ();
+  *os << std::setiosflags (std::ios::left) << std::setw (16) << locprt.str ();
+
+  gloip << tup.GetGlobalAddress ();
+  *os << std::setiosflags (std::ios::left) << std::setw (16) << gloip.str ();
+
+  prt << tup.GetTranslatedPort ();
+  *os << std::setiosflags (std::ios::left) << std::setw (16) << prt.str ();
+
+  *os << std::endl;
+}
+
 /**
  * \brief Print the NAT translation table
  *
@@ -299,368 +492,1169 @@ Ipv4Nat::PrintTable (Ptr<OutputStreamWrapper> stream) const
     {
       *os << std::endl;
       *os << "       Current Dynamic Translations" << std::endl;
-      *os << "Local IP             Global IP           Translated Port" << std::endl;
-      for (uint32_t i = 0; i < GetNDynamicTuples (); i++)
+      *os << "Local IP        Local Port      Global IP       Translated Port" << std::endl;
+      for (DynamicNatTuple::const_iterator i = m_dynatuple.begin (); i != m_dynatuple.end (); i++)
         {
-          std::ostringstream locip,gloip,prt;
-          Ipv4DynamicNatTuple tup = GetDynamicTuple (i);
-
-          locip << tup.GetLocalAddress ();
-          *os << std::setiosflags (std::ios::left) << std::setw (16) << locip.str ();
-
-          gloip << tup.GetGlobalAddress ();
-          *os << std::setiosflags (std::ios::left) << std::setw (16) << gloip.str ();
-
-          prt << tup.GetTranslatedPort ();
-          *os << std::setiosflags (std::ios::left) << std::setw (16) << prt.str ();
-
-          *os << std::endl;
+          PrintDynamicTuple (os, *i);
+        }
+      // carrier-grade translations, out of their port blocks
+      for (uint32_t i = 0; i < m_cgn.GetNBindings (); i++)
+        {
+          PrintDynamicTuple (os, GetCarrierGradeTuple (m_cgn.GetBinding (i)));
         }
 
       *os << std::endl;
     }
 }
 
-uint32_t
-Ipv4Nat::DoNatPreRouting (Hooks_t hookNumber, Ptr<Packet> p,
-                          Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback& ccb)
+/* Record: local address and port, global address and port, remote
+ * address and port, protocol, closing flag and the idle time left,
+ * 28 bytes, then the number of peers let in and their address and port,
+ * 2 + 6 bytes per peer. The records are followed by the number of
+ * carrier-grade translations and their records: subscriber address and
+ * port, translated port, protocol, closing flag and the idle time left,
+ * 18 bytes */
+static const char NAT_SNAPSHOT_MAGIC[4] = { 'N', 'A', 'T', 'B' };
+static const uint8_t NAT_SNAPSHOT_VERSION = 4;
+
+void
+Ipv4Nat::SerializeBindings (std::ostream &os) const
 {
-  NS_LOG_FUNCTION (this << p << hookNumber << in << out);
+  NS_LOG_FUNCTION (this << m_dynatuple.size ());
+  NetfilterSnapshotWriter writer (os);
+  writer.WriteHeader (NAT_SNAPSHOT_MAGIC, NAT_SNAPSHOT_VERSION, m_dynatuple.size ());
+  for (DynamicNatTuple::const_iterator i = m_dynatuple.begin (); i != m_dynatuple.end (); i++)
+    {
+      writer.WriteAddress (i->GetLocalAddress ());
+      writer.WriteU16 (i->GetLocalPort ());
+      writer.WriteAddress (i->GetGlobalAddress ());
+      writer.WriteU16 (i->GetTranslatedPort ());
+      writer.WriteAddress (i->GetRemoteAddress ());
+      writer.WriteU16 (i->GetRemotePort ());
+      writer.WriteU8 (i->GetProtocol ());
+      writer.WriteU8 (i->IsClosing () ? 1 : 0);
+      writer.WriteDeadline (i->GetExpires ());
+      writer.WriteU16 (i->GetNPeers ());
+      for (uint32_t n = 0; n < i->GetNPeers (); n++)
+        {
+          std::pair<Ipv4Address, uint16_t> peer = i->GetPeer (n);
+          writer.WriteAddress (peer.first);
+          writer.WriteU16 (peer.second);
+        }
+    }
+  writer.WriteU32 (m_cgn.GetNBindings ());
+  for (uint32_t i = 0; i < m_cgn.GetNBindings (); i++)
+    {
+      const Ipv4NatBindingTable::Binding &binding = m_cgn.GetBinding (i);
+      writer.WriteAddress (Ipv4Address (binding.local));
+      writer.WriteU16 (binding.localPort);
+      writer.WriteU16 (binding.globalPort);
+      writer.WriteU8 (binding.protocol);
+      writer.WriteU8 (binding.closing);
+      writer.WriteDeadline (m_cgn.GetExpires (binding));
+    }
+}
 
-  if (m_ipv4 == 0)
+/* A translation read from a snapshot with the peers it lets in */
+typedef std::pair<Ipv4DynamicNatTuple, std::vector<std::pair<Ipv4Address, uint16_t> > > NatSnapshotRecord;
+
+/* Pool order of the port allocator: by port, then by address */
+static bool
+CompareGlobalPair (const Ipv4DynamicNatTuple& a, const Ipv4DynamicNatTuple& b)
+{
+  if (a.GetTranslatedPort () != b.GetTranslatedPort ())
     {
-      return 0;
+      return a.GetTranslatedPort () < b.GetTranslatedPort ();
     }
+  return a.GetGlobalAddress ().Get () < b.GetGlobalAddress ().Get ();
+}
 
-  Ipv4Header ipHeader;
+static bool
+CompareSnapshotRecord (const NatSnapshotRecord& a, const NatSnapshotRecord& b)
+{
+  return CompareGlobalPair (a.first, b.first);
+}
 
-  NS_LOG_DEBUG ("Input device " << m_ipv4->GetInterfaceForDevice (in) << " inside interface " << m_insideInterface);
-  NS_LOG_DEBUG ("Output device " << m_ipv4->GetInterfaceForDevice (out) << " outside interface " << m_outsideInterface);
-  p->RemoveHeader (ipHeader);
-  if (m_ipv4->GetInterfaceForDevice (in) == m_outsideInterface)
+bool
+Ipv4Nat::DeserializeBindings (std::istream &is)
+{
+  NS_LOG_FUNCTION (this);
+  NetfilterSnapshotReader reader (is);
+  uint32_t count = reader.ReadHeader (NAT_SNAPSHOT_MAGIC, NAT_SNAPSHOT_VERSION);
+  if (!reader.IsOk ())
     {
-      // outside interface is the input interface, NAT the destination addr
-      // so that the NAT does not try to locally deliver the packet
-      NS_LOG_DEBUG ("evaluating packet with src " << ipHeader.GetSource () << " dst " << ipHeader.GetDestination ());
-      Ipv4Address destAddress = ipHeader.GetDestination ();
+      return false;
+    }
 
-      //Checking for Static NAT Rules
-      for (StaticNatRules::const_iterator i = m_statictable.begin ();
-           i != m_statictable.end (); i++)
+  std::vector<NatSnapshotRecord> records;
+  records.reserve (count);
+  uint32_t nPeers = 0;
+  for (uint32_t n = 0; n < count; n++)
+    {
+      Ipv4Address local = reader.ReadAddress ();
+      uint16_t localPort = reader.ReadU16 ();
+      Ipv4Address global = reader.ReadAddress ();
+      uint16_t port = reader.ReadU16 ();
+      Ipv4Address remote = reader.ReadAddress ();
+      uint16_t remotePort = reader.ReadU16 ();
+      uint8_t protocol = reader.ReadU8 ();
+      Ipv4DynamicNatTuple tuple (local, localPort, global, port, protocol);
+      tuple.SetRemote (remote, remotePort);
+      if (reader.ReadU8 () != 0)
         {
-          if (destAddress != (*i).GetGlobalIp ())
-            {
-              NS_LOG_DEBUG ("Skipping rule with global IP " << (*i).GetGlobalIp ());
-              continue;
-            }
-          if ((*i).GetGlobalPort () == 0)
-            {
-              NS_LOG_DEBUG ("Rule match with a non-port-specific rule");
-              ipHeader.SetDestination ((*i).GetLocalIp ());
-              p->AddHeader (ipHeader);
-              return 0;
-            }
-          else
-            {
-              NS_LOG_DEBUG ("evaluating rule with local port " << (*i).GetLocalPort () << " global port " << (*i).GetGlobalPort ());
-
-              if (ipHeader.GetProtocol () == IPPROTO_TCP
-                  && (((*i).GetProtocol () == IPPROTO_TCP)
-                      || (*i).GetProtocol () == 0))
-                {
-                  TcpHeader tcpHeader;
-                  p->RemoveHeader (tcpHeader);
-                  if (tcpHeader.GetDestinationPort () == (*i).GetGlobalPort ())
-                    {
-                      tcpHeader.SetDestinationPort ((*i).GetLocalPort ());
-                    }
-                  p->AddHeader (tcpHeader);
-                }
-              else if (ipHeader.GetProtocol () == IPPROTO_UDP
-                       && (((*i).GetProtocol () == IPPROTO_UDP)
-                           || (*i).GetProtocol () == 0))
-                {
-                  UdpHeader udpHeader;
-                  p->RemoveHeader (udpHeader);
-                  if (udpHeader.GetDestinationPort () == (*i).GetGlobalPort ())
-                    {
-                      udpHeader.SetDestinationPort ((*i).GetLocalPort ());
-                    }
-                  p->AddHeader (udpHeader);
-                }
-              NS_LOG_DEBUG ("Rule match with a port-specific rule");
-              ipHeader.SetDestination ((*i).GetLocalIp ());
-              p->AddHeader (ipHeader);
-              return 0;
-            }
+          tuple.SetClosing ();
+        }
+      tuple.SetExpires (reader.ReadDeadline ());
+      records.push_back (NatSnapshotRecord (tuple, std::vector<std::pair<Ipv4Address, uint16_t> > ()));
+      uint16_t peers = reader.ReadU16 ();
+      for (uint16_t p = 0; p < peers && reader.IsOk (); p++)
+        {
+          Ipv4Address address = reader.ReadAddress ();
+          records.back ().second.push_back (std::make_pair (address, reader.ReadU16 ()));
+        }
+      if (!reader.IsOk ())
+        {
+          return false;
         }
+      nPeers += std::max<uint32_t> (peers, 1);
+    }
 
+  uint32_t nCarrierGrade = reader.ReadU32 ();
+  std::vector<std::pair<Ipv4NatBindingTable::Binding, Time> > bindings;
+  bindings.reserve (nCarrierGrade);
+  for (uint32_t n = 0; n < nCarrierGrade && reader.IsOk (); n++)
+    {
+      Ipv4NatBindingTable::Binding binding;
+      binding.local = reader.ReadAddress ().Get ();
+      binding.localPort = reader.ReadU16 ();
+      binding.globalPort = reader.ReadU16 ();
+      binding.protocol = reader.ReadU8 ();
+      binding.closing = reader.ReadU8 ();
+      bindings.push_back (std::make_pair (binding, reader.ReadDeadline ()));
+    }
+  if (!reader.IsOk ())
+    {
+      return false;
+    }
 
-      //Passing traffic that has existing outgoing dynamic nat connections
-      for (DynamicNatTuple::const_iterator i = m_dynatuple.begin ();
-           i != m_dynatuple.end (); i++)
+  // in pool order the allocator takes every pair in O(1)
+  std::sort (records.begin (), records.end (), CompareSnapshotRecord);
+  m_insideIndex.resize (m_insideIndex.size () + count);
+  m_outsideIndex.resize (m_outsideIndex.size () + count);
+  if (m_filtering != ENDPOINT_INDEPENDENT)
+    {
+      m_permissions.resize (m_permissions.size () + nPeers);
+    }
+  for (std::vector<NatSnapshotRecord>::const_iterator r = records.begin (); r != records.end (); r++)
+    {
+      const Ipv4DynamicNatTuple &t = r->first;
+      if (!m_ports.Reserve (t.GetLocalAddress (), t.GetGlobalAddress (), t.GetTranslatedPort ()))
         {
-          if (destAddress == GetAddressPoolIp ())
-            {
-              if (ipHeader.GetProtocol () == IPPROTO_TCP)
-
-                {
-                  TcpHeader tcpHeader;
-                  if (tcpHeader.GetDestinationPort () == (*i).GetTranslatedPort ())
-                    {
-                      ipHeader.SetDestination ((*i).GetLocalAddress ());
-                    }
-
-                }
-              else
-                {
-                  UdpHeader udpHeader;
-                  if (udpHeader.GetDestinationPort () == (*i).GetTranslatedPort ())
-                    {
-                      ipHeader.SetDestination ((*i).GetLocalAddress ());
-                    }
-                }
-            }
+          NS_LOG_WARN ("Translation to " << t.GetGlobalAddress () << ":" << t.GetTranslatedPort ()
+                                         << " is not available, skipping it");
+          continue;
+        }
+      m_dynatuple.push_front (t);
+      DynamicNatTuple::iterator tuple = m_dynatuple.begin ();
+      Ipv4NatFlowKey inside = GetMappingKey (t.GetLocalAddress (), t.GetLocalPort (), t.GetProtocol (),
+                                             t.GetRemoteAddress (), t.GetRemotePort ());
+      m_insideIndex[inside] = tuple;
+      m_outsideIndex[Ipv4NatFlowKey (t.GetGlobalAddress (), t.GetTranslatedPort (), t.GetProtocol ())] = tuple;
+      PermitInbound (tuple, t.GetRemoteAddress (), t.GetRemotePort ());
+      for (std::vector<std::pair<Ipv4Address, uint16_t> >::const_iterator peer = r->second.begin ();
+           peer != r->second.end (); peer++)
+        {
+          PermitInbound (tuple, peer->first, peer->second);
         }
+      m_bindingTimers.Schedule (inside, t.GetExpires ());
+    }
 
+  for (std::vector<std::pair<Ipv4NatBindingTable::Binding, Time> >::const_iterator b = bindings.begin ();
+       b != bindings.end (); b++)
+    {
+      Ipv4Address local (b->first.local);
+      Ipv4NatBindingTable::Binding *binding = 0;
+      if (m_cgn.IsEnabled () && m_cgn.IsSubscriber (local)
+          && m_cgn.Lookup (local, b->first.localPort, b->first.protocol) == 0)
+        {
+          binding = m_cgn.Add (local, b->first.localPort, b->first.globalPort, b->first.protocol);
+        }
+      if (binding == 0)
+        {
+          NS_LOG_WARN ("Carrier-grade translation of " << local << ":" << b->first.localPort
+                                                       << " is not available, skipping it");
+          continue;
+        }
+      binding->closing = b->first.closing;
+      m_cgn.SetExpires (binding, b->second);
+      if (!m_cgnSweep.IsRunning ())
+        {
+          m_cgnSweep = Simulator::Schedule (GetExpiryGranularity (), &Ipv4Nat::SweepCarrierGradeTable, this);
+        }
     }
-  p->AddHeader (ipHeader);
-  return 0;
+  NS_LOG_LOGIC ("Loaded " << m_dynatuple.size () << " translations");
+  return true;
 }
 
 uint32_t
-Ipv4Nat::DoNatPostRouting (Hooks_t hookNumber, Ptr<Packet> p,
-                           Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback& ccb)
+Ipv4Nat::DoNatPreRouting (Hooks_t hookNumber, const Ptr<Packet>& p,
+                          const Ptr<NetDevice>& in, const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
 {
   NS_LOG_FUNCTION (this << p << hookNumber << in << out);
 
   if (m_ipv4 == 0)
     {
-      return 0;
+      return NF_ACCEPT;
+    }
+
+  InterfaceRole role = GetInterfaceRole (in);
+  NS_LOG_DEBUG ("Input device " << in << " role " << role);
+  if (role == OUTSIDE)
+    {
+      // outside interface is the input interface, NAT the destination addr
+      // so that the NAT does not try to locally deliver the packet
+      if (ctx.GetIpv4Header ().GetProtocol () == IPPROTO_ICMP && TranslateIcmpError (p, ctx, true))
+        {
+          return NF_ACCEPT;
+        }
+      return TranslateInbound (ctx);
+    }
+  if (role == INSIDE && m_hairpinning)
+    {
+      return TranslateHairpin (ctx);
     }
+  return NF_ACCEPT;
+}
+
+uint32_t
+Ipv4Nat::DoNatPostRouting (Hooks_t hookNumber, const Ptr<Packet>& p,
+                           const Ptr<NetDevice>& in, const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  NS_LOG_FUNCTION (this << p << hookNumber << in << out);
 
-  Ipv4Header ipHeader;
+  if (m_ipv4 == 0)
+    {
+      return NF_ACCEPT;
+    }
 
-  NS_LOG_DEBUG ("Input device " << m_ipv4->GetInterfaceForDevice (in) << " inside interface " << m_insideInterface);
-  NS_LOG_DEBUG ("Output device " << m_ipv4->GetInterfaceForDevice (out) << " outside interface " << m_outsideInterface);
-  p->RemoveHeader (ipHeader);
-  if (m_ipv4->GetInterfaceForDevice (out) == m_outsideInterface)
+  InterfaceRole role = GetInterfaceRole (out);
+  NS_LOG_DEBUG ("Output device " << out << " role " << role);
+  if (role == OUTSIDE)
     {
       // matching output interface, consider whether to NAT the source
       // address and port
-      NS_LOG_DEBUG ("evaluating packet with src " << ipHeader.GetSource () << " dst " << ipHeader.GetDestination ());
-      Ipv4Address srcAddress = ipHeader.GetSource ();
-
-
-      //Checking for Static NAT Rules
-      for (StaticNatRules::const_iterator i = m_statictable.begin ();
-           i != m_statictable.end (); i++)
+      if (ctx.GetIpv4Header ().GetProtocol () == IPPROTO_ICMP && TranslateIcmpError (p, ctx, false))
         {
-          if (srcAddress != (*i).GetLocalIp ())
-            {
-              NS_LOG_DEBUG ("Skipping rule with local IP " << (*i).GetLocalIp ());
-              continue;
-            }
-          if ((*i).GetLocalPort () == 0)
-            {
-              NS_LOG_DEBUG ("Rule match with a non-port-specific rule");
-              ipHeader.SetSource ((*i).GetGlobalIp ());
-              p->AddHeader (ipHeader);
-              return 0;
-            }
-          else
-            {
-              NS_LOG_DEBUG ("Evaluating rule with local port " << (*i).GetLocalPort () << " global port " << (*i).GetGlobalPort ());
-              if (ipHeader.GetProtocol () == IPPROTO_TCP
-                  && (((*i).GetProtocol () == IPPROTO_TCP)
-                      || (*i).GetProtocol () == 0))
-                {
-                  TcpHeader tcpHeader;
-                  p->RemoveHeader (tcpHeader);
-                  if (tcpHeader.GetSourcePort () == (*i).GetLocalPort ())
-                    {
-                      tcpHeader.SetSourcePort ((*i).GetGlobalPort ());
-                    }
-                  p->AddHeader (tcpHeader);
-                }
-              else if (ipHeader.GetProtocol () == IPPROTO_UDP
-                       && (((*i).GetProtocol () == IPPROTO_UDP)
-                           || (*i).GetProtocol () == 0))
-                {
-                  UdpHeader udpHeader;
-                  p->RemoveHeader (udpHeader);
-                  if (udpHeader.GetSourcePort () == (*i).GetLocalPort ())
-                    {
-                      udpHeader.SetSourcePort ((*i).GetGlobalPort ());
-                    }
-                  p->AddHeader (udpHeader);
-                }
-              NS_LOG_DEBUG ("Rule match with a port-specific rule");
-              ipHeader.SetSource ((*i).GetGlobalIp ());
-              p->AddHeader (ipHeader);
-              return 0;
-            }
+          return NF_ACCEPT;
         }
+      return TranslateOutbound (ctx);
+    }
+  return NF_ACCEPT;
+}
 
-      //Checking for Dynamic NAT Rules
-
-      //Checking for existing connection
-      for (DynamicNatTuple::const_iterator i = m_dynatuple.begin ();
-           i != m_dynatuple.end (); i++)
+uint32_t
+Ipv4Nat::TranslateInbound (NetfilterPacketContext& ctx)
+{
+  Ipv4Header &ipHeader = ctx.GetIpv4Header ();
+  NS_LOG_DEBUG ("evaluating packet with src " << ipHeader.GetSource () << " dst " << ipHeader.GetDestination ());
+  Ipv4Address destAddress = ipHeader.GetDestination ();
+
+  uint8_t protocol = ipHeader.GetProtocol ();
+  bool hasPorts = ctx.HasPorts ();
+  uint16_t dstPort = ctx.GetDestinationPort ();
+  bool closing = (ctx.GetTcpFlags () & (TcpHeader::FIN | TcpHeader::RST)) != 0;
+
+  //Checking for Static NAT Rules
+  const Ipv4StaticNatRule *rule = FindStaticRule (m_staticGlobalIndex, destAddress, dstPort, protocol);
+  if (rule != 0)
+    {
+      NS_LOG_DEBUG ("Rule match with global IP " << rule->GetGlobalIp () << " global port " << rule->GetGlobalPort ());
+      if (hasPorts && rule->GetGlobalPort () != 0)
         {
-          if (srcAddress == (*i).GetLocalAddress ())
-            {
-              NS_LOG_DEBUG ("Checking for existing connections");
-              ipHeader.SetSource (GetAddressPoolIp ());
-
-              if (ipHeader.GetProtocol () == IPPROTO_TCP)
-
-                {
-                  TcpHeader tcpHeader;
-                  p->RemoveHeader (tcpHeader);
-                  if (tcpHeader.GetSourcePort () == (*i).GetTranslatedPort ())
-                    {
-                      tcpHeader.SetSourcePort ((*i).GetTranslatedPort ());
-                    }
-                  p->AddHeader (tcpHeader);
-
-
-                }
-              else
-                {
-                  UdpHeader udpHeader;
-                  p->RemoveHeader (udpHeader);
-                  if (udpHeader.GetSourcePort () == (*i).GetTranslatedPort ())
-                    {
-                      udpHeader.SetSourcePort ((*i).GetTranslatedPort ());
-                    }
-                  p->AddHeader (udpHeader);
-                }
-
-            }
+          ctx.SetDestinationPort (rule->GetLocalPort ());
         }
+      ipHeader.SetDestination (rule->GetLocalIp ());
+      ctx.SetIpv4HeaderDirty ();
+      return NF_ACCEPT;
+    }
 
-//This is for the new connections
-
-      for (DynamicNatRules::const_iterator i = m_dynamictable.begin ();
-           i != m_dynamictable.end (); i++)
+  //Passing traffic that has existing outgoing dynamic nat connections
+  Ptr<Ipv4NatL4Protocol> l4 = m_l4Protocols[protocol];
+  uint16_t sourceId;
+  uint16_t destinationId;
+  if (l4 != 0 && m_cgn.IsEnabled ())
+    {
+      if (l4->GetIds (ctx, sourceId, destinationId))
         {
-          if ((*i).GetLocalNet ().CombineMask ((*i).GetLocalMask ()) == srcAddress.CombineMask ((*i).GetLocalMask ()))
-
-            {
-              NS_LOG_DEBUG ("Checking for new connections");
-              ipHeader.SetSource (GetAddressPoolIp ());
-
-              if (ipHeader.GetProtocol () == IPPROTO_TCP)
-
-                {
-                  TcpHeader tcpHeader;
-                  p->RemoveHeader (tcpHeader);
-                  tcpHeader.SetSourcePort (GetNewOutsidePort ());
-                  p->AddHeader (tcpHeader);
-                  Ipv4DynamicNatTuple natuple (srcAddress,GetAddressPoolIp (),GetCurrentPort ());
-                  m_dynatuple.push_front (natuple);
-                }
-              else
-                {
-                  UdpHeader udpHeader;
-                  p->RemoveHeader (udpHeader);
-                  udpHeader.SetSourcePort (GetNewOutsidePort ());
-                  p->AddHeader (udpHeader);
-                  Ipv4DynamicNatTuple natuple (srcAddress,GetAddressPoolIp (),GetCurrentPort ());
-                  m_dynatuple.push_front (natuple);
-
-
-                }
+          TranslateCarrierGradeInbound (ctx, l4, destinationId, closing);
+        }
+    }
+  else if (l4 != 0 && l4->GetIds (ctx, sourceId, destinationId))
+    {
+      // the filtering behavior picks the index the sender must be in
+      const DynamicNatIndex &index = m_filtering == ENDPOINT_INDEPENDENT ? m_outsideIndex : m_permissions;
+      uint16_t remotePort = (protocol == IPPROTO_ICMP || m_filtering != ADDRESS_AND_PORT_DEPENDENT) ? 0 : sourceId;
+      Ipv4Address remote = m_filtering == ENDPOINT_INDEPENDENT ? Ipv4Address () : ipHeader.GetSource ();
+      DynamicNatIndex::const_iterator i = index.find (Ipv4NatFlowKey (destAddress, destinationId, protocol,
+                                                                      remote, remotePort));
+      m_nLookups++;
+      if (i == index.end () && m_filtering != ENDPOINT_INDEPENDENT
+          && m_outsideIndex.find (Ipv4NatFlowKey (destAddress, destinationId, protocol)) != m_outsideIndex.end ())
+        {
+          NS_LOG_LOGIC ("Filtering " << ipHeader.GetSource () << ":" << sourceId << " out of "
+                                     << destAddress << ":" << destinationId);
+          m_nFiltered++;
+          return NF_DROP;
+        }
+      if (i != index.end ())
+        {
+          m_nHits++;
+          NS_LOG_DEBUG ("Translating reply for " << destAddress << ":" << destinationId
+                                                 << " to " << i->second->GetLocalAddress () << ":" << i->second->GetLocalPort ());
+          l4->SetDestinationId (ctx, i->second->GetLocalPort ());
+          ctx.GetIpv4Header ().SetDestination (i->second->GetLocalAddress ());
+          ctx.SetIpv4HeaderDirty ();
+          RefreshDynamicTuple (i->second, closing);
+        }
+    }
+  return NF_ACCEPT;
+}
 
+uint32_t
+Ipv4Nat::TranslateOutbound (NetfilterPacketContext& ctx)
+{
+  Ipv4Header &ipHeader = ctx.GetIpv4Header ();
+  NS_LOG_DEBUG ("evaluating packet with src " << ipHeader.GetSource () << " dst " << ipHeader.GetDestination ());
+  Ipv4Address srcAddress = ipHeader.GetSource ();
+
+  uint8_t protocol = ipHeader.GetProtocol ();
+  bool hasPorts = ctx.HasPorts ();
+  uint16_t srcPort = ctx.GetSourcePort ();
+  bool closing = (ctx.GetTcpFlags () & (TcpHeader::FIN | TcpHeader::RST)) != 0;
+
+  //Checking for Static NAT Rules
+  const Ipv4StaticNatRule *rule = FindStaticRule (m_staticLocalIndex, srcAddress, srcPort, protocol);
+  if (rule != 0)
+    {
+      NS_LOG_DEBUG ("Rule match with local IP " << rule->GetLocalIp () << " local port " << rule->GetLocalPort ());
+      if (hasPorts && rule->GetLocalPort () != 0)
+        {
+          ctx.SetSourcePort (rule->GetGlobalPort ());
+        }
+      ipHeader.SetSource (rule->GetGlobalIp ());
+      ctx.SetIpv4HeaderDirty ();
+      return NF_ACCEPT;
+    }
 
-            }
+  //Checking for Dynamic NAT Rules
+  Ptr<Ipv4NatL4Protocol> l4 = m_l4Protocols[protocol];
+  uint16_t sourceId;
+  uint16_t destinationId;
+  if (l4 == 0 || !l4->GetIds (ctx, sourceId, destinationId))
+    {
+      return NF_ACCEPT;
+    }
+  if (m_cgn.IsEnabled ())
+    {
+      TranslateCarrierGradeOutbound (ctx, l4, sourceId, closing);
+      return NF_ACCEPT;
+    }
 
+  //Checking for existing connection
+  DynamicNatTuple::iterator tuple;
+  Ipv4Address remote = ipHeader.GetDestination ();
+  uint16_t remotePort = protocol == IPPROTO_ICMP ? 0 : destinationId;
+  DynamicNatIndex::const_iterator i = m_insideIndex.find (GetMappingKey (srcAddress, sourceId, protocol,
+                                                                         remote, remotePort));
+  m_nLookups++;
+  if (i != m_insideIndex.end ())
+    {
+      NS_LOG_DEBUG ("Found existing translation");
+      m_nHits++;
+      tuple = i->second;
+    }
+  else if (MatchDynamicRule (srcAddress))
+    {
+      //This is for the new connections
+      NS_LOG_DEBUG ("Creating translation for new connection");
+      tuple = AddDynamicTuple (srcAddress, sourceId, protocol, remote, remotePort);
+      if (tuple == m_dynatuple.end ())
+        {
+          NS_LOG_WARN ("Dynamic NAT port pool exhausted, not translating");
+          m_exhaustionTrace (srcAddress, sourceId, protocol);
+          return NF_ACCEPT;
         }
     }
-  p->AddHeader (ipHeader);
-  return 0;
-}
+  else
+    {
+      return NF_ACCEPT;
+    }
 
-void
-Ipv4Nat::AddAddressPool (Ipv4Address globalip, Ipv4Mask globalmask)
-{
-  NS_LOG_FUNCTION (this << globalip << globalmask);
-  m_globalip = globalip;
-  m_globalmask = globalmask;
+  PermitInbound (tuple, remote, remotePort);
+  l4->SetSourceId (ctx, tuple->GetTranslatedPort ());
+  ctx.GetIpv4Header ().SetSource (tuple->GetGlobalAddress ());
+  ctx.SetIpv4HeaderDirty ();
+  RefreshDynamicTuple (tuple, closing);
+  return NF_ACCEPT;
 }
 
-Ipv4Address
-Ipv4Nat::GetAddressPoolIp () const
+uint32_t
+Ipv4Nat::TranslateHairpin (NetfilterPacketContext& ctx)
 {
-  return m_globalip;
+  // only packets to an address the NAT translates turn around; ICMP
+  // errors are left alone, their quoted packet never crossed the NAT
+  const Ipv4Header &ipHeader = ctx.GetIpv4Header ();
+  Ipv4Address destAddress = ipHeader.GetDestination ();
+  uint8_t protocol = ipHeader.GetProtocol ();
+  bool translated = FindStaticRule (m_staticGlobalIndex, destAddress, ctx.GetDestinationPort (), protocol) != 0;
+  Ptr<Ipv4NatL4Protocol> l4 = m_l4Protocols[protocol];
+  uint16_t sourceId;
+  uint16_t destinationId;
+  if (l4 != 0 && l4->GetIds (ctx, sourceId, destinationId))
+    {
+      translated = translated
+        || m_outsideIndex.find (Ipv4NatFlowKey (destAddress, destinationId, protocol)) != m_outsideIndex.end ()
+        || m_cgn.LookupGlobal (destAddress, destinationId, protocol) != 0;
+    }
+  else if (protocol == IPPROTO_ICMP)
+    {
+      return NF_ACCEPT;
+    }
+  if (!translated)
+    {
+      return NF_ACCEPT;
+    }
+
+  NS_LOG_LOGIC ("Hairpinning " << ipHeader.GetSource () << " to " << destAddress);
+  TranslateOutbound (ctx);
+  return TranslateInbound (ctx);
 }
 
-Ipv4Mask
-Ipv4Nat::GetAddressPoolMask () const
+Ipv4Nat::InterfaceRole
+Ipv4Nat::GetInterfaceRole (Ptr<NetDevice> device)
 {
-  return m_globalmask;
+  if (device == 0)
+    {
+      return UNTRANSLATED;
+    }
+  uint32_t deviceIndex = device->GetIfIndex ();
+  if (deviceIndex >= m_deviceInterfaces.size ())
+    {
+      m_deviceInterfaces.resize (deviceIndex + 1, -1);
+    }
+  int32_t interface = m_deviceInterfaces[deviceIndex];
+  if (interface < 0)
+    {
+      // a device gets its interface once and keeps it
+      interface = m_ipv4->GetInterfaceForDevice (device);
+      if (interface < 0)
+        {
+          return UNTRANSLATED;
+        }
+      m_deviceInterfaces[deviceIndex] = interface;
+    }
+  return (uint32_t)interface < m_interfaceRoles.size () ? (InterfaceRole)m_interfaceRoles[interface] : UNTRANSLATED;
 }
 
 void
-Ipv4Nat::AddPortPool (uint16_t strtprt, uint16_t endprt)         //port range
+Ipv4Nat::SetInterfaceRole (int32_t interfaceIndex, InterfaceRole role)
 {
-  NS_LOG_FUNCTION (this << strtprt << endprt);
-  m_startport = strtprt;
-  m_endport = endprt;
-  m_currentPort = strtprt - 1;
+  NS_ASSERT_MSG (interfaceIndex >= 0, "Invalid interface index " << interfaceIndex);
+  if ((uint32_t)interfaceIndex >= m_interfaceRoles.size ())
+    {
+      m_interfaceRoles.resize (interfaceIndex + 1, UNTRANSLATED);
+    }
+  m_interfaceRoles[interfaceIndex] = role;
 }
 
-uint16_t
-Ipv4Nat::GetStartPort () const
+bool
+Ipv4Nat::TranslateIcmpError (const Ptr<Packet>& p, NetfilterPacketContext& ctx, bool inbound)
 {
-  return m_startport;
-}
+  Ipv4Address source;
+  Ipv4Address destination;
+  uint8_t protocol;
+  uint32_t l4Offset;
+  if (!m_icmp->GetQuotedPacket (ctx, source, destination, protocol, l4Offset))
+    {
+      return false;
+    }
+  ctx.Flush ();
 
-uint16_t
-Ipv4Nat::GetEndPort () const
-{
-  return m_endport;
-}
+  Ipv4Address quoted = inbound ? source : destination;
+  Ptr<Ipv4NatL4Protocol> l4 = l4Offset != 0 ? m_l4Protocols[protocol] : Ptr<Ipv4NatL4Protocol> ();
+  uint16_t id = 0;
+  uint16_t remoteId = 0;
+  if (l4 != 0)
+    {
+      uint16_t sourceId;
+      uint16_t destinationId;
+      Icmpv4NatL4Protocol::GetQuotedIds (p, l4Offset, l4, sourceId, destinationId);
+      id = inbound ? sourceId : destinationId;
+      remoteId = (inbound || protocol == IPPROTO_ICMP) ? 0 : sourceId;
+    }
+  uint16_t port = (protocol == IPPROTO_TCP || protocol == IPPROTO_UDP) ? id : 0;
 
-uint16_t
-Ipv4Nat::GetCurrentPort () const
-{
-  return m_currentPort;
+  Ipv4Address address;
+  const Ipv4StaticNatRule *rule = FindStaticRule (inbound ? m_staticGlobalIndex : m_staticLocalIndex,
+                                                  quoted, port, protocol);
+  if (rule != 0)
+    {
+      address = inbound ? rule->GetLocalIp () : rule->GetGlobalIp ();
+      if (port != 0 && rule->GetLocalPort () != 0)
+        {
+          id = inbound ? rule->GetLocalPort () : rule->GetGlobalPort ();
+        }
+    }
+  else if (l4 != 0 && m_cgn.IsEnabled ())
+    {
+      Ipv4NatBindingTable::Binding *binding = inbound ? m_cgn.LookupGlobal (quoted, id, protocol)
+        : m_cgn.Lookup (quoted, id, protocol);
+      if (binding == 0)
+        {
+          return true;
+        }
+      address = inbound ? Ipv4Address (binding->local) : m_cgn.GetGlobalAddress (quoted);
+      id = inbound ? binding->localPort : binding->globalPort;
+    }
+  else if (l4 != 0)
+    {
+      // an error going out quotes a packet that came in from the remote
+      // endpoint of the flow, which the mapping may depend on
+      const DynamicNatIndex &index = inbound ? m_outsideIndex : m_insideIndex;
+      Ipv4NatFlowKey key = inbound ? Ipv4NatFlowKey (quoted, id, protocol)
+        : GetMappingKey (quoted, id, protocol, source, remoteId);
+      DynamicNatIndex::const_iterator i = index.find (key);
+      if (i == index.end ())
+        {
+          return true;
+        }
+      address = inbound ? i->second->GetLocalAddress () : i->second->GetGlobalAddress ();
+      id = inbound ? i->second->GetLocalPort () : i->second->GetTranslatedPort ();
+    }
+  else
+    {
+      return true;
+    }
+
+  NS_LOG_DEBUG ("Translating quoted " << (inbound ? "source " : "destination ") << quoted << " to " << address);
+  Icmpv4NatL4Protocol::TranslateQuoted (p, inbound, address, l4, id);
+  Ipv4Header &ipHeader = ctx.GetIpv4Header ();
+  if (inbound && ipHeader.GetDestination () == quoted)
+    {
+      ipHeader.SetDestination (address);
+      ctx.SetIpv4HeaderDirty ();
+    }
+  else if (!inbound && ipHeader.GetSource () == quoted)
+    {
+      ipHeader.SetSource (address);
+      ctx.SetIpv4HeaderDirty ();
+    }
+  return true;
 }
 
-uint16_t
-Ipv4Nat::GetNewOutsidePort ()
+const Ipv4StaticNatRule*
+Ipv4Nat::FindStaticRule (const StaticNatIndex& index, Ipv4Address address,
+                         uint16_t port, uint8_t protocol)
 {
-  for (int i = m_startport - 1; i <= m_endport; i++)
+  if (m_statictable.empty ())
     {
-      if ( m_currentPort == i)
-        {
-          m_currentPort++;
-          return m_currentPort;
+      return 0;
+    }
+  if (m_staticIndexDirty)
+    {
+      RebuildStaticIndex ();
+    }
 
+  StaticNatIndex::const_iterator i;
+  if (port != 0)
+    {
+      i = index.find (Ipv4NatFlowKey (address, port, protocol));
+      if (i != index.end ())
+        {
+          return i->second;
+        }
+      // rule for both TCP and UDP
+      i = index.find (Ipv4NatFlowKey (address, port, 0));
+      if (i != index.end ())
+        {
+          return i->second;
         }
     }
+  i = index.find (Ipv4NatFlowKey (address, 0, 0));
+  if (i != index.end ())
+    {
+      return i->second;
+    }
   return 0;
 }
 
 void
-Ipv4Nat::SetInside (int32_t interfaceIndex)
+Ipv4Nat::RebuildStaticIndex (void)
 {
-  NS_LOG_FUNCTION (this << interfaceIndex);
-  m_insideInterface = interfaceIndex;
-
+  NS_LOG_FUNCTION (this);
+  m_staticGlobalIndex.clear ();
+  m_staticLocalIndex.clear ();
+  // The list is newest first and insert () keeps the first rule of a key,
+  // rules without a port are keyed on the address alone
+  for (StaticNatRules::const_iterator i = m_statictable.begin ();
+       i != m_statictable.end (); i++)
+    {
+      uint16_t globalPort = i->GetGlobalPort ();
+      uint16_t localPort = i->GetLocalPort ();
+      m_staticGlobalIndex.insert (std::make_pair (Ipv4NatFlowKey (i->GetGlobalIp (), globalPort,
+                                                                  globalPort ? i->GetProtocol () : 0), &*i));
+      m_staticLocalIndex.insert (std::make_pair (Ipv4NatFlowKey (i->GetLocalIp (), localPort,
+                                                                 localPort ? i->GetProtocol () : 0), &*i));
+    }
+  m_staticIndexDirty = false;
 }
 
-void
-Ipv4Nat::SetOutside (int32_t interfaceIndex)
+bool
+Ipv4Nat::MatchDynamicRule (Ipv4Address address) const
 {
-
-  NS_LOG_FUNCTION (this << interfaceIndex);
-  m_outsideInterface = interfaceIndex;
+  for (DynamicNatRules::const_iterator i = m_dynamictable.begin ();
+       i != m_dynamictable.end (); i++)
+    {
+      if ((*i).GetLocalNet ().CombineMask ((*i).GetLocalMask ()) == address.CombineMask ((*i).GetLocalMask ()))
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+Ipv4Nat::DynamicNatTuple::iterator
+Ipv4Nat::AddDynamicTuple (Ipv4Address local, uint16_t localPort, uint8_t protocol,
+                          Ipv4Address remote, uint16_t remotePort)
+{
+  NS_LOG_FUNCTION (this << local << localPort << (uint16_t)protocol << remote << remotePort);
+  Ipv4Address global;
+  uint16_t port;
+  if (!m_ports.Allocate (local, global, port))
+    {
+      return m_dynatuple.end ();
+    }
+  m_dynatuple.push_front (Ipv4DynamicNatTuple (local, localPort, global, port, protocol));
+  DynamicNatTuple::iterator tuple = m_dynatuple.begin ();
+  tuple->SetRemote (remote, remotePort);
+  Ipv4NatFlowKey inside = GetMappingKey (local, localPort, protocol, remote, remotePort);
+  m_insideIndex[inside] = tuple;
+  m_outsideIndex[Ipv4NatFlowKey (tuple->GetGlobalAddress (), port, protocol)] = tuple;
+  Time timeout = m_udpTimeout;
+  if (protocol == IPPROTO_TCP)
+    {
+      timeout = m_tcpEstablishedTimeout;
+    }
+  else if (protocol == IPPROTO_ICMP)
+    {
+      timeout = m_icmpTimeout;
+    }
+  tuple->SetExpires (Simulator::Now () + timeout);
+  m_bindingTimers.Schedule (inside, tuple->GetExpires ());
+  m_nNewBindings++;
+  m_newBindingTrace (*tuple);
+  return tuple;
+}
+
+Ipv4NatFlowKey
+Ipv4Nat::GetMappingKey (Ipv4Address local, uint16_t localPort, uint8_t protocol,
+                        Ipv4Address remote, uint16_t remotePort) const
+{
+  switch (m_mapping)
+    {
+    case ADDRESS_DEPENDENT:
+      return Ipv4NatFlowKey (local, localPort, protocol, remote, 0);
+    case ADDRESS_AND_PORT_DEPENDENT:
+      return Ipv4NatFlowKey (local, localPort, protocol, remote, remotePort);
+    default:
+      return Ipv4NatFlowKey (local, localPort, protocol);
+    }
+}
+
+void
+Ipv4Nat::PermitInbound (DynamicNatTuple::iterator tuple, Ipv4Address remote, uint16_t remotePort)
+{
+  if (m_filtering == ENDPOINT_INDEPENDENT)
+    {
+      return;
+    }
+  if (m_filtering == ADDRESS_DEPENDENT)
+    {
+      remotePort = 0;
+    }
+  Ipv4NatFlowKey key (tuple->GetGlobalAddress (), tuple->GetTranslatedPort (), tuple->GetProtocol (),
+                      remote, remotePort);
+  std::pair<DynamicNatIndex::iterator, bool> permission = m_permissions.insert (std::make_pair (key, tuple));
+  if (permission.second)
+    {
+      NS_LOG_LOGIC ("Letting " << remote << ":" << remotePort << " in through "
+                               << tuple->GetGlobalAddress () << ":" << tuple->GetTranslatedPort ());
+      tuple->AddPeer (remote, remotePort);
+    }
+}
+
+void
+Ipv4Nat::RefreshDynamicTuple (DynamicNatTuple::iterator tuple, bool closing)
+{
+  if (tuple->GetProtocol () == IPPROTO_TCP && closing)
+    {
+      tuple->SetClosing ();
+    }
+  tuple->SetExpires (Simulator::Now () + GetIdleTimeout (tuple->GetProtocol (), tuple->IsClosing ()));
+}
+
+Time
+Ipv4Nat::GetIdleTimeout (uint8_t protocol, bool closing) const
+{
+  if (protocol == IPPROTO_TCP)
+    {
+      return closing ? m_tcpClosingTimeout : m_tcpEstablishedTimeout;
+    }
+  return protocol == IPPROTO_ICMP ? m_icmpTimeout : m_udpTimeout;
+}
+
+void
+Ipv4Nat::ExpireDynamicTuple (Ipv4NatFlowKey key)
+{
+  DynamicNatIndex::iterator i = m_insideIndex.find (key);
+  if (i == m_insideIndex.end ())
+    {
+      return;
+    }
+  DynamicNatTuple::iterator tuple = i->second;
+  if (tuple->GetExpires () > Simulator::Now ())
+    {
+      m_bindingTimers.Schedule (key, tuple->GetExpires ());
+      return;
+    }
+
+  NS_LOG_LOGIC ("Removing idle translation " << tuple->GetLocalAddress () << ":" << tuple->GetLocalPort ()
+                << " -> " << tuple->GetGlobalAddress () << ":" << tuple->GetTranslatedPort ());
+  m_nEvictions++;
+  m_evictionTrace (*tuple);
+  for (uint32_t n = 0; n < tuple->GetNPeers (); n++)
+    {
+      std::pair<Ipv4Address, uint16_t> peer = tuple->GetPeer (n);
+      m_permissions.erase (Ipv4NatFlowKey (tuple->GetGlobalAddress (), tuple->GetTranslatedPort (),
+                                           tuple->GetProtocol (), peer.first, peer.second));
+    }
+  m_outsideIndex.erase (Ipv4NatFlowKey (tuple->GetGlobalAddress (), tuple->GetTranslatedPort (), tuple->GetProtocol ()));
+  m_insideIndex.erase (i);
+  m_ports.Release (tuple->GetLocalAddress (), tuple->GetGlobalAddress (), tuple->GetTranslatedPort ());
+  m_dynatuple.erase (tuple);
+}
+
+void
+Ipv4Nat::SetExpiryGranularity (Time granularity)
+{
+  NS_LOG_FUNCTION (this << granularity);
+  m_bindingTimers.SetGranularity (granularity);
+}
+
+Time
+Ipv4Nat::GetExpiryGranularity (void) const
+{
+  return m_bindingTimers.GetGranularity ();
+}
+
+void
+Ipv4Nat::AddAddressPool (Ipv4Address globalip, Ipv4Mask globalmask)
+{
+  NS_LOG_FUNCTION (this << globalip << globalmask);
+  m_globalip = globalip;
+  m_globalmask = globalmask;
+
+  Ipv4Address first;
+  uint32_t count;
+  GetAddressPoolRange (first, count);
+  m_ports.SetAddressRange (first, count);
+}
+
+void
+Ipv4Nat::GetAddressPoolRange (Ipv4Address &first, uint32_t &count) const
+{
+  uint32_t mask = m_globalmask.Get ();
+  uint32_t network = m_globalip.Get () & mask;
+  if (mask >= 0xfffffffeU)
+    {
+      first = Ipv4Address (mask == 0xffffffffU ? m_globalip.Get () : network);
+      count = ~mask + 1;
+    }
+  else
+    {
+      first = Ipv4Address (network + 1);
+      count = ~mask - 1;
+    }
+}
+
+Ipv4Address
+Ipv4Nat::GetAddressPoolIp () const
+{
+  return m_globalip;
+}
+
+Ipv4Mask
+Ipv4Nat::GetAddressPoolMask () const
+{
+  return m_globalmask;
 }
 
-
+void
+Ipv4Nat::AddPortPool (uint16_t strtprt, uint16_t endprt)         //port range
+{
+  NS_LOG_FUNCTION (this << strtprt << endprt);
+  m_startport = strtprt;
+  m_endport = endprt;
+  m_ports.SetPortRange (strtprt, endprt);
+}
+
+uint32_t
+Ipv4Nat::GetNAllocatedPorts (void) const
+{
+  return m_ports.GetNAllocated () + m_cgn.GetNBindings ();
+}
+
+uint32_t
+Ipv4Nat::GetNPortAllocationFailures (void) const
+{
+  return m_ports.GetNFailures () + m_nCgnFailures;
+}
+
+uint64_t
+Ipv4Nat::GetNLookups (void) const
+{
+  return m_nLookups;
+}
+
+uint64_t
+Ipv4Nat::GetNHits (void) const
+{
+  return m_nHits;
+}
+
+uint64_t
+Ipv4Nat::GetNMisses (void) const
+{
+  return m_nLookups - m_nHits;
+}
+
+uint64_t
+Ipv4Nat::GetNNewBindings (void) const
+{
+  return m_nNewBindings;
+}
+
+uint64_t
+Ipv4Nat::GetNEvictions (void) const
+{
+  return m_nEvictions;
+}
+
+uint64_t
+Ipv4Nat::GetNFiltered (void) const
+{
+  return m_nFiltered;
+}
+
+void
+Ipv4Nat::SetMappingBehavior (Behavior behavior)
+{
+  NS_LOG_FUNCTION (this << behavior);
+  NS_ASSERT_MSG (m_dynatuple.empty (), "Mapping behavior changed with translations in place");
+  m_mapping = behavior;
+}
+
+Ipv4Nat::Behavior
+Ipv4Nat::GetMappingBehavior (void) const
+{
+  return m_mapping;
+}
+
+void
+Ipv4Nat::SetFilteringBehavior (Behavior behavior)
+{
+  NS_LOG_FUNCTION (this << behavior);
+  NS_ASSERT_MSG (m_dynatuple.empty (), "Filtering behavior changed with translations in place");
+  m_filtering = behavior;
+}
+
+Ipv4Nat::Behavior
+Ipv4Nat::GetFilteringBehavior (void) const
+{
+  return m_filtering;
+}
+
+void
+Ipv4Nat::GetIndexChainHistogram (std::vector<uint32_t>& histogram) const
+{
+  histogram.clear ();
+  const DynamicNatIndex *indices[2] = { &m_insideIndex, &m_outsideIndex };
+  for (uint32_t n = 0; n < 2; n++)
+    {
+      for (size_t bucket = 0; bucket < indices[n]->bucket_count (); bucket++)
+        {
+          size_t length = indices[n]->elems_in_bucket (bucket);
+          if (length >= histogram.size ())
+            {
+              histogram.resize (length + 1, 0);
+            }
+          histogram[length]++;
+        }
+    }
+}
+
+void
+Ipv4Nat::SerializeToXmlStream (std::ostream &os, int indent) const
+{
+#define INDENT(level) for (int __xpto = 0; __xpto < level; __xpto++) os << ' ';
+
+  INDENT (indent);
+  os << "<Ipv4Nat"
+     << " lookups=\"" << m_nLookups << "\""
+     << " hits=\"" << m_nHits << "\""
+     << " misses=\"" << GetNMisses () << "\""
+     << " newBindings=\"" << m_nNewBindings << "\""
+     << " portAllocationFailures=\"" << GetNPortAllocationFailures () << "\""
+     << " evictions=\"" << m_nEvictions << "\""
+     << " filtered=\"" << m_nFiltered << "\""
+     << " bindings=\"" << m_dynatuple.size () << "\""
+     << " allocatedPorts=\"" << m_ports.GetNAllocated () << "\"";
+  if (m_cgn.IsEnabled ())
+    {
+      os << " carrierGradeBindings=\"" << m_cgn.GetNBindings () << "\""
+         << " carrierGradeShards=\"" << m_cgn.GetNAllocatedShards () << "/" << m_cgn.GetNShards () << "\""
+         << " carrierGradeBytes=\"" << m_cgn.GetMemoryUsage () << "\"";
+    }
+  os << ">\n";
+  indent += 2;
+  std::vector<uint32_t> histogram;
+  GetIndexChainHistogram (histogram);
+  INDENT (indent); os << "<chainHistogram nBins=\"" << histogram.size () << "\" >\n";
+  for (uint32_t index = 0; index < histogram.size (); index++)
+    {
+      if (histogram[index])
+        {
+          INDENT (indent + 2);
+          os << "<bin index=\"" << index << "\" count=\"" << histogram[index] << "\" />\n";
+        }
+    }
+  INDENT (indent); os << "</chainHistogram>\n";
+  indent -= 2;
+  INDENT (indent); os << "</Ipv4Nat>\n";
+
+#undef INDENT
+}
+
+void
+Ipv4Nat::SetPortBlockSize (uint16_t size)
+{
+  NS_LOG_FUNCTION (this << size);
+  m_ports.SetBlockSize (size);
+}
+
+uint16_t
+Ipv4Nat::GetPortBlockSize (void) const
+{
+  return m_ports.GetBlockSize ();
+}
+
+void
+Ipv4Nat::SetMaxPortBlocks (uint32_t blocks)
+{
+  NS_LOG_FUNCTION (this << blocks);
+  m_ports.SetMaxBlocksPerSubscriber (blocks);
+}
+
+uint32_t
+Ipv4Nat::GetMaxPortBlocks (void) const
+{
+  return m_ports.GetMaxBlocksPerSubscriber ();
+}
+
+void
+Ipv4Nat::SetCarrierGradeShardSize (uint32_t subscribers)
+{
+  NS_LOG_FUNCTION (this << subscribers);
+  m_cgn.SetShardSize (subscribers);
+}
+
+uint32_t
+Ipv4Nat::GetCarrierGradeShardSize (void) const
+{
+  return m_cgn.GetShardSize ();
+}
+
+void
+Ipv4Nat::EnableCarrierGradeNat (Ipv4Address subscribers, Ipv4Mask mask)
+{
+  NS_LOG_FUNCTION (this << subscribers << mask);
+  NS_ASSERT_MSG (m_mapping == ENDPOINT_INDEPENDENT && m_filtering == ENDPOINT_INDEPENDENT,
+                 "Carrier-grade NAT supports endpoint independent mapping and filtering only");
+  NS_ASSERT_MSG (m_dynatuple.empty (), "Carrier-grade NAT enabled with translations in place");
+  NS_ASSERT_MSG (m_ports.GetBlockSize () > 0, "Carrier-grade NAT needs a port block size");
+  Ipv4Address first;
+  uint32_t count;
+  GetAddressPoolRange (first, count);
+  m_cgnSweep.Cancel ();
+  m_cgn.SetGranularity (GetExpiryGranularity ());
+  m_cgn.SetExpireCallback (MakeCallback (&Ipv4Nat::ExpireCarrierGradeBinding, this));
+  m_cgn.Configure (subscribers, mask, first, count, m_startport, m_endport, m_ports.GetBlockSize ());
+
+  // visit every shard within the shortest idle timeout
+  Time timeout = std::min (std::min (m_icmpTimeout, m_udpTimeout), m_tcpClosingTimeout);
+  uint64_t ticks = std::max ((int64_t)1, timeout.GetTimeStep () / GetExpiryGranularity ().GetTimeStep ());
+  m_cgnSweepShards = (m_cgn.GetNShards () + ticks - 1) / ticks;
+}
+
+const Ipv4NatBindingTable&
+Ipv4Nat::GetCarrierGradeTable (void) const
+{
+  return m_cgn;
+}
+
+void
+Ipv4Nat::TranslateCarrierGradeInbound (NetfilterPacketContext& ctx, Ptr<Ipv4NatL4Protocol> l4,
+                                       uint16_t destinationId, bool closing)
+{
+  Ipv4Header &ipHeader = ctx.GetIpv4Header ();
+  Ipv4NatBindingTable::Binding *binding = m_cgn.LookupGlobal (ipHeader.GetDestination (), destinationId,
+                                                              ipHeader.GetProtocol ());
+  m_nLookups++;
+  if (binding == 0)
+    {
+      return;
+    }
+  m_nHits++;
+  NS_LOG_DEBUG ("Translating reply for " << ipHeader.GetDestination () << ":" << destinationId
+                                         << " to " << Ipv4Address (binding->local) << ":" << binding->localPort);
+  l4->SetDestinationId (ctx, binding->localPort);
+  ipHeader.SetDestination (Ipv4Address (binding->local));
+  ctx.SetIpv4HeaderDirty ();
+  if (binding->protocol == IPPROTO_TCP && closing)
+    {
+      binding->closing = 1;
+    }
+  m_cgn.SetExpires (binding, Simulator::Now () + GetIdleTimeout (binding->protocol, binding->closing));
+}
+
+void
+Ipv4Nat::TranslateCarrierGradeOutbound (NetfilterPacketContext& ctx, Ptr<Ipv4NatL4Protocol> l4,
+                                        uint16_t sourceId, bool closing)
+{
+  Ipv4Header &ipHeader = ctx.GetIpv4Header ();
+  Ipv4Address srcAddress = ipHeader.GetSource ();
+  uint8_t protocol = ipHeader.GetProtocol ();
+  if (!m_cgn.IsSubscriber (srcAddress))
+    {
+      return;
+    }
+  Ipv4NatBindingTable::Binding *binding = m_cgn.Lookup (srcAddress, sourceId, protocol);
+  m_nLookups++;
+  if (binding != 0)
+    {
+      m_nHits++;
+    }
+  else
+    {
+      binding = m_cgn.Add (srcAddress, sourceId, protocol);
+      if (binding == 0)
+        {
+          NS_LOG_WARN ("Port block of " << srcAddress << " exhausted, not translating");
+          m_nCgnFailures++;
+          m_exhaustionTrace (srcAddress, sourceId, protocol);
+          return;
+        }
+      m_nNewBindings++;
+      m_newBindingTrace (GetCarrierGradeTuple (*binding));
+      if (!m_cgnSweep.IsRunning ())
+        {
+          m_cgnSweep = Simulator::Schedule (GetExpiryGranularity (), &Ipv4Nat::SweepCarrierGradeTable, this);
+        }
+    }
+  l4->SetSourceId (ctx, binding->globalPort);
+  ipHeader.SetSource (m_cgn.GetGlobalAddress (srcAddress));
+  ctx.SetIpv4HeaderDirty ();
+  if (protocol == IPPROTO_TCP && closing)
+    {
+      binding->closing = 1;
+    }
+  m_cgn.SetExpires (binding, Simulator::Now () + GetIdleTimeout (protocol, binding->closing));
+}
+
+Ipv4DynamicNatTuple
+Ipv4Nat::GetCarrierGradeTuple (const Ipv4NatBindingTable::Binding &binding) const
+{
+  Ipv4Address local (binding.local);
+  Ipv4DynamicNatTuple tuple (local, binding.localPort, m_cgn.GetGlobalAddress (local),
+                             binding.globalPort, binding.protocol);
+  tuple.SetExpires (m_cgn.GetExpires (binding));
+  if (binding.closing)
+    {
+      tuple.SetClosing ();
+    }
+  return tuple;
+}
+
+void
+Ipv4Nat::ExpireCarrierGradeBinding (const Ipv4NatBindingTable::Binding &binding)
+{
+  NS_LOG_LOGIC ("Removing idle translation " << Ipv4Address (binding.local) << ":" << binding.localPort
+                                             << " -> " << binding.globalPort);
+  m_nEvictions++;
+  m_evictionTrace (GetCarrierGradeTuple (binding));
+}
+
+void
+Ipv4Nat::SweepCarrierGradeTable (void)
+{
+  m_cgn.Sweep (m_cgnSweepShards);
+  if (m_cgn.GetNBindings () > 0)
+    {
+      m_cgnSweep = Simulator::Schedule (GetExpiryGranularity (), &Ipv4Nat::SweepCarrierGradeTable, this);
+    }
+}
+
+uint16_t
+Ipv4Nat::GetStartPort () const
+{
+  return m_startport;
+}
+
+uint16_t
+Ipv4Nat::GetEndPort () const
+{
+  return m_endport;
+}
+
+void
+Ipv4Nat::SetInside (int32_t interfaceIndex)
+{
+  NS_LOG_FUNCTION (this << interfaceIndex);
+  SetInterfaceRole (interfaceIndex, INSIDE);
+}
+
+void
+Ipv4Nat::SetOutside (int32_t interfaceIndex)
+{
+  NS_LOG_FUNCTION (this << interfaceIndex);
+  SetInterfaceRole (interfaceIndex, OUTSIDE);
+}
+
+bool
+Ipv4Nat::IsInside (int32_t interfaceIndex) const
+{
+  return interfaceIndex >= 0 && (uint32_t)interfaceIndex < m_interfaceRoles.size ()
+         && m_interfaceRoles[interfaceIndex] == INSIDE;
+}
+
+bool
+Ipv4Nat::IsOutside (int32_t interfaceIndex) const
+{
+  return interfaceIndex >= 0 && (uint32_t)interfaceIndex < m_interfaceRoles.size ()
+         && m_interfaceRoles[interfaceIndex] == OUTSIDE;
+}
+
+
 void
 Ipv4Nat::AddDynamicRule (const Ipv4DynamicNatRule& rule)
 {
@@ -674,6 +1668,7 @@ Ipv4Nat::AddStaticRule (const Ipv4StaticNatRule& rule)
 {
   NS_LOG_FUNCTION (this);
   m_statictable.push_front (rule);
+  m_staticIndexDirty = true;
   NS_LOG_DEBUG ("list has " << m_statictable.size () << " elements after pushing");
   NS_ASSERT_MSG (m_ipv4, "Forgot to aggregate Ipv4Nat to Node");
   if (m_ipv4->GetInterfaceForAddress (rule.GetGlobalIp ()) != -1)
@@ -681,11 +1676,29 @@ Ipv4Nat::AddStaticRule (const Ipv4StaticNatRule& rule)
       NS_LOG_WARN ("Adding node's own IP address as the global NAT address");
       return;
     }
-  NS_ASSERT_MSG (m_outsideInterface > -1, "Forgot to assign outside interface");
+  int32_t outside = -1;
+  for (uint32_t i = 0; i < m_interfaceRoles.size (); i++)
+    {
+      if (m_interfaceRoles[i] != OUTSIDE)
+        {
+          continue;
+        }
+      if (outside == -1)
+        {
+          outside = i;
+        }
+      Ipv4InterfaceAddress address = m_ipv4->GetAddress (i, 0);
+      if (address.GetMask ().IsMatch (address.GetLocal (), rule.GetGlobalIp ()))
+        {
+          outside = i;
+          break;
+        }
+    }
+  NS_ASSERT_MSG (outside > -1, "Forgot to assign outside interface");
   // Add address to outside interface so that node will proxy ARP for it
-  Ipv4Mask outsideMask = m_ipv4->GetAddress (m_outsideInterface, 0).GetMask ();
+  Ipv4Mask outsideMask = m_ipv4->GetAddress (outside, 0).GetMask ();
   Ipv4InterfaceAddress natAddress (rule.GetGlobalIp (), outsideMask);
-  m_ipv4->AddAddress (m_outsideInterface, natAddress);
+  m_ipv4->AddAddress (outside, natAddress);
 }
 
 Ipv4StaticNatRule::Ipv4StaticNatRule (Ipv4Address localip, uint16_t locprt, Ipv4Address globalip,uint16_t gloprt, uint16_t protocol)
@@ -766,7 +1779,23 @@ Ipv4DynamicNatTuple::Ipv4DynamicNatTuple (Ipv4Address local, Ipv4Address global,
   NS_LOG_FUNCTION (this << local << global << port);
   m_localip = local;
   m_globalip = global;
+  m_localport = 0;
+  m_port = port;
+  m_protocol = 0;
+  m_closing = false;
+  m_remoteport = 0;
+}
+
+Ipv4DynamicNatTuple::Ipv4DynamicNatTuple (Ipv4Address local, uint16_t localPort, Ipv4Address global, uint16_t port, uint8_t protocol)
+{
+  NS_LOG_FUNCTION (this << local << localPort << global << port << (uint16_t)protocol);
+  m_localip = local;
+  m_globalip = global;
+  m_localport = localPort;
   m_port = port;
+  m_protocol = protocol;
+  m_closing = false;
+  m_remoteport = 0;
 }
 
 Ipv4Address
@@ -775,6 +1804,18 @@ Ipv4DynamicNatTuple::GetLocalAddress () const
   return m_localip;
 }
 
+uint16_t
+Ipv4DynamicNatTuple::GetLocalPort () const
+{
+  return m_localport;
+}
+
+uint8_t
+Ipv4DynamicNatTuple::GetProtocol () const
+{
+  return m_protocol;
+}
+
 Ipv4Address
 Ipv4DynamicNatTuple::GetGlobalAddress () const
 {
@@ -787,4 +1828,109 @@ Ipv4DynamicNatTuple::GetTranslatedPort () const
   return m_port;
 }
 
+void
+Ipv4DynamicNatTuple::SetExpires (Time expires)
+{
+  m_expires = expires;
+}
+
+Time
+Ipv4DynamicNatTuple::GetExpires () const
+{
+  return m_expires;
+}
+
+void
+Ipv4DynamicNatTuple::SetRemote (Ipv4Address address, uint16_t port)
+{
+  m_remoteip = address;
+  m_remoteport = port;
+}
+
+Ipv4Address
+Ipv4DynamicNatTuple::GetRemoteAddress () const
+{
+  return m_remoteip;
+}
+
+uint16_t
+Ipv4DynamicNatTuple::GetRemotePort () const
+{
+  return m_remoteport;
+}
+
+void
+Ipv4DynamicNatTuple::AddPeer (Ipv4Address address, uint16_t port)
+{
+  m_peers.push_back (std::make_pair (address, port));
+}
+
+uint32_t
+Ipv4DynamicNatTuple::GetNPeers () const
+{
+  return m_peers.size ();
+}
+
+std::pair<Ipv4Address, uint16_t>
+Ipv4DynamicNatTuple::GetPeer (uint32_t index) const
+{
+  NS_ASSERT (index < m_peers.size ());
+  return m_peers[index];
+}
+
+void
+Ipv4DynamicNatTuple::SetClosing ()
+{
+  m_closing = true;
+}
+
+bool
+Ipv4DynamicNatTuple::IsClosing () const
+{
+  return m_closing;
+}
+
+Ipv4NatFlowKey::Ipv4NatFlowKey ()
+  : m_port (0),
+    m_protocol (0),
+    m_remotePort (0)
+{
+}
+
+Ipv4NatFlowKey::Ipv4NatFlowKey (Ipv4Address address, uint16_t port, uint8_t protocol)
+  : m_address (address),
+    m_port (port),
+    m_protocol (protocol),
+    m_remotePort (0)
+{
+}
+
+Ipv4NatFlowKey::Ipv4NatFlowKey (Ipv4Address address, uint16_t port, uint8_t protocol,
+                                Ipv4Address remoteAddress, uint16_t remotePort)
+  : m_address (address),
+    m_port (port),
+    m_protocol (protocol),
+    m_remoteAddress (remoteAddress),
+    m_remotePort (remotePort)
+{
+}
+
+bool
+Ipv4NatFlowKey::operator== (const Ipv4NatFlowKey& o) const
+{
+  return m_address == o.m_address && m_port == o.m_port && m_protocol == o.m_protocol
+         && m_remoteAddress == o.m_remoteAddress && m_remotePort == o.m_remotePort;
+}
+
+size_t
+Ipv4NatFlowKeyHash::operator() (const Ipv4NatFlowKey& key) const
+{
+  // Fibonacci hashing of the address folded with port and protocol
+  uint32_t h = key.m_address.Get () * 0x9e3779b1U;
+  h ^= ((uint32_t)key.m_port << 8) | key.m_protocol;
+  h ^= (key.m_remoteAddress.Get () ^ ((uint32_t)key.m_remotePort << 16)) * 0xc2b2ae35U;
+  h *= 0x85ebca6bU;
+  return h ^ (h >> 16);
+}
+
 }
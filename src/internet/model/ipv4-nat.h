@@ -23,11 +23,14 @@
 #include <stdint.h>
 #include <limits.h>
 #include <sys/socket.h>
+#include <vector>
 #include "ns3/ptr.h"
 #include "ns3/net-device.h"
 #include "ns3/packet.h"
 #include "ns3/ipv4-header.h"
 #include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/traced-callback.h"
 #include "ipv4-netfilter.h"
 #include "ipv4-netfilter-hook.h"
 #include "netfilter-callback-chain.h"
@@ -38,6 +41,11 @@
 #include "netfilter-conntrack-l4-protocol.h"
 #include "ip-conntrack-info.h"
 #include "ipv4.h"
+#include "sgi-hashmap.h"
+#include "netfilter-timer-wheel.h"
+#include "ipv4-nat-port-allocator.h"
+#include "ipv4-nat-binding-table.h"
+#include "ipv4-nat-l4-protocol.h"
 
 
 namespace ns3 {
@@ -161,11 +169,31 @@ public:
   */
   Ipv4DynamicNatTuple (Ipv4Address local, Ipv4Address global, uint16_t port);
 
+/**
+  *\brief Used to initialize a port specific Dynamic NAT translated tuple entry.
+  *\param local The local host ip that is translated
+  *\param localPort The source port used by the local host
+  *\param global The global ip that the host has been translated to
+  *\param port The source port that the local host has translated to
+  *\param protocol The protocol of the translated flow
+  */
+  Ipv4DynamicNatTuple (Ipv4Address local, uint16_t localPort, Ipv4Address global, uint16_t port, uint8_t protocol);
+
 /**
   *\return The local host Ipv4Address
   */
   Ipv4Address GetLocalAddress () const;
 
+/**
+  *\return The source port used by the local host
+  */
+  uint16_t GetLocalPort () const;
+
+/**
+  *\return The protocol of the translated flow
+  */
+  uint8_t GetProtocol () const;
+
 /**
   *\return The translated global Ipv4Address
   */
@@ -176,10 +204,105 @@ public:
   */
   uint16_t GetTranslatedPort () const;
 
+/**
+  *\param expires The simulation time at which the idle translation expires
+  */
+  void SetExpires (Time expires);
+
+/**
+  *\return The simulation time at which the idle translation expires
+  */
+  Time GetExpires () const;
+
+/**
+  *\brief Record the remote endpoint of the flow the translation was made for
+  *\param address The remote address
+  *\param port The remote port, 0 for ICMP
+  */
+  void SetRemote (Ipv4Address address, uint16_t port);
+
+/**
+  *\return The remote address of the flow the translation was made for
+  */
+  Ipv4Address GetRemoteAddress () const;
+
+/**
+  *\return The remote port of the flow the translation was made for
+  */
+  uint16_t GetRemotePort () const;
+
+/**
+  *\brief Record a remote endpoint that may send in through the translation
+  *\param address The remote address
+  *\param port The remote port, 0 if the filtering does not look at it
+  */
+  void AddPeer (Ipv4Address address, uint16_t port);
+
+/**
+  *\return The number of remote endpoints recorded by AddPeer ()
+  */
+  uint32_t GetNPeers () const;
+
+/**
+  *\param index Index of the remote endpoint
+  *\return The address and port recorded by AddPeer ()
+  */
+  std::pair<Ipv4Address, uint16_t> GetPeer (uint32_t index) const;
+
+/**
+  *\brief Mark the translated TCP connection as being torn down
+  */
+  void SetClosing ();
+
+/**
+  *\return true if a FIN or RST has been seen on the translated connection
+  */
+  bool IsClosing () const;
+
 private:
   Ipv4Address m_localip;
   Ipv4Address m_globalip;
+  uint16_t m_localport;
+  uint16_t m_port;
+  uint8_t m_protocol;
+  bool m_closing;
+  Time m_expires;
+  Ipv4Address m_remoteip;
+  uint16_t m_remoteport;
+  std::vector<std::pair<Ipv4Address, uint16_t> > m_peers;
+};
+
+/**
+  * \brief Key of the dynamic NAT translation indices.
+  *
+  * A (address, port, protocol) triple identifying one side of a
+  * translated flow, either the inside endpoint or the outside one,
+  * optionally qualified by the remote address and port of the flow when
+  * the mapping or filtering behavior depends on them.
+  */
+class Ipv4NatFlowKey
+{
+public:
+  Ipv4NatFlowKey ();
+  Ipv4NatFlowKey (Ipv4Address address, uint16_t port, uint8_t protocol);
+  Ipv4NatFlowKey (Ipv4Address address, uint16_t port, uint8_t protocol,
+                  Ipv4Address remoteAddress, uint16_t remotePort);
+  bool operator== (const Ipv4NatFlowKey& o) const;
+
+  Ipv4Address m_address;
   uint16_t m_port;
+  uint8_t m_protocol;
+  Ipv4Address m_remoteAddress;
+  uint16_t m_remotePort;
+};
+
+/**
+  * \brief Hash functor for Ipv4NatFlowKey
+  */
+class Ipv4NatFlowKeyHash
+{
+public:
+  size_t operator() (const Ipv4NatFlowKey& key) const;
 };
 
 /**
@@ -187,6 +310,14 @@ private:
   *
   * This implements NAT functionality over a Netfilter framework.
   * The NAT is of two major types (static and dynamic).
+  *
+  * Any number of interfaces may be inside or outside. Packets leaving
+  * through an outside interface have their source translated, packets
+  * arriving on one have their destination translated back; the rules and
+  * translations are shared by all of them. A packet from an inside
+  * interface to a translated address is hairpinned: its destination is
+  * translated back as if it came in and its source as if it went out, so
+  * that inside hosts reach each other through their global addresses.
   */
 
 class Ipv4Nat : public Object
@@ -194,6 +325,23 @@ class Ipv4Nat : public Object
 public:
   static TypeId GetTypeId (void);
 
+  /**
+   * \brief Mapping and filtering behaviors of RFC 4787
+   *
+   * The mapping behavior decides which outbound flows of an inside
+   * endpoint share a dynamic translation: all of them, those to the same
+   * remote address, or only those to the same remote address and port.
+   * The filtering behavior decides which remote endpoints may send in
+   * through a translation: any, those at an address the inside endpoint
+   * has sent to, or only those at an address and port it has sent to.
+   */
+  enum Behavior
+  {
+    ENDPOINT_INDEPENDENT,
+    ADDRESS_DEPENDENT,
+    ADDRESS_AND_PORT_DEPENDENT
+  };
+
   Ipv4Nat ();
 
   /**
@@ -213,7 +361,9 @@ public:
    * \param rule Static NAT rule reference reference to the NAT rule to be added
    *
    * Adds a Static NAT rule to the lists that have been dedicated for the specific types
-   * of rules.
+   * of rules. A rule added later takes precedence over an earlier one with
+   * the same addresses and ports; port specific rules take precedence
+   * over rules for the whole address.
    */
 
   void AddStaticRule (const Ipv4StaticNatRule& rule);
@@ -283,15 +433,48 @@ public:
    *
    * \param stream the ostream the NAT table is printed to
    *
-   * Prints out the NAT table.
+   * Prints out the NAT table; the current dynamic translations include
+   * the carrier-grade ones.
    */
   void PrintTable (Ptr<OutputStreamWrapper> stream) const;
 
+  /**
+   * \brief Write the dynamic translations to a snapshot
+   *
+   * \param os Binary stream the translations are written to
+   *
+   * Writes one record per translation, straight from the translation
+   * list, with every remote endpoint the translation lets in, followed
+   * by the carrier-grade translations. The expiry of a translation is
+   * saved as the idle time it had left.
+   */
+  void SerializeBindings (std::ostream &os) const;
+
+  /**
+   * \brief Restore the dynamic translations of a snapshot
+   *
+   * \param is Binary stream written by SerializeBindings ()
+   * \returns false if the stream is not a NAT snapshot or ends early
+   *
+   * The address and port pools must be configured as they were when the
+   * snapshot was taken. The pairs of the translations are taken out of
+   * the port pool in pool order and both lookup indices are sized once
+   * for all of them; translations whose pair is not available are
+   * skipped. Carrier-grade translations are restored into their port
+   * blocks, so EnableCarrierGradeNat () must have been called with the
+   * subscriber prefix of the snapshot; those that do not fit are skipped.
+   */
+  bool DeserializeBindings (std::istream &is);
+
   /**
    * \brief Add the address pool for Dynamic NAT
    *
    * \param Ipv4address the addresses to be added in the Dynamic Nat pool
    * \param Ipv4Mask the mask of the pool of network address given
+   *
+   * Every host address of the prefix is used for translations; with a
+   * /31 or /32 mask every address of the prefix is. The network and
+   * broadcast addresses of longer prefixes are left out.
    */
   void AddAddressPool (Ipv4Address globalip, Ipv4Mask globalmask);
 
@@ -304,31 +487,169 @@ public:
   void AddPortPool (uint16_t strtprt, uint16_t endprt); //port range
 
   /**
-   * \brief Set the inside interface for the node
+   * \return The number of global (address, port) pairs in use by dynamic
+   * translations
+   */
+  uint32_t GetNAllocatedPorts (void) const;
+
+  /**
+   * \return The number of new flows that could not be translated because
+   * the port pool, or the port blocks of the subscriber, were exhausted
+   */
+  uint32_t GetNPortAllocationFailures (void) const;
+
+  /**
+   * \return The number of packets looked up in the dynamic translations,
+   * outgoing by their inside endpoint and incoming by their outside one
+   */
+  uint64_t GetNLookups (void) const;
+
+  /**
+   * \return The number of lookups that found a translation
+   */
+  uint64_t GetNHits (void) const;
+
+  /**
+   * \return The number of lookups that found no translation
+   */
+  uint64_t GetNMisses (void) const;
+
+  /**
+   * \return The number of dynamic translations created
+   */
+  uint64_t GetNNewBindings (void) const;
+
+  /**
+   * \return The number of idle dynamic translations removed
+   */
+  uint64_t GetNEvictions (void) const;
+
+  /**
+   * \param histogram Set to the number of buckets of the translation
+   * indices by the number of translations chained in them
+   */
+  void GetIndexChainHistogram (std::vector<uint32_t>& histogram) const;
+
+  /**
+   * \return The number of inbound packets dropped because the filtering
+   * behavior did not let their sender in through the translation
+   */
+  uint64_t GetNFiltered (void) const;
+
+  /**
+   * \param behavior Which outbound flows of an inside endpoint share a
+   * translation; must be set before the first translation is made
+   */
+  void SetMappingBehavior (Behavior behavior);
+  Behavior GetMappingBehavior (void) const;
+
+  /**
+   * \param behavior Which remote endpoints may send in through a
+   * translation; must be set before the first translation is made
+   */
+  void SetFilteringBehavior (Behavior behavior);
+  Behavior GetFilteringBehavior (void) const;
+
+  /**
+   * \param os Stream the counters are written to
+   * \param indent Number of spaces the elements are indented with
+   *
+   * Writes the counters and the chain histogram of the translation
+   * indices as an Ipv4Nat XML element, in the format of
+   * FlowMonitor::SerializeToXmlStream ().
+   */
+  void SerializeToXmlStream (std::ostream &os, int indent) const;
+
+  /**
+   * \brief Set an inside interface for the node
    *
    * \param interfaceIndex interface index number of the interface on the node
+   *
+   * May be called for several interfaces.
    */
   void SetInside (int32_t interfaceIndex);
 
   /**
-   * \brief Set the outside interfaces for the node
+   * \brief Set an outside interface for the node
    *
    * \param interfaceIndex interface index number of the interface on the node
+   *
+   * May be called for several interfaces. Global addresses of static
+   * rules are added to the first outside interface whose prefix holds
+   * them, or to the first outside interface.
    */
   void SetOutside (int32_t interfaceIndex);
 
+  /**
+   * \param interfaceIndex interface index number of the interface on the node
+   * \returns true if the interface has been set inside
+   */
+  bool IsInside (int32_t interfaceIndex) const;
+
+  /**
+   * \param interfaceIndex interface index number of the interface on the node
+   * \returns true if the interface has been set outside
+   */
+  bool IsOutside (int32_t interfaceIndex) const;
+
+  /**
+   * \brief Translate a subscriber prefix as a carrier-grade NAT
+   *
+   * \param subscribers Subscriber prefix
+   * \param mask Mask of the subscriber prefix
+   *
+   * Dynamic translations are then made for the subscriber prefix only and
+   * kept in an Ipv4NatBindingTable instead of the translation list:
+   * subscriber n is given the n-th block of PortBlockSize ports of the
+   * address pool, counting the blocks of each address in turn (RFC 7422).
+   * The address pool, the port pool and the port block size must be set
+   * first, and the pools must hold a block for every subscriber. Only
+   * endpoint independent mapping and filtering are supported.
+   */
+  void EnableCarrierGradeNat (Ipv4Address subscribers, Ipv4Mask mask);
+
+  /**
+   * \returns The table of carrier-grade translations
+   */
+  const Ipv4NatBindingTable& GetCarrierGradeTable (void) const;
+
+  /**
+   * \brief Register the NAT handler of a transport protocol
+   *
+   * \param protocol The handler, replacing any earlier one for its
+   * protocol number
+   *
+   * Handlers for TCP, UDP and ICMP are registered by the constructor.
+   * Packets of a protocol without a handler only get their addresses
+   * translated by static rules.
+   */
+  void RegisterL4Protocol (Ptr<Ipv4NatL4Protocol> protocol);
+
   typedef std::list<Ipv4StaticNatRule> StaticNatRules;
   typedef std::list<Ipv4DynamicNatRule> DynamicNatRules;
   typedef std::list<Ipv4DynamicNatTuple> DynamicNatTuple;
+  typedef sgi::hash_map<Ipv4NatFlowKey, DynamicNatTuple::iterator, Ipv4NatFlowKeyHash> DynamicNatIndex;
+  typedef sgi::hash_map<Ipv4NatFlowKey, const Ipv4StaticNatRule *, Ipv4NatFlowKeyHash> StaticNatIndex;
 
 
 protected:
   // from Object base class
   virtual void NotifyNewAggregate (void);
+  virtual void DoDispose (void);
 
 private:
   //bool m_isConnected;
 
+  /**
+   * \brief Role of an interface in translation
+   */
+  enum InterfaceRole
+  {
+    UNTRANSLATED,
+    INSIDE,
+    OUTSIDE
+  };
+
   Ptr<Ipv4> m_ipv4;
 
   /**
@@ -344,8 +665,8 @@ private:
     *  This method is invoke to perform NAT of the packet at the NF_INET_PRE_ROUTING stage.
     */
 
-  uint32_t DoNatPreRouting (Hooks_t hookNumber, Ptr<Packet> p,
-                            Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback& ccb);
+  uint32_t DoNatPreRouting (Hooks_t hookNumber, const Ptr<Packet>& p,
+                            const Ptr<NetDevice>& in, const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
 
   /**
      * \param hook The hook number e.g., NF_INET_PRE_ROUTING
@@ -360,8 +681,92 @@ private:
      *  This method is invoke to perform NAT of the packet at the NF_INET_POST_ROUTING stage.
      */
 
-  uint32_t DoNatPostRouting (Hooks_t hookNumber, Ptr<Packet> p,
-                             Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback& ccb);
+  uint32_t DoNatPostRouting (Hooks_t hookNumber, const Ptr<Packet>& p,
+                             const Ptr<NetDevice>& in, const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+
+  /**
+   * \param ctx Headers of a packet coming in, ICMP errors excepted
+   * \returns Netfilter verdict for the packet
+   *
+   * Translates the destination of the packet by a static rule or a
+   * dynamic translation, or drops it if the filtering behavior refuses
+   * its source.
+   */
+  uint32_t TranslateInbound (NetfilterPacketContext& ctx);
+
+  /**
+   * \param ctx Headers of a packet going out, ICMP errors excepted
+   * \returns Netfilter verdict for the packet
+   *
+   * Translates the source of the packet by a static rule or a dynamic
+   * translation, creating the translation if a dynamic rule covers it.
+   */
+  uint32_t TranslateOutbound (NetfilterPacketContext& ctx);
+
+  /**
+   * \param ctx Headers of a packet from an inside interface
+   * \returns Netfilter verdict for the packet
+   *
+   * If the destination of the packet is translated by a static rule or
+   * a dynamic translation, translates the source as TranslateOutbound ()
+   * and the destination as TranslateInbound () would.
+   */
+  uint32_t TranslateHairpin (NetfilterPacketContext& ctx);
+
+  /**
+   * \param device A device of the node, may be 0
+   * \returns Role of the interface of the device
+   *
+   * The interface of a device is looked up once and cached by the
+   * index of the device, so packets do not scan the interface list.
+   */
+  InterfaceRole GetInterfaceRole (Ptr<NetDevice> device);
+
+  /**
+   * \param ctx Headers of a packet coming in
+   * \param l4 Handler of the protocol of the packet
+   * \param destinationId Destination port or ICMP query id of the packet
+   * \param closing true if the packet carries a TCP FIN or RST
+   */
+  void TranslateCarrierGradeInbound (NetfilterPacketContext& ctx, Ptr<Ipv4NatL4Protocol> l4,
+                                     uint16_t destinationId, bool closing);
+
+  /**
+   * \param ctx Headers of a packet going out
+   * \param l4 Handler of the protocol of the packet
+   * \param sourceId Source port or ICMP query id of the packet
+   * \param closing true if the packet carries a TCP FIN or RST
+   */
+  void TranslateCarrierGradeOutbound (NetfilterPacketContext& ctx, Ptr<Ipv4NatL4Protocol> l4,
+                                      uint16_t sourceId, bool closing);
+
+  /**
+   * \param binding A carrier-grade translation
+   * \returns The translation as a dynamic translation tuple, for the traces
+   */
+  Ipv4DynamicNatTuple GetCarrierGradeTuple (const Ipv4NatBindingTable::Binding &binding) const;
+
+  void ExpireCarrierGradeBinding (const Ipv4NatBindingTable::Binding &binding);
+
+  /**
+   * \brief Remove the expired carrier-grade translations of the next shards
+   */
+  void SweepCarrierGradeTable (void);
+
+  /**
+   * \param protocol Protocol of a translation
+   * \param closing true if the TCP connection has seen a FIN or RST
+   * \returns Idle time after which the translation is removed
+   */
+  Time GetIdleTimeout (uint8_t protocol, bool closing) const;
+
+  /**
+   * \param first Set to the first address of the address pool
+   * \param count Set to the number of addresses of the address pool
+   */
+  void GetAddressPoolRange (Ipv4Address &first, uint32_t &count) const;
+
+  void SetInterfaceRole (int32_t interfaceIndex, InterfaceRole role);
   /**
   *\return The Global Pool Ip address
   */
@@ -383,26 +788,143 @@ private:
   uint16_t GetEndPort () const;
 
   /**
-  *\return The current port value for the dynamic nat translation
-  */
-  uint16_t GetCurrentPort () const;
+   * \param address The source address of a new outbound flow
+   * \returns true if a dynamic rule covers the address
+   */
+  bool MatchDynamicRule (Ipv4Address address) const;
 
   /**
-  *\return The a new port to translate to from the port pool
-  */
-  uint16_t GetNewOutsidePort ();
+   * \param local The inside address of the flow
+   * \param localPort The inside port of the flow
+   * \param protocol The protocol of the flow
+   * \returns iterator to the new translation, or m_dynatuple.end () if the
+   * port pool is exhausted
+   *
+   * Allocates a global address and port and records the translation in the
+   * list and in both lookup indices.
+   */
+  DynamicNatTuple::iterator AddDynamicTuple (Ipv4Address local, uint16_t localPort, uint8_t protocol,
+                                              Ipv4Address remote, uint16_t remotePort);
+
+  /**
+   * \param local The inside address of the flow
+   * \param localPort The inside port of the flow
+   * \param protocol The protocol of the flow
+   * \param remote The remote address of the flow
+   * \param remotePort The remote port of the flow, 0 for ICMP
+   * \returns Key of the flow in the inside index, with the parts of the
+   * remote endpoint the mapping behavior ignores left out
+   */
+  Ipv4NatFlowKey GetMappingKey (Ipv4Address local, uint16_t localPort, uint8_t protocol,
+                                Ipv4Address remote, uint16_t remotePort) const;
+
+  /**
+   * \param tuple The translation an outbound packet has just used
+   * \param remote The destination address of the packet
+   * \param remotePort The destination port of the packet, 0 for ICMP
+   *
+   * Lets the destination of the packet send in through the translation,
+   * as far as the filtering behavior requires.
+   */
+  void PermitInbound (DynamicNatTuple::iterator tuple, Ipv4Address remote, uint16_t remotePort);
+
+  /**
+   * \param tuple The translation a packet has just used
+   * \param closing true if the packet carries a TCP FIN or RST
+   *
+   * Pushes back the expiry deadline of the translation.
+   */
+  void RefreshDynamicTuple (DynamicNatTuple::iterator tuple, bool closing);
+
+  /**
+   * \param key Inside key of the translation handed back by the timer wheel
+   *
+   * Removes the translation if it has been idle past its deadline,
+   * otherwise schedules it again.
+   */
+  void ExpireDynamicTuple (Ipv4NatFlowKey key);
+
+  /**
+   * \param index The global or the local static rule index
+   * \param address Destination address (global index) or source address
+   * (local index) of the packet
+   * \param port Destination or source port of the packet, 0 if it has none
+   * \param protocol Protocol of the packet
+   * \returns The matching static rule, or 0
+   *
+   * Rebuilds the indices first if the rules changed since the last lookup.
+   */
+  const Ipv4StaticNatRule* FindStaticRule (const StaticNatIndex& index, Ipv4Address address,
+                                           uint16_t port, uint8_t protocol);
+
+  /**
+   * \brief Rebuild both static rule indices from m_statictable
+   */
+  void RebuildStaticIndex (void);
+
+  /**
+   * \param p The packet
+   * \param ctx Headers of the packet
+   * \param inbound true if the packet arrived on the outside interface
+   * \returns true if the packet is an ICMP error
+   *
+   * An ICMP error quotes the packet it reports on. An error coming in is
+   * about a packet that went out and had its source translated, one going
+   * out is about a packet that came in and had its destination
+   * translated; the quoted endpoint is translated back, along with the
+   * outer address when the error comes from that endpoint.
+   */
+  bool TranslateIcmpError (const Ptr<Packet>& p, NetfilterPacketContext& ctx, bool inbound);
+
+  void SetExpiryGranularity (Time granularity);
+  Time GetExpiryGranularity (void) const;
+  void SetPortBlockSize (uint16_t size);
+  uint16_t GetPortBlockSize (void) const;
+  void SetMaxPortBlocks (uint32_t blocks);
+  uint32_t GetMaxPortBlocks (void) const;
+  void SetCarrierGradeShardSize (uint32_t subscribers);
+  uint32_t GetCarrierGradeShardSize (void) const;
 
   StaticNatRules m_statictable;
+  StaticNatIndex m_staticGlobalIndex;  //!< (global ip, global port, proto) to rule
+  StaticNatIndex m_staticLocalIndex;   //!< (local ip, local port, proto) to rule
+  bool m_staticIndexDirty;
   DynamicNatRules m_dynamictable;
   DynamicNatTuple m_dynatuple;
-  int32_t m_insideInterface;
-  int32_t m_outsideInterface;
+  DynamicNatIndex m_insideIndex;   //!< (inside ip, inside port, proto) to translation
+  DynamicNatIndex m_outsideIndex;  //!< (outside ip, outside port, proto) to translation
+  DynamicNatIndex m_permissions;   //!< (outside ip, outside port, proto, remote ip[, remote port]) to translation
+  Behavior m_mapping;
+  Behavior m_filtering;
+  std::vector<uint8_t> m_interfaceRoles;    //!< InterfaceRole by interface index
+  std::vector<int32_t> m_deviceInterfaces;  //!< interface index by device index, -1 if not looked up
+  bool m_hairpinning;
   Ipv4Address m_globalip;
   Ipv4Mask m_globalmask;
   uint16_t m_startport;
   uint16_t m_endport;
-  uint16_t m_currentPort;
-
+  Ipv4NatPortAllocator m_ports;
+  Ptr<Ipv4NatL4Protocol> m_l4Protocols[256];  //!< handlers by protocol number
+  Ptr<Icmpv4NatL4Protocol> m_icmp;
+  Ipv4NatBindingTable m_cgn;  //!< carrier-grade translations
+  EventId m_cgnSweep;
+  uint32_t m_cgnSweepShards;  //!< shards visited per sweep
+
+  NetfilterTimerWheel<Ipv4NatFlowKey> m_bindingTimers;
+  Time m_tcpEstablishedTimeout;
+  Time m_tcpClosingTimeout;
+  Time m_udpTimeout;
+  Time m_icmpTimeout;
+  TracedCallback<const Ipv4DynamicNatTuple &> m_evictionTrace;
+  TracedCallback<const Ipv4DynamicNatTuple &> m_newBindingTrace;
+  TracedCallback<Ipv4Address, uint16_t, uint8_t> m_exhaustionTrace;
+
+  uint64_t m_nLookups;
+  uint64_t m_nHits;
+  uint64_t m_nNewBindings;
+  uint64_t m_nEvictions;
+  uint64_t m_nFiltered;
+  uint64_t m_nCgnFailures;
 };
 
 }
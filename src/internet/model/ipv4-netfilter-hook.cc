@@ -81,13 +81,14 @@ Ipv4NetfilterHook::GetHookNumber () const
 }
 
 int32_t
-Ipv4NetfilterHook::HookCallback (Hooks_t hookNumber, Ptr<Packet> p, Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback ccb)
+Ipv4NetfilterHook::HookCallback (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                                 const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
 {
   if (m_hook.IsNull ())
     {
       std::cout << "********* OOOPS! ***********" << std::endl;
     }
-  return m_hook (hookNumber, p, in, out, ccb);
+  return m_hook (hookNumber, p, in, out, ccb, ctx);
 }
 
 void
@@ -32,6 +32,7 @@ namespace ns3 {
 
 class Packet;
 class NetDevice;
+class NetfilterPacketContext;
 
 typedef enum
 {
@@ -54,7 +55,7 @@ typedef enum
 } Verdicts_t;
 
 typedef Callback<uint32_t, Ptr<Packet> > ContinueCallback;
-typedef Callback<uint32_t, Hooks_t, Ptr<Packet>, Ptr<NetDevice>, Ptr<NetDevice>, ContinueCallback&> NetfilterHookCallback;
+typedef Callback<uint32_t, Hooks_t, const Ptr<Packet>&, const Ptr<NetDevice>&, const Ptr<NetDevice>&, ContinueCallback&, NetfilterPacketContext&> NetfilterHookCallback;
 
 /**
   * \brief Implementation of the Hook datastructure
@@ -76,7 +77,7 @@ public:
   bool operator== (const Ipv4NetfilterHook& hook) const;
   int32_t GetPriority () const;
   int32_t GetHookNumber () const;
-  int32_t HookCallback (Hooks_t, Ptr<Packet>, Ptr<NetDevice>, Ptr<NetDevice>, ContinueCallback);
+  int32_t HookCallback (Hooks_t, const Ptr<Packet>&, const Ptr<NetDevice>&, const Ptr<NetDevice>&, ContinueCallback&, NetfilterPacketContext&);
   void Print (std::ostream &os) const;
 
 private:
@@ -19,6 +19,9 @@
  */
 #include "ns3/log.h"
 #include "ns3/uinteger.h"
+#include "ns3/boolean.h"
+#include "ns3/simulator.h"
+#include "ns3/trace-source-accessor.h"
 #include "ipv4-netfilter.h"
 
 #include "ip-conntrack-info.h"
@@ -31,6 +34,11 @@
 #include "udp-header.h"
 #include "ns3/node.h"
 #include "ns3/net-device.h"
+#include "ns3/output-stream-wrapper.h"
+#include "netfilter-snapshot.h"
+
+#include <iomanip>
+#include <time.h>
 
 NS_LOG_COMPONENT_DEFINE ("Ipv4Netfilter");
 
@@ -43,21 +51,112 @@ Ipv4Netfilter::GetTypeId (void)
 {
   static TypeId tId = TypeId ("ns3::Ipv4Netfilter")
     .SetParent<Object> ()
-#ifdef NOTYET
-    .AddAttribute ("EnableNat", "0 disbales NAT and is the default, 1 enabled NAT",
+    .AddAttribute ("ConntrackTableSize",
+                   "Number of connections the conntrack tables hold before they have to grow.",
+                   UintegerValue (1024),
+                   MakeUintegerAccessor (&Ipv4Netfilter::SetConntrackTableSize,
+                                         &Ipv4Netfilter::GetConntrackTableSize),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("TcpEstablishedTimeout",
+                   "Idle time after which an established TCP connection is evicted.",
+                   TimeValue (Seconds (7440)),
+                   MakeTimeAccessor (&Ipv4Netfilter::m_tcpEstablishedTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("TcpClosingTimeout",
+                   "Idle time after which a TCP connection that has seen a FIN or RST is evicted.",
+                   TimeValue (Seconds (240)),
+                   MakeTimeAccessor (&Ipv4Netfilter::m_tcpClosingTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("UdpTimeout",
+                   "Idle time after which a UDP flow is evicted.",
+                   TimeValue (Seconds (300)),
+                   MakeTimeAccessor (&Ipv4Netfilter::m_udpTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("IcmpTimeout",
+                   "Idle time after which an ICMP flow is evicted.",
+                   TimeValue (Seconds (60)),
+                   MakeTimeAccessor (&Ipv4Netfilter::m_icmpTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("ExpiryGranularity",
+                   "Resolution of the timer wheel that expires idle connections.",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&Ipv4Netfilter::SetExpiryGranularity,
+                                     &Ipv4Netfilter::GetExpiryGranularity),
+                   MakeTimeChecker ())
+    .AddAttribute ("FragmentCacheSize",
+                   "Number of fragmented datagrams whose ports are kept to classify their trailing fragments.",
+                   UintegerValue (1024),
+                   MakeUintegerAccessor (&Ipv4Netfilter::SetFragmentCacheSize,
+                                         &Ipv4Netfilter::GetFragmentCacheSize),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("FragmentTimeout",
+                   "Time after the first fragment of a datagram for which its trailing fragments are classified by its ports.",
+                   TimeValue (Seconds (30)),
+                   MakeTimeAccessor (&Ipv4Netfilter::SetFragmentTimeout,
+                                     &Ipv4Netfilter::GetFragmentTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("HookTiming",
+                   "Measure the wall clock time the hook callback chains take per packet.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&Ipv4Netfilter::SetHookTiming,
+                                        &Ipv4Netfilter::GetHookTiming),
+                   MakeBooleanChecker ())
+    .AddAttribute ("ConntrackLookups",
+                   "Number of packets looked up in the table of confirmed connections.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&Ipv4Netfilter::GetNConntrackLookups),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("ConntrackHits",
+                   "Number of lookups that found a confirmed connection.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&Ipv4Netfilter::GetNConntrackHits),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("ConntrackMisses",
+                   "Number of lookups that found no confirmed connection.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&Ipv4Netfilter::GetNConntrackMisses),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("NewConnections",
+                   "Number of connections created.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&Ipv4Netfilter::GetNNewConnections),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("ConntrackEvictions",
+                   "Number of idle connections evicted.",
+                   TypeId::ATTR_GET,
                    UintegerValue (0),
-                   MakeUintegerAccessor (&Ipv4Netfilter::m_enableNat),
-                   MakeUintegerChecker <uint8_t> ())
-#endif
+                   MakeUintegerAccessor (&Ipv4Netfilter::GetNConntrackEvictions),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("HookDrops",
+                   "Number of packets the hook callback chains dropped.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&Ipv4Netfilter::GetNHookDrops),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddTraceSource ("ConntrackEviction",
+                     "An idle connection has been removed from the conntrack tables.",
+                     MakeTraceSourceAccessor (&Ipv4Netfilter::m_evictionTrace))
+    .AddTraceSource ("NewConnection",
+                     "A connection has been added to the unconfirmed conntrack table.",
+                     MakeTraceSourceAccessor (&Ipv4Netfilter::m_newConnectionTrace))
+    .AddTraceSource ("HookDrop",
+                     "A hook callback chain has dropped a packet; the hook and the NF_DROP verdict are passed along.",
+                     MakeTraceSourceAccessor (&Ipv4Netfilter::m_hookDropTrace))
   ;
 
   return tId;
 }
 
 Ipv4Netfilter::Ipv4Netfilter ()
- // : m_enableNat (0)
+  : m_conntrackTableSize (0),
+    m_hookTiming (false)
 {
   NS_LOG_FUNCTION_NOARGS ();
+  ResetStatistics ();
 
   /* Create callback chains for all of the hooks */
   for (int i = 0; i < NF_INET_NUMHOOKS; i++)
@@ -82,6 +181,8 @@ Ipv4Netfilter::Ipv4Netfilter ()
   this->RegisterL4Protocol (icmpv4);
 
   //Ptr <NetworkAddressTranslation> networkAddressTranslation = Create<NetworkAddressTranslation> (this);
+
+  m_conntrackTimers.SetExpireCallback (MakeCallback (&Ipv4Netfilter::ExpireConntrack, this));
   // Create and register hook callbacks for conntrack
   NetfilterHookCallback preRouting = MakeCallback (&Ipv4Netfilter::NetfilterConntrackIn, this);
   NetfilterHookCallback localIn = MakeCallback (&Ipv4ConntrackL3Protocol::Ipv4Confirm, PeekPointer (ipv4));
@@ -96,14 +197,6 @@ Ipv4Netfilter::Ipv4Netfilter ()
   this->RegisterHook (nfh1);
   this->RegisterHook (nfh2);
   this->RegisterHook (nfh3);
-
-/*  if (m_enableNat)
-    {
-      EnableNat ();
-    }
-
-  nextAvailablePort = 1024;
-*/
   }
 
 void
@@ -118,11 +211,46 @@ Ipv4Netfilter::DeregisterHook (const Ipv4NetfilterHook& hook)
   m_netfilterHooks[hook.GetHookNumber ()].Remove (hook);
 }
 
+/* Monotonic wall clock, for the hook timings */
+static uint64_t
+GetWallClockNanoSeconds (void)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
 uint32_t
-Ipv4Netfilter::ProcessHook (uint8_t protocolFamily, Hooks_t hookNumber, Ptr<Packet> p,Ptr<NetDevice> in, Ptr<NetDevice> out,ContinueCallback ccb)
+Ipv4Netfilter::ProcessHook (uint8_t protocolFamily, Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                            const Ptr<NetDevice>& out)
 {
-  return m_netfilterHooks[(uint32_t)hookNumber].IterateAndCallHook (hookNumber, p, in, out, ccb);
-  //return 1;
+  ContinueCallback ccb;
+  return ProcessHook (protocolFamily, hookNumber, p, in, out, ccb);
+}
+
+uint32_t
+Ipv4Netfilter::ProcessHook (uint8_t protocolFamily, Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                            const Ptr<NetDevice>& out, ContinueCallback& ccb)
+{
+  uint32_t verdict;
+  if (!m_hookTiming)
+    {
+      verdict = m_netfilterHooks[(uint32_t)hookNumber].IterateAndCallHook (hookNumber, p, in, out, ccb, &m_fragments);
+    }
+  else
+    {
+      uint64_t start = GetWallClockNanoSeconds ();
+      verdict = m_netfilterHooks[(uint32_t)hookNumber].IterateAndCallHook (hookNumber, p, in, out, ccb, &m_fragments);
+      m_hookNanoSeconds[hookNumber] += GetWallClockNanoSeconds () - start;
+      m_hookPackets[hookNumber]++;
+    }
+  // stolen and queued packets are still alive, only count the drops
+  if (verdict == NF_DROP)
+    {
+      m_hookDrops[hookNumber]++;
+      m_hookDropTrace (p, hookNumber, verdict);
+    }
+  return verdict;
 }
 
 uint32_t
@@ -175,45 +303,63 @@ Ipv4Netfilter::FindL4ProtocolHelper (uint8_t protocol)
 }
 
 int
-Ipv4Netfilter::UpdateConntrackInfo (uint8_t info)
+Ipv4Netfilter::UpdateConntrackInfo (NetfilterPacketContext& ctx, uint8_t info)
 {
-  m_hash[currentOriginalTuple].SetInfo (info);
-  m_hash[currentReplyTuple].SetInfo (info);
+  NetfilterConntrackTuple tuple;
+  if (!ctx.GetConntrackTuple (tuple))
+    {
+      return -1;
+    }
+  NetfilterConntrackTable::Entry *entry = m_hash.Find (tuple);
+  if (entry == 0)
+    {
+      entry = m_unconfirmed.Find (tuple);
+      if (entry == 0)
+        {
+          return -1;
+        }
+    }
+  NetfilterConntrackTuple reply;
+  Ptr<NetfilterConntrackL4Protocol> l4proto = FindL4ProtocolHelper (entry->tuple.GetDestinationProtocol ());
+  if (l4proto == 0 || !InvertTuple (reply, entry->tuple, FindL3ProtocolHelper (1), l4proto))
+    {
+      return -1;
+    }
+  entry->info.SetInfo (info);
+  NetfilterConntrackTable::Entry *replyEntry = m_hash.Find (reply);
+  if (replyEntry != 0)
+    {
+      replyEntry->info.SetInfo (info);
+    }
   return 0;
 }
 
 bool
-Ipv4Netfilter::NetfilterConntrackGetTuple (Ptr<Packet> packet, uint16_t l3Number, uint8_t protocolNumber,
+Ipv4Netfilter::NetfilterConntrackGetTuple (NetfilterPacketContext& ctx, uint16_t l3Number, uint8_t protocolNumber,
                                            NetfilterConntrackTuple& tuple, Ptr<NetfilterConntrackL3Protocol> l3Protocol,
                                            Ptr<NetfilterConntrackL4Protocol> l4Protocol)
 {
   tuple.SetProtocol (l3Number);
+  tuple.SetDestinationProtocol (protocolNumber);
 
-  if (l3Protocol->PacketToTuple (packet, tuple) == false)
+  if (l3Protocol->PacketToTuple (ctx, tuple) == false)
     {
       return false;
     }
 
   //TODO: Do we really need the Protocol Family as well?
   //tuple->Set
-  Ipv4Header ipHeader;
-  NS_LOG_DEBUG (" :: Remove Ipv4 Header :: ");
-  packet->RemoveHeader (ipHeader);
-
   tuple.SetDirection (IP_CT_DIR_ORIGINAL);
 
-  if (l4Protocol->PacketToTuple (packet, tuple) == false)
+  if (l4Protocol->PacketToTuple (ctx, tuple) == false)
     {
       return false;
     }
 
-  NS_LOG_DEBUG (" :: Add Ipv4 Header :: ");
-  packet->AddHeader (ipHeader);
-
   return true;
 }
 
-TupleHashI
+NetfilterConntrackTable::Entry*
 Ipv4Netfilter::NewConnection (NetfilterConntrackTuple& tuple, Ptr<NetfilterConntrackL3Protocol> l3proto,
                               Ptr<NetfilterConntrackL4Protocol> l4proto, Ptr<Packet> packet)
 {
@@ -223,46 +369,65 @@ Ipv4Netfilter::NewConnection (NetfilterConntrackTuple& tuple, Ptr<NetfilterConnt
 
   if (!InvertTuple (replyTuple, tuple, l3proto, l4proto))
     {
-      return m_hash.end ();
+      return 0;
     }
 
   // Invoke l4proto->New
 
   // Find expectatons here
 
-  NS_LOG_DEBUG (":: Creating an unconfirmed entry for this tuple ::");
-  m_unconfirmed[tuple] = IpConntrackInfo ();
-
-  TupleHashI it = m_unconfirmed.find (tuple);
-
-  return it;
+  NetfilterConntrackTable::Entry *entry = m_unconfirmed.Find (tuple);
+  if (entry == 0)
+    {
+      NS_LOG_DEBUG (":: Creating an unconfirmed entry for this tuple ::");
+      entry = m_unconfirmed.Insert (tuple, IpConntrackInfo ());
+      entry->info.SetExpires (Simulator::Now () + GetConntrackTimeout (tuple.GetDestinationProtocol (), false));
+      m_conntrackTimers.Schedule (tuple, entry->info.GetExpires ());
+      m_nNewConnections++;
+      m_newConnectionTrace (tuple);
+    }
+  return entry;
 }
 
 uint32_t
-Ipv4Netfilter::ResolveNormalConntrack (Ptr<Packet> packet, uint32_t protocolFamily, uint8_t protocol,
+Ipv4Netfilter::ResolveNormalConntrack (NetfilterPacketContext& ctx, uint32_t protocolFamily, uint8_t protocol,
                                        Ptr<NetfilterConntrackL3Protocol> l3Protocol, Ptr<NetfilterConntrackL4Protocol> l4Protocol,
-                                       int& setReply, ConntrackInfo_t& ctInfo, Ipv4Header ipHeader)
+                                       int& setReply, ConntrackInfo_t& ctInfo)
 {
-  NS_LOG_FUNCTION (this << packet);
+  NS_LOG_FUNCTION (this << ctx.GetPacket ());
   //NetfilterConntrackTuple tuple (ipHeader.GetSource(), 0, ipHeader.GetDestination(), 0);
   NetfilterConntrackTuple tuple;
   uint8_t conntrackInfo = 0;
 
   /* Get a tuple from the information in the packet */
-  if (!NetfilterConntrackGetTuple (packet, protocolFamily, protocol, tuple, l3Protocol, l4Protocol))
+  if (!NetfilterConntrackGetTuple (ctx, protocolFamily, protocol, tuple, l3Protocol, l4Protocol))
     {
       NS_LOG_DEBUG ("Cannot create a tuple from the packet");
       return -1;
     }
 
-  TupleHashI it = m_hash.find (tuple);
+  /* Both directions of the connection in both tables, looked up once
+   * here and reused for the rest of the packet */
+  IpConntrackInfo *infos[4] = { 0, 0, 0, 0 };
+  NetfilterConntrackTable::Entry *entry = m_hash.Find (tuple);
+  NetfilterConntrackTable::Entry *unconfirmed = 0;
+  m_nConntrackLookups++;
 
-  if (it == m_hash.end ())
+  if (entry == 0)
     {
       NS_LOG_DEBUG ("No tuple found");
-      //TupleHashI newIt = NewConnection(tuple, l3Protocol, l4Protocol, packet);
-      it = NewConnection (tuple, l3Protocol, l4Protocol, packet);
+      unconfirmed = NewConnection (tuple, l3Protocol, l4Protocol, ctx.GetPacket ());
+      if (unconfirmed == 0)
+        {
+          return -1;
+        }
+    }
+  else
+    {
+      infos[0] = &entry->info;
+      m_nConntrackHits++;
     }
+  ctx.SetConntrackTuple (tuple);
 
   NetfilterConntrackTuple replyTuple;
 
@@ -271,15 +436,7 @@ Ipv4Netfilter::ResolveNormalConntrack (Ptr<Packet> packet, uint32_t protocolFami
       return -1;
     }
 
-  currentOriginalTuple = tuple;
-  currentReplyTuple = replyTuple;
-
-  /* TODO: Add a pointer to the hashed tuple in IpConntrackInfo()
-   * and store these tuples somehwere, when you destruct then you
-   * you have to take care of the tuples stored in the vector as
-   * well
-   */
-  if ((it->first).GetDirection () == (uint8_t)IP_CT_DIR_REPLY)
+  if (entry != 0 && entry->tuple.GetDirection () == (uint8_t)IP_CT_DIR_REPLY)
     {
       NS_LOG_DEBUG (":: **** This is a REPLY *** ::");
       conntrackInfo = IP_CT_ESTABLISHED + IP_CT_IS_REPLY;
@@ -288,7 +445,7 @@ Ipv4Netfilter::ResolveNormalConntrack (Ptr<Packet> packet, uint32_t protocolFami
   else
     {
       NS_LOG_DEBUG (":: Packet is in the original direction ::");
-      if ( m_hash[tuple].GetStatus () & IPS_SEEN_REPLY)
+      if (entry != 0 && (entry->info.GetStatus () & IPS_SEEN_REPLY))
         {
           NS_LOG_DEBUG (":: Connection ESTABLISHED! ::");
           conntrackInfo = IP_CT_ESTABLISHED;
@@ -300,26 +457,55 @@ Ipv4Netfilter::ResolveNormalConntrack (Ptr<Packet> packet, uint32_t protocolFami
         }
 
     }
+  ctInfo = (ConntrackInfo_t)conntrackInfo;
 
-  m_unconfirmed[tuple].SetInfo (conntrackInfo);
-  //UpdateConntrackInfo (conntrackInfo);
-  /*NS_LOG_DEBUG ("Adding the conntrack packet tag" );
-  ConntrackTag ctTag;
-  bool tagFound = packet->PeekPacketTag (ctTag);
+  if (unconfirmed == 0)
+    {
+      /* A packet in the reply direction has no unconfirmed entry of its
+       * own; leave the slot empty rather than create one */
+      unconfirmed = m_unconfirmed.Find (tuple);
+    }
+  if (unconfirmed != 0)
+    {
+      infos[2] = &unconfirmed->info;
+      infos[2]->SetInfo (conntrackInfo);
+    }
+  NetfilterConntrackTable::Entry *replyEntry = m_hash.Find (replyTuple);
+  if (replyEntry != 0)
+    {
+      infos[1] = &replyEntry->info;
+    }
+  replyEntry = m_unconfirmed.Find (replyTuple);
+  if (replyEntry != 0)
+    {
+      infos[3] = &replyEntry->info;
+    }
 
-  if (!tagFound)
-    packet->AddPacketTag (ConntrackTag (conntrackInfo));
-  else
-    NS_LOG_DEBUG ("Tag already present");
-    */
+  if (setReply)
+    {
+      NS_LOG_DEBUG ("Setting IPS_SEEN_REPLY");
+      infos[0]->SetStatus (IPS_SEEN_REPLY);
+      if (infos[1] != 0)
+        {
+          infos[1]->SetStatus (IPS_SEEN_REPLY);
+        }
+    }
+  RefreshConntrack (ctx, infos);
+
+  /* Confirmation happens in another hook chain, hand the tuple over with
+   * the packet */
+  Ptr<Packet> packet = ctx.GetPacket ();
+  ConntrackTag ctTag;
+  packet->RemovePacketTag (ctTag);
+  packet->AddPacketTag (ConntrackTag (tuple, conntrackInfo));
 
   return NF_ACCEPT;
 
 }
 
 uint32_t
-Ipv4Netfilter::NetfilterConntrackIn (Hooks_t hook, Ptr<Packet> packet, Ptr<NetDevice> in,
-                                     Ptr<NetDevice> out, ContinueCallback& ccb)
+Ipv4Netfilter::NetfilterConntrackIn (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                                     const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
 {
   NS_LOG_DEBUG ("::: Executing Hook Function :::");
   int setReply = 0;
@@ -329,9 +515,7 @@ Ipv4Netfilter::NetfilterConntrackIn (Hooks_t hook, Ptr<Packet> packet, Ptr<NetDe
   /* Find layer 3 helper for this packet */
   Ptr<NetfilterConntrackL3Protocol> l3proto = FindL3ProtocolHelper (1);
 
-  Ipv4Header ipHeader;
-
-  packet->PeekHeader (ipHeader);
+  const Ipv4Header &ipHeader = ctx.GetIpv4Header ();
 
   NS_LOG_DEBUG ( "IP header protocol: " << (int)ipHeader.GetProtocol ());
 
@@ -346,104 +530,53 @@ Ipv4Netfilter::NetfilterConntrackIn (Hooks_t hook, Ptr<Packet> packet, Ptr<NetDe
       return NF_ACCEPT;
     }
 
-  ResolveNormalConntrack (packet, 1 /* PF */, ipHeader.GetProtocol (), l3proto, l4proto, setReply, ctInfo, ipHeader);
+  if (ResolveNormalConntrack (ctx, 1 /* PF */, ipHeader.GetProtocol (), l3proto, l4proto, setReply, ctInfo) != NF_ACCEPT)
+    {
+      return NF_ACCEPT;
+    }
 
   // Call layer 4 Packet callback
   //uint32_t ret = l4proto->packet(packet, protocolFamily, hook);
 
-  if (setReply)
-    {
-      NS_LOG_DEBUG ("Setting IPS_SEEN_REPLY");
-      m_hash[currentOriginalTuple].SetStatus ( IPS_SEEN_REPLY );
-      m_hash[currentReplyTuple].SetStatus ( IPS_SEEN_REPLY );
-    }
-
   return NF_ACCEPT;
 
 }
 
 uint32_t
 Ipv4Netfilter::NetfilterConntrackConfirm (Ptr<Packet> packet)
-//, NetfilterConntrackTuple& orig,
-//          NetfilterConntrackTuple& reply)
 {
   NS_LOG_FUNCTION ( this << packet );
-  /* If this packet has been seen previously, Ignore. */
-
-  /* Find layer 3 helper for this packet */
-  /*Ptr<NetfilterConntrackL3Protocol> l3proto = FindL3ProtocolHelper (1);
-
-    Ipv4Header ipHeader;
-
-  //packet->RemoveHeader(ipHeader);
-  packet->PeekHeader (ipHeader);
-
-  NS_LOG_DEBUG ( "IP header protocol: " << (int)ipHeader.GetProtocol ());
-
-  Ptr<NetfilterConntrackL4Protocol> l4proto = FindL4ProtocolHelper (ipHeader.GetProtocol ());
-
-  NetfilterConntrackTuple orig;*/
-
-  /* Get a tuple from the information in the packet */
-  /*if (!NetfilterConntrackGetTuple (packet, 1, ipHeader.GetProtocol (), orig, l3proto, l4proto))
+  ConntrackTag ctTag;
+  if (!packet->RemovePacketTag (ctTag))
     {
-    NS_LOG_DEBUG ("Cannot create a tuple from the packet");
-    return -1;
+      NS_LOG_DEBUG ("Packet is not tracked");
+      return NF_ACCEPT;
     }
 
-    NetfilterConntrackTuple reply;
-
-
-    InvertTuple (reply, orig, l3proto, l4proto);
-
-    currentOriginalTuple = orig;
-    currentReplyTuple = reply;
-
-    NS_LOG_DEBUG ("Current Original Tuple: " << currentOriginalTuple.GetSource () << ", " << currentOriginalTuple.GetDestination ());
-    NS_LOG_DEBUG ("Current Reply Tuple: " << currentReplyTuple.GetSource () << ", " << currentReplyTuple.GetDestination ());
-  //currentTuple[IP_CT_DIR_REPLY] = reply;*/
-
-  /**************************/
-
-  /*ConntrackTag ctTag;
-
-    if (!packet->PeekPacketTag (ctTag))
+  if ( CTINFO2DIR (ctTag.GetConntrack ()) != IP_CT_DIR_ORIGINAL)
     {
-    NS_LOG_DEBUG ("ConntrackTag not found");
-    return 0;
+      NS_LOG_DEBUG ("Not a packet in the original direction");
+      return NF_ACCEPT;
     }
-    else {
-    if ( CTINFO2DIR (ctTag.GetConntrack ()) != IP_CT_DIR_ORIGINAL)
-    return 0;
 
-    if (m_hash.find (orig) != m_hash.end () && m_hash.find (reply) != m_hash.end () )
+  NetfilterConntrackTuple tuple = ctTag.GetTuple ();
+  NetfilterConntrackTuple reply;
+  Ptr<NetfilterConntrackL4Protocol> l4proto = FindL4ProtocolHelper (tuple.GetDestinationProtocol ());
+  if (l4proto == 0 || !InvertTuple (reply, tuple, FindL3ProtocolHelper (1), l4proto))
     {
-    NS_LOG_DEBUG ("Entries already present!");
-    return NF_DROP;
+      return NF_ACCEPT;
     }
 
-    NS_LOG_DEBUG ("Creating confirmed hash entries");
-  //m_hash[orig] = IpConntrackInfo().SetStatus(IPS_CONFIRMED);
-  m_hash[orig] = IpConntrackInfo ();
-  m_hash[reply] = IpConntrackInfo ();
-
-  }*/
-
-  if ( CTINFO2DIR (m_unconfirmed[currentOriginalTuple].GetInfo ()) != IP_CT_DIR_ORIGINAL)
+  NetfilterConntrackTable::Entry *entry = m_unconfirmed.Find (tuple);
+  if (entry == 0)
     {
-      NS_LOG_DEBUG ("Not a packet in the original direction");
+      NS_LOG_DEBUG ("Connection evicted before it was confirmed");
       return NF_ACCEPT;
     }
-
-  /*if (m_hash.find (currentOriginalTuple) != m_hash.end () && m_hash.find (currentReplyTuple) != m_hash.end () )
-  {
-    NS_LOG_DEBUG ("Entries already present!");
-    return NF_DROP;
-  }*/
-
   NS_LOG_DEBUG ("Creating confirmed hash entries");
-  m_hash[currentOriginalTuple] = m_unconfirmed[currentOriginalTuple];
-  m_hash[currentReplyTuple] = m_unconfirmed[currentOriginalTuple];
+  IpConntrackInfo info = entry->info;
+  m_hash[tuple] = info;
+  m_hash[reply] = info;
 
   return 0;
 }
@@ -454,6 +587,7 @@ Ipv4Netfilter::InvertTuple (NetfilterConntrackTuple& inverse, NetfilterConntrack
                             Ptr<NetfilterConntrackL4Protocol> l4Protocol)
 {
   inverse.SetProtocol (orig.GetProtocol ());
+  inverse.SetDestinationProtocol (orig.GetDestinationProtocol ());
 
   if (!l3Protocol->InvertTuple (inverse, orig))
     {
@@ -466,298 +600,412 @@ Ipv4Netfilter::InvertTuple (NetfilterConntrackTuple& inverse, NetfilterConntrack
 
 }
 
-TupleHash&
+NetfilterConntrackTable&
 Ipv4Netfilter::GetHash ()
 {
   return m_hash;
 }
 
-#ifdef NOTYET
-uint32_t
-Ipv4Netfilter::NetfilterDoNat (Hooks_t hookNumber, Ptr<Packet> p,
-                               Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback& ccb)
-{
-  NS_LOG_FUNCTION ( this << p );
-  /*ConntrackTag ctTag;
-
-  bool found = p->PeekPacketTag (ctTag);
-
-  if (!found)
-  {
-    NS_LOG_DEBUG ("Conntrack tag not found");
-    return NF_ACCEPT;
-  }*/
-
-  /* Conntrack has a higher priority so currentOriginalTuple and
-   * currentReply tuple should always be correct
-   */
-
-  //std::vector<NatRule>::iterator it = FindNatDevice (out);
-
-  /*if (it == m_natRules.end ())
-  {
-    NS_LOG_DEBUG ("No NAT rule for device " << out->GetId ());
-    return NF_ACCEPT;
-  }*/
-
-  NS_LOG_DEBUG ("Current Original Tuple: " << currentOriginalTuple.GetSource () << ", " << currentOriginalTuple.GetDestination ());
-  NS_LOG_DEBUG ("Current Reply Tuple: " << currentReplyTuple.GetSource () << ", " << currentReplyTuple.GetDestination ());
-
-  NS_LOG_DEBUG ("ConntrackInfo: " << (uint16_t)m_unconfirmed[currentOriginalTuple].GetInfo () );
-
-  /* TODO: Why are you checking m_hash here when the info is in
-   * m_unconfirmed. This could be a problem because NAT is sandwiched
-   * between conntrack hook callbacks
-   */
-  switch (m_unconfirmed[currentOriginalTuple].GetInfo ())
-    {
-    case IP_CT_RELATED:
-    case IP_CT_RELATED + IP_CT_IS_REPLY:
-      /* This should be updated when "expectations" are added */
-      break;
-
-    case IP_CT_NEW:
-
-      if ( hookNumber == NF_INET_POST_ROUTING )
-        {
-          NS_LOG_DEBUG ("SRC_NAT: New Connection encountered");
-
-          TupleHashI it;
-
-
-          if ( (it = m_hash.find (currentOriginalTuple)) != m_hash.end ())
-            {
-              if ( !((it->second).GetStatus () & IPS_SRC_NAT_DONE) )
-                {
-                  /* Get a unique tuple and create a mapping */
-
-                  NS_LOG_DEBUG ("Doing rule lookup at device " << out->GetIfIndex ());
-                  std::vector<NatRule>::iterator it =
-                    FindNatRule ( Ipv4Address (currentOriginalTuple.GetSource ()), out );
-
-                  if ( it == m_natRules.end () )
-                    {
-                      NS_LOG_DEBUG ("No rule matched!");
-                      return NF_ACCEPT;
-                    }
-
-                  NS_LOG_DEBUG ("Creating a NAT mapping");
-
-                  /* Create a NULL mapping, which does not contain port numbers */
-                  NetfilterConntrackTuple mapping =
-                    NetfilterConntrackTuple (it->GetMangledSource (), nextAvailablePort,
-                                             currentOriginalTuple.GetDestination (), 9);
-                  mapping.SetDirection (IP_CT_DIR_ORIGINAL);
-                  nextAvailablePort++;
-
-                  NS_LOG_DEBUG ("Creating a NAT mapping for the tuple " << currentOriginalTuple
-                                                                        << ": " << mapping );
-                  m_natMappings[currentOriginalTuple] = mapping;
-                  m_natReplyLookup[mapping] = currentOriginalTuple;
-                }
-
-
-              NS_LOG_DEBUG (":: Translating addresses and fixing IP checksum ::");
-              NetfilterNatPacket (hookNumber, p);
-            }
-          else
-            {
-              NS_LOG_DEBUG ("BUG: currentTuple non-existent in hash!");
-            }
-        }
-
-      break;
-
-    default:
-      NS_LOG_DEBUG ("SRC_NAT: Connection is established!");
-      NS_LOG_DEBUG (":: Translating addresses and fixing IP checksum ::");
-      NetfilterNatPacket (hookNumber, p);
-
-    }
-
-
-  return NF_ACCEPT;
-}
-
+/* Record: source, source port, destination, destination port, l3 and l4
+ * protocol, direction, status, info and the idle time left, 33 bytes */
+static const char CONNTRACK_SNAPSHOT_MAGIC[4] = { 'N', 'F', 'C', 'T' };
+static const uint8_t CONNTRACK_SNAPSHOT_VERSION = 1;
 
 void
-Ipv4Netfilter::AddNatRule (NatRule natRule)
+Ipv4Netfilter::SerializeConntrackTable (std::ostream &os)
 {
-  m_natRules.push_back (natRule);
+  NS_LOG_FUNCTION (this << m_hash.GetSize ());
+  NetfilterSnapshotWriter writer (os);
+  writer.WriteHeader (CONNTRACK_SNAPSHOT_MAGIC, CONNTRACK_SNAPSHOT_VERSION, m_hash.GetSize ());
+  for (NetfilterConntrackTable::Iterator i = m_hash.Begin (); i != m_hash.End (); ++i)
+    {
+      NetfilterConntrackTuple &tuple = i->tuple;
+      writer.WriteAddress (tuple.GetSource ());
+      writer.WriteU16 (tuple.GetSourcePort ());
+      writer.WriteAddress (tuple.GetDestination ());
+      writer.WriteU16 (tuple.GetDestinationPort ());
+      writer.WriteU16 (tuple.GetProtocol ());
+      writer.WriteU8 (tuple.GetDestinationProtocol ());
+      writer.WriteU8 (tuple.GetDirection ());
+      writer.WriteU32 (i->info.GetStatus ());
+      writer.WriteU8 (i->info.GetInfo ());
+      writer.WriteDeadline (i->info.GetExpires ());
+    }
 }
 
-std::vector<NatRule>::iterator
-Ipv4Netfilter::FindNatRule (NatRule natRule)
+bool
+Ipv4Netfilter::DeserializeConntrackTable (std::istream &is)
 {
-  std::vector<NatRule>::iterator it = m_natRules.begin ();
+  NS_LOG_FUNCTION (this);
+  NetfilterSnapshotReader reader (is);
+  uint32_t count = reader.ReadHeader (CONNTRACK_SNAPSHOT_MAGIC, CONNTRACK_SNAPSHOT_VERSION);
+  if (!reader.IsOk ())
+    {
+      return false;
+    }
 
-  for (; it != m_natRules.end ();  it++)
+  // grow the table once instead of doubling it while loading
+  m_hash.Reserve (m_hash.GetSize () + count);
+  for (uint32_t n = 0; n < count; n++)
     {
-      if ( *it == natRule )
+      NetfilterConntrackTuple tuple;
+      tuple.SetSource (reader.ReadAddress ());
+      tuple.SetSourcePort (reader.ReadU16 ());
+      tuple.SetDestination (reader.ReadAddress ());
+      tuple.SetDestinationPort (reader.ReadU16 ());
+      tuple.SetProtocol (reader.ReadU16 ());
+      tuple.SetDestinationProtocol (reader.ReadU8 ());
+      tuple.SetDirection ((ConntrackDirection_t)reader.ReadU8 ());
+      IpConntrackInfo info (reader.ReadU32 ());
+      info.SetInfo (reader.ReadU8 ());
+      info.SetExpires (reader.ReadDeadline ());
+      if (!reader.IsOk ())
         {
-          return it;
+          return false;
+        }
+      m_hash.Insert (tuple, info);
+      // the original direction drives the expiry of both
+      if (tuple.GetDirection () == IP_CT_DIR_ORIGINAL)
+        {
+          m_conntrackTimers.Schedule (tuple, info.GetExpires ());
         }
     }
-
-  return m_natRules.end ();
+  NS_LOG_LOGIC ("Loaded " << count << " conntrack entries");
+  return true;
 }
 
-std::vector<NatRule>::iterator
-Ipv4Netfilter::FindNatRule (Ipv4Address orig, Ptr<NetDevice> out)
+void
+Ipv4Netfilter::PrintConntrackTable (Ptr<OutputStreamWrapper> stream)
 {
-  std::vector<NatRule>::iterator it = m_natRules.begin ();
-
-  NS_LOG_DEBUG ("Number of rules: " << m_natRules.size () );
-  NS_LOG_DEBUG ("Orig: " << orig );
-
-  for (; it != m_natRules.end ();  it++)
+  NS_LOG_FUNCTION (this);
+  std::ostream* os = stream->GetStream ();
+  if (m_hash.GetSize () == 0)
     {
-      NS_LOG_DEBUG ("Rule source: " << it->GetOriginalSource () << ", passed in source: " << orig);
-      NS_LOG_DEBUG ("Rule device: " << it->GetDevice () << ", passed in dev: " << out);
-      if ( it->GetOriginalSource () == orig && it->GetDevice () == out)
-        {
-          NS_LOG_DEBUG ("Rule match found!");
-          return it;
-        }
+      return;
     }
-
-  return m_natRules.end ();
+  *os << "       Confirmed Connections" << std::endl;
+  *os << "Source          Src Port  Destination     Dst Port  Proto  Dir     Status    Expires" << std::endl;
+  for (NetfilterConntrackTable::Iterator i = m_hash.Begin (); i != m_hash.End (); ++i)
+    {
+      std::ostringstream src, dst;
+      const NetfilterConntrackTuple &tuple = i->tuple;
+      src << tuple.GetSource ();
+      dst << tuple.GetDestination ();
+      *os << std::setiosflags (std::ios::left) << std::setw (16) << src.str ();
+      *os << std::setiosflags (std::ios::left) << std::setw (10) << tuple.GetSourcePort ();
+      *os << std::setiosflags (std::ios::left) << std::setw (16) << dst.str ();
+      *os << std::setiosflags (std::ios::left) << std::setw (10) << tuple.GetDestinationPort ();
+      *os << std::setiosflags (std::ios::left) << std::setw (7) << tuple.GetDestinationProtocol ();
+      *os << std::setiosflags (std::ios::left) << std::setw (8)
+          << (tuple.GetDirection () == IP_CT_DIR_ORIGINAL ? "orig" : "reply");
+      *os << std::setiosflags (std::ios::left) << std::setw (10) << i->info.GetStatus ();
+      *os << i->info.GetExpires ().GetSeconds () << std::endl;
+    }
+  *os << std::endl;
 }
 
 void
-Ipv4Netfilter::EnableNat ()
+Ipv4Netfilter::SetConntrackTableSize (uint32_t size)
 {
-  m_enableNat = 1;
+  NS_LOG_FUNCTION (this << size);
+  m_conntrackTableSize = size;
+  m_hash.Reserve (size);
+  m_unconfirmed.Reserve (size);
+}
 
-  NS_LOG_DEBUG (":: Enabling NAT ::");
+uint32_t
+Ipv4Netfilter::GetConntrackTableSize (void) const
+{
+  return m_conntrackTableSize;
+}
 
-  NetfilterHookCallback doNat = MakeCallback (&Ipv4Netfilter::NetfilterDoNat, this);
+NetfilterFragmentCache&
+Ipv4Netfilter::GetFragmentCache ()
+{
+  return m_fragments;
+}
 
-  Ipv4NetfilterHook natCallback1 = Ipv4NetfilterHook (1, NF_INET_POST_ROUTING, NF_IP_PRI_NAT_SRC, doNat);
-  Ipv4NetfilterHook natCallback2 = Ipv4NetfilterHook (1, NF_INET_PRE_ROUTING, NF_IP_PRI_NAT_DST, doNat);
+void
+Ipv4Netfilter::SetFragmentCacheSize (uint32_t entries)
+{
+  NS_LOG_FUNCTION (this << entries);
+  m_fragments.SetMaxEntries (entries);
+}
 
+uint32_t
+Ipv4Netfilter::GetFragmentCacheSize (void) const
+{
+  return m_fragments.GetMaxEntries ();
+}
 
-  this->RegisterHook (natCallback1);
-  this->RegisterHook (natCallback2);
+void
+Ipv4Netfilter::SetFragmentTimeout (Time timeout)
+{
+  NS_LOG_FUNCTION (this << timeout);
+  m_fragments.SetTimeout (timeout);
 }
 
-uint32_t
-Ipv4Netfilter::NetfilterNatPacket (Hooks_t hookNumber, Ptr<Packet> p)
+Time
+Ipv4Netfilter::GetFragmentTimeout (void) const
 {
-  NS_LOG_FUNCTION ( this << p );
-  Ipv4Header ipHeader;
-  uint16_t dstPort; //, srcPort;
-  Ipv4Address dstAddress, srcAddress;
+  return m_fragments.GetTimeout ();
+}
 
-  p->RemoveHeader (ipHeader);
+void
+Ipv4Netfilter::SetExpiryGranularity (Time granularity)
+{
+  NS_LOG_FUNCTION (this << granularity);
+  m_conntrackTimers.SetGranularity (granularity);
+}
 
-  uint16_t protocol = ipHeader.GetProtocol ();
+Time
+Ipv4Netfilter::GetExpiryGranularity (void) const
+{
+  return m_conntrackTimers.GetGranularity ();
+}
 
-  if (hookNumber == NF_INET_POST_ROUTING)
+Time
+Ipv4Netfilter::GetConntrackTimeout (uint8_t protocol, bool closing) const
+{
+  switch (protocol)
     {
-      NetfilterConntrackTuple mapped = m_natMappings[currentOriginalTuple];
+    case IPPROTO_TCP:
+      return closing ? m_tcpClosingTimeout : m_tcpEstablishedTimeout;
+    case IPPROTO_ICMP:
+      return m_icmpTimeout;
+    default:
+      return m_udpTimeout;
+    }
+}
 
-      ipHeader.SetSource (mapped.GetSource ());
+void
+Ipv4Netfilter::RefreshConntrack (NetfilterPacketContext& ctx, IpConntrackInfo *infos[4])
+{
+  uint8_t protocol = ctx.GetIpv4Header ().GetProtocol ();
+  bool closing = false;
+  if (protocol == IPPROTO_TCP)
+    {
+      closing = (ctx.GetTcpFlags () & (TcpHeader::FIN | TcpHeader::RST)) != 0;
+    }
 
-      if (protocol == IPPROTO_TCP)
+  for (int i = 0; i < 4; i++)
+    {
+      if (infos[i] != 0 && infos[i]->IsDying ())
         {
-          TcpHeader tcpHeader;
-
-          p->RemoveHeader (tcpHeader);
-
-          tcpHeader.SetSourcePort (mapped.GetSourcePort ());
-
-          p->AddHeader (tcpHeader);
-
+          closing = true;
         }
-      else
-        {
-          UdpHeader udpHeader;
-
-          p->RemoveHeader (udpHeader);
-
-          udpHeader.SetSourcePort (mapped.GetSourcePort ());
+    }
 
-          p->AddHeader (udpHeader);
+  Time expires = Simulator::Now () + GetConntrackTimeout (protocol, closing);
+  for (int i = 0; i < 4; i++)
+    {
+      if (infos[i] != 0)
+        {
+          if (closing)
+            {
+              infos[i]->SetDying ();
+            }
+          infos[i]->SetExpires (expires);
         }
+    }
+}
 
-      p->AddHeader (ipHeader);
-
-      NetfilterConntrackTuple oldOriginalTuple = currentOriginalTuple;
+void
+Ipv4Netfilter::ExpireConntrack (NetfilterConntrackTuple tuple)
+{
+  NetfilterConntrackTable::Entry *entry = m_hash.Find (tuple);
+  if (entry == 0)
+    {
+      entry = m_unconfirmed.Find (tuple);
+      if (entry == 0)
+        {
+          return;
+        }
+    }
 
+  if (entry->info.GetExpires () > Simulator::Now ())
+    {
+      m_conntrackTimers.Schedule (tuple, entry->info.GetExpires ());
+      return;
+    }
 
-      currentOriginalTuple = NetfilterConntrackTuple (mapped.GetSource (), mapped.GetSourcePort (),
-                                                      currentOriginalTuple.GetDestination (),
-                                                      currentOriginalTuple.GetDestinationPort ());
+  NS_LOG_LOGIC ("Evicting idle connection " << tuple.GetSource () << ":" << tuple.GetSourcePort ()
+                << " -> " << tuple.GetDestination () << ":" << tuple.GetDestinationPort ());
+  NetfilterConntrackTuple reply;
+  Ptr<NetfilterConntrackL4Protocol> l4proto = FindL4ProtocolHelper (tuple.GetDestinationProtocol ());
+  if (l4proto != 0 && InvertTuple (reply, tuple, FindL3ProtocolHelper (1), l4proto))
+    {
+      m_hash.Erase (reply);
+      m_unconfirmed.Erase (reply);
+    }
+  m_hash.Erase (tuple);
+  m_unconfirmed.Erase (tuple);
+  m_nConntrackEvictions++;
+  m_evictionTrace (tuple);
+}
 
-      currentOriginalTuple.SetDirection (IP_CT_DIR_ORIGINAL);
+uint64_t
+Ipv4Netfilter::GetNConntrackLookups (void) const
+{
+  return m_nConntrackLookups;
+}
 
-      currentReplyTuple = NetfilterConntrackTuple (currentOriginalTuple.GetDestination (),
-                                                   currentOriginalTuple.GetDestinationPort (),
-                                                   mapped.GetSource (), mapped.GetSourcePort ());
+uint64_t
+Ipv4Netfilter::GetNConntrackHits (void) const
+{
+  return m_nConntrackHits;
+}
 
-      currentReplyTuple.SetDirection (IP_CT_DIR_REPLY);
+uint64_t
+Ipv4Netfilter::GetNConntrackMisses (void) const
+{
+  return m_nConntrackLookups - m_nConntrackHits;
+}
 
-      std::cout << " New Original Tuple: " << currentOriginalTuple << std::endl;
-      std::cout << " New Reply Tuple: " << currentReplyTuple << std::endl;
+uint64_t
+Ipv4Netfilter::GetNNewConnections (void) const
+{
+  return m_nNewConnections;
+}
 
-      m_unconfirmed[currentOriginalTuple] = m_unconfirmed[oldOriginalTuple];
+uint64_t
+Ipv4Netfilter::GetNConntrackEvictions (void) const
+{
+  return m_nConntrackEvictions;
+}
 
-    }
-  else if (hookNumber == NF_INET_PRE_ROUTING)
+uint64_t
+Ipv4Netfilter::GetNHookDrops (void) const
+{
+  uint64_t drops = 0;
+  for (int i = 0; i < NF_INET_NUMHOOKS; i++)
     {
-      NS_LOG_DEBUG ("Mapping back to LAN address");
-      //NetfilterConntrackTuple mapped = m_natMappings[currentReplyTuple];
-      NetfilterConntrackTuple temp = currentReplyTuple;
-      temp.SetDirection (IP_CT_DIR_ORIGINAL);
-      TranslationMapI transIt = m_natReplyLookup.find (temp);
-
-      if (transIt == m_natMappings.end ())
-        {
-          NS_LOG_DEBUG ("No such mapping found!");
-          return NF_ACCEPT;
-        }
+      drops += m_hookDrops[i];
+    }
+  return drops;
+}
 
-      dstPort = (transIt->second).GetSourcePort ();
-      dstAddress = (transIt->second).GetSource ();
+uint64_t
+Ipv4Netfilter::GetNDropsAtHook (Hooks_t hook) const
+{
+  NS_ASSERT (hook < NF_INET_NUMHOOKS);
+  return m_hookDrops[hook];
+}
 
-      currentOriginalTuple = NetfilterConntrackTuple ((transIt->second).GetSource (), (transIt->second).GetSourcePort (), dstAddress, dstPort);
-      currentReplyTuple = NetfilterConntrackTuple (dstAddress, dstPort, (transIt->second).GetSource (), (transIt->second).GetSourcePort ());
+void
+Ipv4Netfilter::SetHookTiming (bool enable)
+{
+  NS_LOG_FUNCTION (this << enable);
+  m_hookTiming = enable;
+}
 
-      NS_LOG_DEBUG ("Setting Destination IP address to : " << dstAddress);
-      ipHeader.SetDestination (dstAddress);
+bool
+Ipv4Netfilter::GetHookTiming (void) const
+{
+  return m_hookTiming;
+}
 
-      if (protocol == IPPROTO_TCP)
-        {
-          TcpHeader tcpHeader;
+uint64_t
+Ipv4Netfilter::GetNTimedPackets (Hooks_t hook) const
+{
+  NS_ASSERT (hook < NF_INET_NUMHOOKS);
+  return m_hookPackets[hook];
+}
 
-          p->RemoveHeader (tcpHeader);
+double
+Ipv4Netfilter::GetHookNanoSeconds (Hooks_t hook) const
+{
+  NS_ASSERT (hook < NF_INET_NUMHOOKS);
+  if (m_hookPackets[hook] == 0)
+    {
+      return 0;
+    }
+  return (double)m_hookNanoSeconds[hook] / m_hookPackets[hook];
+}
 
-          tcpHeader.SetDestinationPort (dstPort);
+void
+Ipv4Netfilter::GetConntrackChainHistogram (std::vector<uint32_t>& histogram) const
+{
+  m_hash.GetProbeHistogram (histogram);
+}
 
-          p->AddHeader (tcpHeader);
+void
+Ipv4Netfilter::ResetStatistics (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_nConntrackLookups = 0;
+  m_nConntrackHits = 0;
+  m_nNewConnections = 0;
+  m_nConntrackEvictions = 0;
+  for (int i = 0; i < NF_INET_NUMHOOKS; i++)
+    {
+      m_hookDrops[i] = 0;
+      m_hookPackets[i] = 0;
+      m_hookNanoSeconds[i] = 0;
+    }
+}
 
-        }
-      else
+void
+Ipv4Netfilter::SerializeToXmlStream (std::ostream &os, int indent) const
+{
+#define INDENT(level) for (int __xpto = 0; __xpto < level; __xpto++) os << ' ';
+
+  static const char *hookNames[NF_INET_NUMHOOKS] = {
+    "PRE_ROUTING", "LOCAL_IN", "FORWARD", "LOCAL_OUT", "POST_ROUTING"
+  };
+
+  INDENT (indent); os << "<Ipv4Netfilter>\n";
+  indent += 2;
+  INDENT (indent);
+  os << "<Conntrack"
+     << " lookups=\"" << m_nConntrackLookups << "\""
+     << " hits=\"" << m_nConntrackHits << "\""
+     << " misses=\"" << GetNConntrackMisses () << "\""
+     << " newConnections=\"" << m_nNewConnections << "\""
+     << " evictions=\"" << m_nConntrackEvictions << "\""
+     << " entries=\"" << m_hash.GetSize () << "\""
+     << " slots=\"" << m_hash.GetCapacity () << "\""
+     << ">\n";
+  indent += 2;
+  std::vector<uint32_t> histogram;
+  m_hash.GetProbeHistogram (histogram);
+  INDENT (indent); os << "<chainHistogram nBins=\"" << histogram.size () << "\" >\n";
+  for (uint32_t index = 0; index < histogram.size (); index++)
+    {
+      if (histogram[index])
         {
-          UdpHeader udpHeader;
-
-          p->RemoveHeader (udpHeader);
-
-          udpHeader.SetDestinationPort (dstPort);
-          NS_LOG_DEBUG ("Setting destination port to: " << dstPort);
-
-          p->AddHeader (udpHeader);
+          INDENT (indent + 2);
+          os << "<bin index=\"" << index << "\" count=\"" << histogram[index] << "\" />\n";
         }
-
-      p->AddHeader (ipHeader);
     }
+  INDENT (indent); os << "</chainHistogram>\n";
+  indent -= 2;
+  INDENT (indent); os << "</Conntrack>\n";
 
+  for (int i = 0; i < NF_INET_NUMHOOKS; i++)
+    {
+      INDENT (indent);
+      os << "<Hook name=\"" << hookNames[i] << "\""
+         << " drops=\"" << m_hookDrops[i] << "\""
+         << " timedPackets=\"" << m_hookPackets[i] << "\""
+         << " nsPerPacket=\"" << GetHookNanoSeconds ((Hooks_t)i) << "\""
+         << " />\n";
+    }
+  indent -= 2;
+  INDENT (indent); os << "</Ipv4Netfilter>\n";
 
+#undef INDENT
+}
 
-  return NF_ACCEPT;
-
+void
+Ipv4Netfilter::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_conntrackTimers.Clear ();
+  m_hash.Clear ();
+  m_unconfirmed.Clear ();
+  m_fragments.Clear ();
+  Object::DoDispose ();
 }
-#endif 
 
 } // Namespace ns3
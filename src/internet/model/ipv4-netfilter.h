@@ -27,14 +27,20 @@
 #include "ns3/ptr.h"
 #include "ns3/net-device.h"
 #include "ns3/packet.h"
-//#include "ns3/conntrack-tag.h"
 #include "ns3/ipv4-header.h"
 #include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/traced-callback.h"
 
 #include "ipv4-netfilter-hook.h"
 #include "netfilter-callback-chain.h"
 
 #include "netfilter-tuple-hash.h"
+#include "netfilter-conntrack-table.h"
+#include "netfilter-packet-context.h"
+#include "netfilter-fragment-cache.h"
+#include "conntrack-tag.h"
+#include "netfilter-timer-wheel.h"
 #include "netfilter-conntrack-tuple.h"
 #include "netfilter-conntrack-l3-protocol.h"
 #include "netfilter-conntrack-l4-protocol.h"
@@ -47,6 +53,7 @@ namespace ns3 {
 
 class Packet;
 class NetDevice;
+class OutputStreamWrapper;
 
 typedef enum
 {
@@ -108,33 +115,45 @@ public:
     * \param protocolFamily The protocol family e.g., PF_INET
     * \param hook The hook number e.g., NF_INET_PRE_ROUTING
     * \param p Packet that is handed over to the callback chain for this hook
-#if 0
     * \param in NetDevice which received the packet
     * \param out The outgoing NetDevice
     * \param ccb If not NULL, this callback will be invoked once the hook
     * callback chain has finished processing
-#endif
     * \returns Netfilter verdict for the Packet. e.g., NF_ACCEPT, NF_DROP etc.
     *
     * Various invocations of this method are used to implement hooks within the
     * ns-3 IP stack. When a packet "traverses" a hook, it is handed over to the
     * callback chain for that hook by this method.
     */
-  uint32_t ProcessHook (uint8_t protocolFamily, Hooks_t hookNumber, Ptr<Packet> p,Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback cc = MakeNullCallback <uint32_t, Ptr<Packet> > ());       //ContinueCallback ccb = defaultContinueCallback);
+  uint32_t ProcessHook (uint8_t protocolFamily, Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                        const Ptr<NetDevice>& out, ContinueCallback& ccb);
+
+  /**
+    * \param protocolFamily The protocol family e.g., PF_INET
+    * \param hook The hook number e.g., NF_INET_PRE_ROUTING
+    * \param p Packet that is handed over to the callback chain for this hook
+    * \param in NetDevice which received the packet
+    * \param out The outgoing NetDevice
+    * \returns Netfilter verdict for the Packet. e.g., NF_ACCEPT, NF_DROP etc.
+    *
+    * Hands the packet over to the callback chain without a continue callback.
+    */
+  uint32_t ProcessHook (uint8_t protocolFamily, Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                        const Ptr<NetDevice>& out);
 
 
   //Adding void methods for Hooking on specific nodes - sender,forwarder and receiver
   // uint32_t HookRegistered(Hooks_t hook, Ptr<Packet> packet, Ptr<NetDevice> in,
-  //          Ptr<NetDevice> out, ContinueCallback& ccb);
+  //          Ptr<NetDevice> out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
 
-  uint32_t HookPri1 (Hooks_t hook, Ptr<Packet> packet, Ptr<NetDevice> in,
-                     Ptr<NetDevice> out, ContinueCallback& ccb);
+  uint32_t HookPri1 (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                     const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
 
-  uint32_t HookPri2 (Hooks_t hook, Ptr<Packet> packet, Ptr<NetDevice> in,
-                     Ptr<NetDevice> out, ContinueCallback& ccb);
+  uint32_t HookPri2 (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                     const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
 
-  uint32_t HookPri3 (Hooks_t hook, Ptr<Packet> packet, Ptr<NetDevice> in,
-                     Ptr<NetDevice> out, ContinueCallback& ccb);
+  uint32_t HookPri3 (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                     const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
 
   /**
     * \param l3Protocol Layer 3 protocol
@@ -173,27 +192,27 @@ public:
   Ptr<NetfilterConntrackL4Protocol> FindL4ProtocolHelper (uint8_t protocol);
 
   /**
-    * \param packet The packet being processed by a hook
+    * \param ctx Headers of the packet being processed by a hook
     * \param protocolFamily Protocol Family e.g., PF_INET
     * \param protocol The value in the protocol field of the IP header
     * \param l3Protocol Layer 3 protocol helper
     * \param l4Protocol Layer 4 protocol helper
     * \param setReply Set to 1 if this is a reply
     * \param ctInfo Connection tracking information e.g., IP_CT_ESTABLISHED
-    * \param ipHeader IP header of the packet
     * \returns 0 on success
     *
     * This method checks whether this is a new connection and if so creates an
     * entry for it in the hash table. If this connection already exists in the
     * hash table then the state of the connection is updated depending on the
-    * information inside the packet
+    * information inside the packet. The entry is attached to the context
+    * and the packet is tagged with a ConntrackTag for the confirmation.
     */
-  uint32_t ResolveNormalConntrack (Ptr<Packet> packet, uint32_t protocolFamily, uint8_t protocol,
+  uint32_t ResolveNormalConntrack (NetfilterPacketContext& ctx, uint32_t protocolFamily, uint8_t protocol,
                                    Ptr<NetfilterConntrackL3Protocol> l3Protocol, Ptr<NetfilterConntrackL4Protocol> l4Protocol,
-                                   int& setReply, ConntrackInfo_t& ctInfo, Ipv4Header ipHeader);
+                                   int& setReply, ConntrackInfo_t& ctInfo);
 
   /**
-    * \param packet Packet that should be converted to a tuple
+    * \param ctx Headers of the packet that should be converted to a tuple
     * \param l3Number Layer 3 protocol
     * \param protocolNumber Layer 4 protocol
     * \param tuple Stores the created tuple
@@ -204,7 +223,7 @@ public:
     * Extracts information from the packet to create a corresponding tuple
     */
 
-  bool NetfilterConntrackGetTuple (Ptr<Packet> packet, uint16_t l3Number, uint8_t protocolNumber,
+  bool NetfilterConntrackGetTuple (NetfilterPacketContext& ctx, uint16_t l3Number, uint8_t protocolNumber,
                                    NetfilterConntrackTuple& tuple, Ptr<NetfilterConntrackL3Protocol> l3Protocol,
                                    Ptr<NetfilterConntrackL4Protocol> l4Protocol);
 
@@ -213,19 +232,27 @@ public:
     * \param l3proto Layer 3 protocol helper
     * \param l4proto Layer 4 protocol helper
     * \param packet Packet
-    * \returns TupleHash Iterator
+    * \returns Pointer to the unconfirmed entry, or 0 on failure
     *
     * Updates the hash table to create an entry for the new connection
     */
 
-  TupleHashI NewConnection (NetfilterConntrackTuple& tuple, Ptr<NetfilterConntrackL3Protocol> l3proto,
+  NetfilterConntrackTable::Entry* NewConnection (NetfilterConntrackTuple& tuple, Ptr<NetfilterConntrackL3Protocol> l3proto,
                             Ptr<NetfilterConntrackL4Protocol> l4proto, Ptr<Packet> packet);
 
 
-  int UpdateConntrackInfo (uint8_t info);
+  /**
+    * \param ctx Headers of a packet tracked by NetfilterConntrackIn ()
+    * \param info Connection tracking information e.g., IP_CT_ESTABLISHED
+    * \returns 0 on success
+    *
+    * Updates the information of both directions of the confirmed
+    * connection the packet belongs to.
+    */
+  int UpdateConntrackInfo (NetfilterPacketContext& ctx, uint8_t info);
 
-  uint32_t NetfilterConntrackIn (Hooks_t hook, Ptr <Packet> packet, Ptr<NetDevice> in,
-                                 Ptr<NetDevice> out, ContinueCallback& ccb);
+  uint32_t NetfilterConntrackIn (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                                 const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
 
   uint32_t NetfilterConntrackConfirm (Ptr<Packet> p);
 
@@ -244,57 +271,213 @@ public:
                     Ptr<NetfilterConntrackL3Protocol> l3Protocol,
                     Ptr<NetfilterConntrackL4Protocol> l4Protocol);
 
-  TupleHash& GetHash ();
+  /**
+    * \returns The table of confirmed connections
+    */
+  NetfilterConntrackTable& GetHash ();
 
-#ifdef NOTYET
-  void AddNatRule (NatRule natRule);
+  /**
+    * \param os Binary stream the confirmed connections are written to
+    *
+    * Writes one fixed size record per entry of the table, straight from
+    * the table. The expiry of a connection is saved as the idle time it
+    * had left.
+    */
+  void SerializeConntrackTable (std::ostream &os);
 
-  uint32_t NetfilterDoNat (Hooks_t hookNumber, Ptr<Packet> p,
-                           Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback& ccb);
+  /**
+    * \param is Binary stream written by SerializeConntrackTable ()
+    * \returns false if the stream is not a conntrack snapshot or ends early
+    *
+    * Adds the connections of the snapshot to the table, growing it once
+    * for all of them, and schedules their expiry relative to the current
+    * simulation time.
+    */
+  bool DeserializeConntrackTable (std::istream &is);
 
+  /**
+    * \param stream The stream the confirmed connections are printed to
+    */
+  void PrintConntrackTable (Ptr<OutputStreamWrapper> stream);
 
-  std::vector<NatRule>::iterator FindNatRule (NatRule natRule);
+  /**
+    * \param size Number of connections the conntrack tables should hold
+    * before they need to grow
+    */
+  void SetConntrackTableSize (uint32_t size);
 
-  std::vector<NatRule>::iterator FindNatRule (Ipv4Address orig, Ptr<NetDevice> out);
-  //static NetfilterConntrackTuple currentTuple[IP_CT_DIR_MAX];
+  /**
+    * \returns The configured conntrack table size
+    */
+  uint32_t GetConntrackTableSize (void) const;
 
-  void EnableNat ();
+  /**
+    * \param granularity Resolution of the connection expiry timers
+    */
+  void SetExpiryGranularity (Time granularity);
 
-  uint32_t NetfilterNatPacket (Hooks_t hookNumber, Ptr<Packet> p);
+  /**
+    * \returns The resolution of the connection expiry timers
+    */
+  Time GetExpiryGranularity (void) const;
 
-#endif 
+  /**
+    * \returns The ports of fragmented datagrams, by which the hooks
+    * classify fragments other than the first one
+    */
+  NetfilterFragmentCache& GetFragmentCache ();
 
-private:
-  NetfilterCallbackChain m_netfilterHooks[NF_INET_NUMHOOKS];
-  //std::vector<Ptr<NetfilterConntrackL3Protocol> > m_netfilterConntrackL3Protocols;
-  TupleHash m_netfilterTupleHash[IP_CT_DIR_MAX];
-  TupleHash m_unconfirmed;
-  TupleHash m_hash;
+  /**
+    * \param entries Number of fragmented datagrams whose ports are kept
+    */
+  void SetFragmentCacheSize (uint32_t entries);
+  uint32_t GetFragmentCacheSize (void) const;
 
-  /* TODO: Should be a table once we have more L3/L4 Protocols */
-  Ptr<NetfilterConntrackL3Protocol> m_netfilterConntrackL3Protocols;
-  std::vector<Ptr<NetfilterConntrackL4Protocol> > m_netfilterConntrackL4Protocols;
+  /**
+    * \param timeout How long the ports of a fragmented datagram are kept
+    */
+  void SetFragmentTimeout (Time timeout);
+  Time GetFragmentTimeout (void) const;
 
-  //TranslationMap m_natMappings;
+  /**
+    * \param protocol Layer 4 protocol of the connection
+    * \param closing true if the connection is being torn down
+    * \returns How long the connection may stay idle before it is evicted
+    */
+  Time GetConntrackTimeout (uint8_t protocol, bool closing) const;
 
-  NetfilterConntrackTuple currentOriginalTuple;
-  NetfilterConntrackTuple currentReplyTuple;
+  /**
+    * \returns Number of packets looked up in the table of confirmed
+    * connections
+    */
+  uint64_t GetNConntrackLookups (void) const;
 
-/*
-  uint8_t m_enableNat;
-  std::vector <NatRule> m_natRules;
+  /**
+    * \returns Number of lookups that found a confirmed connection
+    */
+  uint64_t GetNConntrackHits (void) const;
 
+  /**
+    * \returns Number of lookups that found no confirmed connection
+    */
+  uint64_t GetNConntrackMisses (void) const;
 
-  uint16_t nextAvailablePort;
+  /**
+    * \returns Number of connections created, confirmed or not
+    */
+  uint64_t GetNNewConnections (void) const;
 
-  TranslationMap m_natReplyLookup;
-*/
-};
+  /**
+    * \returns Number of idle connections evicted
+    */
+  uint64_t GetNConntrackEvictions (void) const;
+
+  /**
+    * \returns Number of packets the hook chains dropped, all hooks
+    * together; stolen and queued packets are not counted
+    */
+  uint64_t GetNHookDrops (void) const;
+
+  /**
+    * \param hook The hook number e.g., NF_INET_FORWARD
+    * \returns Number of packets the callback chain of the hook dropped
+    */
+  uint64_t GetNDropsAtHook (Hooks_t hook) const;
+
+  /**
+    * \param enable true to measure the wall clock time the callback chains
+    * take for each packet
+    *
+    * Timing costs two clock reads per hook traversal and is off by default.
+    */
+  void SetHookTiming (bool enable);
+  bool GetHookTiming (void) const;
+
+  /**
+    * \param hook The hook number e.g., NF_INET_FORWARD
+    * \returns Number of packets timed at the hook
+    */
+  uint64_t GetNTimedPackets (Hooks_t hook) const;
+
+  /**
+    * \param hook The hook number e.g., NF_INET_FORWARD
+    * \returns Mean wall clock time in nanoseconds the callback chain of the
+    * hook took per timed packet, 0 if none was timed
+    */
+  double GetHookNanoSeconds (Hooks_t hook) const;
+
+  /**
+    * \param histogram Set to the number of confirmed connection entries by
+    * the number of slots probed past their home slot to find them
+    */
+  void GetConntrackChainHistogram (std::vector<uint32_t>& histogram) const;
 
-//uint16_t Ipv4Netfilter::nextAvailablePort = 1024;
+  /**
+    * \brief Zero the counters and the hook timings
+    */
+  void ResetStatistics (void);
 
-//NetfilterConntrackTuple Ipv4Netfilter::currentTuple = NetfilterConntrackTuple ();
-//NetfilterConntrackTuple Ipv4Netfilter::currentTuple[IP_CT_DIR_ORIGINAL] = NetfilterConntrackTuple ();
+  /**
+    * \param os Stream the counters are written to
+    * \param indent Number of spaces the elements are indented with
+    *
+    * Writes the counters, the hook timings and the chain histogram of
+    * the conntrack table as an Ipv4Netfilter XML element, in the format
+    * of FlowMonitor::SerializeToXmlStream ().
+    */
+  void SerializeToXmlStream (std::ostream &os, int indent) const;
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  /**
+    * \param ctx Headers of the packet that has just been tracked
+    * \param infos Entries of the connection, original and reply direction
+    * in the confirmed table followed by the same in the unconfirmed one,
+    * 0 where absent
+    *
+    * Pushes back the expiry deadline of the connection the packet belongs
+    * to and notes when a TCP connection starts closing.
+    */
+  void RefreshConntrack (NetfilterPacketContext& ctx, IpConntrackInfo *infos[4]);
+
+  /**
+    * \param tuple Original direction tuple handed back by the timer wheel
+    *
+    * Evicts the connection if it has been idle past its deadline,
+    * otherwise schedules it again.
+    */
+  void ExpireConntrack (NetfilterConntrackTuple tuple);
+
+  NetfilterCallbackChain m_netfilterHooks[NF_INET_NUMHOOKS];
+  //std::vector<Ptr<NetfilterConntrackL3Protocol> > m_netfilterConntrackL3Protocols;
+  NetfilterConntrackTable m_unconfirmed;
+  NetfilterConntrackTable m_hash;
+  uint32_t m_conntrackTableSize;
+  NetfilterTimerWheel<NetfilterConntrackTuple> m_conntrackTimers;
+  NetfilterFragmentCache m_fragments;
+  Time m_tcpEstablishedTimeout;
+  Time m_tcpClosingTimeout;
+  Time m_udpTimeout;
+  Time m_icmpTimeout;
+  TracedCallback<const NetfilterConntrackTuple &> m_evictionTrace;
+  TracedCallback<const NetfilterConntrackTuple &> m_newConnectionTrace;
+  TracedCallback<Ptr<const Packet>, Hooks_t, uint32_t> m_hookDropTrace;
+
+  uint64_t m_nConntrackLookups;
+  uint64_t m_nConntrackHits;
+  uint64_t m_nNewConnections;
+  uint64_t m_nConntrackEvictions;
+  uint64_t m_hookDrops[NF_INET_NUMHOOKS];
+  bool m_hookTiming;
+  uint64_t m_hookPackets[NF_INET_NUMHOOKS];
+  uint64_t m_hookNanoSeconds[NF_INET_NUMHOOKS];
+
+  /* TODO: Should be a table once we have more L3/L4 Protocols */
+  Ptr<NetfilterConntrackL3Protocol> m_netfilterConntrackL3Protocols;
+  std::vector<Ptr<NetfilterConntrackL4Protocol> > m_netfilterConntrackL4Protocols;
+};
 
 } // Namespace ns3
 #endif /* IPV4_NETFILTER_H */
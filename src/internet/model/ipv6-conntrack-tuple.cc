@@ -0,0 +1,137 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ipv6-conntrack-tuple.h"
+#include "netfilter-jhash.h"
+
+namespace ns3 {
+
+Ipv6ConntrackTuple::Ipv6ConntrackTuple ()
+  : m_sourcePort (0),
+    m_destinationPort (0),
+    m_protocol (0),
+    m_direction (IP_CT_DIR_ORIGINAL)
+{
+}
+
+Ipv6ConntrackTuple::Ipv6ConntrackTuple (Ipv6Address source, uint16_t sourcePort, Ipv6Address destination,
+                                        uint16_t destinationPort, uint8_t protocol)
+  : m_source (source),
+    m_destination (destination),
+    m_sourcePort (sourcePort),
+    m_destinationPort (destinationPort),
+    m_protocol (protocol),
+    m_direction (IP_CT_DIR_ORIGINAL)
+{
+}
+
+bool
+Ipv6ConntrackTuple::operator== (const Ipv6ConntrackTuple& t) const
+{
+  return m_sourcePort == t.m_sourcePort
+         && m_destinationPort == t.m_destinationPort
+         && m_protocol == t.m_protocol
+         && m_source == t.m_source
+         && m_destination == t.m_destination;
+}
+
+Ipv6ConntrackTuple
+Ipv6ConntrackTuple::Invert (void) const
+{
+  Ipv6ConntrackTuple inverse (m_destination, m_destinationPort, m_source, m_sourcePort, m_protocol);
+  inverse.m_direction = m_direction == IP_CT_DIR_ORIGINAL ? IP_CT_DIR_REPLY : IP_CT_DIR_ORIGINAL;
+  return inverse;
+}
+
+Ipv6Address
+Ipv6ConntrackTuple::GetSource (void) const
+{
+  return m_source;
+}
+
+Ipv6Address
+Ipv6ConntrackTuple::GetDestination (void) const
+{
+  return m_destination;
+}
+
+uint16_t
+Ipv6ConntrackTuple::GetSourcePort (void) const
+{
+  return m_sourcePort;
+}
+
+uint16_t
+Ipv6ConntrackTuple::GetDestinationPort (void) const
+{
+  return m_destinationPort;
+}
+
+uint8_t
+Ipv6ConntrackTuple::GetProtocol (void) const
+{
+  return m_protocol;
+}
+
+uint8_t
+Ipv6ConntrackTuple::GetDirection (void) const
+{
+  return m_direction;
+}
+
+void
+Ipv6ConntrackTuple::SetDirection (ConntrackDirection_t direction)
+{
+  m_direction = direction;
+}
+
+void
+Ipv6ConntrackTuple::Print (std::ostream &os) const
+{
+  os << "( " << m_source << "," << m_sourcePort << "," << m_destination << "," << m_destinationPort
+     << ", " << (uint32_t)m_protocol << ", " << (uint32_t)m_direction << ")";
+}
+
+std::ostream& operator << (std::ostream& os, Ipv6ConntrackTuple const& tuple)
+{
+  tuple.Print (os);
+  return os;
+}
+
+size_t
+Ipv6ConntrackTupleHash::operator() (const Ipv6ConntrackTuple &x) const
+{
+  /* Fixed seed so that simulations stay reproducible */
+  static const uint32_t rnd = 0x5bd1e995;
+
+  uint8_t source[16];
+  uint8_t destination[16];
+  x.GetSource ().GetBytes (source);
+  x.GetDestination ().GetBytes (destination);
+
+  uint32_t words[9];
+  for (uint32_t i = 0; i < 4; i++)
+    {
+      words[i] = (source[4 * i] << 24) | (source[4 * i + 1] << 16) | (source[4 * i + 2] << 8) | source[4 * i + 3];
+      words[4 + i] = (destination[4 * i] << 24) | (destination[4 * i + 1] << 16)
+        | (destination[4 * i + 2] << 8) | destination[4 * i + 3];
+    }
+  words[8] = ((uint32_t)x.GetSourcePort () << 16) | x.GetDestinationPort ();
+
+  return JHash2 (words, 9, rnd ^ x.GetProtocol ());
+}
+
+} // namespace ns3
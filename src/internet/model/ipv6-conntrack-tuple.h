@@ -0,0 +1,90 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef IPV6_CONNTRACK_TUPLE_H
+#define IPV6_CONNTRACK_TUPLE_H
+
+#include <stdint.h>
+#include <ostream>
+#include <functional>
+#include "ns3/ipv6-address.h"
+#include "ip-conntrack-info.h"
+
+namespace ns3 {
+
+/**
+  * \brief Connection tracking tuple of an IPv6 flow
+  *
+  * Addresses, ports and layer 4 protocol of a packet, and the direction
+  * of the connection the packet travels in. For ICMPv6 echo messages both
+  * ports hold the echo identifier. The direction is not part of equality,
+  * so that the tuple of a reply packet finds the reply entry of its
+  * connection.
+  */
+class Ipv6ConntrackTuple
+{
+public:
+  Ipv6ConntrackTuple ();
+  Ipv6ConntrackTuple (Ipv6Address source, uint16_t sourcePort, Ipv6Address destination,
+                      uint16_t destinationPort, uint8_t protocol);
+
+  bool operator== (const Ipv6ConntrackTuple& t) const;
+
+  /**
+    * \returns The tuple of the packets travelling the other way, in the
+    * other direction
+    */
+  Ipv6ConntrackTuple Invert (void) const;
+
+  Ipv6Address GetSource (void) const;
+  Ipv6Address GetDestination (void) const;
+  uint16_t GetSourcePort (void) const;
+  uint16_t GetDestinationPort (void) const;
+  uint8_t GetProtocol (void) const;
+  uint8_t GetDirection (void) const;
+  void SetDirection (ConntrackDirection_t direction);
+
+  void Print (std::ostream &os) const;
+
+private:
+  Ipv6Address m_source;
+  Ipv6Address m_destination;
+  uint16_t m_sourcePort;
+  uint16_t m_destinationPort;
+  uint8_t m_protocol;
+  uint8_t m_direction;
+};
+
+std::ostream& operator << (std::ostream& os, Ipv6ConntrackTuple const& tuple);
+
+/**
+  * \brief Hash functor for IPv6 connection tracking tuples
+  *
+  * All 128 bits of both addresses go through the Jenkins mix along with
+  * the ports and the protocol, as jhash2 () does for the Linux IPv6
+  * conntrack. Folding the addresses into 32 bits first would let the
+  * many hosts of a /64, which only differ in their low bits, and the many
+  * prefixes delegated by a provider, which only differ in their high
+  * bits, collide.
+  */
+class Ipv6ConntrackTupleHash : public std::unary_function<Ipv6ConntrackTuple, size_t>
+{
+public:
+  size_t operator() (const Ipv6ConntrackTuple &x) const;
+};
+
+} // namespace ns3
+
+#endif /* IPV6_CONNTRACK_TUPLE_H */
@@ -41,6 +41,8 @@
 #include "ipv6-option.h"
 #include "icmpv6-l4-protocol.h"
 #include "ndisc-cache.h"
+#include "ipv6-netfilter.h"
+#include "conntrack-tag.h"
 
 namespace ns3 {
 
@@ -129,6 +131,7 @@ void Ipv6L3Protocol::DoDispose ()
 
   m_node = 0;
   m_routingProtocol = 0;
+  m_netfilter = 0;
   Object::DoDispose ();
 }
 
@@ -145,6 +148,18 @@ Ptr<Ipv6RoutingProtocol> Ipv6L3Protocol::GetRoutingProtocol () const
   return m_routingProtocol;
 }
 
+void Ipv6L3Protocol::SetNetfilter (Ptr<Ipv6Netfilter> netfilter)
+{
+  NS_LOG_FUNCTION (this << netfilter);
+  m_netfilter = netfilter;
+}
+
+Ptr<Ipv6Netfilter> Ipv6L3Protocol::GetNetfilter () const
+{
+  NS_LOG_FUNCTION_NOARGS ();
+  return m_netfilter;
+}
+
 uint32_t Ipv6L3Protocol::AddInterface (Ptr<NetDevice> device)
 {
   NS_LOG_FUNCTION (this << device);
@@ -637,6 +652,14 @@ void Ipv6L3Protocol::Send (Ptr<Packet> packet, Ipv6Address source, Ipv6Address d
       tclass = tclassTag.GetTclass ();
     }
 
+  hdr = BuildHeader (source, destination, protocol, packet->GetSize (), ttl, tclass);
+
+  if (m_netfilter != 0 && !RunNetfilterHook (NF_INET_LOCAL_OUT, packet, hdr, 0, route ? route->GetOutputDevice () : Ptr<NetDevice> ()))
+    {
+      NS_LOG_LOGIC ("NF_INET_LOCAL_OUT packet not accepted");
+      return;
+    }
+
   /* Handle 3 cases:
    * 1) Packet is passed in with a route entry
    * 2) Packet is passed in with a route entry but route->GetGateway is not set (e.g., same network)
@@ -647,7 +670,6 @@ void Ipv6L3Protocol::Send (Ptr<Packet> packet, Ipv6Address source, Ipv6Address d
   if (route && route->GetGateway () != Ipv6Address::GetZero ())
     {
       NS_LOG_LOGIC ("Ipv6L3Protocol::Send case 1: passed in with a route");
-      hdr = BuildHeader (source, destination, protocol, packet->GetSize (), ttl, tclass);
       SendRealOut (route, packet, hdr);
       return;
     }
@@ -657,7 +679,6 @@ void Ipv6L3Protocol::Send (Ptr<Packet> packet, Ipv6Address source, Ipv6Address d
     {
       NS_LOG_LOGIC ("Ipv6L3Protocol::Send case 1: probably sent to machine on same IPv6 network");
       /* NS_FATAL_ERROR ("This case is not yet implemented"); */
-      hdr = BuildHeader (source, destination, protocol, packet->GetSize (), ttl, tclass);
       SendRealOut (route, packet, hdr);
       return;
     }
@@ -668,8 +689,6 @@ void Ipv6L3Protocol::Send (Ptr<Packet> packet, Ipv6Address source, Ipv6Address d
   Ptr<NetDevice> oif (0);
   Ptr<Ipv6Route> newRoute = 0;
 
-  hdr = BuildHeader (source, destination, protocol, packet->GetSize (), ttl, tclass);
-
   //for link-local traffic, we need to determine the interface
   if (source.IsLinkLocal ()
       || destination.IsLinkLocal ()
@@ -727,6 +746,16 @@ void Ipv6L3Protocol::Receive (Ptr<NetDevice> device, Ptr<const Packet> p, uint16
       interface++;
     }
 
+  if (m_netfilter != 0)
+    {
+      uint32_t verdict = m_netfilter->ProcessHook (NF_INET_PRE_ROUTING, packet, device, 0);
+      if (verdict != NF_ACCEPT)
+        {
+          NS_LOG_LOGIC ("NF_INET_PRE_ROUTING packet not accepted");
+          return;
+        }
+    }
+
   Ipv6Header hdr;
   packet->RemoveHeader (hdr);
 
@@ -774,9 +803,9 @@ void Ipv6L3Protocol::Receive (Ptr<NetDevice> device, Ptr<const Packet> p, uint16
     }
 }
 
-void Ipv6L3Protocol::SendRealOut (Ptr<Ipv6Route> route, Ptr<Packet> packet, Ipv6Header const& ipHeader)
+void Ipv6L3Protocol::SendRealOut (Ptr<Ipv6Route> route, Ptr<Packet> packet, Ipv6Header const& header)
 {
-  NS_LOG_FUNCTION (this << route << packet << ipHeader);
+  NS_LOG_FUNCTION (this << route << packet << header);
 
   if (!route)
     {
@@ -785,6 +814,13 @@ void Ipv6L3Protocol::SendRealOut (Ptr<Ipv6Route> route, Ptr<Packet> packet, Ipv6
     }
 
   Ptr<NetDevice> dev = route->GetOutputDevice ();
+  Ipv6Header ipHeader = header;
+  if (m_netfilter != 0 && !RunNetfilterHook (NF_INET_POST_ROUTING, packet, ipHeader, 0, dev))
+    {
+      NS_LOG_LOGIC ("NF_INET_POST_ROUTING packet not accepted");
+      return;
+    }
+
   int32_t interface = GetInterfaceForDevice (dev);
   NS_ASSERT (interface >= 0);
 
@@ -945,6 +981,12 @@ void Ipv6L3Protocol::IpForward (Ptr<Ipv6Route> rtentry, Ptr<const Packet> p, con
         }
     }
 
+  if (m_netfilter != 0 && !RunNetfilterHook (NF_INET_FORWARD, packet, ipHeader, 0, rtentry->GetOutputDevice ()))
+    {
+      NS_LOG_LOGIC ("NF_INET_FORWARD packet not accepted");
+      return;
+    }
+
   SendRealOut (rtentry, packet, ipHeader);
 }
 
@@ -993,6 +1035,19 @@ void Ipv6L3Protocol::LocalDeliver (Ptr<const Packet> packet, Ipv6Header const& i
   uint8_t nextHeaderPosition = 0;
   bool isDropped = false;
 
+  if (m_netfilter != 0)
+    {
+      Ipv6Header ipHeader = ip;
+      if (!RunNetfilterHook (NF_INET_LOCAL_IN, p, ipHeader, GetNetDevice (iif), 0))
+        {
+          NS_LOG_LOGIC ("NF_INET_LOCAL_IN packet not accepted");
+          return;
+        }
+      // conntrack state ends at LOCAL_IN, do not hand it to the sockets
+      Ipv6ConntrackTag conntrackTag;
+      p->RemovePacketTag (conntrackTag);
+    }
+
   /* process hop-by-hop extension first if exists */
   if (nextHeader == Ipv6Header::IPV6_EXT_HOP_BY_HOP)
     {
@@ -1086,6 +1141,15 @@ void Ipv6L3Protocol::RouteInputError (Ptr<const Packet> p, const Ipv6Header& ipH
   m_dropTrace (ipHeader, p, DROP_ROUTE_ERROR, m_node->GetObject<Ipv6> (), 0);
 }
 
+bool Ipv6L3Protocol::RunNetfilterHook (Hooks_t hook, Ptr<Packet> packet, Ipv6Header& ipHeader,
+                                       Ptr<NetDevice> in, Ptr<NetDevice> out)
+{
+  NS_LOG_FUNCTION (this << hook << packet << ipHeader);
+  // the hooks reach the header through the packet context, which
+  // writes their changes back to ipHeader
+  return m_netfilter->ProcessHook (hook, packet, ipHeader, in, out) == NF_ACCEPT;
+}
+
 Ipv6Header Ipv6L3Protocol::BuildHeader (Ipv6Address src, Ipv6Address dst, uint8_t protocol, uint16_t payloadSize, uint8_t ttl, uint8_t tclass)
 {
   NS_LOG_FUNCTION (this << src << dst << (uint32_t)protocol << (uint32_t)payloadSize << (uint32_t)ttl << (uint32_t)tclass);
@@ -28,6 +28,7 @@
 #include "ns3/ipv6.h"
 #include "ns3/ipv6-address.h"
 #include "ns3/ipv6-header.h"
+#include "ns3/ipv4-netfilter-hook.h"
 
 namespace ns3
 {
@@ -40,6 +41,7 @@ class Ipv6MulticastRoute;
 class Ipv6RawSocketImpl;
 class Icmpv6L4Protocol;
 class Ipv6AutoconfiguredPrefix;
+class Ipv6Netfilter;
 
 /**
  * \class Ipv6L3Protocol
@@ -178,6 +180,18 @@ public:
    */
   Ptr<Ipv6RoutingProtocol> GetRoutingProtocol () const;
 
+  /**
+   * \brief Set the netfilter object run on the packets of this stack.
+   * \param netfilter IPv6 netfilter
+   */
+  void SetNetfilter (Ptr<Ipv6Netfilter> netfilter);
+
+  /**
+   * \brief Get the netfilter object of this stack.
+   * \return netfilter, or null pointer if none
+   */
+  Ptr<Ipv6Netfilter> GetNetfilter () const;
+
   /**
    * \brief Add IPv6 interface for a device.
    * \param device net device
@@ -418,6 +432,19 @@ private:
    */
   void SendRealOut (Ptr<Ipv6Route> route, Ptr<Packet> packet, Ipv6Header const& ipHeader);
 
+  /**
+   * \brief Run the netfilter hooks of a hook point on a packet.
+   * \param hook hook point e.g., NF_INET_LOCAL_OUT
+   * \param packet packet without its IPv6 header
+   * \param ipHeader IPv6 header of the packet, kept out of it and handed
+   * to the hooks in place, so it carries the changes they made
+   * \param in device the packet came in from, if any
+   * \param out device the packet goes out to, if known
+   * \return true if the packet was accepted
+   */
+  bool RunNetfilterHook (Hooks_t hook, Ptr<Packet> packet, Ipv6Header& ipHeader,
+                         Ptr<NetDevice> in, Ptr<NetDevice> out);
+
   /**
    * \brief Forward a packet.
    * \param rtentry route 
@@ -526,6 +553,11 @@ private:
    */
   Ptr<Ipv6RoutingProtocol> m_routingProtocol;
 
+  /**
+   * \brief Netfilter hooks.
+   */
+  Ptr<Ipv6Netfilter> m_netfilter;
+
   /**
    * \brief List of IPv6 raw sockets.
    */
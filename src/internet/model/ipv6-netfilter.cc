@@ -0,0 +1,475 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <algorithm>
+#include "ns3/log.h"
+#include "ns3/uinteger.h"
+#include "ns3/simulator.h"
+#include "ns3/trace-source-accessor.h"
+#include "ipv6-netfilter.h"
+#include "ipv6-header.h"
+#include "icmpv6-header.h"
+#include "tcp-header.h"
+#include "conntrack-tag.h"
+
+NS_LOG_COMPONENT_DEFINE ("Ipv6Netfilter");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (Ipv6Netfilter);
+
+/* Offsets into the IPv6 header */
+static const uint32_t IPV6_HEADER_SIZE = 40;
+
+/* Bytes of a packet looked at to find its transport header */
+static const uint32_t IPV6_PARSE_SIZE = 128;
+
+TypeId
+Ipv6Netfilter::GetTypeId (void)
+{
+  static TypeId tId = TypeId ("ns3::Ipv6Netfilter")
+    .SetParent<Object> ()
+    .AddConstructor<Ipv6Netfilter> ()
+    .AddAttribute ("ConntrackTableSize",
+                   "Number of connections the conntrack tables hold before they have to grow.",
+                   UintegerValue (1024),
+                   MakeUintegerAccessor (&Ipv6Netfilter::SetConntrackTableSize,
+                                         &Ipv6Netfilter::GetConntrackTableSize),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("TcpEstablishedTimeout",
+                   "Idle time after which an established TCP connection is evicted.",
+                   TimeValue (Seconds (7440)),
+                   MakeTimeAccessor (&Ipv6Netfilter::m_tcpEstablishedTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("TcpClosingTimeout",
+                   "Idle time after which a TCP connection that has seen a FIN or RST is evicted.",
+                   TimeValue (Seconds (240)),
+                   MakeTimeAccessor (&Ipv6Netfilter::m_tcpClosingTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("UdpTimeout",
+                   "Idle time after which a UDP flow is evicted.",
+                   TimeValue (Seconds (300)),
+                   MakeTimeAccessor (&Ipv6Netfilter::m_udpTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("IcmpTimeout",
+                   "Idle time after which an ICMPv6 echo flow is evicted.",
+                   TimeValue (Seconds (60)),
+                   MakeTimeAccessor (&Ipv6Netfilter::m_icmpTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("ExpiryGranularity",
+                   "Resolution of the timer wheel that expires idle connections.",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&Ipv6Netfilter::SetExpiryGranularity,
+                                     &Ipv6Netfilter::GetExpiryGranularity),
+                   MakeTimeChecker ())
+    .AddTraceSource ("ConntrackEviction",
+                     "An idle connection has been removed from the conntrack tables.",
+                     MakeTraceSourceAccessor (&Ipv6Netfilter::m_evictionTrace))
+  ;
+  return tId;
+}
+
+Ipv6Netfilter::Ipv6Netfilter ()
+  : m_conntrackEnabled (false),
+    m_nextId (1),
+    m_conntrackTableSize (0)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+
+  m_conntrackTimers.SetExpireCallback (MakeCallback (&Ipv6Netfilter::ExpireConntrack, this));
+}
+
+void
+Ipv6Netfilter::EnableConntrack (void)
+{
+  NS_LOG_FUNCTION (this);
+  if (m_conntrackEnabled)
+    {
+      return;
+    }
+  m_conntrackEnabled = true;
+  NetfilterHookCallback in = MakeCallback (&Ipv6Netfilter::ConntrackIn, this);
+  NetfilterHookCallback confirm = MakeCallback (&Ipv6Netfilter::ConntrackConfirm, this);
+  RegisterHook (Ipv4NetfilterHook (PF_INET6, NF_INET_PRE_ROUTING, NF_IP_PRI_CONNTRACK, in));
+  RegisterHook (Ipv4NetfilterHook (PF_INET6, NF_INET_LOCAL_OUT, NF_IP_PRI_CONNTRACK, in));
+  RegisterHook (Ipv4NetfilterHook (PF_INET6, NF_INET_POST_ROUTING, NF_IP_PRI_CONNTRACK_CONFIRM, confirm));
+  RegisterHook (Ipv4NetfilterHook (PF_INET6, NF_INET_LOCAL_IN, NF_IP_PRI_CONNTRACK_CONFIRM, confirm));
+}
+
+bool
+Ipv6Netfilter::IsConntrackEnabled (void) const
+{
+  return m_conntrackEnabled;
+}
+
+void
+Ipv6Netfilter::RegisterHook (const Ipv4NetfilterHook& hook)
+{
+  m_netfilterHooks[hook.GetHookNumber ()].Insert (hook);
+}
+
+void
+Ipv6Netfilter::DeregisterHook (const Ipv4NetfilterHook& hook)
+{
+  m_netfilterHooks[hook.GetHookNumber ()].Remove (hook);
+}
+
+uint32_t
+Ipv6Netfilter::ProcessHook (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                            const Ptr<NetDevice>& out)
+{
+  NetfilterCallbackChain &chain = m_netfilterHooks[(uint32_t)hookNumber];
+  if (chain.IsEmpty ())
+    {
+      return NF_ACCEPT;
+    }
+  ContinueCallback ccb;
+  NetfilterPacketContext ctx (p);
+  return chain.IterateAndCallHook (hookNumber, p, in, out, ccb, ctx);
+}
+
+uint32_t
+Ipv6Netfilter::ProcessHook (Hooks_t hookNumber, const Ptr<Packet>& p, Ipv6Header& header,
+                            const Ptr<NetDevice>& in, const Ptr<NetDevice>& out)
+{
+  NetfilterCallbackChain &chain = m_netfilterHooks[(uint32_t)hookNumber];
+  if (chain.IsEmpty ())
+    {
+      return NF_ACCEPT;
+    }
+  ContinueCallback ccb;
+  NetfilterPacketContext ctx (p, &header);
+  return chain.IterateAndCallHook (hookNumber, p, in, out, ccb, ctx);
+}
+
+bool
+Ipv6Netfilter::PacketToTuple (Ptr<const Packet> p, Ipv6ConntrackTuple& tuple, uint8_t& tcpFlags)
+{
+  uint8_t buffer[IPV6_PARSE_SIZE];
+  uint32_t size = p->CopyData (buffer, std::min (p->GetSize (), IPV6_PARSE_SIZE));
+  if (size < IPV6_HEADER_SIZE)
+    {
+      return false;
+    }
+  Ipv6Header header;
+  p->PeekHeader (header);
+  return ParseTuple (header, buffer + IPV6_HEADER_SIZE, size - IPV6_HEADER_SIZE, tuple, tcpFlags);
+}
+
+bool
+Ipv6Netfilter::ParseTuple (const Ipv6Header& header, const uint8_t *buffer, uint32_t size,
+                           Ipv6ConntrackTuple& tuple, uint8_t& tcpFlags)
+{
+  uint8_t nextHeader = header.GetNextHeader ();
+  uint32_t offset = 0;
+  bool extension = true;
+  while (extension)
+    {
+      if (offset + 8 > size)
+        {
+          return false;
+        }
+      switch (nextHeader)
+        {
+        case Ipv6Header::IPV6_EXT_HOP_BY_HOP:
+        case Ipv6Header::IPV6_EXT_ROUTING:
+        case Ipv6Header::IPV6_EXT_DESTINATION:
+          nextHeader = buffer[offset];
+          offset += (buffer[offset + 1] + 1) * 8;
+          break;
+        case Ipv6Header::IPV6_EXT_FRAGMENTATION:
+          if ((((buffer[offset + 2] << 8) | buffer[offset + 3]) & 0xfff8) != 0)
+            {
+              // only the first fragment has the transport header
+              return false;
+            }
+          nextHeader = buffer[offset];
+          offset += 8;
+          break;
+        case Ipv6Header::IPV6_EXT_AUTHENTIFICATION:
+          nextHeader = buffer[offset];
+          offset += (buffer[offset + 1] + 2) * 4;
+          break;
+        default:
+          extension = false;
+          break;
+        }
+    }
+
+  uint16_t sourcePort;
+  uint16_t destinationPort;
+  tcpFlags = 0;
+  switch (nextHeader)
+    {
+    case Ipv6Header::IPV6_TCP:
+      if (offset + 14 > size)
+        {
+          return false;
+        }
+      tcpFlags = buffer[offset + 13] & 0x3f;
+    /* fall through */
+    case Ipv6Header::IPV6_UDP:
+      sourcePort = (buffer[offset] << 8) | buffer[offset + 1];
+      destinationPort = (buffer[offset + 2] << 8) | buffer[offset + 3];
+      break;
+    case Ipv6Header::IPV6_ICMPV6:
+      if (buffer[offset] != Icmpv6Header::ICMPV6_ECHO_REQUEST
+          && buffer[offset] != Icmpv6Header::ICMPV6_ECHO_REPLY)
+        {
+          return false;
+        }
+      sourcePort = (buffer[offset + 4] << 8) | buffer[offset + 5];
+      destinationPort = sourcePort;
+      break;
+    default:
+      return false;
+    }
+
+  tuple = Ipv6ConntrackTuple (header.GetSourceAddress (), sourcePort,
+                              header.GetDestinationAddress (), destinationPort, nextHeader);
+  return true;
+}
+
+uint32_t
+Ipv6Netfilter::ConntrackIn (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                            const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  NS_LOG_FUNCTION (this << packet);
+  // the bytes after the IPv6 header, which may be kept apart from the packet
+  uint8_t buffer[IPV6_PARSE_SIZE];
+  uint32_t offset = ctx.GetIpv6PayloadOffset ();
+  uint32_t size = packet->CopyData (buffer, std::min (packet->GetSize (), IPV6_PARSE_SIZE));
+  Ipv6ConntrackTuple tuple;
+  uint8_t tcpFlags;
+  if (size < offset || !ParseTuple (ctx.GetIpv6Header (), buffer + offset, size - offset, tuple, tcpFlags))
+    {
+      NS_LOG_LOGIC ("Letting packet pass untracked");
+      return NF_ACCEPT;
+    }
+
+  uint8_t info;
+  uint32_t id = 0;
+  bool closing = (tcpFlags & (TcpHeader::FIN | TcpHeader::RST)) != 0;
+  ConntrackTable::iterator entry = m_hash.find (tuple);
+  if (entry != m_hash.end ())
+    {
+      ConntrackTable::iterator reply = m_hash.find (tuple.Invert ());
+      if (entry->first.GetDirection () == IP_CT_DIR_REPLY)
+        {
+          NS_LOG_LOGIC ("Reply of connection " << entry->first);
+          info = IP_CT_ESTABLISHED + IP_CT_IS_REPLY;
+          entry->second.SetStatus (IPS_SEEN_REPLY);
+          if (reply != m_hash.end ())
+            {
+              reply->second.SetStatus (IPS_SEEN_REPLY);
+            }
+        }
+      else
+        {
+          info = (entry->second.GetStatus () & IPS_SEEN_REPLY) ? IP_CT_ESTABLISHED : IP_CT_NEW;
+        }
+
+      closing = closing || entry->second.IsDying ();
+      Time expires = Simulator::Now () + GetConntrackTimeout (tuple.GetProtocol (), closing);
+      entry->second.SetExpires (expires);
+      if (reply != m_hash.end ())
+        {
+          reply->second.SetExpires (expires);
+        }
+      if (closing)
+        {
+          entry->second.SetDying ();
+          if (reply != m_hash.end ())
+            {
+              reply->second.SetDying ();
+            }
+        }
+    }
+  else
+    {
+      info = IP_CT_NEW;
+      UnconfirmedTable::iterator unconfirmed = m_unconfirmed.find (tuple);
+      if (unconfirmed == m_unconfirmed.end ())
+        {
+          NS_LOG_LOGIC ("New connection " << tuple);
+          id = m_nextId++;
+          if (m_nextId == 0)
+            {
+              m_nextId = 1;
+            }
+          m_unconfirmed[tuple] = id;
+          m_pending[id] = tuple;
+          m_conntrackTimers.Schedule (tuple, Simulator::Now () + GetConntrackTimeout (tuple.GetProtocol (), closing));
+        }
+      else
+        {
+          id = unconfirmed->second;
+        }
+    }
+
+  /* Confirmation happens in another hook chain, hand the state over with
+   * the packet */
+  Ipv6ConntrackTag tag;
+  packet->RemovePacketTag (tag);
+  packet->AddPacketTag (Ipv6ConntrackTag (id, info));
+  return NF_ACCEPT;
+}
+
+uint32_t
+Ipv6Netfilter::ConntrackConfirm (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                                 const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  NS_LOG_FUNCTION (this << packet);
+  Ipv6ConntrackTag tag;
+  if (!packet->RemovePacketTag (tag) || tag.GetId () == 0)
+    {
+      return NF_ACCEPT;
+    }
+
+  PendingTable::iterator pending = m_pending.find (tag.GetId ());
+  if (pending == m_pending.end ())
+    {
+      NS_LOG_LOGIC ("Unconfirmed connection expired before its confirmation");
+      return NF_ACCEPT;
+    }
+  Ipv6ConntrackTuple tuple = pending->second;
+  m_pending.erase (pending);
+  m_unconfirmed.erase (tuple);
+  if (m_hash.find (tuple) != m_hash.end ())
+    {
+      return NF_ACCEPT;
+    }
+
+  NS_LOG_LOGIC ("Confirming connection " << tuple);
+  IpConntrackInfo info;
+  info.SetConfirmed ();
+  info.SetInfo (IP_CT_NEW);
+  info.SetExpires (Simulator::Now () + GetConntrackTimeout (tuple.GetProtocol (), false));
+  m_hash[tuple] = info;
+  m_hash[tuple.Invert ()] = info;
+  return NF_ACCEPT;
+}
+
+bool
+Ipv6Netfilter::FindConnection (const Ipv6ConntrackTuple& tuple, IpConntrackInfo& info) const
+{
+  ConntrackTable::const_iterator entry = m_hash.find (tuple);
+  if (entry == m_hash.end ())
+    {
+      return false;
+    }
+  info = entry->second;
+  return true;
+}
+
+uint32_t
+Ipv6Netfilter::GetNConnections (void) const
+{
+  return m_hash.size () / 2;
+}
+
+uint32_t
+Ipv6Netfilter::GetNUnconfirmed (void) const
+{
+  return m_unconfirmed.size ();
+}
+
+void
+Ipv6Netfilter::SetConntrackTableSize (uint32_t size)
+{
+  NS_LOG_FUNCTION (this << size);
+  m_conntrackTableSize = size;
+  // both directions of every connection
+  m_hash.resize (2 * size);
+}
+
+uint32_t
+Ipv6Netfilter::GetConntrackTableSize (void) const
+{
+  return m_conntrackTableSize;
+}
+
+void
+Ipv6Netfilter::SetExpiryGranularity (Time granularity)
+{
+  NS_LOG_FUNCTION (this << granularity);
+  m_conntrackTimers.SetGranularity (granularity);
+}
+
+Time
+Ipv6Netfilter::GetExpiryGranularity (void) const
+{
+  return m_conntrackTimers.GetGranularity ();
+}
+
+Time
+Ipv6Netfilter::GetConntrackTimeout (uint8_t protocol, bool closing) const
+{
+  switch (protocol)
+    {
+    case Ipv6Header::IPV6_TCP:
+      return closing ? m_tcpClosingTimeout : m_tcpEstablishedTimeout;
+    case Ipv6Header::IPV6_ICMPV6:
+      return m_icmpTimeout;
+    default:
+      return m_udpTimeout;
+    }
+}
+
+void
+Ipv6Netfilter::ExpireConntrack (Ipv6ConntrackTuple tuple)
+{
+  ConntrackTable::iterator entry = m_hash.find (tuple);
+  if (entry == m_hash.end ())
+    {
+      // the packet that opened the connection never made it out
+      UnconfirmedTable::iterator unconfirmed = m_unconfirmed.find (tuple);
+      if (unconfirmed != m_unconfirmed.end ())
+        {
+          m_pending.erase (unconfirmed->second);
+          m_unconfirmed.erase (unconfirmed);
+        }
+      return;
+    }
+
+  if (entry->second.GetExpires () > Simulator::Now ())
+    {
+      m_conntrackTimers.Schedule (tuple, entry->second.GetExpires ());
+      return;
+    }
+
+  NS_LOG_LOGIC ("Evicting idle connection " << tuple);
+  m_hash.erase (entry);
+  m_hash.erase (tuple.Invert ());
+  m_evictionTrace (tuple);
+}
+
+void
+Ipv6Netfilter::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_conntrackTimers.Clear ();
+  m_hash.clear ();
+  m_unconfirmed.clear ();
+  m_pending.clear ();
+  for (int i = 0; i < NF_INET_NUMHOOKS; i++)
+    {
+      m_netfilterHooks[i].Clear ();
+    }
+  Object::DoDispose ();
+}
+
+} // namespace ns3
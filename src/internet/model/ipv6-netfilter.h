@@ -0,0 +1,201 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef IPV6_NETFILTER_H
+#define IPV6_NETFILTER_H
+
+#include <stdint.h>
+#include "ns3/ptr.h"
+#include "ns3/net-device.h"
+#include "ns3/packet.h"
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/traced-callback.h"
+#include "ns3/ipv6-header.h"
+
+#include "ipv4-netfilter.h"
+#include "ipv6-conntrack-tuple.h"
+#include "sgi-hashmap.h"
+
+namespace ns3 {
+
+/**
+  * \brief Implementation of netfilter for IPv6
+  *
+  * The IPv6 counterpart of Ipv4Netfilter: Ipv6L3Protocol hands packets
+  * to the same five hooks, each a NetfilterCallbackChain ordered by the
+  * NF_IP_PRI_* priorities, and hooks are registered as Ipv4NetfilterHook
+  * objects. Hooks find the IPv6 header with NetfilterPacketContext::
+  * GetIpv6Header (): at PRE_ROUTING the packet starts with it, at the
+  * other hooks Ipv6L3Protocol keeps it apart from the packet and the hooks
+  * change it in place, so that it is not serialized for them.
+  *
+  * Neither the netfilter nor connection tracking is set up by default:
+  * an IPv6 stack runs hooks once an Ipv6Netfilter is set on it, e.g. by
+  * Ipv6Npt, and tracks connections once EnableConntrack () is called.
+  * Connections are tracked by Ipv6ConntrackTuple for TCP, UDP and ICMPv6
+  * echo, in the same two steps as IPv4: PRE_ROUTING and LOCAL_OUT look
+  * the packet up and note new connections as unconfirmed, POST_ROUTING
+  * and LOCAL_IN confirm them once the packet has made it through the
+  * stack. Idle connections are evicted by a timer wheel.
+  */
+class Ipv6Netfilter : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+
+  Ipv6Netfilter ();
+
+  /**
+    * \param hook The hook function to be registered
+    *
+    * The hook function is added to the callback chain of its hook number,
+    * at its priority.
+    */
+  void RegisterHook (const Ipv4NetfilterHook& hook);
+
+  /**
+    * \param hook The hook function to be removed
+    */
+  void DeregisterHook (const Ipv4NetfilterHook& hook);
+
+  /**
+    * \param hookNumber The hook e.g., NF_INET_PRE_ROUTING
+    * \param p Packet, starting with its IPv6 header
+    * \param in NetDevice which received the packet
+    * \param out The outgoing NetDevice
+    * \returns Netfilter verdict for the Packet: NF_ACCEPT, NF_DROP or NF_STOLEN
+    */
+  uint32_t ProcessHook (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                        const Ptr<NetDevice>& out);
+
+  /**
+    * \param hookNumber The hook e.g., NF_INET_LOCAL_OUT
+    * \param p Packet, without its IPv6 header
+    * \param header IPv6 header of the packet, changed in place by the hooks
+    * \param in NetDevice which received the packet
+    * \param out The outgoing NetDevice
+    * \returns Netfilter verdict for the Packet: NF_ACCEPT, NF_DROP or NF_STOLEN
+    */
+  uint32_t ProcessHook (Hooks_t hookNumber, const Ptr<Packet>& p, Ipv6Header& header,
+                        const Ptr<NetDevice>& in, const Ptr<NetDevice>& out);
+
+  /**
+    * \brief Register the connection tracking hooks
+    *
+    * Does nothing if connection tracking is already enabled.
+    */
+  void EnableConntrack (void);
+
+  /**
+    * \returns true if connections are tracked
+    */
+  bool IsConntrackEnabled (void) const;
+
+  /**
+    * \param p Packet, starting with its IPv6 header
+    * \param tuple The tuple of the packet, in the original direction
+    * \param tcpFlags The flags of a TCP segment, 0 for other packets
+    * \returns true if the packet belongs to a flow that can be tracked
+    *
+    * Skips the extension headers to find the TCP or UDP ports or the
+    * identifier of an ICMPv6 echo message. Fragments other than the first
+    * and other ICMPv6 messages are not tracked.
+    */
+  static bool PacketToTuple (Ptr<const Packet> p, Ipv6ConntrackTuple& tuple, uint8_t& tcpFlags);
+
+  /**
+    * \param tuple Tuple of a packet, in either direction
+    * \param info Set to the conntrack information of the connection
+    * \returns true if the tuple belongs to a confirmed connection
+    */
+  bool FindConnection (const Ipv6ConntrackTuple& tuple, IpConntrackInfo& info) const;
+
+  /**
+    * \returns Number of confirmed connections
+    */
+  uint32_t GetNConnections (void) const;
+
+  /**
+    * \returns Number of connections waiting for their first packet to be
+    * confirmed
+    */
+  uint32_t GetNUnconfirmed (void) const;
+
+  /**
+    * \param size Number of connections the conntrack tables should hold
+    * before they need to grow
+    */
+  void SetConntrackTableSize (uint32_t size);
+  uint32_t GetConntrackTableSize (void) const;
+
+  /**
+    * \param granularity Resolution of the connection expiry timers
+    */
+  void SetExpiryGranularity (Time granularity);
+  Time GetExpiryGranularity (void) const;
+
+  /**
+    * \param protocol Layer 4 protocol of the connection
+    * \param closing true if the connection is being torn down
+    * \returns How long the connection may stay idle before it is evicted
+    */
+  Time GetConntrackTimeout (uint8_t protocol, bool closing) const;
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  typedef sgi::hash_map<Ipv6ConntrackTuple, IpConntrackInfo, Ipv6ConntrackTupleHash> ConntrackTable;
+  typedef sgi::hash_map<Ipv6ConntrackTuple, uint32_t, Ipv6ConntrackTupleHash> UnconfirmedTable;
+  typedef sgi::hash_map<uint32_t, Ipv6ConntrackTuple> PendingTable;
+
+  uint32_t ConntrackIn (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                        const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+  uint32_t ConntrackConfirm (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                             const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+
+  /**
+    * \param tuple Original direction tuple handed back by the timer wheel
+    */
+  void ExpireConntrack (Ipv6ConntrackTuple tuple);
+
+  /**
+    * \param header IPv6 header of the packet
+    * \param buffer Bytes of the packet that follow the IPv6 header
+    * \param size Number of bytes in buffer
+    */
+  static bool ParseTuple (const Ipv6Header& header, const uint8_t *buffer, uint32_t size,
+                          Ipv6ConntrackTuple& tuple, uint8_t& tcpFlags);
+
+  NetfilterCallbackChain m_netfilterHooks[NF_INET_NUMHOOKS];
+  bool m_conntrackEnabled;
+  ConntrackTable m_hash;
+  UnconfirmedTable m_unconfirmed;
+  PendingTable m_pending;
+  uint32_t m_nextId;
+  uint32_t m_conntrackTableSize;
+  NetfilterTimerWheel<Ipv6ConntrackTuple> m_conntrackTimers;
+  Time m_tcpEstablishedTimeout;
+  Time m_tcpClosingTimeout;
+  Time m_udpTimeout;
+  Time m_icmpTimeout;
+  TracedCallback<const Ipv6ConntrackTuple &> m_evictionTrace;
+};
+
+} // namespace ns3
+
+#endif /* IPV6_NETFILTER_H */
@@ -0,0 +1,328 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <algorithm>
+#include "ns3/log.h"
+#include "ns3/node.h"
+#include "ipv6.h"
+#include "ipv6-netfilter.h"
+#include "ipv6-npt.h"
+
+NS_LOG_COMPONENT_DEFINE ("Ipv6Npt");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (Ipv6Npt);
+
+/* One's complement addition of two 16 bit words */
+static inline uint16_t
+OnesAdd (uint16_t a, uint16_t b)
+{
+  uint32_t sum = (uint32_t)a + b;
+  return (sum & 0xffff) + (sum >> 16);
+}
+
+static inline uint16_t
+GetWord (const uint8_t *address, uint32_t word)
+{
+  return (address[2 * word] << 8) | address[2 * word + 1];
+}
+
+static inline void
+SetWord (uint8_t *address, uint32_t word, uint16_t value)
+{
+  address[2 * word] = value >> 8;
+  address[2 * word + 1] = value & 0xff;
+}
+
+Ipv6NptRule::Ipv6NptRule (Ipv6Address internalPrefix, Ipv6Address externalPrefix, uint8_t prefixLength)
+  : m_prefixLength (prefixLength)
+{
+  NS_ASSERT_MSG (prefixLength <= 64, "NPTv6 prefixes are at most /64");
+
+  uint8_t internal[16];
+  uint8_t external[16];
+  internalPrefix.GetBytes (internal);
+  externalPrefix.GetBytes (external);
+
+  uint16_t internalSum = 0;
+  uint16_t externalSum = 0;
+  for (uint32_t i = 0; i < 8; i++)
+    {
+      uint32_t bits = prefixLength > 8 * i ? prefixLength - 8 * i : 0;
+      m_mask[i] = bits >= 8 ? 0xff : (uint8_t)(0xff << (8 - bits));
+      m_internal[i] = internal[i] & m_mask[i];
+      m_external[i] = external[i] & m_mask[i];
+    }
+  for (uint32_t word = 0; word < 4; word++)
+    {
+      internalSum = OnesAdd (internalSum, GetWord (m_internal, word));
+      externalSum = OnesAdd (externalSum, GetWord (m_external, word));
+    }
+
+  // difference to add to the adjusted word, RFC 6296 section 3.2
+  m_outboundAdjustment = OnesAdd (internalSum, ~externalSum);
+  m_inboundAdjustment = OnesAdd (externalSum, ~internalSum);
+}
+
+Ipv6Address
+Ipv6NptRule::GetInternalPrefix (void) const
+{
+  uint8_t address[16] = { 0 };
+  std::copy (m_internal, m_internal + 8, address);
+  return Ipv6Address (address);
+}
+
+Ipv6Address
+Ipv6NptRule::GetExternalPrefix (void) const
+{
+  uint8_t address[16] = { 0 };
+  std::copy (m_external, m_external + 8, address);
+  return Ipv6Address (address);
+}
+
+uint8_t
+Ipv6NptRule::GetPrefixLength (void) const
+{
+  return m_prefixLength;
+}
+
+bool
+Ipv6NptRule::Matches (const uint8_t address[16], const uint8_t prefix[8]) const
+{
+  for (uint32_t i = 0; i < 8; i++)
+    {
+      if ((address[i] & m_mask[i]) != prefix[i])
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+bool
+Ipv6NptRule::MatchesInternal (const uint8_t address[16]) const
+{
+  return Matches (address, m_internal);
+}
+
+bool
+Ipv6NptRule::MatchesExternal (const uint8_t address[16]) const
+{
+  return Matches (address, m_external);
+}
+
+bool
+Ipv6NptRule::Translate (uint8_t address[16], const uint8_t prefix[8], uint16_t adjustment) const
+{
+  // the subnet word for a /48 or shorter prefix, else the first
+  // interface identifier word that is not 0xffff
+  uint32_t word = 3;
+  if (m_prefixLength > 48)
+    {
+      for (word = 4; word < 8 && GetWord (address, word) == 0xffff; word++)
+        {
+        }
+    }
+  if (word == 8 || GetWord (address, word) == 0xffff)
+    {
+      return false;
+    }
+
+  for (uint32_t i = 0; i < 8; i++)
+    {
+      address[i] = (address[i] & ~m_mask[i]) | prefix[i];
+    }
+  uint16_t value = OnesAdd (GetWord (address, word), adjustment);
+  SetWord (address, word, value == 0xffff ? 0 : value);
+  return true;
+}
+
+bool
+Ipv6NptRule::TranslateOutbound (uint8_t address[16]) const
+{
+  return Translate (address, m_external, m_outboundAdjustment);
+}
+
+bool
+Ipv6NptRule::TranslateInbound (uint8_t address[16]) const
+{
+  return Translate (address, m_internal, m_inboundAdjustment);
+}
+
+TypeId
+Ipv6Npt::GetTypeId (void)
+{
+  static TypeId tId = TypeId ("ns3::Ipv6Npt")
+    .SetParent<Object> ()
+    .AddConstructor<Ipv6Npt> ()
+  ;
+  return tId;
+}
+
+Ipv6Npt::Ipv6Npt ()
+  : m_ipv6 (0),
+    m_outsideInterface (-1),
+    m_dropped (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+Ipv6Npt::NotifyNewAggregate ()
+{
+  NS_LOG_FUNCTION (this);
+  if (m_ipv6 != 0)
+    {
+      return;
+    }
+  Ptr<Node> node = this->GetObject<Node> ();
+  if (node != 0)
+    {
+      Ptr<Ipv6> ipv6 = node->GetObject<Ipv6> ();
+      if (ipv6 != 0)
+        {
+          m_ipv6 = ipv6;
+          Ptr<Ipv6Netfilter> netfilter = ipv6->GetNetfilter ();
+          if (netfilter == 0)
+            {
+              netfilter = CreateObject<Ipv6Netfilter> ();
+              ipv6->SetNetfilter (netfilter);
+            }
+          netfilter->RegisterHook (Ipv4NetfilterHook (PF_INET6, NF_INET_PRE_ROUTING, NF_IP_PRI_NAT_DST,
+                                                      MakeCallback (&Ipv6Npt::DoNptPreRouting, this)));
+          netfilter->RegisterHook (Ipv4NetfilterHook (PF_INET6, NF_INET_POST_ROUTING, NF_IP_PRI_NAT_SRC,
+                                                      MakeCallback (&Ipv6Npt::DoNptPostRouting, this)));
+        }
+    }
+  Object::NotifyNewAggregate ();
+}
+
+void
+Ipv6Npt::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_ipv6 = 0;
+  m_rules.clear ();
+  Object::DoDispose ();
+}
+
+void
+Ipv6Npt::AddRule (const Ipv6NptRule& rule)
+{
+  NS_LOG_FUNCTION (this << rule.GetInternalPrefix () << rule.GetExternalPrefix ());
+  m_rules.push_back (rule);
+}
+
+uint32_t
+Ipv6Npt::GetNRules (void) const
+{
+  return m_rules.size ();
+}
+
+Ipv6NptRule
+Ipv6Npt::GetRule (uint32_t index) const
+{
+  NS_ASSERT (index < m_rules.size ());
+  return m_rules[index];
+}
+
+void
+Ipv6Npt::RemoveRule (uint32_t index)
+{
+  NS_LOG_FUNCTION (this << index);
+  NS_ASSERT (index < m_rules.size ());
+  m_rules.erase (m_rules.begin () + index);
+}
+
+void
+Ipv6Npt::SetOutside (int32_t interfaceIndex)
+{
+  NS_LOG_FUNCTION (this << interfaceIndex);
+  m_outsideInterface = interfaceIndex;
+}
+
+uint32_t
+Ipv6Npt::GetNDropped (void) const
+{
+  return m_dropped;
+}
+
+uint32_t
+Ipv6Npt::DoNptPreRouting (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                          const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  NS_LOG_FUNCTION (this << p);
+  if (m_ipv6->GetInterfaceForDevice (in) != m_outsideInterface)
+    {
+      return NF_ACCEPT;
+    }
+
+  Ipv6Header &header = ctx.GetIpv6Header ();
+  uint8_t destination[16];
+  header.GetDestinationAddress ().Serialize (destination);
+  for (NptRules::const_iterator i = m_rules.begin (); i != m_rules.end (); i++)
+    {
+      if (!i->MatchesExternal (destination))
+        {
+          continue;
+        }
+      if (!i->TranslateInbound (destination))
+        {
+          NS_LOG_LOGIC ("Destination can not be translated, dropping");
+          m_dropped++;
+          return NF_DROP;
+        }
+      header.SetDestinationAddress (Ipv6Address (destination));
+      ctx.SetIpv6HeaderDirty ();
+      break;
+    }
+  return NF_ACCEPT;
+}
+
+uint32_t
+Ipv6Npt::DoNptPostRouting (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                           const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  NS_LOG_FUNCTION (this << p);
+  if (m_ipv6->GetInterfaceForDevice (out) != m_outsideInterface)
+    {
+      return NF_ACCEPT;
+    }
+
+  Ipv6Header &header = ctx.GetIpv6Header ();
+  uint8_t source[16];
+  header.GetSourceAddress ().Serialize (source);
+  for (NptRules::const_iterator i = m_rules.begin (); i != m_rules.end (); i++)
+    {
+      if (!i->MatchesInternal (source))
+        {
+          continue;
+        }
+      if (!i->TranslateOutbound (source))
+        {
+          NS_LOG_LOGIC ("Source can not be translated, dropping");
+          m_dropped++;
+          return NF_DROP;
+        }
+      header.SetSourceAddress (Ipv6Address (source));
+      ctx.SetIpv6HeaderDirty ();
+      break;
+    }
+  return NF_ACCEPT;
+}
+
+} // namespace ns3
@@ -0,0 +1,172 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef IPV6_NPT_H
+#define IPV6_NPT_H
+
+#include <stdint.h>
+#include <vector>
+#include "ns3/ptr.h"
+#include "ns3/net-device.h"
+#include "ns3/packet.h"
+#include "ns3/object.h"
+#include "ns3/ipv6-address.h"
+#include "ipv4-netfilter.h"
+
+namespace ns3 {
+
+class Ipv6;
+
+/**
+  * \brief Prefix translation rule of NPTv6 (RFC 6296).
+  *
+  * Maps an internal prefix onto an external one of the same length, at
+  * most /64. The one's complement sums of both prefixes are computed once
+  * when the rule is made; translating an address then replaces the
+  * prefix bits and adds the precomputed difference to one 16 bit word of
+  * the address, so the one's complement sum of the address, and with it
+  * the transport checksum of every packet, does not change.
+  */
+class Ipv6NptRule
+{
+public:
+  /**
+    * \param internalPrefix The prefix used inside the site
+    * \param externalPrefix The prefix the site is known by outside
+    * \param prefixLength The length of both prefixes, 64 at most
+    */
+  Ipv6NptRule (Ipv6Address internalPrefix, Ipv6Address externalPrefix, uint8_t prefixLength);
+
+  Ipv6Address GetInternalPrefix (void) const;
+  Ipv6Address GetExternalPrefix (void) const;
+  uint8_t GetPrefixLength (void) const;
+
+  /**
+    * \param address Address in network order
+    * \returns true if the address is in the internal prefix
+    */
+  bool MatchesInternal (const uint8_t address[16]) const;
+
+  /**
+    * \param address Address in network order
+    * \returns true if the address is in the external prefix
+    */
+  bool MatchesExternal (const uint8_t address[16]) const;
+
+  /**
+    * \param address Address in the internal prefix, rewritten in place
+    * \returns false if the address can not be translated
+    *
+    * With a prefix of /48 or shorter the subnet word 0xffff can not be
+    * translated, RFC 6296 section 3.5.
+    */
+  bool TranslateOutbound (uint8_t address[16]) const;
+
+  /**
+    * \param address Address in the external prefix, rewritten in place
+    * \returns false if the address can not be translated
+    */
+  bool TranslateInbound (uint8_t address[16]) const;
+
+private:
+  bool Translate (uint8_t address[16], const uint8_t prefix[8], uint16_t adjustment) const;
+  bool Matches (const uint8_t address[16], const uint8_t prefix[8]) const;
+
+  uint8_t m_internal[8];
+  uint8_t m_external[8];
+  uint8_t m_mask[8];
+  uint8_t m_prefixLength;
+  uint16_t m_outboundAdjustment;
+  uint16_t m_inboundAdjustment;
+};
+
+/**
+  * \brief Stateless IPv6-to-IPv6 network prefix translation (NPTv6)
+  *
+  * Hooks into the Ipv6Netfilter of its node, setting one up when the IPv6
+  * stack has none, since the netfilter is opt-in: packets leaving through the
+  * outside interface get the internal prefix of their source replaced by
+  * the external one at POST_ROUTING, packets received on the outside
+  * interface get the external prefix of their destination replaced by the
+  * internal one at PRE_ROUTING. No per flow state is kept and neither
+  * the transport header nor its checksum is touched, so the per packet
+  * cost is one rule lookup and an address rewrite of the IPv6 header,
+  * written back in place by the packet context.
+  */
+class Ipv6Npt : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+
+  Ipv6Npt ();
+
+  /**
+    * \param rule Prefix translation rule to add
+    */
+  void AddRule (const Ipv6NptRule& rule);
+
+  /**
+    * \returns Number of prefix translation rules
+    */
+  uint32_t GetNRules (void) const;
+
+  /**
+    * \param index Index of the rule
+    * \returns The rule
+    */
+  Ipv6NptRule GetRule (uint32_t index) const;
+
+  /**
+    * \param index Index of the rule to remove
+    */
+  void RemoveRule (uint32_t index);
+
+  /**
+    * \param interfaceIndex IPv6 interface facing the external network
+    */
+  void SetOutside (int32_t interfaceIndex);
+
+  /**
+    * \returns Number of packets dropped because their address could not
+    * be translated
+    */
+  uint32_t GetNDropped (void) const;
+
+protected:
+  /**
+    * This function will notify other components connected to the node
+    * that a new stack member is now connected. This will be used to
+    * register the translation hooks with the Ipv6Netfilter of the node.
+    */
+  virtual void NotifyNewAggregate ();
+  virtual void DoDispose (void);
+
+private:
+  typedef std::vector<Ipv6NptRule> NptRules;
+
+  uint32_t DoNptPreRouting (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                            const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+  uint32_t DoNptPostRouting (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                             const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+
+  Ptr<Ipv6> m_ipv6;
+  NptRules m_rules;
+  int32_t m_outsideInterface;
+  uint32_t m_dropped;
+};
+
+} // namespace ns3
+
+#endif /* IPV6_NPT_H */
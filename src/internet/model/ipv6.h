@@ -38,6 +38,7 @@ class Node;
 class NetDevice;
 class Packet;
 class Ipv6RoutingProtocol;
+class Ipv6Netfilter;
 
 /**
  * \ingroup internet
@@ -109,6 +110,22 @@ public:
    */
   virtual Ptr<Ipv6RoutingProtocol> GetRoutingProtocol (void) const = 0;
 
+  /**
+   * \brief Add a netfilter object to be used by this IPv6 stack
+   *
+   * This call will replace any previously added Ipv6Netfilter object.
+   *
+   * \param netfilter smart pointer to Ipv6Netfilter object
+   */
+  virtual void SetNetfilter (Ptr<Ipv6Netfilter> netfilter) = 0;
+
+  /**
+   * \brief Get the Ipv6Netfilter object used by this Ipv6 stack
+   *
+   * \returns smart pointer to Ipv6Netfilter object, or null pointer if none
+   */
+  virtual Ptr<Ipv6Netfilter> GetNetfilter (void) const = 0;
+
   /**
    * \brief Add a NetDevice interface.
    *
@@ -20,73 +20,66 @@
 
 #include "netfilter-callback-chain.h"
 #include "ipv4-netfilter-hook.h"
+#include "netfilter-packet-context.h"
+#include <algorithm>
+#include <iterator>
 
 namespace ns3 {
 
 NetfilterCallbackChain::NetfilterCallbackChain ()
+  : m_netfilterHooks (Create<HookList> ())
 {
 }
 
 void
 NetfilterCallbackChain::Insert (const Ipv4NetfilterHook& hook)
 {
-  if (m_netfilterHooks.empty () )
+  // a traversal in progress keeps the old array
+  Ptr<HookList> list = Create<HookList> ();
+  list->hooks.reserve (m_netfilterHooks->hooks.size () + 1);
+  // after the hooks of the same priority
+  std::vector<Ipv4NetfilterHook>::iterator it = m_netfilterHooks->hooks.begin ();
+  while (it != m_netfilterHooks->hooks.end () && it->GetPriority () <= hook.GetPriority ())
     {
-      m_netfilterHooks.push_front (hook);
-    }
-  else
-    {
-      std::list<Ipv4NetfilterHook>::iterator it = m_netfilterHooks.begin ();
-      for (; it != m_netfilterHooks.end (); it++)
-        {
-          if (hook.GetPriority () < it->GetPriority ())
-            {
-              m_netfilterHooks.insert (it,hook);
-              return;
-            }
-        }
-      m_netfilterHooks.push_back (hook);
+      list->hooks.push_back (*it);
+      it++;
     }
+  list->hooks.push_back (hook);
+  list->hooks.insert (list->hooks.end (), it, m_netfilterHooks->hooks.end ());
+  m_netfilterHooks = list;
 }
 
-std::list<Ipv4NetfilterHook>::iterator
+std::vector<Ipv4NetfilterHook>::iterator
 NetfilterCallbackChain::Find (const Ipv4NetfilterHook& hook)
 {
-  std::list<Ipv4NetfilterHook>::iterator it = m_netfilterHooks.begin ();
-  std::list<Ipv4NetfilterHook>::iterator it2;
-
-  for (; it != m_netfilterHooks.end (); it++)
-    {
-      if (*it == hook)
-        {
-          return it;
-        }
-    }
-  return it2;
+  return std::find (m_netfilterHooks->hooks.begin (), m_netfilterHooks->hooks.end (), hook);
 }
 
 void
 NetfilterCallbackChain::Remove (const Ipv4NetfilterHook& hook)
 {
-  m_netfilterHooks.remove (hook);
+  Ptr<HookList> list = Create<HookList> ();
+  std::remove_copy (m_netfilterHooks->hooks.begin (), m_netfilterHooks->hooks.end (),
+                    std::back_inserter (list->hooks), hook);
+  m_netfilterHooks = list;
 }
 
 Ipv4NetfilterHook
 NetfilterCallbackChain::Front ()
 {
-  return m_netfilterHooks.front ();
+  return m_netfilterHooks->hooks.front ();
 }
 
 uint32_t
 NetfilterCallbackChain::Size () const
 {
-  return m_netfilterHooks.size ();
+  return m_netfilterHooks->hooks.size ();
 }
 
 bool
 NetfilterCallbackChain::IsEmpty () const
 {
-  if (m_netfilterHooks.empty ())
+  if (m_netfilterHooks->hooks.empty ())
     {
       return true;
     }
@@ -99,20 +92,55 @@ NetfilterCallbackChain::IsEmpty () const
 void
 NetfilterCallbackChain::Clear ()
 {
-  m_netfilterHooks.clear ();
+  m_netfilterHooks = Create<HookList> ();
 }
 
 int32_t
-NetfilterCallbackChain::IterateAndCallHook (Hooks_t hookNumber, Ptr<Packet> p, Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback ccb)
+NetfilterCallbackChain::IterateAndCallHook (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                                            const Ptr<NetDevice>& out, ContinueCallback& ccb,
+                                            NetfilterFragmentCache *fragments)
 {
-  std::list<Ipv4NetfilterHook>::iterator it = m_netfilterHooks.begin ();
+  if (m_netfilterHooks->hooks.empty ())
+    {
+      return NF_ACCEPT;
+    }
+
+  // the headers are parsed once for the whole chain and changes to them
+  // are written back when the last hook is done
+  NetfilterPacketContext ctx (p, fragments);
+  return IterateAndCallHook (hookNumber, p, in, out, ccb, ctx);
+}
 
-  for (; it != m_netfilterHooks.end (); it++)
+int32_t
+NetfilterCallbackChain::IterateAndCallHook (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                                            const Ptr<NetDevice>& out, ContinueCallback& ccb,
+                                            NetfilterPacketContext& ctx)
+{
+  // the array of the chain as it is now, even if a hook changes the chain
+  Ptr<HookList> list = m_netfilterHooks;
+  std::vector<Ipv4NetfilterHook>& hooks = list->hooks;
+  for (uint32_t i = 0; i < hooks.size (); i++)
     {
-      it->HookCallback (hookNumber, p, in, out, ccb);
+      uint32_t verdict = hooks[i].HookCallback (hookNumber, p, in, out, ccb, ctx);
+      // a dropped or stolen packet is not looked at by the remaining hooks;
+      // a stolen one is handed on with the changes made to it so far
+      if (verdict == NF_DROP)
+        {
+          return verdict;
+        }
+      if (verdict == NF_STOLEN)
+        {
+          ctx.Flush ();
+          return verdict;
+        }
+      if (verdict == NF_STOP)
+        {
+          break;
+        }
     }
+  ctx.Flush ();
 
-  return NF_ACCEPT; // TODO: Check
+  return NF_ACCEPT;
 }
 
 } // namespace ns3
@@ -21,16 +21,25 @@
 #ifndef NETFILTER_CALLBACK_CHAIN_H
 #define NETFILTER_CALLBACK_CHAIN_H
 
-#include <list>
+#include <vector>
+#include "ns3/ptr.h"
+#include "ns3/simple-ref-count.h"
 #include "ipv4-netfilter-hook.h"
 
 namespace ns3 {
 
+class NetfilterFragmentCache;
+
 /**
  * \brief container class for holding netfilter callbacks
  *
  * This class manages a list of callbacks for the netfilter system.
- * The callback objects are copied upon insertion into a list.
+ * The callback objects are copied upon insertion into an array that is
+ * kept sorted by priority, hooks of equal priority in the order they were
+ * inserted. Insert (), Remove () and Clear () build a new array in place of
+ * the old one, so that a traversal walks over contiguous memory and is not
+ * disturbed by a hook that changes the chain it is called from: it finishes
+ * with the hooks the chain held when it started.
  * The IP netfilter code can call IterateAndCallHook () to traverse the
  * callback chain.
  */
@@ -39,16 +48,59 @@ class NetfilterCallbackChain
 public:
   NetfilterCallbackChain ();
   void Insert (const Ipv4NetfilterHook& hook);
-  std::list<Ipv4NetfilterHook>::iterator Find (const Ipv4NetfilterHook& hook);
+  std::vector<Ipv4NetfilterHook>::iterator Find (const Ipv4NetfilterHook& hook);
   void Remove (const Ipv4NetfilterHook& hook);
   Ipv4NetfilterHook Front ();
   uint32_t Size () const;
   bool IsEmpty () const;
   void Clear ();
-  int32_t IterateAndCallHook (Hooks_t, Ptr<Packet> p, Ptr<NetDevice> in, Ptr<NetDevice> out, ContinueCallback ccb);
+
+  /**
+    * \param hookNumber The hook the packet traverses
+    * \param p The packet
+    * \param in NetDevice which received the packet
+    * \param out The outgoing NetDevice
+    * \param ccb Callback handed to the hooks
+    * \param fragments Ports of fragmented datagrams for the packet context,
+    * 0 for none
+    * \returns NF_ACCEPT, or the NF_DROP or NF_STOLEN verdict of the hook
+    * that stopped the traversal
+    *
+    * The hooks are called in order of priority until one drops or steals
+    * the packet. NF_STOP accepts the packet without calling the remaining
+    * hooks. An empty chain accepts the packet without looking at it.
+    */
+  int32_t IterateAndCallHook (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                              const Ptr<NetDevice>& out, ContinueCallback& ccb,
+                              NetfilterFragmentCache *fragments = 0);
+
+  /**
+    * \param hookNumber The hook the packet traverses
+    * \param p The packet
+    * \param in NetDevice which received the packet
+    * \param out The outgoing NetDevice
+    * \param ccb Callback handed to the hooks
+    * \param ctx Context of the packet, set up by the caller
+    * \returns NF_ACCEPT, or the NF_DROP or NF_STOLEN verdict of the hook
+    * that stopped the traversal
+    *
+    * Traverses the chain like the method above, with the context given.
+    */
+  int32_t IterateAndCallHook (Hooks_t hookNumber, const Ptr<Packet>& p, const Ptr<NetDevice>& in,
+                              const Ptr<NetDevice>& out, ContinueCallback& ccb,
+                              NetfilterPacketContext& ctx);
 
 private:
-  std::list<Ipv4NetfilterHook> m_netfilterHooks;
+  /**
+   * \brief The hooks of the chain, shared with the traversals in progress
+   */
+  class HookList : public SimpleRefCount<HookList>
+  {
+public:
+    std::vector<Ipv4NetfilterHook> hooks;
+  };
+
+  Ptr<HookList> m_netfilterHooks;
 };
 
 } // namespace ns3
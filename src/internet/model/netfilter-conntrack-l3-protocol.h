@@ -30,6 +30,7 @@
 namespace ns3 {
 
 class Packet;
+class NetfilterPacketContext;
 
 /**
   * \brief Base class for Netfilter Layer 3 m_protocol helper
@@ -42,14 +43,14 @@ class NetfilterConntrackL3Protocol : public RefCountBase
 {
 public:
   /**
-    * \param packet Packet that should be converted to a tuple
+    * \param ctx Headers of the packet that should be converted to a tuple
     * \param tuple The created tuple is stored here
     * \returns true if success, false otherwise
     *
     * Protocol specific method to convert a packet into a tuple
     * for connection tracking purposes.
     */
-  virtual bool PacketToTuple (Ptr<Packet> packet, NetfilterConntrackTuple& tuple)
+  virtual bool PacketToTuple (NetfilterPacketContext& ctx, NetfilterConntrackTuple& tuple)
   {
     return false;
   }
@@ -32,6 +32,7 @@
 namespace ns3 {
 
 class Packet;
+class NetfilterPacketContext;
 
 class NetfilterConntrackL4Protocol : public RefCountBase
 {
@@ -41,14 +42,14 @@ public:
   PacketVerdict_t PacketVerdict;
 
   /**
-    * \param packet Packet that should be converted to a tuple
+    * \param ctx Headers of the packet that should be converted to a tuple
     * \param tuple The created tuple is stored here
     * \returns true if success, false otherwise
     *
     * Protocol specific method to convert a packet into a tuple
     * for connection tracking purposes.
     */
-  virtual bool PacketToTuple (Ptr<Packet>, NetfilterConntrackTuple&)
+  virtual bool PacketToTuple (NetfilterPacketContext&, NetfilterConntrackTuple&)
   {
     return false;
   }
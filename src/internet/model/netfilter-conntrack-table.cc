@@ -0,0 +1,303 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2009 University of Texas at Dallas
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "netfilter-conntrack-table.h"
+
+NS_LOG_COMPONENT_DEFINE ("NetfilterConntrackTable");
+
+namespace ns3 {
+
+NetfilterConntrackTable::Iterator::Iterator ()
+  : m_table (0),
+    m_index (0)
+{
+}
+
+NetfilterConntrackTable::Iterator::Iterator (const NetfilterConntrackTable *table, uint32_t index)
+  : m_table (table),
+    m_index (index)
+{
+  SkipEmpty ();
+}
+
+void
+NetfilterConntrackTable::Iterator::SkipEmpty (void)
+{
+  while (m_index < m_table->m_slots.size () && !m_table->m_slots[m_index].used)
+    {
+      m_index++;
+    }
+}
+
+NetfilterConntrackTable::Entry&
+NetfilterConntrackTable::Iterator::operator* () const
+{
+  return const_cast<Entry&> (m_table->m_slots[m_index].entry);
+}
+
+NetfilterConntrackTable::Entry*
+NetfilterConntrackTable::Iterator::operator-> () const
+{
+  return const_cast<Entry*> (&m_table->m_slots[m_index].entry);
+}
+
+NetfilterConntrackTable::Iterator&
+NetfilterConntrackTable::Iterator::operator++ ()
+{
+  m_index++;
+  SkipEmpty ();
+  return *this;
+}
+
+bool
+NetfilterConntrackTable::Iterator::operator== (const Iterator& o) const
+{
+  return m_table == o.m_table && m_index == o.m_index;
+}
+
+bool
+NetfilterConntrackTable::Iterator::operator!= (const Iterator& o) const
+{
+  return !(*this == o);
+}
+
+NetfilterConntrackTable::NetfilterConntrackTable ()
+  : m_mask (0),
+    m_size (0)
+{
+  Rehash (16);
+}
+
+NetfilterConntrackTable::NetfilterConntrackTable (uint32_t capacity)
+  : m_mask (0),
+    m_size (0)
+{
+  Reserve (capacity);
+}
+
+uint32_t
+NetfilterConntrackTable::RoundUpToPowerOfTwo (uint32_t n)
+{
+  uint32_t slots = 16;
+  while (slots < n && slots < 0x80000000U)
+    {
+      slots <<= 1;
+    }
+  return slots;
+}
+
+void
+NetfilterConntrackTable::Reserve (uint32_t capacity)
+{
+  NS_LOG_FUNCTION (this << capacity);
+  if (capacity < m_size)
+    {
+      capacity = m_size;
+    }
+  /* keep the load factor at or below 3/4 once capacity entries are in */
+  uint64_t wanted = ((uint64_t)capacity * 4 + 2) / 3;
+  Rehash (RoundUpToPowerOfTwo (wanted > 0x80000000U ? 0x80000000U : (uint32_t)wanted));
+}
+
+void
+NetfilterConntrackTable::Rehash (uint32_t slots)
+{
+  NS_LOG_FUNCTION (this << slots);
+  std::vector<Slot> old;
+  old.swap (m_slots);
+
+  Slot empty;
+  empty.hash = 0;
+  empty.used = false;
+  m_slots.assign (slots, empty);
+  m_mask = slots - 1;
+  m_size = 0;
+
+  for (std::vector<Slot>::const_iterator it = old.begin (); it != old.end (); it++)
+    {
+      if (it->used)
+        {
+          Entry *e = DoInsert (it->entry.tuple, it->hash);
+          e->info = it->entry.info;
+        }
+    }
+}
+
+uint32_t
+NetfilterConntrackTable::Lookup (const NetfilterConntrackTuple& tuple, uint32_t hash) const
+{
+  uint32_t i = hash & m_mask;
+  while (m_slots[i].used)
+    {
+      if (m_slots[i].hash == hash && m_slots[i].entry.tuple == tuple)
+        {
+          return i;
+        }
+      i = (i + 1) & m_mask;
+    }
+  return m_slots.size ();
+}
+
+NetfilterConntrackTable::Entry*
+NetfilterConntrackTable::DoInsert (const NetfilterConntrackTuple& tuple, uint32_t hash)
+{
+  uint32_t i = hash & m_mask;
+  while (m_slots[i].used)
+    {
+      i = (i + 1) & m_mask;
+    }
+  m_slots[i].used = true;
+  m_slots[i].hash = hash;
+  m_slots[i].entry.tuple = tuple;
+  m_slots[i].entry.info = IpConntrackInfo ();
+  m_size++;
+  return &m_slots[i].entry;
+}
+
+NetfilterConntrackTable::Entry*
+NetfilterConntrackTable::Find (const NetfilterConntrackTuple& tuple)
+{
+  uint32_t i = Lookup (tuple, m_hasher (tuple));
+  if (i == m_slots.size ())
+    {
+      return 0;
+    }
+  return &m_slots[i].entry;
+}
+
+NetfilterConntrackTable::Entry*
+NetfilterConntrackTable::Insert (const NetfilterConntrackTuple& tuple, const IpConntrackInfo& info)
+{
+  uint32_t hash = m_hasher (tuple);
+  uint32_t i = Lookup (tuple, hash);
+  Entry *e;
+  if (i != m_slots.size ())
+    {
+      e = &m_slots[i].entry;
+    }
+  else
+    {
+      if ((uint64_t)(m_size + 1) * 4 > (uint64_t)m_slots.size () * 3)
+        {
+          Rehash (m_slots.size () * 2);
+        }
+      e = DoInsert (tuple, hash);
+    }
+  e->info = info;
+  return e;
+}
+
+IpConntrackInfo&
+NetfilterConntrackTable::operator[] (const NetfilterConntrackTuple& tuple)
+{
+  Entry *e = Find (tuple);
+  if (e == 0)
+    {
+      e = Insert (tuple, IpConntrackInfo ());
+    }
+  return e->info;
+}
+
+bool
+NetfilterConntrackTable::Erase (const NetfilterConntrackTuple& tuple)
+{
+  uint32_t i = Lookup (tuple, m_hasher (tuple));
+  if (i == m_slots.size ())
+    {
+      return false;
+    }
+
+  /* Backward shift deletion: move up every following entry of the probe
+   * run that would still be reachable from its home slot through i */
+  uint32_t j = i;
+  while (true)
+    {
+      j = (j + 1) & m_mask;
+      if (!m_slots[j].used)
+        {
+          break;
+        }
+      uint32_t home = m_slots[j].hash & m_mask;
+      bool movable = (i <= j) ? (home <= i || home > j) : (home <= i && home > j);
+      if (movable)
+        {
+          m_slots[i] = m_slots[j];
+          i = j;
+        }
+    }
+  m_slots[i].used = false;
+  m_size--;
+  return true;
+}
+
+void
+NetfilterConntrackTable::Clear (void)
+{
+  for (std::vector<Slot>::iterator it = m_slots.begin (); it != m_slots.end (); it++)
+    {
+      it->used = false;
+    }
+  m_size = 0;
+}
+
+uint32_t
+NetfilterConntrackTable::GetSize (void) const
+{
+  return m_size;
+}
+
+uint32_t
+NetfilterConntrackTable::GetCapacity (void) const
+{
+  return m_slots.size ();
+}
+
+void
+NetfilterConntrackTable::GetProbeHistogram (std::vector<uint32_t>& histogram) const
+{
+  histogram.clear ();
+  for (uint32_t i = 0; i < m_slots.size (); i++)
+    {
+      if (!m_slots[i].used)
+        {
+          continue;
+        }
+      uint32_t distance = (i - m_slots[i].hash) & m_mask;
+      if (distance >= histogram.size ())
+        {
+          histogram.resize (distance + 1, 0);
+        }
+      histogram[distance]++;
+    }
+}
+
+NetfilterConntrackTable::Iterator
+NetfilterConntrackTable::Begin (void) const
+{
+  return Iterator (this, 0);
+}
+
+NetfilterConntrackTable::Iterator
+NetfilterConntrackTable::End (void) const
+{
+  return Iterator (this, m_slots.size ());
+}
+
+} // namespace ns3
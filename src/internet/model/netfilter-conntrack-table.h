@@ -0,0 +1,167 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2009 University of Texas at Dallas
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef NETFILTER_CONNTRACK_TABLE_H
+#define NETFILTER_CONNTRACK_TABLE_H
+
+#include <stdint.h>
+#include <vector>
+#include "netfilter-conntrack-tuple.h"
+#include "ip-conntrack-info.h"
+
+namespace ns3 {
+
+/**
+  * \brief Open addressing hash table holding connection tracking entries
+  *
+  * Maps a NetfilterConntrackTuple to its IpConntrackInfo. Slots live in a
+  * single contiguous array whose size is always a power of two; collisions
+  * are resolved by linear probing and removals use backward shift deletion,
+  * so no tombstones accumulate in long running simulations. The full 32 bit
+  * hash of every key is cached in its slot, which lets a probe skip
+  * mismatching entries without comparing the tuples themselves.
+  *
+  * The table doubles its capacity whenever the load factor would exceed
+  * 3/4. Pointers to entries returned by Find (), Insert () and operator[]
+  * stay valid until the next insertion or removal on the same table.
+  */
+class NetfilterConntrackTable
+{
+public:
+  /**
+    * \brief A connection tracking entry stored in the table
+    */
+  struct Entry
+  {
+    NetfilterConntrackTuple tuple;
+    IpConntrackInfo info;
+  };
+
+  /**
+    * \brief Forward iterator over the occupied slots of the table
+    */
+  class Iterator
+  {
+  public:
+    Iterator ();
+    Entry& operator* () const;
+    Entry* operator-> () const;
+    Iterator& operator++ ();
+    bool operator== (const Iterator& o) const;
+    bool operator!= (const Iterator& o) const;
+
+  private:
+    friend class NetfilterConntrackTable;
+    Iterator (const NetfilterConntrackTable *table, uint32_t index);
+    void SkipEmpty (void);
+    const NetfilterConntrackTable *m_table;
+    uint32_t m_index;
+  };
+
+  NetfilterConntrackTable ();
+
+  /**
+    * \param capacity Number of entries the table should hold without
+    * having to grow
+    */
+  NetfilterConntrackTable (uint32_t capacity);
+
+  /**
+    * \param capacity Number of entries the table should hold without
+    * having to grow
+    *
+    * Resizes the slot array, rehashing the entries already present. The
+    * table never shrinks below the number of entries it currently holds.
+    */
+  void Reserve (uint32_t capacity);
+
+  /**
+    * \param tuple The tuple to look up
+    * \returns Pointer to the matching entry or 0 if there is none
+    */
+  Entry* Find (const NetfilterConntrackTuple& tuple);
+
+  /**
+    * \param tuple The key of the entry
+    * \param info The connection tracking information to store
+    * \returns Pointer to the stored entry
+    *
+    * Inserts a new entry or overwrites the information of an existing one.
+    * The stored key keeps the direction of the first inserted tuple.
+    */
+  Entry* Insert (const NetfilterConntrackTuple& tuple, const IpConntrackInfo& info);
+
+  /**
+    * \param tuple The key to look up
+    * \returns Reference to the information stored for the tuple, a default
+    * initialized entry is created if the tuple is not present yet
+    */
+  IpConntrackInfo& operator[] (const NetfilterConntrackTuple& tuple);
+
+  /**
+    * \param tuple The key of the entry to remove
+    * \returns true if an entry was removed
+    */
+  bool Erase (const NetfilterConntrackTuple& tuple);
+
+  /**
+    * \brief Remove all entries, the capacity is kept
+    */
+  void Clear (void);
+
+  /**
+    * \returns Number of entries in the table
+    */
+  uint32_t GetSize (void) const;
+
+  /**
+    * \returns Number of slots in the table
+    */
+  uint32_t GetCapacity (void) const;
+
+  /**
+    * \param histogram Set to the number of entries by the number of slots
+    * a lookup of them probes; entry n counts the entries found n slots
+    * after their home slot
+    */
+  void GetProbeHistogram (std::vector<uint32_t>& histogram) const;
+
+  Iterator Begin (void) const;
+  Iterator End (void) const;
+
+private:
+  struct Slot
+  {
+    Entry entry;
+    uint32_t hash;
+    bool used;
+  };
+
+  static uint32_t RoundUpToPowerOfTwo (uint32_t n);
+  uint32_t Lookup (const NetfilterConntrackTuple& tuple, uint32_t hash) const;
+  Entry* DoInsert (const NetfilterConntrackTuple& tuple, uint32_t hash);
+  void Rehash (uint32_t slots);
+
+  std::vector<Slot> m_slots;
+  uint32_t m_mask;
+  uint32_t m_size;
+  ConntrackTupleHash m_hasher;
+};
+
+} // namespace ns3
+
+#endif /* NETFILTER_CONNTRACK_TABLE_H */
@@ -19,23 +19,30 @@
  */
 
 #include "netfilter-conntrack-tuple.h"
+#include "netfilter-jhash.h"
 
 NS_LOG_COMPONENT_DEFINE ("ConntrackTupleHash");
 
 namespace ns3 {
 
 NetfilterConntrackTuple::NetfilterConntrackTuple ()
+  : m_l3Protocol (0),
+    m_l4Source (0),
+    m_l4Destination (0),
+    m_protocolNumber (0),
+    m_direction (IP_CT_DIR_ORIGINAL)
 {
-  m_l4Source = 0;
-  m_l4Destination = 0;
 }
 
 NetfilterConntrackTuple::NetfilterConntrackTuple (Ipv4Address src, uint16_t srcPort, Ipv4Address dst, uint16_t dstPort)
+  : m_l3Source (src),
+    m_l3Protocol (0),
+    m_l4Source (srcPort),
+    m_l3Destination (dst),
+    m_l4Destination (dstPort),
+    m_protocolNumber (0),
+    m_direction (IP_CT_DIR_ORIGINAL)
 {
-  m_l3Source = src;
-  m_l4Source = srcPort;
-  m_l3Destination = dst;
-  m_l4Destination = dstPort;
 }
 
 bool
@@ -44,7 +51,8 @@ NetfilterConntrackTuple::operator== (const NetfilterConntrackTuple t) const
   return (m_l3Source == t.m_l3Source)
          && (m_l4Source == t.m_l4Source)
          && (m_l3Destination == t.m_l3Destination)
-         && (m_l4Destination == t.m_l4Destination);
+         && (m_l4Destination == t.m_l4Destination)
+         && (m_protocolNumber == t.m_protocolNumber);
 }
 
 bool
@@ -127,6 +135,12 @@ uint16_t NetfilterConntrackTuple::GetProtocol ()
   return m_l3Protocol;
 }
 
+void
+NetfilterConntrackTuple::SetDestinationProtocol (uint8_t protocol)
+{
+  m_protocolNumber = protocol;
+}
+
 void
 NetfilterConntrackTuple::SetDirection (ConntrackDirection_t direction)
 {
@@ -149,6 +163,8 @@ NetfilterConntrackTuple
 NetfilterConntrackTuple::Invert ()
 {
   NetfilterConntrackTuple inverse (GetDestination (), GetDestinationPort (), GetSource (), GetSourcePort ());
+  inverse.m_l3Protocol = m_l3Protocol;
+  inverse.m_protocolNumber = m_protocolNumber;
   inverse.SetDirection (this->GetDirection () == IP_CT_DIR_ORIGINAL ? IP_CT_DIR_REPLY : IP_CT_DIR_ORIGINAL);
   return inverse;
 }
@@ -183,90 +199,19 @@ std::ostream& operator << (std::ostream& os, NetfilterConntrackTuple const& tupl
   return os;
 }
 
-#define JHASH_GOLDEN_RATIO  0x9e3779b9
-
-void
-JHashMix (uint32_t a, uint32_t b, uint32_t c)
-{
-  a -= b;
-  a -= c;
-  a ^= (c >> 13);
-  b -= c;
-  b -= a;
-  b ^= (a << 8);
-  c -= a;
-  c -= b;
-  c ^= (b >> 13);
-  a -= b;
-  a -= c;
-  a ^= (c >> 12);
-  b -= c;
-  b -= a;
-  b ^= (a << 16);
-  c -= a;
-  c -= b;
-  c ^= (b >> 5);
-  a -= b;
-  a -= c;
-  a ^= (c >> 3);
-  b -= c;
-  b -= a;
-  b ^= (a << 10);
-  c -= a;
-  c -= b;
-  c ^= (b >> 15);
-}
-
-uint32_t
-JHash2 (const uint32_t *k, uint32_t length, uint32_t initval)
-{
-  uint32_t a, b, c, len;
-
-  a = b = JHASH_GOLDEN_RATIO;
-  c = initval;
-  len = length;
-
-  while (len >= 3)
-    {
-      a += k[0];
-      b += k[1];
-      c += k[2];
-      JHashMix (a, b, c);
-      k += 3;
-      len -= 3;
-    }
-
-  c += length * 4;
-
-  switch (len)
-    {
-    case 2:
-      b += k[1];
-    case 1:
-      a += k[0];
-    }
-
-  JHashMix (a,b,c);
-  return c;
-
-}
-
 size_t
 ConntrackTupleHash::operator() (const NetfilterConntrackTuple &x) const
 {
-  uint32_t n;
-  uint32_t h;
-  uint16_t rnd = 2;
-  uint32_t size = 12;
-
-  n = (sizeof (x.GetSource ()) + sizeof (x.GetSourcePort ()) +
-       sizeof (x.GetDestination ()) + sizeof (x.GetDestinationPort ())) / sizeof (uint32_t);
+  /* Fixed seed so that simulations stay reproducible */
+  static const uint32_t rnd = 0x5bd1e995;
 
-  h = JHash2 ((uint32_t*)(x.ToString ()), n, rnd ^ (((x.GetDestinationPort ()) << 16) | x.GetDestinationProtocol ()));
+  uint32_t ports = ((uint32_t)x.GetSourcePort () << 16) | x.GetDestinationPort ();
+  uint32_t h = JHash3Words (x.GetSource ().Get (), x.GetDestination ().Get (), ports,
+                            rnd ^ x.GetDestinationProtocol ());
 
-  NS_LOG_DEBUG ("Hashing ==> Tuple " <<  "( " << x.GetSource () << "," << x.GetSourcePort () << "," << x.GetDestination () << "," << x.GetDestinationPort () << "," << (int)x.GetDirection () << ")" << " Hash: " << (((uint64_t)h * size) >> 32));
+  NS_LOG_DEBUG ("Hashing ==> Tuple " << x << " Hash: " << h);
 
-  return ((uint64_t)h * size) >> 32;
+  return h;
 }
 
 }
@@ -57,6 +57,7 @@ public:
   void SetDestination (Ipv4Address destination);
   void SetDestinationPort (uint16_t destination);
   void SetProtocol (uint16_t protocol);
+  void SetDestinationProtocol (uint8_t protocol);
   void SetDirection (ConntrackDirection_t direction);
 
   void Print (std::ostream &os) const;
@@ -76,6 +77,17 @@ private:
 };
 
 
+/**
+  * \brief Hash functor for connection tracking tuples
+  *
+  * Hashes the normalized tuple fields (addresses, ports and layer 4
+  * protocol number) rather than the raw object bytes, so that padding
+  * never leaks into the hash and the full 32 bit width of the result
+  * is available to the table. The direction is deliberately not part
+  * of the hash because it is not part of tuple equality: the reply
+  * entry of a connection must be found by a lookup done with the
+  * tuple taken from a reply packet.
+  */
 class ConntrackTupleHash : public std::unary_function<NetfilterConntrackTuple, size_t>
 {
 public:
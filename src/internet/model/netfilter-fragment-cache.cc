@@ -0,0 +1,185 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "netfilter-fragment-cache.h"
+#include "netfilter-jhash.h"
+
+NS_LOG_COMPONENT_DEFINE ("NetfilterFragmentCache");
+
+namespace ns3 {
+
+NetfilterFragmentKey::NetfilterFragmentKey ()
+  : m_identification (0),
+    m_protocol (0)
+{
+}
+
+NetfilterFragmentKey::NetfilterFragmentKey (const Ipv4Header& header)
+  : m_source (header.GetSource ()),
+    m_destination (header.GetDestination ()),
+    m_identification (header.GetIdentification ()),
+    m_protocol (header.GetProtocol ())
+{
+}
+
+bool
+NetfilterFragmentKey::operator== (const NetfilterFragmentKey& o) const
+{
+  return m_identification == o.m_identification && m_source == o.m_source
+         && m_destination == o.m_destination && m_protocol == o.m_protocol;
+}
+
+size_t
+NetfilterFragmentKeyHash::operator() (const NetfilterFragmentKey& key) const
+{
+  return JHash3Words (key.m_source.Get (), key.m_destination.Get (),
+                      ((uint32_t)key.m_identification << 8) | key.m_protocol, 0);
+}
+
+NetfilterFragmentCache::NetfilterFragmentCache ()
+  : m_size (0),
+    m_maxEntries (1024),
+    m_evictions (0),
+    m_timeout (Seconds (30))
+{
+}
+
+void
+NetfilterFragmentCache::SetMaxEntries (uint32_t entries)
+{
+  NS_LOG_FUNCTION (this << entries);
+  NS_ASSERT (entries > 0);
+  m_maxEntries = entries;
+  while (m_size > m_maxEntries)
+    {
+      Erase (m_entries.begin ());
+      m_evictions++;
+    }
+}
+
+uint32_t
+NetfilterFragmentCache::GetMaxEntries (void) const
+{
+  return m_maxEntries;
+}
+
+void
+NetfilterFragmentCache::SetTimeout (Time timeout)
+{
+  NS_LOG_FUNCTION (this << timeout);
+  m_timeout = timeout;
+}
+
+Time
+NetfilterFragmentCache::GetTimeout (void) const
+{
+  return m_timeout;
+}
+
+void
+NetfilterFragmentCache::Insert (const Ipv4Header& header, uint16_t sourcePort, uint16_t destinationPort)
+{
+  NS_LOG_FUNCTION (this << header.GetSource () << header.GetDestination ()
+                        << header.GetIdentification () << sourcePort << destinationPort);
+  Time now = Simulator::Now ();
+  NetfilterFragmentKey key (header);
+  EntryIndex::iterator i = m_index.find (key);
+  if (i != m_index.end ())
+    {
+      // seen by an earlier hook chain, move it to the back of the order
+      EntryList::iterator entry = i->second;
+      entry->sourcePort = sourcePort;
+      entry->destinationPort = destinationPort;
+      entry->expires = now + m_timeout;
+      m_entries.splice (m_entries.end (), m_entries, entry);
+      return;
+    }
+
+  while (m_size > 0 && m_entries.front ().expires <= now)
+    {
+      Erase (m_entries.begin ());
+    }
+  if (m_size >= m_maxEntries)
+    {
+      NS_LOG_LOGIC ("Fragment cache full, evicting the oldest datagram");
+      Erase (m_entries.begin ());
+      m_evictions++;
+    }
+
+  Entry entry;
+  entry.key = key;
+  entry.sourcePort = sourcePort;
+  entry.destinationPort = destinationPort;
+  entry.expires = now + m_timeout;
+  m_index[key] = m_entries.insert (m_entries.end (), entry);
+  m_size++;
+}
+
+bool
+NetfilterFragmentCache::Lookup (const Ipv4Header& header, uint16_t& sourcePort, uint16_t& destinationPort)
+{
+  if (m_size == 0)
+    {
+      return false;
+    }
+  EntryIndex::iterator i = m_index.find (NetfilterFragmentKey (header));
+  if (i == m_index.end ())
+    {
+      return false;
+    }
+  EntryList::iterator entry = i->second;
+  if (entry->expires <= Simulator::Now ())
+    {
+      NS_LOG_LOGIC ("First fragment seen too long ago");
+      Erase (entry);
+      return false;
+    }
+  sourcePort = entry->sourcePort;
+  destinationPort = entry->destinationPort;
+  return true;
+}
+
+uint32_t
+NetfilterFragmentCache::GetNEntries (void) const
+{
+  return m_size;
+}
+
+uint32_t
+NetfilterFragmentCache::GetNEvictions (void) const
+{
+  return m_evictions;
+}
+
+void
+NetfilterFragmentCache::Clear (void)
+{
+  m_index.clear ();
+  m_entries.clear ();
+  m_size = 0;
+}
+
+void
+NetfilterFragmentCache::Erase (EntryList::iterator entry)
+{
+  m_index.erase (entry->key);
+  m_entries.erase (entry);
+  m_size--;
+}
+
+} // namespace ns3
@@ -0,0 +1,138 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef NETFILTER_FRAGMENT_CACHE_H
+#define NETFILTER_FRAGMENT_CACHE_H
+
+#include <stdint.h>
+#include <list>
+#include "ns3/nstime.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/ipv4-header.h"
+#include "sgi-hashmap.h"
+
+namespace ns3 {
+
+/**
+  * \brief Key of a fragmented IPv4 datagram, RFC 791 section 3.2
+  */
+class NetfilterFragmentKey
+{
+public:
+  NetfilterFragmentKey ();
+  NetfilterFragmentKey (const Ipv4Header& header);
+  bool operator== (const NetfilterFragmentKey& o) const;
+
+  Ipv4Address m_source;
+  Ipv4Address m_destination;
+  uint16_t m_identification;
+  uint8_t m_protocol;
+};
+
+/**
+  * \brief Hash functor for NetfilterFragmentKey
+  */
+class NetfilterFragmentKeyHash
+{
+public:
+  size_t operator() (const NetfilterFragmentKey& key) const;
+};
+
+/**
+  * \brief Ports of fragmented datagrams, for the fragments without them
+  *
+  * Only the first fragment of a TCP or UDP datagram carries its ports.
+  * Forwarded datagrams are not reassembled before the hooks see them, so
+  * the ports of the first fragment are remembered under the (source,
+  * destination, identification, protocol) of the datagram, and the
+  * trailing fragments are classified by them without being reassembled.
+  *
+  * The cache holds at most a fixed number of datagrams; inserting into a
+  * full cache evicts the oldest one. An entry lives for a fixed time from
+  * its last insertion, long enough for all fragments of the datagram to
+  * pass; it is not removed by the last fragment, which may arrive before
+  * others and is seen by more than one hook chain. Expired entries are
+  * dropped when they are looked up or reach the head of the insertion
+  * order, so the cache needs no timer.
+  */
+class NetfilterFragmentCache
+{
+public:
+  NetfilterFragmentCache ();
+
+  /**
+    * \param entries Number of datagrams the cache holds at most
+    */
+  void SetMaxEntries (uint32_t entries);
+  uint32_t GetMaxEntries (void) const;
+
+  /**
+    * \param timeout Lifetime of an entry
+    */
+  void SetTimeout (Time timeout);
+  Time GetTimeout (void) const;
+
+  /**
+    * \param header IPv4 header of the first fragment of a datagram
+    * \param sourcePort Source port of the datagram
+    * \param destinationPort Destination port of the datagram
+    */
+  void Insert (const Ipv4Header& header, uint16_t sourcePort, uint16_t destinationPort);
+
+  /**
+    * \param header IPv4 header of a fragment other than the first one
+    * \param sourcePort Set to the source port of the datagram
+    * \param destinationPort Set to the destination port of the datagram
+    * \returns false if the first fragment of the datagram has not been
+    * seen or its entry has expired
+    */
+  bool Lookup (const Ipv4Header& header, uint16_t& sourcePort, uint16_t& destinationPort);
+
+  /**
+    * \returns Number of datagrams in the cache, expired ones included
+    */
+  uint32_t GetNEntries (void) const;
+
+  /**
+    * \returns Number of datagrams evicted to make room for others
+    */
+  uint32_t GetNEvictions (void) const;
+
+  void Clear (void);
+
+private:
+  struct Entry
+  {
+    NetfilterFragmentKey key;
+    uint16_t sourcePort;
+    uint16_t destinationPort;
+    Time expires;
+  };
+  typedef std::list<Entry> EntryList;
+  typedef sgi::hash_map<NetfilterFragmentKey, EntryList::iterator, NetfilterFragmentKeyHash> EntryIndex;
+
+  void Erase (EntryList::iterator entry);
+
+  EntryList m_entries;  //!< oldest insertion first
+  EntryIndex m_index;
+  uint32_t m_size;
+  uint32_t m_maxEntries;
+  uint32_t m_evictions;
+  Time m_timeout;
+};
+
+} // namespace ns3
+
+#endif /* NETFILTER_FRAGMENT_CACHE_H */
@@ -0,0 +1,267 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ns3/buffer.h"
+#include "netfilter-header-mangle.h"
+#include "tcp-l4-protocol.h"
+#include "udp-l4-protocol.h"
+
+NS_LOG_COMPONENT_DEFINE ("NetfilterHeaderMangle");
+
+namespace ns3 {
+
+/* Offsets into the IPv4 header */
+static const uint32_t IPV4_HEADER_SIZE = 20;
+static const uint32_t IPV4_FRAGMENT = 6;
+static const uint32_t IPV4_PROTOCOL = 9;
+static const uint32_t IPV4_CHECKSUM = 10;
+static const uint32_t IPV4_SOURCE = 12;
+static const uint32_t IPV4_DESTINATION = 16;
+
+/* Offsets into the TCP and UDP headers */
+static const uint32_t L4_SOURCE_PORT = 0;
+static const uint32_t L4_DESTINATION_PORT = 2;
+static const uint32_t UDP_CHECKSUM = 6;
+static const uint32_t TCP_CHECKSUM = 16;
+
+/* Reads what is needed to find the transport header behind the IPv4 header */
+static void
+ReadIpv4Header (Buffer::Iterator i, uint32_t &headerSize, uint8_t &protocol, bool &firstFragment)
+{
+  headerSize = (i.ReadU8 () & 0x0f) * 4;
+  i.Next (IPV4_FRAGMENT - 1);
+  firstFragment = (i.ReadNtohU16 () & 0x1fff) == 0;
+  i.Next (IPV4_PROTOCOL - IPV4_FRAGMENT - 2);
+  protocol = i.ReadU8 ();
+}
+
+uint16_t
+NetfilterHeaderMangle::UpdateChecksum (uint16_t checksum, uint16_t from, uint16_t to)
+{
+  // HC' = ~(~HC + ~m + m')
+  uint32_t sum = (uint16_t)~checksum + (uint16_t)~from + (uint32_t)to;
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  return ~sum & 0xffff;
+}
+
+uint16_t
+NetfilterHeaderMangle::UpdateChecksum32 (uint16_t checksum, uint32_t from, uint32_t to)
+{
+  uint32_t sum = (uint16_t)~checksum
+    + (uint16_t)~(from >> 16) + (uint16_t)~(from & 0xffff)
+    + (to >> 16) + (to & 0xffff);
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  return ~sum & 0xffff;
+}
+
+uint32_t
+NetfilterHeaderMangle::GetTransportChecksumOffset (uint8_t protocol)
+{
+  if (protocol == TcpL4Protocol::PROT_NUMBER)
+    {
+      return TCP_CHECKSUM;
+    }
+  if (protocol == UdpL4Protocol::PROT_NUMBER)
+    {
+      return UDP_CHECKSUM;
+    }
+  return 0;
+}
+
+void
+NetfilterHeaderMangle::SetAddress (Ptr<Packet> p, uint32_t offset, Ipv4Address address)
+{
+  NS_ASSERT (p->GetSize () >= IPV4_HEADER_SIZE);
+  Buffer::Iterator start = p->BeginWritable (IPV4_HEADER_SIZE);
+  uint32_t headerSize;
+  uint8_t protocol;
+  bool firstFragment;
+  ReadIpv4Header (start, headerSize, protocol, firstFragment);
+
+  Buffer::Iterator i = start;
+  i.Next (offset);
+  uint32_t from = i.ReadNtohU32 ();
+  uint32_t to = address.Get ();
+  if (from == to)
+    {
+      return;
+    }
+  i.Prev (4);
+  i.WriteHtonU32 (to);
+
+  i = start;
+  i.Next (IPV4_CHECKSUM);
+  uint16_t checksum = i.ReadNtohU16 ();
+  if (checksum != 0)
+    {
+      i.Prev (2);
+      i.WriteHtonU16 (UpdateChecksum32 (checksum, from, to));
+    }
+
+  // the pseudo header of the TCP and UDP checksums covers the addresses
+  if (firstFragment)
+    {
+      UpdateTransportChecksum (p, headerSize, protocol, from, to);
+    }
+}
+
+void
+NetfilterHeaderMangle::UpdateTransportChecksum (Ptr<Packet> p, uint32_t headerSize, uint8_t protocol,
+                                                uint32_t from, uint32_t to)
+{
+  uint32_t l4Checksum = GetTransportChecksumOffset (protocol);
+  if (l4Checksum == 0 || p->GetSize () < headerSize + l4Checksum + 2)
+    {
+      return;
+    }
+  Buffer::Iterator i = p->BeginWritable (headerSize + l4Checksum + 2);
+  i.Next (headerSize + l4Checksum);
+  uint16_t checksum = i.ReadNtohU16 ();
+  if (checksum != 0)
+    {
+      checksum = UpdateChecksum32 (checksum, from, to);
+      if (checksum == 0 && protocol == UdpL4Protocol::PROT_NUMBER)
+        {
+          // zero means no checksum for UDP, send its other representation
+          checksum = 0xffff;
+        }
+      i.Prev (2);
+      i.WriteHtonU16 (checksum);
+    }
+}
+
+void
+NetfilterHeaderMangle::SetIpv4Header (Ptr<Packet> p, const Ipv4Header& header)
+{
+  NS_LOG_FUNCTION (p);
+  NS_ASSERT (p->GetSize () >= IPV4_HEADER_SIZE);
+  Buffer::Iterator start = p->BeginWritable (IPV4_HEADER_SIZE);
+  uint32_t headerSize;
+  uint8_t protocol;
+  bool firstFragment;
+  ReadIpv4Header (start, headerSize, protocol, firstFragment);
+  Buffer::Iterator i = start;
+  i.Next (IPV4_CHECKSUM);
+  bool checksum = i.ReadNtohU16 () != 0;
+  uint32_t source = i.ReadNtohU32 ();
+  uint32_t destination = i.ReadNtohU32 ();
+
+  Ipv4Header copy = header;
+  if (checksum)
+    {
+      copy.EnableChecksum ();
+    }
+  if (headerSize == IPV4_HEADER_SIZE)
+    {
+      copy.Serialize (start);
+    }
+  else
+    {
+      // Ipv4Header does not write options, the header shrinks
+      Ipv4Header old;
+      p->RemoveHeader (old);
+      p->AddHeader (copy);
+      headerSize = IPV4_HEADER_SIZE;
+    }
+
+  if (firstFragment && header.GetFragmentOffset () == 0)
+    {
+      if (source != header.GetSource ().Get ())
+        {
+          UpdateTransportChecksum (p, headerSize, protocol, source, header.GetSource ().Get ());
+        }
+      if (destination != header.GetDestination ().Get ())
+        {
+          UpdateTransportChecksum (p, headerSize, protocol, destination, header.GetDestination ().Get ());
+        }
+    }
+}
+
+void
+NetfilterHeaderMangle::SetPort (Ptr<Packet> p, uint32_t offset, uint16_t port)
+{
+  NS_ASSERT (p->GetSize () >= IPV4_HEADER_SIZE);
+  uint32_t headerSize;
+  uint8_t protocol;
+  bool firstFragment;
+  Buffer::Iterator start = p->BeginWritable (IPV4_HEADER_SIZE);
+  ReadIpv4Header (start, headerSize, protocol, firstFragment);
+
+  uint32_t l4Checksum = GetTransportChecksumOffset (protocol);
+  if (l4Checksum == 0 || !firstFragment || p->GetSize () < headerSize + l4Checksum + 2)
+    {
+      NS_LOG_LOGIC ("No ports to rewrite in this packet");
+      return;
+    }
+  start = p->BeginWritable (headerSize + l4Checksum + 2);
+  Buffer::Iterator i = start;
+  i.Next (headerSize + offset);
+  uint16_t from = i.ReadNtohU16 ();
+  if (from == port)
+    {
+      return;
+    }
+  i.Prev (2);
+  i.WriteHtonU16 (port);
+
+  i = start;
+  i.Next (headerSize + l4Checksum);
+  uint16_t checksum = i.ReadNtohU16 ();
+  if (checksum != 0)
+    {
+      checksum = UpdateChecksum (checksum, from, port);
+      if (checksum == 0 && protocol == UdpL4Protocol::PROT_NUMBER)
+        {
+          checksum = 0xffff;
+        }
+      i.Prev (2);
+      i.WriteHtonU16 (checksum);
+    }
+}
+
+void
+NetfilterHeaderMangle::SetSource (Ptr<Packet> p, Ipv4Address address)
+{
+  NS_LOG_FUNCTION (p << address);
+  SetAddress (p, IPV4_SOURCE, address);
+}
+
+void
+NetfilterHeaderMangle::SetDestination (Ptr<Packet> p, Ipv4Address address)
+{
+  NS_LOG_FUNCTION (p << address);
+  SetAddress (p, IPV4_DESTINATION, address);
+}
+
+void
+NetfilterHeaderMangle::SetSourcePort (Ptr<Packet> p, uint16_t port)
+{
+  NS_LOG_FUNCTION (p << port);
+  SetPort (p, L4_SOURCE_PORT, port);
+}
+
+void
+NetfilterHeaderMangle::SetDestinationPort (Ptr<Packet> p, uint16_t port)
+{
+  NS_LOG_FUNCTION (p << port);
+  SetPort (p, L4_DESTINATION_PORT, port);
+}
+
+} // namespace ns3
@@ -0,0 +1,111 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef NETFILTER_HEADER_MANGLE_H
+#define NETFILTER_HEADER_MANGLE_H
+
+#include <stdint.h>
+#include "ns3/ptr.h"
+#include "ns3/packet.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/ipv4-header.h"
+
+namespace ns3 {
+
+/**
+  * \brief Rewrites the addresses and ports of IPv4 packets in place
+  *
+  * Netfilter hooks see packets that start with their IPv4 header. Instead
+  * of removing the IPv4 and transport headers, changing them and adding
+  * them back, which serializes both headers again and may reallocate the
+  * packet buffer, these functions patch the fields directly in the bytes
+  * of the packet.
+  *
+  * The IPv4 header checksum and the TCP or UDP checksum, whose pseudo
+  * header covers the addresses, are fixed with the incremental update of
+  * RFC 1624. A checksum field of zero means that the sender did not
+  * compute the checksum, as ns-3 does when checksums are disabled, and it
+  * is left untouched.
+  */
+class NetfilterHeaderMangle
+{
+public:
+  /**
+    * \param p Packet starting with its IPv4 header
+    * \param address New source address
+    */
+  static void SetSource (Ptr<Packet> p, Ipv4Address address);
+
+  /**
+    * \param p Packet starting with its IPv4 header
+    * \param address New destination address
+    */
+  static void SetDestination (Ptr<Packet> p, Ipv4Address address);
+
+  /**
+    * \param p Packet starting with its IPv4 header
+    * \param header Header to write over it
+    *
+    * Serializes the header in place of the one the packet starts with. The
+    * IPv4 checksum is computed again if the packet had one, the TCP or UDP
+    * checksum is updated for changed addresses.
+    */
+  static void SetIpv4Header (Ptr<Packet> p, const Ipv4Header& header);
+
+  /**
+    * \param p Packet starting with the IPv4 header of a TCP or UDP segment
+    * \param port New source port
+    *
+    * Packets of other protocols and fragments other than the first one
+    * are left unchanged.
+    */
+  static void SetSourcePort (Ptr<Packet> p, uint16_t port);
+
+  /**
+    * \param p Packet starting with the IPv4 header of a TCP or UDP segment
+    * \param port New destination port
+    *
+    * Packets of other protocols and fragments other than the first one
+    * are left unchanged.
+    */
+  static void SetDestinationPort (Ptr<Packet> p, uint16_t port);
+
+  /**
+    * \param checksum Checksum of the data, in network byte order
+    * \param from 16 bit word of the data before the change
+    * \param to The same word after the change
+    * \returns The checksum of the changed data (RFC 1624, eqn. 3)
+    */
+  static uint16_t UpdateChecksum (uint16_t checksum, uint16_t from, uint16_t to);
+
+  /**
+    * \param checksum Checksum of the data, in network byte order
+    * \param from 32 bit word of the data before the change
+    * \param to The same word after the change
+    * \returns The checksum of the changed data
+    */
+  static uint16_t UpdateChecksum32 (uint16_t checksum, uint32_t from, uint32_t to);
+
+private:
+  static void SetAddress (Ptr<Packet> p, uint32_t offset, Ipv4Address address);
+  static void UpdateTransportChecksum (Ptr<Packet> p, uint32_t headerSize, uint8_t protocol,
+                                       uint32_t from, uint32_t to);
+  static void SetPort (Ptr<Packet> p, uint32_t offset, uint16_t port);
+  static uint32_t GetTransportChecksumOffset (uint8_t protocol);
+};
+
+} // namespace ns3
+
+#endif /* NETFILTER_HEADER_MANGLE_H */
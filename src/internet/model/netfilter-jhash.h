@@ -0,0 +1,104 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef NETFILTER_JHASH_H
+#define NETFILTER_JHASH_H
+
+#include <stdint.h>
+
+namespace ns3 {
+
+#define JHASH_GOLDEN_RATIO  0x9e3779b9
+
+/* Bob Jenkins' mixing step; the three words are mixed in place */
+static inline void
+JHashMix (uint32_t &a, uint32_t &b, uint32_t &c)
+{
+  a -= b;
+  a -= c;
+  a ^= (c >> 13);
+  b -= c;
+  b -= a;
+  b ^= (a << 8);
+  c -= a;
+  c -= b;
+  c ^= (b >> 13);
+  a -= b;
+  a -= c;
+  a ^= (c >> 12);
+  b -= c;
+  b -= a;
+  b ^= (a << 16);
+  c -= a;
+  c -= b;
+  c ^= (b >> 5);
+  a -= b;
+  a -= c;
+  a ^= (c >> 3);
+  b -= c;
+  b -= a;
+  b ^= (a << 10);
+  c -= a;
+  c -= b;
+  c ^= (b >> 15);
+}
+
+/* Specialized version of JHash2 () for exactly three words, as used by
+ * the Linux conntrack code for its tuple hash */
+static inline uint32_t
+JHash3Words (uint32_t a, uint32_t b, uint32_t c, uint32_t initval)
+{
+  a += JHASH_GOLDEN_RATIO;
+  b += JHASH_GOLDEN_RATIO;
+  c += initval;
+  JHashMix (a, b, c);
+  return c;
+}
+
+/* Hash of an array of 32 bit words, every word feeds the mix */
+static inline uint32_t
+JHash2 (const uint32_t *k, uint32_t length, uint32_t initval)
+{
+  uint32_t a = JHASH_GOLDEN_RATIO;
+  uint32_t b = JHASH_GOLDEN_RATIO;
+  uint32_t c = initval;
+  uint32_t len = length;
+
+  while (len >= 3)
+    {
+      a += k[0];
+      b += k[1];
+      c += k[2];
+      JHashMix (a, b, c);
+      k += 3;
+      len -= 3;
+    }
+
+  c += length * 4;
+  switch (len)
+    {
+    case 2:
+      b += k[1];
+    /* fall through */
+    case 1:
+      a += k[0];
+    }
+  JHashMix (a, b, c);
+  return c;
+}
+
+} // namespace ns3
+
+#endif /* NETFILTER_JHASH_H */
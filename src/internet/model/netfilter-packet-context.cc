@@ -0,0 +1,253 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/log.h"
+#include "netfilter-packet-context.h"
+#include "netfilter-header-mangle.h"
+#include "tcp-l4-protocol.h"
+#include "udp-l4-protocol.h"
+
+NS_LOG_COMPONENT_DEFINE ("NetfilterPacketContext");
+
+namespace ns3 {
+
+NetfilterPacketContext::NetfilterPacketContext (Ptr<Packet> packet, NetfilterFragmentCache *fragments)
+  : m_packet (packet),
+    m_fragments (fragments),
+    m_sourcePort (0),
+    m_destinationPort (0),
+    m_tcpFlags (0),
+    m_ipv4Parsed (false),
+    m_ipv4Dirty (false),
+    m_portsParsed (false),
+    m_hasPorts (false),
+    m_sourcePortDirty (false),
+    m_destinationPortDirty (false),
+    m_tracked (false),
+    m_ipv6 (0),
+    m_ipv6InPacket (true),
+    m_ipv6Dirty (false)
+{
+}
+
+NetfilterPacketContext::NetfilterPacketContext (Ptr<Packet> packet, Ipv6Header *ipv6Header)
+  : m_packet (packet),
+    m_fragments (0),
+    m_sourcePort (0),
+    m_destinationPort (0),
+    m_tcpFlags (0),
+    m_ipv4Parsed (false),
+    m_ipv4Dirty (false),
+    m_portsParsed (false),
+    m_hasPorts (false),
+    m_sourcePortDirty (false),
+    m_destinationPortDirty (false),
+    m_tracked (false),
+    m_ipv6 (ipv6Header),
+    m_ipv6InPacket (ipv6Header == 0),
+    m_ipv6Dirty (false)
+{
+}
+
+Ptr<Packet>
+NetfilterPacketContext::GetPacket (void) const
+{
+  return m_packet;
+}
+
+Ipv4Header&
+NetfilterPacketContext::GetIpv4Header (void)
+{
+  if (!m_ipv4Parsed)
+    {
+      m_packet->PeekHeader (m_ipv4Header);
+      m_ipv4Parsed = true;
+    }
+  return m_ipv4Header;
+}
+
+void
+NetfilterPacketContext::SetIpv4HeaderDirty (void)
+{
+  NS_ASSERT (m_ipv4Parsed);
+  m_ipv4Dirty = true;
+}
+
+Ipv6Header&
+NetfilterPacketContext::GetIpv6Header (void)
+{
+  if (m_ipv6 == 0)
+    {
+      m_packet->PeekHeader (m_ipv6Header);
+      m_ipv6 = &m_ipv6Header;
+    }
+  return *m_ipv6;
+}
+
+void
+NetfilterPacketContext::SetIpv6HeaderDirty (void)
+{
+  NS_ASSERT (m_ipv6 != 0);
+  m_ipv6Dirty = m_ipv6InPacket;
+}
+
+uint32_t
+NetfilterPacketContext::GetIpv6PayloadOffset (void) const
+{
+  return m_ipv6InPacket ? 40 : 0;
+}
+
+void
+NetfilterPacketContext::ParsePorts (void)
+{
+  m_portsParsed = true;
+  const Ipv4Header &ipHeader = GetIpv4Header ();
+  uint8_t protocol = ipHeader.GetProtocol ();
+  if (protocol != TcpL4Protocol::PROT_NUMBER && protocol != UdpL4Protocol::PROT_NUMBER)
+    {
+      return;
+    }
+  if (ipHeader.GetFragmentOffset () != 0)
+    {
+      // a trailing fragment, classified by the first one of its datagram
+      m_hasPorts = m_fragments != 0 && m_fragments->Lookup (ipHeader, m_sourcePort, m_destinationPort);
+      return;
+    }
+  // up to 60 bytes of IPv4 header and the TCP flags
+  uint8_t buffer[60 + 14];
+  uint32_t offset = ipHeader.GetSerializedSize ();
+  uint32_t needed = offset + (protocol == TcpL4Protocol::PROT_NUMBER ? 14 : 4);
+  if (m_packet->CopyData (buffer, needed) < needed)
+    {
+      NS_LOG_LOGIC ("Packet too short for its transport header");
+      return;
+    }
+  m_sourcePort = (buffer[offset] << 8) | buffer[offset + 1];
+  m_destinationPort = (buffer[offset + 2] << 8) | buffer[offset + 3];
+  if (protocol == TcpL4Protocol::PROT_NUMBER)
+    {
+      m_tcpFlags = buffer[offset + 13] & 0x3f;
+    }
+  m_hasPorts = true;
+  if (m_fragments != 0 && !ipHeader.IsLastFragment ())
+    {
+      m_fragments->Insert (ipHeader, m_sourcePort, m_destinationPort);
+    }
+}
+
+bool
+NetfilterPacketContext::HasPorts (void)
+{
+  if (!m_portsParsed)
+    {
+      ParsePorts ();
+    }
+  return m_hasPorts;
+}
+
+uint16_t
+NetfilterPacketContext::GetSourcePort (void)
+{
+  HasPorts ();
+  return m_sourcePort;
+}
+
+uint16_t
+NetfilterPacketContext::GetDestinationPort (void)
+{
+  HasPorts ();
+  return m_destinationPort;
+}
+
+uint8_t
+NetfilterPacketContext::GetTcpFlags (void)
+{
+  HasPorts ();
+  return m_tcpFlags;
+}
+
+void
+NetfilterPacketContext::SetSourcePort (uint16_t port)
+{
+  NS_ASSERT (HasPorts ());
+  m_sourcePort = port;
+  m_sourcePortDirty = true;
+}
+
+void
+NetfilterPacketContext::SetDestinationPort (uint16_t port)
+{
+  NS_ASSERT (HasPorts ());
+  m_destinationPort = port;
+  m_destinationPortDirty = true;
+}
+
+bool
+NetfilterPacketContext::GetConntrackTuple (NetfilterConntrackTuple& tuple) const
+{
+  if (m_tracked)
+    {
+      tuple = m_conntrack;
+    }
+  return m_tracked;
+}
+
+void
+NetfilterPacketContext::SetConntrackTuple (const NetfilterConntrackTuple& tuple)
+{
+  m_conntrack = tuple;
+  m_tracked = true;
+}
+
+void
+NetfilterPacketContext::Flush (void)
+{
+  if (m_ipv4Dirty)
+    {
+      NS_LOG_LOGIC ("Writing back the IPv4 header");
+      NetfilterHeaderMangle::SetIpv4Header (m_packet, m_ipv4Header);
+    }
+  if (m_sourcePortDirty)
+    {
+      NetfilterHeaderMangle::SetSourcePort (m_packet, m_sourcePort);
+    }
+  if (m_destinationPortDirty)
+    {
+      NetfilterHeaderMangle::SetDestinationPort (m_packet, m_destinationPort);
+    }
+  if (m_ipv6Dirty)
+    {
+      NS_LOG_LOGIC ("Writing back the IPv6 header");
+      Buffer::Iterator start = m_packet->BeginWritable (m_ipv6Header.GetSerializedSize ());
+      m_ipv6Header.Serialize (start);
+    }
+  if (m_ipv6InPacket)
+    {
+      m_ipv6 = 0;
+    }
+  m_ipv6Dirty = false;
+  m_ipv4Parsed = false;
+  m_ipv4Dirty = false;
+  m_portsParsed = false;
+  m_hasPorts = false;
+  m_sourcePortDirty = false;
+  m_destinationPortDirty = false;
+  m_sourcePort = 0;
+  m_destinationPort = 0;
+  m_tcpFlags = 0;
+}
+
+} // namespace ns3
@@ -0,0 +1,177 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef NETFILTER_PACKET_CONTEXT_H
+#define NETFILTER_PACKET_CONTEXT_H
+
+#include <stdint.h>
+#include "ns3/ptr.h"
+#include "ns3/packet.h"
+#include "ns3/ipv4-header.h"
+#include "ns3/ipv6-header.h"
+#include "netfilter-conntrack-table.h"
+#include "netfilter-fragment-cache.h"
+
+namespace ns3 {
+
+/**
+  * \brief Headers of a packet shared by the hooks of a callback chain
+  *
+  * NetfilterCallbackChain::IterateAndCallHook () creates one context per
+  * packet and hands it to every hook of the chain. The IPv4 header and the
+  * TCP/UDP ports are parsed on first use only, so that a packet is parsed
+  * once no matter how many hooks look at it.
+  *
+  * Hooks change the headers through the context: a hook that modifies the
+  * header returned by GetIpv4Header () marks it with SetIpv4HeaderDirty (),
+  * ports are changed with SetSourcePort () and SetDestinationPort (). The
+  * changes are written back into the packet in place, once, at the end of
+  * the chain. A hook that accesses the packet bytes directly must call
+  * Flush () first.
+  *
+  * With a NetfilterFragmentCache, the ports of the first fragment of a
+  * TCP or UDP datagram are remembered and handed out for its trailing
+  * fragments. Those fragments carry no transport header: changing their
+  * ports only changes what the later hooks of the chain see.
+  *
+  * The context of an IPv6 packet gives access to its IPv6 header through
+  * GetIpv6Header (); its IPv4 and port accessors must not be used. The
+  * header is either at the start of the packet, and written back in place
+  * if marked with SetIpv6HeaderDirty (), or kept by Ipv6L3Protocol apart
+  * from the packet, in which case the hooks change it directly and the
+  * packet starts with the payload.
+  */
+class NetfilterPacketContext
+{
+public:
+  /**
+    * \param packet Packet starting with its IPv4 header
+    * \param fragments Ports of fragmented datagrams, 0 to leave trailing
+    * fragments without ports
+    */
+  NetfilterPacketContext (Ptr<Packet> packet, NetfilterFragmentCache *fragments = 0);
+
+  /**
+    * \param packet IPv6 packet, without its header if one is given
+    * \param ipv6Header IPv6 header of the packet kept apart from it, 0 if
+    * the packet starts with its header
+    */
+  NetfilterPacketContext (Ptr<Packet> packet, Ipv6Header *ipv6Header);
+
+  /**
+    * \returns The packet this context describes
+    */
+  Ptr<Packet> GetPacket (void) const;
+
+  /**
+    * \returns The IPv4 header of the packet
+    */
+  Ipv4Header& GetIpv4Header (void);
+
+  /**
+    * \brief Have the IPv4 header written back at the end of the chain
+    */
+  void SetIpv4HeaderDirty (void);
+
+  /**
+    * \returns The IPv6 header of the packet
+    */
+  Ipv6Header& GetIpv6Header (void);
+
+  /**
+    * \brief Have the IPv6 header written back at the end of the chain
+    */
+  void SetIpv6HeaderDirty (void);
+
+  /**
+    * \returns Offset of the payload of an IPv6 packet: the size of its
+    * header if the packet starts with it, 0 if the header is kept apart
+    */
+  uint32_t GetIpv6PayloadOffset (void) const;
+
+  /**
+    * \returns true if this is a TCP or UDP packet whose ports are available,
+    * i.e. not a fragment other than the first one, unless the fragment
+    * cache knows the ports of its datagram
+    */
+  bool HasPorts (void);
+
+  uint16_t GetSourcePort (void);
+  uint16_t GetDestinationPort (void);
+
+  /**
+    * \returns The flags of a TCP segment, 0 for other packets
+    */
+  uint8_t GetTcpFlags (void);
+
+  /**
+    * \param port New source port, written back at the end of the chain
+    */
+  void SetSourcePort (uint16_t port);
+
+  /**
+    * \param port New destination port, written back at the end of the chain
+    */
+  void SetDestinationPort (uint16_t port);
+
+  /**
+    * \param tuple Set to the tuple of the connection the packet belongs to
+    * \returns false if the packet is not tracked
+    *
+    * The tuple stays valid while the conntrack tables change; look the
+    * entry up with it when it is needed.
+    */
+  bool GetConntrackTuple (NetfilterConntrackTuple& tuple) const;
+
+  /**
+    * \param tuple The tuple of the connection the packet belongs to
+    */
+  void SetConntrackTuple (const NetfilterConntrackTuple& tuple);
+
+  /**
+    * \brief Write pending changes into the packet
+    *
+    * Headers are parsed again on their next use, so hooks may change the
+    * packet directly after calling this.
+    */
+  void Flush (void);
+
+private:
+  void ParsePorts (void);
+
+  Ptr<Packet> m_packet;
+  NetfilterFragmentCache *m_fragments;
+  Ipv4Header m_ipv4Header;
+  uint16_t m_sourcePort;
+  uint16_t m_destinationPort;
+  uint8_t m_tcpFlags;
+  bool m_ipv4Parsed;
+  bool m_ipv4Dirty;
+  bool m_portsParsed;
+  bool m_hasPorts;
+  bool m_sourcePortDirty;
+  bool m_destinationPortDirty;
+  NetfilterConntrackTuple m_conntrack;
+  bool m_tracked;
+  // header of an IPv6 packet: m_ipv6Header, or the one kept by the caller
+  Ipv6Header *m_ipv6;
+  Ipv6Header m_ipv6Header;
+  bool m_ipv6InPacket;
+  bool m_ipv6Dirty;
+};
+
+} // namespace ns3
+
+#endif /* NETFILTER_PACKET_CONTEXT_H */
@@ -0,0 +1,159 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <cstring>
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "netfilter-snapshot.h"
+
+NS_LOG_COMPONENT_DEFINE ("NetfilterSnapshot");
+
+namespace ns3 {
+
+NetfilterSnapshotWriter::NetfilterSnapshotWriter (std::ostream &os)
+  : m_os (os)
+{
+}
+
+void
+NetfilterSnapshotWriter::WriteHeader (const char magic[4], uint8_t version, uint32_t count)
+{
+  m_os.write (magic, 4);
+  WriteU8 (version);
+  WriteU32 (count);
+}
+
+void
+NetfilterSnapshotWriter::WriteU8 (uint8_t value)
+{
+  m_os.put ((char)value);
+}
+
+void
+NetfilterSnapshotWriter::WriteU16 (uint16_t value)
+{
+  char buffer[2] = { (char)(value >> 8), (char)value };
+  m_os.write (buffer, 2);
+}
+
+void
+NetfilterSnapshotWriter::WriteU32 (uint32_t value)
+{
+  char buffer[4] = { (char)(value >> 24), (char)(value >> 16), (char)(value >> 8), (char)value };
+  m_os.write (buffer, 4);
+}
+
+void
+NetfilterSnapshotWriter::WriteAddress (Ipv4Address address)
+{
+  WriteU32 (address.Get ());
+}
+
+void
+NetfilterSnapshotWriter::WriteDeadline (Time time)
+{
+  int64_t left = (time - Simulator::Now ()).GetNanoSeconds ();
+  uint64_t value = left > 0 ? left : 0;
+  WriteU32 (value >> 32);
+  WriteU32 (value & 0xffffffffU);
+}
+
+NetfilterSnapshotReader::NetfilterSnapshotReader (std::istream &is)
+  : m_is (is),
+    m_ok (true)
+{
+}
+
+uint32_t
+NetfilterSnapshotReader::ReadHeader (const char magic[4], uint8_t version)
+{
+  char found[4];
+  if (!Read ((uint8_t *)found, 4) || std::memcmp (found, magic, 4) != 0)
+    {
+      NS_LOG_WARN ("Not a " << std::string (magic, 4) << " snapshot");
+      m_ok = false;
+      return 0;
+    }
+  if (ReadU8 () != version)
+    {
+      NS_LOG_WARN ("Unsupported " << std::string (magic, 4) << " snapshot version");
+      m_ok = false;
+      return 0;
+    }
+  return ReadU32 ();
+}
+
+uint8_t
+NetfilterSnapshotReader::ReadU8 (void)
+{
+  uint8_t buffer[1];
+  return Read (buffer, 1) ? buffer[0] : 0;
+}
+
+uint16_t
+NetfilterSnapshotReader::ReadU16 (void)
+{
+  uint8_t buffer[2];
+  return Read (buffer, 2) ? (buffer[0] << 8) | buffer[1] : 0;
+}
+
+uint32_t
+NetfilterSnapshotReader::ReadU32 (void)
+{
+  uint8_t buffer[4];
+  if (!Read (buffer, 4))
+    {
+      return 0;
+    }
+  return ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) | ((uint32_t)buffer[2] << 8) | buffer[3];
+}
+
+Ipv4Address
+NetfilterSnapshotReader::ReadAddress (void)
+{
+  return Ipv4Address (ReadU32 ());
+}
+
+Time
+NetfilterSnapshotReader::ReadDeadline (void)
+{
+  uint64_t value = (uint64_t)ReadU32 () << 32;
+  value |= ReadU32 ();
+  return Simulator::Now () + NanoSeconds (value);
+}
+
+bool
+NetfilterSnapshotReader::IsOk (void) const
+{
+  return m_ok;
+}
+
+bool
+NetfilterSnapshotReader::Read (uint8_t *buffer, uint32_t size)
+{
+  if (m_ok && !m_is.read ((char *)buffer, size))
+    {
+      NS_LOG_WARN ("Snapshot ends early");
+      m_ok = false;
+    }
+  if (!m_ok)
+    {
+      std::memset (buffer, 0, size);
+    }
+  return m_ok;
+}
+
+} // namespace ns3
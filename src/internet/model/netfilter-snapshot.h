@@ -0,0 +1,112 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef NETFILTER_SNAPSHOT_H
+#define NETFILTER_SNAPSHOT_H
+
+#include <stdint.h>
+#include <iostream>
+#include "ns3/nstime.h"
+#include "ns3/ipv4-address.h"
+
+namespace ns3 {
+
+/**
+  * \brief Writes the fields of a conntrack or NAT snapshot to a stream
+  *
+  * A snapshot starts with a four character magic, a version byte and the
+  * number of records, followed by the records. Integers are
+  * written in network byte order. Times are written relative to the
+  * simulation time the snapshot is taken at, so that a snapshot taken at
+  * time T can be loaded at the start of another simulation. Records are
+  * written as they are visited; no copy of the table is built.
+  */
+class NetfilterSnapshotWriter
+{
+public:
+  /**
+    * \param os Stream opened in binary mode
+    */
+  NetfilterSnapshotWriter (std::ostream &os);
+
+  /**
+    * \param magic Four characters identifying the kind of snapshot
+    * \param version Version of the record layout
+    * \param count Number of records that follow
+    */
+  void WriteHeader (const char magic[4], uint8_t version, uint32_t count);
+
+  void WriteU8 (uint8_t value);
+  void WriteU16 (uint16_t value);
+  void WriteU32 (uint32_t value);
+  void WriteAddress (Ipv4Address address);
+
+  /**
+    * \param time Absolute simulation time, written as the time left until
+    * then, 0 if it has passed
+    */
+  void WriteDeadline (Time time);
+
+private:
+  std::ostream &m_os;
+};
+
+/**
+  * \brief Reads the fields written by NetfilterSnapshotWriter
+  *
+  * Reading past the end of the stream or a header that does not match
+  * sets the reader in a failed state in which every read returns 0.
+  */
+class NetfilterSnapshotReader
+{
+public:
+  /**
+    * \param is Stream opened in binary mode
+    */
+  NetfilterSnapshotReader (std::istream &is);
+
+  /**
+    * \param magic Four characters expected at the start of the snapshot
+    * \param version Version of the record layout expected
+    * \returns Number of records that follow, 0 if the header does not match
+    */
+  uint32_t ReadHeader (const char magic[4], uint8_t version);
+
+  uint8_t ReadU8 (void);
+  uint16_t ReadU16 (void);
+  uint32_t ReadU32 (void);
+  Ipv4Address ReadAddress (void);
+
+  /**
+    * \returns The time left when the snapshot was taken, added to the
+    * current simulation time
+    */
+  Time ReadDeadline (void);
+
+  /**
+    * \returns false if the stream ended early or the header did not match
+    */
+  bool IsOk (void) const;
+
+private:
+  bool Read (uint8_t *buffer, uint32_t size);
+
+  std::istream &m_is;
+  bool m_ok;
+};
+
+} // namespace ns3
+
+#endif /* NETFILTER_SNAPSHOT_H */
@@ -0,0 +1,315 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef NETFILTER_TIMER_WHEEL_H
+#define NETFILTER_TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <vector>
+#include "ns3/nstime.h"
+#include "ns3/simulator.h"
+#include "ns3/event-id.h"
+#include "ns3/callback.h"
+
+namespace ns3 {
+
+/**
+  * \brief Hierarchical timer wheel used to expire idle flows
+  *
+  * Simulation time is cut into ticks of a configurable granularity. The
+  * wheel has four levels of 64 slots; level n holds the items due within
+  * 64^(n+1) ticks and is cascaded into the level below whenever that one
+  * wraps around, so scheduling an item and expiring it are both O(1).
+  *
+  * A single simulator event drives the wheel. It is only pending while
+  * the wheel holds items and it skips over runs of empty ticks, so an idle
+  * wheel costs nothing and a busy one costs one event per occupied tick.
+  *
+  * Items are never removed before they are due. Owners keep the real
+  * deadline of each flow next to the flow itself, update it on every
+  * packet, and when the wheel hands an item back they either evict the
+  * flow or schedule it again for its new deadline.
+  */
+template <typename T>
+class NetfilterTimerWheel
+{
+public:
+  NetfilterTimerWheel ();
+  ~NetfilterTimerWheel ();
+
+  /**
+    * \param granularity Duration of one tick. Changing it is only allowed
+    * while the wheel is empty.
+    */
+  void SetGranularity (Time granularity);
+  Time GetGranularity (void) const;
+
+  /**
+    * \param cb Invoked with every item whose tick has passed. The callback
+    * may schedule items again.
+    */
+  void SetExpireCallback (Callback<void, T> cb);
+
+  /**
+    * \param item The item to hand back to the expire callback
+    * \param expires Absolute simulation time at which the item is due
+    */
+  void Schedule (const T& item, Time expires);
+
+  /**
+    * \returns Number of items in the wheel
+    */
+  uint32_t GetSize (void) const;
+
+  /**
+    * \brief Drop every item and cancel the driving event
+    */
+  void Clear (void);
+
+private:
+  enum
+  {
+    BITS = 6,
+    SLOTS = 1 << BITS,
+    MASK = SLOTS - 1,
+    LEVELS = 4
+  };
+
+  struct Node
+  {
+    T item;
+    uint64_t tick;
+  };
+
+  typedef std::vector<Node> Slot;
+
+  void Insert (const Node& node);
+  void Cascade (uint32_t level);
+  void Step (std::vector<T>& expired);
+  uint64_t GetNextTick (void) const;
+  uint64_t TimeToTick (Time t) const;
+  void Advance (void);
+
+  Slot m_slots[LEVELS][SLOTS];
+  uint64_t m_current;
+  uint32_t m_size;
+  Time m_granularity;
+  EventId m_event;
+  Callback<void, T> m_expire;
+};
+
+template <typename T>
+NetfilterTimerWheel<T>::NetfilterTimerWheel ()
+  : m_current (0),
+    m_size (0),
+    m_granularity (Seconds (1))
+{
+}
+
+template <typename T>
+NetfilterTimerWheel<T>::~NetfilterTimerWheel ()
+{
+  m_event.Cancel ();
+}
+
+template <typename T>
+void
+NetfilterTimerWheel<T>::SetGranularity (Time granularity)
+{
+  NS_ASSERT (m_size == 0 && granularity.IsStrictlyPositive ());
+  m_granularity = granularity;
+}
+
+template <typename T>
+Time
+NetfilterTimerWheel<T>::GetGranularity (void) const
+{
+  return m_granularity;
+}
+
+template <typename T>
+void
+NetfilterTimerWheel<T>::SetExpireCallback (Callback<void, T> cb)
+{
+  m_expire = cb;
+}
+
+template <typename T>
+uint64_t
+NetfilterTimerWheel<T>::TimeToTick (Time t) const
+{
+  int64_t g = m_granularity.GetTimeStep ();
+  int64_t v = t.GetTimeStep ();
+  if (v <= 0)
+    {
+      return 0;
+    }
+  /* round up: an item is never handed back before its deadline */
+  return (v + g - 1) / g;
+}
+
+template <typename T>
+void
+NetfilterTimerWheel<T>::Insert (const Node& node)
+{
+  uint64_t tick = node.tick < m_current ? m_current : node.tick;
+  uint64_t delta = tick - m_current;
+  uint32_t level = 0;
+  while (level < LEVELS - 1 && delta >= ((uint64_t)1 << (BITS * (level + 1))))
+    {
+      level++;
+    }
+  if (delta >= ((uint64_t)1 << (BITS * LEVELS)))
+    {
+      /* beyond the range of the wheel, park it in the farthest slot and
+       * let the cascade place it again */
+      tick = m_current + ((uint64_t)1 << (BITS * LEVELS)) - 1;
+    }
+  m_slots[level][(tick >> (BITS * level)) & MASK].push_back (node);
+}
+
+template <typename T>
+void
+NetfilterTimerWheel<T>::Schedule (const T& item, Time expires)
+{
+  if (m_size == 0)
+    {
+      m_current = TimeToTick (Simulator::Now ());
+    }
+  Node node;
+  node.item = item;
+  node.tick = TimeToTick (expires);
+  /* the slot of the current tick has been processed already */
+  if (node.tick <= m_current)
+    {
+      node.tick = m_current + 1;
+    }
+  Insert (node);
+  m_size++;
+
+  if (!m_event.IsRunning ())
+    {
+      Time next = TimeStep (m_granularity.GetTimeStep () * GetNextTick ());
+      m_event = Simulator::Schedule (next - Simulator::Now (), &NetfilterTimerWheel<T>::Advance, this);
+    }
+}
+
+template <typename T>
+void
+NetfilterTimerWheel<T>::Cascade (uint32_t level)
+{
+  Slot items;
+  items.swap (m_slots[level][(m_current >> (BITS * level)) & MASK]);
+  for (typename Slot::const_iterator i = items.begin (); i != items.end (); i++)
+    {
+      Insert (*i);
+    }
+}
+
+template <typename T>
+void
+NetfilterTimerWheel<T>::Step (std::vector<T>& expired)
+{
+  m_current++;
+  for (uint32_t level = 1; level < LEVELS; level++)
+    {
+      if ((m_current & (((uint64_t)1 << (BITS * level)) - 1)) != 0)
+        {
+          break;
+        }
+      Cascade (level);
+    }
+
+  Slot items;
+  items.swap (m_slots[0][m_current & MASK]);
+  for (typename Slot::const_iterator i = items.begin (); i != items.end (); i++)
+    {
+      if (i->tick > m_current)
+        {
+          /* parked beyond the range of the wheel */
+          Insert (*i);
+          continue;
+        }
+      expired.push_back (i->item);
+      m_size--;
+    }
+}
+
+template <typename T>
+uint64_t
+NetfilterTimerWheel<T>::GetNextTick (void) const
+{
+  /* first occupied slot of level 0 before it wraps, else the wrap itself
+   * where the upper levels are cascaded */
+  uint64_t t = m_current + 1;
+  while ((t & MASK) != 0)
+    {
+      if (!m_slots[0][t & MASK].empty ())
+        {
+          return t;
+        }
+      t++;
+    }
+  return t;
+}
+
+template <typename T>
+void
+NetfilterTimerWheel<T>::Advance (void)
+{
+  uint64_t now = TimeToTick (Simulator::Now ());
+  std::vector<T> expired;
+  while (m_current < now)
+    {
+      Step (expired);
+    }
+
+  for (typename std::vector<T>::const_iterator i = expired.begin (); i != expired.end (); i++)
+    {
+      m_expire (*i);
+    }
+
+  if (m_size > 0 && !m_event.IsRunning ())
+    {
+      Time next = TimeStep (m_granularity.GetTimeStep () * GetNextTick ());
+      m_event = Simulator::Schedule (next - Simulator::Now (), &NetfilterTimerWheel<T>::Advance, this);
+    }
+}
+
+template <typename T>
+uint32_t
+NetfilterTimerWheel<T>::GetSize (void) const
+{
+  return m_size;
+}
+
+template <typename T>
+void
+NetfilterTimerWheel<T>::Clear (void)
+{
+  m_event.Cancel ();
+  for (uint32_t level = 0; level < LEVELS; level++)
+    {
+      for (uint32_t slot = 0; slot < SLOTS; slot++)
+        {
+          m_slots[level][slot].clear ();
+        }
+    }
+  m_size = 0;
+}
+
+} // namespace ns3
+
+#endif /* NETFILTER_TIMER_WHEEL_H */
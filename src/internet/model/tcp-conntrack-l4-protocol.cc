@@ -18,7 +18,7 @@
  * Author: Qasim Javed <qasim@utdallas.edu>
  */
 #include "ns3/log.h"
-#include "tcp-header.h"
+#include "netfilter-packet-context.h"
 #include "tcp-conntrack-l4-protocol.h"
 
 NS_LOG_COMPONENT_DEFINE ("TcpConntrackL4Protocol");
@@ -31,13 +31,17 @@ TcpConntrackL4Protocol::TcpConntrackL4Protocol ()
 }
 
 bool 
-TcpConntrackL4Protocol::PacketToTuple (Ptr<Packet> p, NetfilterConntrackTuple& tuple)
+TcpConntrackL4Protocol::PacketToTuple (NetfilterPacketContext& ctx, NetfilterConntrackTuple& tuple)
 {
-  TcpHeader tcpHeader;
-  p->PeekHeader (tcpHeader);
-
-  tuple.SetSourcePort (tcpHeader.GetSourcePort ());
-  tuple.SetDestinationPort (tcpHeader.GetDestinationPort ());
+  if (!ctx.HasPorts ())
+    {
+      // a trailing fragment of an unknown datagram, or a truncated packet
+      NS_LOG_DEBUG (":: No TCP Header :: ");
+      return false;
+    }
+
+  tuple.SetSourcePort (ctx.GetSourcePort ());
+  tuple.SetDestinationPort (ctx.GetDestinationPort ());
   
   NS_LOG_DEBUG ("TCP Packet To Tuple: " << "( " << tuple.GetSource () << "," << tuple.GetSourcePort () << "," << tuple.GetDestination () << "," << tuple.GetDestinationPort () << ")" );
   return true;
@@ -34,7 +34,7 @@ class NetDevice;
   class TcpConntrackL4Protocol : public NetfilterConntrackL4Protocol {
     public:
       TcpConntrackL4Protocol ();
-      bool PacketToTuple (Ptr<Packet> p, NetfilterConntrackTuple& tuple);
+      bool PacketToTuple (NetfilterPacketContext& ctx, NetfilterConntrackTuple& tuple);
       bool InvertTuple (NetfilterConntrackTuple& inverse, NetfilterConntrackTuple& orig);
 
     private:
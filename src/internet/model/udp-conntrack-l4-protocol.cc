@@ -17,7 +17,7 @@
  * 
  * Author: Qasim Javed <qasim@utdallas.edu>
  */
-#include "udp-header.h"
+#include "netfilter-packet-context.h"
 #include "udp-conntrack-l4-protocol.h"
 
 NS_LOG_COMPONENT_DEFINE ("UdpConntrackL4Protocol");
@@ -30,17 +30,18 @@ UdpConntrackL4Protocol::UdpConntrackL4Protocol ()
 }
 
 bool 
-UdpConntrackL4Protocol::PacketToTuple (Ptr<Packet> p, NetfilterConntrackTuple& tuple)
+UdpConntrackL4Protocol::PacketToTuple (NetfilterPacketContext& ctx, NetfilterConntrackTuple& tuple)
 {
-  NS_LOG_FUNCTION ( this << p );
-  UdpHeader udpHeader;
-  bool found = p->PeekHeader (udpHeader);
-
-  if (!found)
-    NS_LOG_DEBUG (":: Errrr, No UDP Header :: ");
-
-  tuple.SetSourcePort (udpHeader.GetSourcePort ());
-  tuple.SetDestinationPort (udpHeader.GetDestinationPort ());
+  NS_LOG_FUNCTION ( this << ctx.GetPacket () );
+  if (!ctx.HasPorts ())
+    {
+      // a trailing fragment of an unknown datagram, or a truncated packet
+      NS_LOG_DEBUG (":: No UDP Header :: ");
+      return false;
+    }
+
+  tuple.SetSourcePort (ctx.GetSourcePort ());
+  tuple.SetDestinationPort (ctx.GetDestinationPort ());
   
   NS_LOG_DEBUG ("UDP Packet To Tuple: " << "( " << tuple.GetSource () << "," << tuple.GetSourcePort () << "," << tuple.GetDestination () << "," << tuple.GetDestinationPort () << ")" );
   return true;
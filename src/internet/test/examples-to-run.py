@@ -9,6 +9,7 @@
 # See test.py for more information.
 cpp_examples = [
     ("main-simple", "True", "True"),
+    ("ipv4-cgn-scale-example --subscribers=10000 --rounds=3", "True", "False"),
 ]
 
 # A list of Python examples to run in order to ensure that they remain
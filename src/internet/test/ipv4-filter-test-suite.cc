@@ -0,0 +1,312 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/test.h"
+#include "ns3/ptr.h"
+#include "ns3/node.h"
+#include "ns3/ipv4-filter.h"
+#include "ns3/ipv4-filter-helper.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-static-routing-helper.h"
+#include "ns3/ipv4-static-routing.h"
+#include "ns3/simple-channel.h"
+#include "ns3/simple-net-device.h"
+#include "ns3/ipv4-l3-protocol.h"
+#include "ns3/ipv4-netfilter.h"
+#include "ns3/netfilter-packet-context.h"
+#include "ns3/ipv4-header.h"
+#include "ns3/udp-header.h"
+#include "ns3/packet.h"
+#include "ns3/simulator.h"
+
+#include <vector>
+
+using namespace ns3;
+
+class Ipv4FilterClassify : public TestCase
+{
+public:
+  Ipv4FilterClassify ();
+  virtual ~Ipv4FilterClassify ();
+
+private:
+  virtual void DoRun (void);
+  uint32_t Random (void);
+
+  uint32_t m_seed;
+};
+
+Ipv4FilterClassify::Ipv4FilterClassify ()
+  : TestCase ("The compiled rules find the first matching rule"),
+    m_seed (1)
+{
+}
+
+Ipv4FilterClassify::~Ipv4FilterClassify ()
+{
+}
+
+uint32_t
+Ipv4FilterClassify::Random (void)
+{
+  m_seed = m_seed * 1103515245U + 12345U;
+  return m_seed >> 8;
+}
+
+void
+Ipv4FilterClassify::DoRun (void)
+{
+  Ptr<Ipv4Filter> filter = CreateObject<Ipv4Filter> ();
+  NS_TEST_ASSERT_MSG_EQ (filter->Classify (NF_INET_FORWARD, Ipv4Address ("10.0.0.1"), Ipv4Address ("10.0.0.2"),
+                                           17, true, 1000, 53, Ipv4FilterRule::STATE_NEW),
+                         -1, "empty table matched");
+
+  // Rules of every shape over a small address space, so that they overlap
+  std::vector<Ipv4FilterRule> rules;
+  uint32_t prefixes[] = { 0, 8, 16, 24, 32 };
+  for (uint32_t i = 0; i < 400; i++)
+    {
+      Ipv4FilterRule rule ((Random () & 1) ? NF_ACCEPT : NF_DROP);
+      uint32_t sourceLength = prefixes[Random () % 5];
+      uint32_t destinationLength = prefixes[Random () % 5];
+      rule.SetSource (Ipv4Address (0x0a000000 | (Random () & 0x00030303)),
+                      Ipv4Mask (sourceLength ? ~0U << (32 - sourceLength) : 0));
+      rule.SetDestination (Ipv4Address (0xc0a80000 | (Random () & 0x00000303)),
+                           Ipv4Mask (destinationLength ? ~0U << (32 - destinationLength) : 0));
+      switch (Random () % 4)
+        {
+        case 0:
+          break;
+        case 1:
+          {
+            uint16_t port = 50 + Random () % 8;
+            rule.SetProtocol (17);
+            rule.SetDestinationPortRange (port, port + 2);
+            break;
+          }
+        case 2:
+          rule.SetProtocol (6);
+          rule.SetDestinationPortRange (53, 53);
+          break;
+        case 3:
+          {
+            uint16_t port = 53 + Random () % 2;
+            rule.SetProtocol (17);
+            rule.SetDestinationPortRange (port, port);
+            rule.SetSourcePortRange (1000, 1000 + Random () % 4);
+            break;
+          }
+        }
+      if (Random () % 4 == 0)
+        {
+          rule.SetState (Ipv4FilterRule::STATE_ESTABLISHED | Ipv4FilterRule::STATE_RELATED);
+        }
+      rules.push_back (rule);
+      filter->AddRule (NF_INET_FORWARD, rule);
+    }
+  NS_TEST_ASSERT_MSG_EQ (filter->GetNRules (NF_INET_FORWARD), 400, "rules not added");
+  NS_TEST_ASSERT_MSG_EQ ((filter->GetNTuples (NF_INET_FORWARD) < 400), true, "rules not grouped");
+
+  // the first matching rule, as a linear search finds it
+  uint8_t protocols[] = { 6, 17, 1 };
+  for (uint32_t i = 0; i < 5000; i++)
+    {
+      Ipv4Address source (0x0a000000 | (Random () & 0x00030303));
+      Ipv4Address destination (0xc0a80000 | (Random () & 0x00000303));
+      uint8_t protocol = protocols[Random () % 3];
+      bool hasPorts = protocol != 1;
+      uint16_t sourcePort = hasPorts ? 1000 + Random () % 4 : 0;
+      uint16_t destinationPort = hasPorts ? 50 + Random () % 10 : 0;
+      uint8_t state = 1 << (Random () % 4);
+      int32_t expected = -1;
+      for (uint32_t j = 0; j < rules.size (); j++)
+        {
+          if (rules[j].Matches (source, destination, protocol, hasPorts, sourcePort, destinationPort, state))
+            {
+              expected = j;
+              break;
+            }
+        }
+      int32_t found = filter->Classify (NF_INET_FORWARD, source, destination, protocol, hasPorts,
+                                        sourcePort, destinationPort, state);
+      NS_TEST_ASSERT_MSG_EQ (found, expected, "wrong rule for " << source << ":" << sourcePort << " > "
+                                                                << destination << ":" << destinationPort
+                                                                << " protocol " << (uint32_t)protocol);
+    }
+
+  // the rules are compiled again after a change
+  filter->RemoveRule (NF_INET_FORWARD, 0);
+  Ipv4FilterRule all (NF_DROP);
+  filter->AddRule (NF_INET_FORWARD, all);
+  NS_TEST_ASSERT_MSG_EQ (filter->GetNRules (NF_INET_FORWARD), 400, "rules not changed");
+  for (uint32_t i = 0; i < 100; i++)
+    {
+      Ipv4Address source (0x0a000000 | (Random () & 0x00030303));
+      Ipv4Address destination (0xc0a80000 | (Random () & 0x00000303));
+      int32_t expected = 399;
+      for (uint32_t j = 1; j < rules.size (); j++)
+        {
+          if (rules[j].Matches (source, destination, 17, true, 1000, 53, Ipv4FilterRule::STATE_NEW))
+            {
+              expected = j - 1;
+              break;
+            }
+        }
+      int32_t found = filter->Classify (NF_INET_FORWARD, source, destination, 17, true,
+                                        1000, 53, Ipv4FilterRule::STATE_NEW);
+      NS_TEST_ASSERT_MSG_EQ (found, expected, "stale rules after a change");
+    }
+}
+
+class Ipv4FilterVerdict : public TestCase
+{
+public:
+  Ipv4FilterVerdict ();
+  virtual ~Ipv4FilterVerdict ();
+
+private:
+  virtual void DoRun (void);
+  void Receive (Ptr<NetDevice> device, Ipv4Address src, uint16_t sport, Ipv4Address dst, uint16_t dport);
+  uint32_t CountHook (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                      const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+
+  Ptr<Ipv4L3Protocol> m_ipv4;
+  uint32_t m_forwarded;
+  uint32_t m_seen;
+};
+
+Ipv4FilterVerdict::Ipv4FilterVerdict ()
+  : TestCase ("Packets dropped by the filter do not make it through the node"),
+    m_forwarded (0),
+    m_seen (0)
+{
+}
+
+Ipv4FilterVerdict::~Ipv4FilterVerdict ()
+{
+}
+
+uint32_t
+Ipv4FilterVerdict::CountHook (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                              const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  if (hook == NF_INET_FORWARD)
+    {
+      m_seen++;
+    }
+  else
+    {
+      m_forwarded++;
+    }
+  return NF_ACCEPT;
+}
+
+void
+Ipv4FilterVerdict::Receive (Ptr<NetDevice> device, Ipv4Address src, uint16_t sport, Ipv4Address dst, uint16_t dport)
+{
+  Ptr<Packet> p = Create<Packet> (64);
+  UdpHeader udp;
+  udp.SetSourcePort (sport);
+  udp.SetDestinationPort (dport);
+  p->AddHeader (udp);
+  Ipv4Header ip;
+  ip.SetSource (src);
+  ip.SetDestination (dst);
+  ip.SetProtocol (17);
+  ip.SetPayloadSize (p->GetSize ());
+  ip.SetTtl (64);
+  p->AddHeader (ip);
+  m_ipv4->Receive (device, p, Ipv4L3Protocol::PROT_NUMBER, device->GetBroadcast (),
+                   device->GetAddress (), NetDevice::PACKET_HOST);
+}
+
+void
+Ipv4FilterVerdict::DoRun (void)
+{
+  Ptr<Node> node = CreateObject<Node> ();
+  InternetStackHelper stack;
+  stack.Install (node);
+  m_ipv4 = node->GetObject<Ipv4L3Protocol> ();
+  Ptr<SimpleNetDevice> devs[2];
+  const char *addresses[] = { "203.0.113.1", "192.168.0.1" };
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      devs[i] = CreateObject<SimpleNetDevice> ();
+      devs[i]->SetAddress (Mac48Address::Allocate ());
+      devs[i]->SetChannel (CreateObject<SimpleChannel> ());
+      node->AddDevice (devs[i]);
+      uint32_t interface = m_ipv4->AddInterface (devs[i]);
+      m_ipv4->AddAddress (interface, Ipv4InterfaceAddress (Ipv4Address (addresses[i]), Ipv4Mask ("255.255.255.0")));
+      m_ipv4->SetUp (interface);
+    }
+  Ipv4StaticRoutingHelper routing;
+  routing.GetStaticRouting (m_ipv4)->SetDefaultRoute (Ipv4Address ("203.0.113.254"), 1);
+
+  // a firewall letting out the inside network and the replies back in
+  Ipv4FilterHelper filterHelper;
+  Ptr<Ipv4Filter> filter = filterHelper.Install (node);
+  filter->SetPolicy (NF_INET_FORWARD, NF_DROP);
+  Ipv4FilterRule dns (NF_DROP);
+  dns.SetSource (Ipv4Address ("192.168.0.66"), Ipv4Mask ("255.255.255.255"));
+  dns.SetProtocol (17);
+  dns.SetDestinationPortRange (53, 53);
+  filter->AddRule (NF_INET_FORWARD, dns);
+  Ipv4FilterRule outbound (NF_ACCEPT);
+  outbound.SetSource (Ipv4Address ("192.168.0.0"), Ipv4Mask ("255.255.255.0"));
+  filter->AddRule (NF_INET_FORWARD, outbound);
+  Ipv4FilterRule replies (NF_ACCEPT);
+  replies.SetState (Ipv4FilterRule::STATE_ESTABLISHED);
+  filter->AddRule (NF_INET_FORWARD, replies);
+
+  Ptr<Ipv4Netfilter> netfilter = m_ipv4->GetNetfilter ();
+  netfilter->RegisterHook (Ipv4NetfilterHook (1, NF_INET_FORWARD, NF_IP_PRI_FILTER + 10,
+                                              MakeCallback (&Ipv4FilterVerdict::CountHook, this)));
+  netfilter->RegisterHook (Ipv4NetfilterHook (1, NF_INET_POST_ROUTING, NF_IP_PRI_FILTER,
+                                              MakeCallback (&Ipv4FilterVerdict::CountHook, this)));
+
+  Ipv4Address server ("198.51.100.7");
+  Receive (devs[1], Ipv4Address ("192.168.0.3"), 1000, server, 53);
+  NS_TEST_ASSERT_MSG_EQ (m_forwarded, 1, "accepted packet not forwarded");
+  Receive (devs[0], server, 53, Ipv4Address ("192.168.0.3"), 1000);
+  NS_TEST_ASSERT_MSG_EQ (m_forwarded, 2, "reply not forwarded");
+  Receive (devs[0], server, 53, Ipv4Address ("192.168.0.3"), 1001);
+  NS_TEST_ASSERT_MSG_EQ (m_forwarded, 2, "unsolicited packet forwarded");
+  Receive (devs[1], Ipv4Address ("192.168.0.66"), 1000, server, 53);
+  NS_TEST_ASSERT_MSG_EQ (m_forwarded, 2, "packet of a drop rule forwarded");
+  Receive (devs[1], Ipv4Address ("192.168.0.66"), 1000, server, 54);
+  NS_TEST_ASSERT_MSG_EQ (m_forwarded, 3, "drop rule too wide");
+  // the hooks behind the filter never saw the dropped packets
+  NS_TEST_ASSERT_MSG_EQ (m_seen, 3, "hooks ran after a drop");
+
+  m_ipv4 = 0;
+  Simulator::Destroy ();
+}
+
+class Ipv4FilterTestSuite : public TestSuite
+{
+public:
+  Ipv4FilterTestSuite ();
+};
+
+Ipv4FilterTestSuite::Ipv4FilterTestSuite ()
+  : TestSuite ("ipv4-filter", UNIT)
+{
+  AddTestCase (new Ipv4FilterClassify);
+  AddTestCase (new Ipv4FilterVerdict);
+}
+
+static Ipv4FilterTestSuite ipv4FilterTestSuite;
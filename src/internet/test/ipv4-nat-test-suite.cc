@@ -27,6 +27,21 @@
 #include "ns3/inet-socket-address.h"
 #include "ns3/ipv4-l3-protocol.h"
 #include "ns3/ipv4.h"
+#include "ns3/ipv4-netfilter.h"
+#include "ns3/ipv4-header.h"
+#include "ns3/udp-header.h"
+#include "ns3/icmpv4.h"
+#include "ns3/packet.h"
+#include "ns3/simulator.h"
+#include "ns3/ipv4-nat-port-allocator.h"
+#include "ns3/uinteger.h"
+#include "ns3/enum.h"
+#include "ns3/string.h"
+#include "ns3/boolean.h"
+#include "ns3/output-stream-wrapper.h"
+
+#include <set>
+#include <sstream>
 
 using namespace ns3;
 
@@ -124,6 +139,1165 @@ Ipv4NatStatic::DoRun (void)
 {
 }
 
+// Walk a UDP packet through the hooks a forwarding node would run and
+// return the headers it leaves with
+static Ptr<Packet>
+Forward (Ptr<Ipv4Netfilter> nf, Ptr<NetDevice> in, Ptr<NetDevice> out,
+         Ipv4Address src, uint16_t sport, Ipv4Address dst, uint16_t dport,
+         Ipv4Header &ipHeader, UdpHeader &udpHeader)
+{
+  Ptr<Packet> p = Create<Packet> (64);
+  UdpHeader udp;
+  udp.SetSourcePort (sport);
+  udp.SetDestinationPort (dport);
+  p->AddHeader (udp);
+  Ipv4Header ip;
+  ip.SetSource (src);
+  ip.SetDestination (dst);
+  ip.SetProtocol (17);
+  ip.SetPayloadSize (p->GetSize ());
+  p->AddHeader (ip);
+
+  nf->ProcessHook (PF_INET, NF_INET_PRE_ROUTING, p, in, 0);
+  ContinueCallback confirm = MakeCallback (&Ipv4Netfilter::NetfilterConntrackConfirm, nf);
+  nf->ProcessHook (PF_INET, NF_INET_POST_ROUTING, p, 0, out, confirm);
+
+  p->RemoveHeader (ipHeader);
+  p->PeekHeader (udpHeader);
+  return p;
+}
+
+// Node with an outside interface 203.0.113.1 and an inside interface
+// 192.168.0.1 doing dynamic NAT of 192.168.0.0/24 behind 203.0.113.10
+static Ptr<Ipv4Nat>
+CreateDynamicNatNode (Ptr<SimpleNetDevice> &outsideDev, Ptr<SimpleNetDevice> &insideDev)
+{
+  Ptr<Node> testNode = CreateObject<Node> ();
+  InternetStackHelper stack;
+  stack.Install (testNode);
+  Ptr<Ipv4> ipv4 = testNode->GetObject<Ipv4> ();
+
+  outsideDev = CreateObject<SimpleNetDevice> ();
+  outsideDev->SetAddress (Mac48Address::ConvertFrom (Mac48Address::Allocate ()));
+  testNode->AddDevice (outsideDev);
+  uint32_t outside = ipv4->AddInterface (outsideDev);
+  ipv4->AddAddress (outside, Ipv4InterfaceAddress (Ipv4Address ("203.0.113.1"), Ipv4Mask (0xffffff00U)));
+  ipv4->SetUp (outside);
+
+  insideDev = CreateObject<SimpleNetDevice> ();
+  insideDev->SetAddress (Mac48Address::ConvertFrom (Mac48Address::Allocate ()));
+  testNode->AddDevice (insideDev);
+  uint32_t inside = ipv4->AddInterface (insideDev);
+  ipv4->AddAddress (inside, Ipv4InterfaceAddress (Ipv4Address ("192.168.0.1"), Ipv4Mask (0xffffff00U)));
+  ipv4->SetUp (inside);
+
+  Ptr<Ipv4Nat> nat = CreateObject<Ipv4Nat> ();
+  nat->SetOutside (outside);
+  nat->SetInside (inside);
+  testNode->AggregateObject (nat);
+  nat->AddDynamicRule (Ipv4DynamicNatRule (Ipv4Address ("192.168.0.0"), Ipv4Mask ("255.255.255.0")));
+  nat->AddAddressPool (Ipv4Address ("203.0.113.10"), Ipv4Mask ("255.255.255.255"));
+  nat->AddPortPool (49153, 49163);
+  return nat;
+}
+
+class Ipv4NatDynamic : public TestCase
+{
+public:
+  Ipv4NatDynamic ();
+  virtual ~Ipv4NatDynamic ();
+
+private:
+  virtual void DoRun (void);
+};
+
+Ipv4NatDynamic::Ipv4NatDynamic ()
+  : TestCase ("Test that NAT translates and reverses dynamic flows")
+{
+}
+
+Ipv4NatDynamic::~Ipv4NatDynamic ()
+{
+}
+
+void
+Ipv4NatDynamic::DoRun (void)
+{
+  Ptr<SimpleNetDevice> outsideDev, insideDev;
+  Ptr<Ipv4Nat> nat = CreateDynamicNatNode (outsideDev, insideDev);
+  Ptr<Ipv4Netfilter> nf = nat->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  Ipv4Address server ("198.51.100.7");
+  Ipv4Header ip;
+  UdpHeader udp;
+
+  // First packet of a flow creates a binding
+  Forward (nf, insideDev, outsideDev, Ipv4Address ("192.168.0.3"), 5000, server, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetSource (), Ipv4Address ("203.0.113.10"), "source address not translated");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49153, "source port not translated");
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNDynamicTuples (), 1, "binding not created");
+
+  // Later packets of the same flow reuse it
+  Forward (nf, insideDev, outsideDev, Ipv4Address ("192.168.0.3"), 5000, server, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49153, "binding not reused");
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNDynamicTuples (), 1, "binding duplicated");
+
+  // A second flow from the same host gets its own port
+  Forward (nf, insideDev, outsideDev, Ipv4Address ("192.168.0.3"), 5001, server, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49154, "second flow shares a port");
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNDynamicTuples (), 2, "second binding not created");
+
+  // Replies are mapped back to the inside host and port
+  Forward (nf, outsideDev, insideDev, server, 53, Ipv4Address ("203.0.113.10"), 49153, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), Ipv4Address ("192.168.0.3"), "reply address not reversed");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetDestinationPort (), 5000, "reply port not reversed");
+
+  Forward (nf, outsideDev, insideDev, server, 53, Ipv4Address ("203.0.113.10"), 49154, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (udp.GetDestinationPort (), 5001, "reply port of second flow not reversed");
+
+  // Traffic to an unbound port passes untouched
+  Forward (nf, outsideDev, insideDev, server, 53, Ipv4Address ("203.0.113.10"), 49160, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), Ipv4Address ("203.0.113.10"), "unbound port translated");
+
+  Simulator::Destroy ();
+}
+
+/* One's complement sum of a byte range, 0xffff over a valid checksum */
+static uint16_t
+OnesSum (const uint8_t *data, uint32_t size)
+{
+  uint32_t sum = 0;
+  for (uint32_t i = 0; i + 1 < size; i += 2)
+    {
+      sum += (data[i] << 8) | data[i + 1];
+    }
+  if (size & 1)
+    {
+      sum += data[size - 1] << 8;
+    }
+  while (sum >> 16)
+    {
+      sum = (sum & 0xffff) + (sum >> 16);
+    }
+  return sum;
+}
+
+static uint16_t
+GetWord (const uint8_t *data)
+{
+  return (data[0] << 8) | data[1];
+}
+
+class Ipv4NatIcmp : public TestCase
+{
+public:
+  Ipv4NatIcmp ();
+  virtual ~Ipv4NatIcmp ();
+
+private:
+  virtual void DoRun (void);
+  void ForwardIcmp (Ptr<NetDevice> in, Ptr<NetDevice> out, Ipv4Address src, Ipv4Address dst,
+                    Ptr<Packet> p, uint8_t buffer[]);
+
+  Ptr<Ipv4Netfilter> m_netfilter;
+};
+
+Ipv4NatIcmp::Ipv4NatIcmp ()
+  : TestCase ("Test that NAT maps ICMP query identifiers and translates quoted packets of ICMP errors")
+{
+}
+
+Ipv4NatIcmp::~Ipv4NatIcmp ()
+{
+}
+
+void
+Ipv4NatIcmp::ForwardIcmp (Ptr<NetDevice> in, Ptr<NetDevice> out, Ipv4Address src, Ipv4Address dst,
+                          Ptr<Packet> p, uint8_t buffer[])
+{
+  Ipv4Header ip;
+  ip.SetSource (src);
+  ip.SetDestination (dst);
+  ip.SetProtocol (1);
+  ip.SetPayloadSize (p->GetSize ());
+  p->AddHeader (ip);
+
+  m_netfilter->ProcessHook (PF_INET, NF_INET_PRE_ROUTING, p, in, 0);
+  ContinueCallback confirm = MakeCallback (&Ipv4Netfilter::NetfilterConntrackConfirm, m_netfilter);
+  m_netfilter->ProcessHook (PF_INET, NF_INET_POST_ROUTING, p, 0, out, confirm);
+  p->CopyData (buffer, p->GetSize ());
+}
+
+void
+Ipv4NatIcmp::DoRun (void)
+{
+  Ptr<SimpleNetDevice> outsideDev, insideDev;
+  Ptr<Ipv4Nat> nat = CreateDynamicNatNode (outsideDev, insideDev);
+  m_netfilter = nat->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  Ipv4Address host ("192.168.0.3");
+  Ipv4Address global ("203.0.113.10");
+  Ipv4Address server ("198.51.100.7");
+  uint8_t buffer[128];
+
+  // An echo request gets an identifier from the port pool
+  Icmpv4Echo echo;
+  echo.SetIdentifier (7);
+  echo.SetSequenceNumber (1);
+  Icmpv4Header icmp;
+  icmp.EnableChecksum ();
+  icmp.SetType (Icmpv4Header::ECHO);
+  Ptr<Packet> p = Create<Packet> (32);
+  p->AddHeader (echo);
+  p->AddHeader (icmp);
+  uint32_t size = p->GetSize ();
+  ForwardIcmp (insideDev, outsideDev, host, server, p, buffer);
+  NS_TEST_ASSERT_MSG_EQ (Ipv4Address::Deserialize (buffer + 12), global, "echo source not translated");
+  NS_TEST_ASSERT_MSG_EQ (GetWord (buffer + 24), 49153, "echo identifier not mapped");
+  NS_TEST_ASSERT_MSG_EQ (OnesSum (buffer + 20, size), 0xffff, "bad echo checksum");
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNDynamicTuples (), 1, "echo binding not created");
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNAllocatedPorts (), 1, "echo identifier not taken from the port pool");
+
+  // The reply is mapped back to the inside host and identifier
+  echo.SetIdentifier (49153);
+  icmp.SetType (Icmpv4Header::ECHO_REPLY);
+  p = Create<Packet> (32);
+  p->AddHeader (echo);
+  p->AddHeader (icmp);
+  ForwardIcmp (outsideDev, insideDev, server, global, p, buffer);
+  NS_TEST_ASSERT_MSG_EQ (Ipv4Address::Deserialize (buffer + 16), host, "echo reply destination not reversed");
+  NS_TEST_ASSERT_MSG_EQ (GetWord (buffer + 24), 7, "echo reply identifier not reversed");
+  NS_TEST_ASSERT_MSG_EQ (OnesSum (buffer + 20, size), 0xffff, "bad echo reply checksum");
+
+  // A UDP flow, then a port unreachable error about one of its packets
+  Ipv4Header ipHeader;
+  UdpHeader udpHeader;
+  Forward (m_netfilter, insideDev, outsideDev, host, 5000, server, 53, ipHeader, udpHeader);
+  NS_TEST_ASSERT_MSG_EQ (udpHeader.GetSourcePort (), 49154, "UDP flow not translated");
+
+  UdpHeader udp;
+  udp.EnableChecksums ();
+  udp.InitializeChecksum (global, server, 17);
+  udp.SetSourcePort (49154);
+  udp.SetDestinationPort (53);
+  Ptr<Packet> quoted = Create<Packet> ();
+  quoted->AddHeader (udp);
+  Ipv4Header quotedIp;
+  quotedIp.EnableChecksum ();
+  quotedIp.SetSource (global);
+  quotedIp.SetDestination (server);
+  quotedIp.SetProtocol (17);
+  quotedIp.SetPayloadSize (quoted->GetSize ());
+
+  // checksum of the quoted datagram as the inside host sent it
+  UdpHeader original;
+  original.EnableChecksums ();
+  original.InitializeChecksum (host, server, 17);
+  original.SetSourcePort (5000);
+  original.SetDestinationPort (53);
+  Ptr<Packet> originalPacket = Create<Packet> ();
+  originalPacket->AddHeader (original);
+  uint8_t originalBytes[8];
+  originalPacket->CopyData (originalBytes, 8);
+
+  Icmpv4DestinationUnreachable unreachable;
+  unreachable.SetHeader (quotedIp);
+  unreachable.SetData (quoted);
+  icmp.SetType (Icmpv4Header::DEST_UNREACH);
+  icmp.SetCode (Icmpv4DestinationUnreachable::PORT_UNREACHABLE);
+  p = Create<Packet> ();
+  p->AddHeader (unreachable);
+  p->AddHeader (icmp);
+  size = p->GetSize ();
+  ForwardIcmp (outsideDev, insideDev, server, global, p, buffer);
+  NS_TEST_ASSERT_MSG_EQ (Ipv4Address::Deserialize (buffer + 16), host, "error destination not reversed");
+  NS_TEST_ASSERT_MSG_EQ (OnesSum (buffer + 20, size), 0xffff, "bad error checksum");
+  NS_TEST_ASSERT_MSG_EQ (Ipv4Address::Deserialize (buffer + 40), host, "quoted source not reversed");
+  NS_TEST_ASSERT_MSG_EQ (OnesSum (buffer + 28, 20), 0xffff, "bad quoted IPv4 checksum");
+  NS_TEST_ASSERT_MSG_EQ (GetWord (buffer + 48), 5000, "quoted source port not reversed");
+  NS_TEST_ASSERT_MSG_EQ (GetWord (buffer + 54), GetWord (originalBytes + 6),
+                         "quoted UDP checksum not updated");
+
+  // An error quoting a packet of no translation is left alone
+  unreachable.SetData (originalPacket);
+  quotedIp.SetSource (Ipv4Address ("203.0.113.20"));
+  unreachable.SetHeader (quotedIp);
+  p = Create<Packet> ();
+  p->AddHeader (unreachable);
+  p->AddHeader (icmp);
+  ForwardIcmp (outsideDev, insideDev, server, global, p, buffer);
+  NS_TEST_ASSERT_MSG_EQ (Ipv4Address::Deserialize (buffer + 16), global, "unrelated error translated");
+
+  m_netfilter = 0;
+  Simulator::Destroy ();
+}
+
+class Ipv4NatFragments : public TestCase
+{
+public:
+  Ipv4NatFragments ();
+  virtual ~Ipv4NatFragments ();
+
+private:
+  virtual void DoRun (void);
+  Ptr<Packet> SendFragment (Ptr<NetDevice> in, Ptr<NetDevice> out, Ipv4Address src, Ipv4Address dst,
+                            uint16_t sport, uint16_t dport, uint16_t offset);
+
+  Ptr<Ipv4Netfilter> m_netfilter;
+};
+
+Ipv4NatFragments::Ipv4NatFragments ()
+  : TestCase ("Test that NAT translates trailing fragments like the first one of their datagram")
+{
+}
+
+Ipv4NatFragments::~Ipv4NatFragments ()
+{
+}
+
+Ptr<Packet>
+Ipv4NatFragments::SendFragment (Ptr<NetDevice> in, Ptr<NetDevice> out, Ipv4Address src, Ipv4Address dst,
+                                uint16_t sport, uint16_t dport, uint16_t offset)
+{
+  uint8_t payload[16];
+  for (uint32_t i = 0; i < 16; i++)
+    {
+      payload[i] = i;
+    }
+  Ptr<Packet> p = Create<Packet> (payload, 16);
+  if (offset == 0)
+    {
+      UdpHeader udp;
+      udp.SetSourcePort (sport);
+      udp.SetDestinationPort (dport);
+      p->AddHeader (udp);
+    }
+  Ipv4Header ip;
+  ip.SetSource (src);
+  ip.SetDestination (dst);
+  ip.SetProtocol (17);
+  ip.EnableChecksum ();
+  ip.SetIdentification (42);
+  ip.SetFragmentOffset (offset);
+  if (offset == 0)
+    {
+      ip.SetMoreFragments ();
+    }
+  else
+    {
+      ip.SetLastFragment ();
+    }
+  ip.SetPayloadSize (p->GetSize ());
+  p->AddHeader (ip);
+
+  m_netfilter->ProcessHook (PF_INET, NF_INET_PRE_ROUTING, p, in, 0);
+  ContinueCallback confirm = MakeCallback (&Ipv4Netfilter::NetfilterConntrackConfirm, m_netfilter);
+  m_netfilter->ProcessHook (PF_INET, NF_INET_POST_ROUTING, p, 0, out, confirm);
+  return p;
+}
+
+void
+Ipv4NatFragments::DoRun (void)
+{
+  Ptr<SimpleNetDevice> outsideDev, insideDev;
+  Ptr<Ipv4Nat> nat = CreateDynamicNatNode (outsideDev, insideDev);
+  m_netfilter = nat->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  Ipv4Address host ("192.168.0.3");
+  Ipv4Address global ("203.0.113.10");
+  Ipv4Address server ("198.51.100.7");
+  uint8_t buffer[64];
+
+  // The first fragment creates the binding, the trailing one follows it
+  Ptr<Packet> p = SendFragment (insideDev, outsideDev, host, server, 5000, 53, 0);
+  p->CopyData (buffer, 28);
+  NS_TEST_ASSERT_MSG_EQ (Ipv4Address::Deserialize (buffer + 12), global, "first fragment not translated");
+  NS_TEST_ASSERT_MSG_EQ (GetWord (buffer + 20), 49153, "port of the first fragment not translated");
+
+  p = SendFragment (insideDev, outsideDev, host, server, 0, 0, 24);
+  p->CopyData (buffer, 36);
+  NS_TEST_ASSERT_MSG_EQ (Ipv4Address::Deserialize (buffer + 12), global, "trailing fragment not translated");
+  NS_TEST_ASSERT_MSG_EQ (OnesSum (buffer, 20), 0xffff, "bad IPv4 checksum of the trailing fragment");
+  bool payloadIntact = true;
+  for (uint32_t i = 0; i < 16; i++)
+    {
+      payloadIntact = payloadIntact && buffer[20 + i] == i;
+    }
+  NS_TEST_ASSERT_MSG_EQ (payloadIntact, true, "payload of the trailing fragment changed");
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNDynamicTuples (), 1, "trailing fragment created a binding");
+
+  // Fragmented replies are mapped back the same way
+  SendFragment (outsideDev, insideDev, server, global, 53, 49153, 0);
+  p = SendFragment (outsideDev, insideDev, server, global, 0, 0, 24);
+  p->CopyData (buffer, 20);
+  NS_TEST_ASSERT_MSG_EQ (Ipv4Address::Deserialize (buffer + 16), host, "trailing fragment of the reply not reversed");
+
+  m_netfilter = 0;
+  Simulator::Destroy ();
+}
+
+class Ipv4NatExpiry : public TestCase
+{
+public:
+  Ipv4NatExpiry ();
+  virtual ~Ipv4NatExpiry ();
+
+private:
+  virtual void DoRun (void);
+  void SendOut (uint16_t sport);
+  void SendIn (uint16_t dport);
+  void CheckBindings (uint32_t expected);
+  void Evicted (const Ipv4DynamicNatTuple &tuple);
+
+  Ptr<Ipv4Nat> m_nat;
+  Ptr<Ipv4Netfilter> m_netfilter;
+  Ptr<SimpleNetDevice> m_outsideDev;
+  Ptr<SimpleNetDevice> m_insideDev;
+  uint32_t m_evictions;
+};
+
+Ipv4NatExpiry::Ipv4NatExpiry ()
+  : TestCase ("Test that idle dynamic NAT translations expire"),
+    m_evictions (0)
+{
+}
+
+Ipv4NatExpiry::~Ipv4NatExpiry ()
+{
+}
+
+void
+Ipv4NatExpiry::SendOut (uint16_t sport)
+{
+  Ipv4Header ip;
+  UdpHeader udp;
+  Forward (m_netfilter, m_insideDev, m_outsideDev, Ipv4Address ("192.168.0.3"), sport,
+           Ipv4Address ("198.51.100.7"), 53, ip, udp);
+}
+
+void
+Ipv4NatExpiry::SendIn (uint16_t dport)
+{
+  Ipv4Header ip;
+  UdpHeader udp;
+  Forward (m_netfilter, m_outsideDev, m_insideDev, Ipv4Address ("198.51.100.7"), 53,
+           Ipv4Address ("203.0.113.10"), dport, ip, udp);
+}
+
+void
+Ipv4NatExpiry::CheckBindings (uint32_t expected)
+{
+  NS_TEST_EXPECT_MSG_EQ (m_nat->GetNDynamicTuples (), expected,
+                         "unexpected number of translations at " << Simulator::Now ().GetSeconds ());
+}
+
+void
+Ipv4NatExpiry::Evicted (const Ipv4DynamicNatTuple &tuple)
+{
+  m_evictions++;
+}
+
+void
+Ipv4NatExpiry::DoRun (void)
+{
+  m_nat = CreateDynamicNatNode (m_outsideDev, m_insideDev);
+  m_netfilter = m_nat->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  m_nat->SetAttribute ("UdpTimeout", TimeValue (Seconds (30)));
+  m_nat->TraceConnectWithoutContext ("BindingEviction", MakeCallback (&Ipv4NatExpiry::Evicted, this));
+
+  // Two flows; replies keep the first one alive, the second one idles out
+  SendOut (5000);
+  SendOut (5001);
+  CheckBindings (2);
+  Simulator::Schedule (Seconds (20), &Ipv4NatExpiry::SendIn, this, 49153);
+  Simulator::Schedule (Seconds (40), &Ipv4NatExpiry::CheckBindings, this, 1);
+  Simulator::Schedule (Seconds (45), &Ipv4NatExpiry::CheckBindings, this, 1);
+  Simulator::Schedule (Seconds (55), &Ipv4NatExpiry::CheckBindings, this, 0);
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_evictions, 2, "evictions not traced");
+  NS_TEST_ASSERT_MSG_EQ (m_nat->GetNDynamicTuples (), 0, "translations left behind");
+  NS_TEST_ASSERT_MSG_EQ (m_nat->GetNAllocatedPorts (), 0, "ports of expired translations not released");
+
+  m_nat = 0;
+  m_netfilter = 0;
+  m_outsideDev = 0;
+  m_insideDev = 0;
+  Simulator::Destroy ();
+}
+
+class Ipv4NatPortAllocation : public TestCase
+{
+public:
+  Ipv4NatPortAllocation ();
+  virtual ~Ipv4NatPortAllocation ();
+
+private:
+  virtual void DoRun (void);
+};
+
+Ipv4NatPortAllocation::Ipv4NatPortAllocation ()
+  : TestCase ("Test the NAT port allocator with and without port blocks")
+{
+}
+
+Ipv4NatPortAllocation::~Ipv4NatPortAllocation ()
+{
+}
+
+void
+Ipv4NatPortAllocation::DoRun (void)
+{
+  Ipv4NatPortAllocator ports;
+  ports.SetAddressRange (Ipv4Address ("203.0.113.8"), 2);
+  ports.SetPortRange (1000, 1003);
+  NS_TEST_ASSERT_MSG_EQ (ports.GetCapacity (), 8, "wrong pool size");
+
+  Ipv4Address host ("192.168.0.3");
+  Ipv4Address address;
+  uint16_t port;
+  std::set<std::pair<uint32_t, uint16_t> > seen;
+  for (uint32_t i = 0; i < 8; i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (ports.Allocate (host, address, port), true, "pool exhausted early");
+      NS_TEST_ASSERT_MSG_EQ ((address == Ipv4Address ("203.0.113.8") || address == Ipv4Address ("203.0.113.9")),
+                             true, "address outside the pool");
+      NS_TEST_ASSERT_MSG_EQ ((port >= 1000 && port <= 1003), true, "port outside the pool");
+      seen.insert (std::make_pair (address.Get (), port));
+    }
+  NS_TEST_ASSERT_MSG_EQ (seen.size (), 8, "a pair was handed out twice");
+  NS_TEST_ASSERT_MSG_EQ (ports.Allocate (host, address, port), false, "allocated beyond the pool");
+  NS_TEST_ASSERT_MSG_EQ (ports.GetNFailures (), 1, "failure not counted");
+
+  // Released pairs are reused oldest first
+  ports.Release (host, Ipv4Address ("203.0.113.9"), 1001);
+  ports.Release (host, Ipv4Address ("203.0.113.8"), 1002);
+  NS_TEST_ASSERT_MSG_EQ (ports.GetNAllocated (), 6, "release not counted");
+  ports.Allocate (host, address, port);
+  NS_TEST_ASSERT_MSG_EQ (address, Ipv4Address ("203.0.113.9"), "released address not reused");
+  NS_TEST_ASSERT_MSG_EQ (port, 1001, "released port not reused");
+
+  // A pair that is not in use is not released again
+  ports.Release (host, Ipv4Address ("203.0.113.8"), 1002);
+  NS_TEST_ASSERT_MSG_EQ (ports.GetNAllocated (), 7, "double release counted");
+  NS_TEST_ASSERT_MSG_EQ (ports.Allocate (host, address, port), true, "released pair not reused");
+  NS_TEST_ASSERT_MSG_EQ (ports.Allocate (host, address, port), false, "double released pair handed out twice");
+
+  // A reserved pair is skipped in the free list
+  ports.Release (host, Ipv4Address ("203.0.113.8"), 1000);
+  ports.Release (host, Ipv4Address ("203.0.113.9"), 1000);
+  NS_TEST_ASSERT_MSG_EQ (ports.Reserve (host, Ipv4Address ("203.0.113.9"), 1000), true, "free pair not reserved");
+  NS_TEST_ASSERT_MSG_EQ (ports.Reserve (host, Ipv4Address ("203.0.113.9"), 1000), false, "pair reserved twice");
+  NS_TEST_ASSERT_MSG_EQ (ports.Allocate (host, address, port), true, "released pair not reused");
+  NS_TEST_ASSERT_MSG_EQ (address, Ipv4Address ("203.0.113.8"), "reserved pair handed out");
+  NS_TEST_ASSERT_MSG_EQ (ports.Allocate (host, address, port), false, "reserved pair handed out");
+
+  // Port blocks: two blocks of two ports per address, one block per host
+  ports.SetBlockSize (2);
+  ports.SetMaxBlocksPerSubscriber (1);
+  NS_TEST_ASSERT_MSG_EQ (ports.GetCapacity (), 8, "wrong pool size with blocks");
+  Ipv4Address a1, a2, b1;
+  uint16_t p1, p2, q1;
+  Ipv4Address other ("192.168.0.4");
+  NS_TEST_ASSERT_MSG_EQ (ports.Allocate (host, a1, p1), true, "no block for the first host");
+  NS_TEST_ASSERT_MSG_EQ (ports.Allocate (host, a2, p2), true, "block not shared by the host");
+  NS_TEST_ASSERT_MSG_EQ (a1, a2, "ports of a block on different addresses");
+  NS_TEST_ASSERT_MSG_EQ (p2, p1 + 1, "block ports not consecutive");
+  NS_TEST_ASSERT_MSG_EQ (ports.Allocate (host, address, port), false, "host exceeded its block limit");
+  NS_TEST_ASSERT_MSG_EQ (ports.Allocate (other, b1, q1), true, "no block for the second host");
+  NS_TEST_ASSERT_MSG_EQ ((b1 != a1 || q1 < p1 || q1 > p2), true, "second host got a port of the first block");
+  NS_TEST_ASSERT_MSG_EQ (ports.GetNSubscribers (), 2, "wrong number of subscribers");
+
+  // The block goes back to the pool with the last port of its host
+  ports.Release (host, a1, p1);
+  NS_TEST_ASSERT_MSG_EQ (ports.GetNSubscribers (), 2, "block released while in use");
+  ports.Release (host, a2, p2);
+  NS_TEST_ASSERT_MSG_EQ (ports.GetNSubscribers (), 1, "block not released");
+  NS_TEST_ASSERT_MSG_EQ (ports.GetNAllocated (), 1, "wrong number of allocated ports");
+
+  // Pairs a host does not use are not released
+  ports.Release (host, a2, p2);
+  ports.Release (other, a1, p1);
+  ports.Release (other, b1, q1 + 1);
+  NS_TEST_ASSERT_MSG_EQ (ports.GetNAllocated (), 1, "pair not in use released");
+  NS_TEST_ASSERT_MSG_EQ (ports.GetNSubscribers (), 1, "block of a host released by another");
+}
+
+class Ipv4NatStaticIndex : public TestCase
+{
+public:
+  Ipv4NatStaticIndex ();
+  virtual ~Ipv4NatStaticIndex ();
+
+private:
+  virtual void DoRun (void);
+};
+
+Ipv4NatStaticIndex::Ipv4NatStaticIndex ()
+  : TestCase ("Test the lookup of static rules among many port forwards")
+{
+}
+
+Ipv4NatStaticIndex::~Ipv4NatStaticIndex ()
+{
+}
+
+void
+Ipv4NatStaticIndex::DoRun (void)
+{
+  Ptr<SimpleNetDevice> outsideDev, insideDev;
+  Ptr<Ipv4Nat> nat = CreateDynamicNatNode (outsideDev, insideDev);
+  Ptr<Ipv4Netfilter> nf = nat->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  Ipv4Address client ("198.51.100.7");
+  Ipv4Address outside ("203.0.113.1");
+  Ipv4Header ip;
+  UdpHeader udp;
+
+  // Forward ports 10000-11999 of the outside address to ports 8000-9999
+  // spread over 200 inside hosts
+  for (uint32_t i = 0; i < 2000; i++)
+    {
+      nat->AddStaticRule (Ipv4StaticNatRule (Ipv4Address (0xc0a80002 + i % 200), 8000 + i,
+                                             outside, 10000 + i, 17));
+    }
+  nat->AddStaticRule (Ipv4StaticNatRule (Ipv4Address ("192.168.0.250"), Ipv4Address ("203.0.113.20")));
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNStaticRules (), 2001, "rules not added");
+
+  Forward (nf, outsideDev, insideDev, client, 4000, outside, 11234, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), Ipv4Address (0xc0a80002 + 1234 % 200), "port forward not applied");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetDestinationPort (), 9234, "forwarded port not translated");
+
+  // Replies of the forwarded flow leave from the global port
+  Forward (nf, insideDev, outsideDev, Ipv4Address (0xc0a80002 + 1234 % 200), 9234, client, 4000, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetSource (), outside, "reply address not translated");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 11234, "reply port not translated");
+
+  // A port without a forward is left to the dynamic rules
+  Forward (nf, outsideDev, insideDev, client, 4000, outside, 12000, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), outside, "unforwarded port translated");
+
+  // Rules without ports match every port of the address
+  Forward (nf, outsideDev, insideDev, client, 4000, Ipv4Address ("203.0.113.20"), 7, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), Ipv4Address ("192.168.0.250"), "address rule not applied");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetDestinationPort (), 7, "address rule changed the port");
+
+  // The newest rule for a port wins, and removing it restores the older one
+  nat->AddStaticRule (Ipv4StaticNatRule (Ipv4Address ("192.168.0.251"), 8080, outside, 11234, 17));
+  Forward (nf, outsideDev, insideDev, client, 4001, outside, 11234, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), Ipv4Address ("192.168.0.251"), "newest rule not preferred");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetDestinationPort (), 8080, "newest rule port not applied");
+
+  nat->RemoveStaticRule (0);
+  Forward (nf, outsideDev, insideDev, client, 4002, outside, 11234, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), Ipv4Address (0xc0a80002 + 1234 % 200), "removed rule still applied");
+
+  Simulator::Destroy ();
+}
+
+class Ipv4NatSnapshot : public TestCase
+{
+public:
+  Ipv4NatSnapshot ();
+  virtual ~Ipv4NatSnapshot ();
+
+private:
+  virtual void DoRun (void);
+};
+
+Ipv4NatSnapshot::Ipv4NatSnapshot ()
+  : TestCase ("Test that dynamic NAT translations survive a snapshot")
+{
+}
+
+Ipv4NatSnapshot::~Ipv4NatSnapshot ()
+{
+}
+
+void
+Ipv4NatSnapshot::DoRun (void)
+{
+  Ptr<SimpleNetDevice> outsideDev, insideDev;
+  Ptr<Ipv4Nat> nat = CreateDynamicNatNode (outsideDev, insideDev);
+  Ptr<Ipv4Netfilter> nf = nat->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  Ipv4Address server ("198.51.100.7");
+  Ipv4Header ip;
+  UdpHeader udp;
+
+  Forward (nf, insideDev, outsideDev, Ipv4Address ("192.168.0.3"), 5000, server, 53, ip, udp);
+  Forward (nf, insideDev, outsideDev, Ipv4Address ("192.168.0.3"), 5001, server, 53, ip, udp);
+  Forward (nf, insideDev, outsideDev, Ipv4Address ("192.168.0.4"), 6000, server, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNDynamicTuples (), 3, "translations not created");
+
+  std::stringstream snapshot;
+  nat->SerializeBindings (snapshot);
+  NS_TEST_ASSERT_MSG_EQ (snapshot.str ().size (), 9 + 3 * 30 + 4, "unexpected snapshot size");
+
+  // Warm start another NAT with the same pools
+  Ptr<SimpleNetDevice> outsideDev2, insideDev2;
+  Ptr<Ipv4Nat> nat2 = CreateDynamicNatNode (outsideDev2, insideDev2);
+  Ptr<Ipv4Netfilter> nf2 = nat2->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  bool loaded = nat2->DeserializeBindings (snapshot);
+  NS_TEST_ASSERT_MSG_EQ (loaded, true, "snapshot not loaded");
+  NS_TEST_ASSERT_MSG_EQ (nat2->GetNDynamicTuples (), 3, "translations not restored");
+  NS_TEST_ASSERT_MSG_EQ (nat2->GetNAllocatedPorts (), 3, "ports of restored translations not reserved");
+
+  // Restored translations map replies back and keep outgoing packets on their port
+  Forward (nf2, outsideDev2, insideDev2, server, 53, Ipv4Address ("203.0.113.10"), 49154, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), Ipv4Address ("192.168.0.3"), "reply address not reversed");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetDestinationPort (), 5001, "reply port not reversed");
+  Forward (nf2, insideDev2, outsideDev2, Ipv4Address ("192.168.0.4"), 6000, server, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49155, "restored translation not reused");
+
+  // A new flow does not get a restored port
+  Forward (nf2, insideDev2, outsideDev2, Ipv4Address ("192.168.0.5"), 7000, server, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49156, "restored port handed out again");
+  NS_TEST_ASSERT_MSG_EQ (nat2->GetNDynamicTuples (), 4, "new translation not created");
+
+  // Restored translations still idle out
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (nat2->GetNDynamicTuples (), 0, "restored translations do not expire");
+  NS_TEST_ASSERT_MSG_EQ (nat2->GetNAllocatedPorts (), 0, "ports of restored translations not released");
+
+  // Anything else is refused
+  std::stringstream garbage ("not a snapshot");
+  loaded = nat2->DeserializeBindings (garbage);
+  NS_TEST_ASSERT_MSG_EQ (loaded, false, "garbage loaded as a snapshot");
+
+  // Every remote endpoint a translation lets in survives the snapshot
+  Ptr<Ipv4Nat> nat3 = CreateDynamicNatNode (outsideDev, insideDev);
+  nat3->SetFilteringBehavior (Ipv4Nat::ADDRESS_AND_PORT_DEPENDENT);
+  Ptr<Ipv4Netfilter> nf3 = nat3->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  Ipv4Address host ("192.168.0.3");
+  Ipv4Address global ("203.0.113.10");
+  Ipv4Address server2 ("198.51.100.8");
+  Forward (nf3, insideDev, outsideDev, host, 5000, server, 53, ip, udp);
+  Forward (nf3, insideDev, outsideDev, host, 5000, server, 123, ip, udp);
+  Forward (nf3, insideDev, outsideDev, host, 5000, server2, 3478, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (nat3->GetNDynamicTuples (), 1, "remote endpoints got their own translations");
+  NS_TEST_ASSERT_MSG_EQ (nat3->GetDynamicTuple (0).GetNPeers (), 3, "remote endpoints not recorded");
+  uint16_t port = udp.GetSourcePort ();
+  std::stringstream peers;
+  nat3->SerializeBindings (peers);
+  NS_TEST_ASSERT_MSG_EQ (peers.str ().size (), 9 + 30 + 3 * 6 + 4, "peers missing from the snapshot");
+
+  Ptr<Ipv4Nat> nat4 = CreateDynamicNatNode (outsideDev2, insideDev2);
+  nat4->SetFilteringBehavior (Ipv4Nat::ADDRESS_AND_PORT_DEPENDENT);
+  Ptr<Ipv4Netfilter> nf4 = nat4->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  loaded = nat4->DeserializeBindings (peers);
+  NS_TEST_ASSERT_MSG_EQ (loaded, true, "snapshot with peers not loaded");
+  NS_TEST_ASSERT_MSG_EQ (nat4->GetDynamicTuple (0).GetNPeers (), 3, "peers not restored");
+  Forward (nf4, outsideDev2, insideDev2, server, 53, global, port, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), host, "first peer filtered after the restore");
+  Forward (nf4, outsideDev2, insideDev2, server, 123, global, port, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), host, "second peer filtered after the restore");
+  Forward (nf4, outsideDev2, insideDev2, server2, 3478, global, port, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), host, "third peer filtered after the restore");
+  Forward (nf4, outsideDev2, insideDev2, server2, 53, global, port, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), global, "uncontacted endpoint let in after the restore");
+
+  Simulator::Destroy ();
+}
+
+class Ipv4NatStatistics : public TestCase
+{
+public:
+  Ipv4NatStatistics ();
+  virtual ~Ipv4NatStatistics ();
+
+private:
+  virtual void DoRun (void);
+  void Created (const Ipv4DynamicNatTuple &tuple);
+  void Exhausted (Ipv4Address address, uint16_t port, uint8_t protocol);
+
+  uint32_t m_created;
+  uint32_t m_exhausted;
+};
+
+Ipv4NatStatistics::Ipv4NatStatistics ()
+  : TestCase ("Test that NAT counts lookups, new translations and exhaustion"),
+    m_created (0),
+    m_exhausted (0)
+{
+}
+
+Ipv4NatStatistics::~Ipv4NatStatistics ()
+{
+}
+
+void
+Ipv4NatStatistics::Created (const Ipv4DynamicNatTuple &tuple)
+{
+  m_created++;
+}
+
+void
+Ipv4NatStatistics::Exhausted (Ipv4Address address, uint16_t port, uint8_t protocol)
+{
+  m_exhausted++;
+}
+
+void
+Ipv4NatStatistics::DoRun (void)
+{
+  Ptr<SimpleNetDevice> outsideDev, insideDev;
+  Ptr<Ipv4Nat> nat = CreateDynamicNatNode (outsideDev, insideDev);
+  Ptr<Ipv4Netfilter> nf = nat->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  nat->TraceConnectWithoutContext ("BindingCreated", MakeCallback (&Ipv4NatStatistics::Created, this));
+  nat->TraceConnectWithoutContext ("PortPoolExhausted", MakeCallback (&Ipv4NatStatistics::Exhausted, this));
+  Ipv4Address server ("198.51.100.7");
+  Ipv4Header ip;
+  UdpHeader udp;
+
+  // The pool holds 11 ports, the twelfth flow finds it exhausted
+  for (uint16_t i = 0; i < 12; i++)
+    {
+      Forward (nf, insideDev, outsideDev, Ipv4Address ("192.168.0.3"), 5000 + i, server, 53, ip, udp);
+    }
+  Forward (nf, insideDev, outsideDev, Ipv4Address ("192.168.0.3"), 5000, server, 53, ip, udp);
+  Forward (nf, outsideDev, insideDev, server, 53, Ipv4Address ("203.0.113.10"), 49153, ip, udp);
+  Forward (nf, outsideDev, insideDev, server, 53, Ipv4Address ("203.0.113.10"), 49999, ip, udp);
+
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNLookups (), 15, "lookups not counted");
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNHits (), 2, "hits not counted");
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNMisses (), 13, "misses not counted");
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNNewBindings (), 11, "new translations not counted");
+  NS_TEST_ASSERT_MSG_EQ (m_created, 11, "new translations not traced");
+  NS_TEST_ASSERT_MSG_EQ (m_exhausted, 1, "exhaustion not traced");
+
+  UintegerValue failures;
+  nat->GetAttribute ("PortAllocationFailures", failures);
+  NS_TEST_ASSERT_MSG_EQ (failures.Get (), 1, "exhaustion not readable as an attribute");
+
+  std::vector<uint32_t> histogram;
+  nat->GetIndexChainHistogram (histogram);
+  uint32_t chained = 0;
+  for (uint32_t i = 0; i < histogram.size (); i++)
+    {
+      chained += i * histogram[i];
+    }
+  NS_TEST_ASSERT_MSG_EQ (chained, 2 * nat->GetNDynamicTuples (), "histogram does not cover both indices");
+
+  std::ostringstream xml;
+  nat->SerializeToXmlStream (xml, 0);
+  bool found = xml.str ().find ("newBindings=\"11\"") != std::string::npos;
+  NS_TEST_ASSERT_MSG_EQ (found, true, "counters missing from the XML output");
+
+  Simulator::Destroy ();
+}
+
+class Ipv4NatBehavior : public TestCase
+{
+public:
+  Ipv4NatBehavior ();
+  virtual ~Ipv4NatBehavior ();
+
+private:
+  virtual void DoRun (void);
+};
+
+Ipv4NatBehavior::Ipv4NatBehavior ()
+  : TestCase ("Test the RFC 4787 mapping and filtering behaviors of NAT")
+{
+}
+
+Ipv4NatBehavior::~Ipv4NatBehavior ()
+{
+}
+
+void
+Ipv4NatBehavior::DoRun (void)
+{
+  Ipv4Address host ("192.168.0.3");
+  Ipv4Address global ("203.0.113.10");
+  Ipv4Address server1 ("198.51.100.7");
+  Ipv4Address server2 ("198.51.100.8");
+  Ipv4Header ip;
+  UdpHeader udp;
+
+  // Endpoint independent mapping and filtering by default: one port for
+  // every remote endpoint, and anyone may send in through it
+  Ptr<SimpleNetDevice> outsideDev, insideDev;
+  Ptr<Ipv4Nat> nat = CreateDynamicNatNode (outsideDev, insideDev);
+  Ptr<Ipv4Netfilter> nf = nat->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  NS_TEST_ASSERT_MSG_EQ (nat->GetMappingBehavior (), Ipv4Nat::ENDPOINT_INDEPENDENT, "unexpected default mapping");
+  Forward (nf, insideDev, outsideDev, host, 5000, server1, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49153, "source port not translated");
+  Forward (nf, insideDev, outsideDev, host, 5000, server2, 3478, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49153, "mapping depends on the remote endpoint");
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNDynamicTuples (), 1, "second remote got its own translation");
+  Forward (nf, outsideDev, insideDev, Ipv4Address ("198.51.100.9"), 7000, global, 49153, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), host, "unknown remote filtered");
+
+  // Address and port dependent mapping gives every remote endpoint its own port
+  nat = CreateDynamicNatNode (outsideDev, insideDev);
+  nat->SetMappingBehavior (Ipv4Nat::ADDRESS_AND_PORT_DEPENDENT);
+  nf = nat->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  Forward (nf, insideDev, outsideDev, host, 5000, server1, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49153, "source port not translated");
+  Forward (nf, insideDev, outsideDev, host, 5000, server1, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49153, "translation not reused");
+  Forward (nf, insideDev, outsideDev, host, 5000, server1, 54, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49154, "remote port ignored by the mapping");
+  Forward (nf, insideDev, outsideDev, host, 5000, server2, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49155, "remote address ignored by the mapping");
+  Forward (nf, outsideDev, insideDev, server1, 54, global, 49154, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (udp.GetDestinationPort (), 5000, "reply port not reversed");
+
+  // Address dependent filtering lets in any port of a contacted address only
+  nat = CreateDynamicNatNode (outsideDev, insideDev);
+  EnumValue filtering;
+  nat->SetAttribute ("FilteringBehavior", StringValue ("AddressDependent"));
+  nat->GetAttribute ("FilteringBehavior", filtering);
+  NS_TEST_ASSERT_MSG_EQ (filtering.Get (), Ipv4Nat::ADDRESS_DEPENDENT, "filtering not set as an attribute");
+  nf = nat->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  Forward (nf, insideDev, outsideDev, host, 5000, server1, 53, ip, udp);
+  Forward (nf, outsideDev, insideDev, server1, 4000, global, 49153, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), host, "other port of a contacted address filtered");
+  Forward (nf, outsideDev, insideDev, server2, 53, global, 49153, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), global, "uncontacted address let in");
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNFiltered (), 1, "filtered packet not counted");
+  Forward (nf, insideDev, outsideDev, host, 5000, server2, 3478, ip, udp);
+  Forward (nf, outsideDev, insideDev, server2, 53, global, 49153, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), host, "newly contacted address filtered");
+
+  // Address and port dependent filtering also checks the remote port
+  nat = CreateDynamicNatNode (outsideDev, insideDev);
+  nat->SetFilteringBehavior (Ipv4Nat::ADDRESS_AND_PORT_DEPENDENT);
+  nf = nat->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  Forward (nf, insideDev, outsideDev, host, 5000, server1, 53, ip, udp);
+  Forward (nf, outsideDev, insideDev, server1, 53, global, 49153, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (udp.GetDestinationPort (), 5000, "reply filtered");
+  Forward (nf, outsideDev, insideDev, server1, 4000, global, 49153, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), global, "other port of a contacted address let in");
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNFiltered (), 1, "filtered packet not counted");
+
+  // Permissions go away with the translation
+  Simulator::Stop (Seconds (600));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNDynamicTuples (), 0, "translation not expired");
+  Forward (nf, outsideDev, insideDev, server1, 53, global, 49153, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), global, "expired translation still reversed");
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNFiltered (), 1, "traffic to an unbound port counted as filtered");
+
+  Simulator::Destroy ();
+}
+
+// Add an interface with a /24 address to a NAT node
+static Ptr<SimpleNetDevice>
+AddNatInterface (Ptr<Node> node, Ipv4Address address, uint32_t &interface)
+{
+  Ptr<SimpleNetDevice> dev = CreateObject<SimpleNetDevice> ();
+  dev->SetAddress (Mac48Address::ConvertFrom (Mac48Address::Allocate ()));
+  node->AddDevice (dev);
+  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+  interface = ipv4->AddInterface (dev);
+  ipv4->AddAddress (interface, Ipv4InterfaceAddress (address, Ipv4Mask (0xffffff00U)));
+  ipv4->SetUp (interface);
+  return dev;
+}
+
+class Ipv4NatMultiInterface : public TestCase
+{
+public:
+  Ipv4NatMultiInterface ();
+  virtual ~Ipv4NatMultiInterface ();
+
+private:
+  virtual void DoRun (void);
+};
+
+Ipv4NatMultiInterface::Ipv4NatMultiInterface ()
+  : TestCase ("Test NAT with several inside and outside interfaces and hairpinning")
+{
+}
+
+Ipv4NatMultiInterface::~Ipv4NatMultiInterface ()
+{
+}
+
+void
+Ipv4NatMultiInterface::DoRun (void)
+{
+  // Two uplinks and two inside networks
+  Ptr<Node> node = CreateObject<Node> ();
+  InternetStackHelper stack;
+  stack.Install (node);
+  uint32_t uplink1, uplink2, lan1, lan2;
+  Ptr<SimpleNetDevice> uplinkDev1 = AddNatInterface (node, Ipv4Address ("203.0.113.1"), uplink1);
+  Ptr<SimpleNetDevice> uplinkDev2 = AddNatInterface (node, Ipv4Address ("198.18.0.1"), uplink2);
+  Ptr<SimpleNetDevice> lanDev1 = AddNatInterface (node, Ipv4Address ("192.168.0.1"), lan1);
+  Ptr<SimpleNetDevice> lanDev2 = AddNatInterface (node, Ipv4Address ("192.168.1.1"), lan2);
+
+  Ptr<Ipv4Nat> nat = CreateObject<Ipv4Nat> ();
+  nat->SetOutside (uplink1);
+  nat->SetOutside (uplink2);
+  nat->SetInside (lan1);
+  nat->SetInside (lan2);
+  node->AggregateObject (nat);
+  nat->AddDynamicRule (Ipv4DynamicNatRule (Ipv4Address ("192.168.0.0"), Ipv4Mask ("255.255.254.0")));
+  nat->AddAddressPool (Ipv4Address ("203.0.113.10"), Ipv4Mask ("255.255.255.255"));
+  nat->AddPortPool (49153, 49163);
+  nat->AddStaticRule (Ipv4StaticNatRule (Ipv4Address ("192.168.1.9"), 80, Ipv4Address ("198.18.0.80"), 8080, 17));
+  NS_TEST_ASSERT_MSG_EQ (nat->IsOutside (uplink2), true, "second outside interface not kept");
+  NS_TEST_ASSERT_MSG_EQ (nat->IsInside (lan2), true, "second inside interface not kept");
+  NS_TEST_ASSERT_MSG_EQ (nat->IsInside (uplink1), false, "outside interface reported inside");
+  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+  NS_TEST_ASSERT_MSG_EQ (ipv4->GetInterfaceForAddress (Ipv4Address ("198.18.0.80")), (int32_t)uplink2,
+                         "static global address not added to the uplink holding its prefix");
+
+  Ptr<Ipv4Netfilter> nf = node->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  Ipv4Address hostA ("192.168.0.3");
+  Ipv4Address hostB ("192.168.1.5");
+  Ipv4Address global ("203.0.113.10");
+  Ipv4Address server ("198.51.100.7");
+  Ipv4Header ip;
+  UdpHeader udp;
+
+  // Flows out of either uplink share the translations
+  Forward (nf, lanDev1, uplinkDev1, hostA, 5000, server, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetSource (), global, "source not translated on the first uplink");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49153, "source port not translated on the first uplink");
+  Forward (nf, lanDev2, uplinkDev2, hostB, 6000, server, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetSource (), global, "source not translated on the second uplink");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49154, "source port not translated on the second uplink");
+  Forward (nf, uplinkDev2, lanDev1, server, 53, global, 49153, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), hostA, "reply on the other uplink not reversed");
+
+  // Inside to inside traffic is routed untouched
+  Forward (nf, lanDev1, lanDev2, hostA, 5000, hostB, 6000, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetSource (), hostA, "inside to inside source translated");
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), hostB, "inside to inside destination translated");
+
+  // Inside to a translated address turns around with both ends translated
+  Forward (nf, lanDev1, lanDev2, hostA, 5000, global, 49154, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), hostB, "hairpinned destination not translated");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetDestinationPort (), 6000, "hairpinned destination port not translated");
+  NS_TEST_ASSERT_MSG_EQ (ip.GetSource (), global, "hairpinned source not translated");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49153, "hairpinned source not mapped as the outbound flow");
+  Forward (nf, lanDev2, lanDev1, hostB, 6000, global, 49153, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), hostA, "hairpinned reply not translated");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49154, "hairpinned reply source not translated");
+  Forward (nf, lanDev1, lanDev2, hostA, 5001, Ipv4Address ("198.18.0.80"), 8080, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), Ipv4Address ("192.168.1.9"), "hairpin to a static rule not translated");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetDestinationPort (), 80, "hairpin to a static rule port not translated");
+
+  // Unless turned off
+  nat->SetAttribute ("Hairpinning", BooleanValue (false));
+  Forward (nf, lanDev1, lanDev2, hostA, 5000, global, 49154, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), global, "hairpinned with hairpinning off");
+
+  Simulator::Destroy ();
+}
+
+class Ipv4NatCarrierGrade : public TestCase
+{
+public:
+  Ipv4NatCarrierGrade ();
+  virtual ~Ipv4NatCarrierGrade ();
+
+private:
+  virtual void DoRun (void);
+};
+
+Ipv4NatCarrierGrade::Ipv4NatCarrierGrade ()
+  : TestCase ("Test deterministic port blocks of carrier-grade NAT")
+{
+}
+
+Ipv4NatCarrierGrade::~Ipv4NatCarrierGrade ()
+{
+}
+
+// 8 subscribers behind 203.0.113.9 and 203.0.113.10, 4 blocks of 4
+// ports per address
+static Ptr<Ipv4Nat>
+CreateCarrierGradeNatNode (Ptr<SimpleNetDevice> &outsideDev, Ptr<SimpleNetDevice> &insideDev)
+{
+  Ptr<Ipv4Nat> nat = CreateDynamicNatNode (outsideDev, insideDev);
+  nat->SetAttribute ("CarrierGradeShardSize", UintegerValue (2));
+  nat->SetAttribute ("UdpTimeout", TimeValue (Seconds (30)));
+  nat->AddAddressPool (Ipv4Address ("203.0.113.8"), Ipv4Mask ("255.255.255.252"));
+  nat->AddPortPool (49153, 49168);
+  nat->SetAttribute ("PortBlockSize", UintegerValue (4));
+  nat->EnableCarrierGradeNat (Ipv4Address ("192.168.0.0"), Ipv4Mask ("255.255.255.248"));
+  return nat;
+}
+
+void
+Ipv4NatCarrierGrade::DoRun (void)
+{
+  Ipv4Address server ("198.51.100.7");
+  Ipv4Header ip;
+  UdpHeader udp;
+
+  Ptr<SimpleNetDevice> outsideDev, insideDev;
+  Ptr<Ipv4Nat> nat = CreateCarrierGradeNatNode (outsideDev, insideDev);
+  Ptr<Ipv4Netfilter> nf = nat->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  const Ipv4NatBindingTable &table = nat->GetCarrierGradeTable ();
+  NS_TEST_ASSERT_MSG_EQ (table.GetNShards (), 4, "subscriber prefix not sharded");
+
+  // The address and port block follow from the subscriber address
+  Forward (nf, insideDev, outsideDev, Ipv4Address ("192.168.0.3"), 5000, server, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetSource (), Ipv4Address ("203.0.113.9"), "wrong address for subscriber 3");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49165, "wrong port block for subscriber 3");
+  Forward (nf, insideDev, outsideDev, Ipv4Address ("192.168.0.5"), 5001, server, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetSource (), Ipv4Address ("203.0.113.10"), "wrong address for subscriber 5");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49158, "wrong port in the block of subscriber 5");
+  Forward (nf, insideDev, outsideDev, Ipv4Address ("192.168.0.3"), 5000, server, 54, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49165, "translation not reused");
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNDynamicTuples (), 2, "translations not counted");
+  NS_TEST_ASSERT_MSG_EQ (table.GetNAllocatedShards (), 2, "shards allocated for idle subscribers");
+  Ipv4DynamicNatTuple tuple = nat->GetDynamicTuple (0);
+  NS_TEST_ASSERT_MSG_EQ (tuple.GetLocalAddress (), Ipv4Address ("192.168.0.3"), "translation not listed");
+
+  // Replies are reversed from the address and port alone
+  Forward (nf, outsideDev, insideDev, Ipv4Address ("198.51.100.9"), 7000, Ipv4Address ("203.0.113.10"), 49158,
+           ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), Ipv4Address ("192.168.0.5"), "reply not reversed");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetDestinationPort (), 5001, "reply port not reversed");
+  Forward (nf, outsideDev, insideDev, server, 53, Ipv4Address ("203.0.113.10"), 49157, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), Ipv4Address ("203.0.113.10"), "unbound port reversed");
+
+  // A subscriber never takes a port out of another block
+  for (uint16_t port = 6000; port < 6003; port++)
+    {
+      Forward (nf, insideDev, outsideDev, Ipv4Address ("192.168.0.3"), port, server, 53, ip, udp);
+      bool inBlock = udp.GetSourcePort () >= 49165 && udp.GetSourcePort () <= 49168;
+      NS_TEST_ASSERT_MSG_EQ (inBlock, true, "port outside the block of the subscriber");
+    }
+  Forward (nf, insideDev, outsideDev, Ipv4Address ("192.168.0.3"), 6003, server, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetSource (), Ipv4Address ("192.168.0.3"), "exhausted block translated");
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNPortAllocationFailures (), 1, "exhaustion not counted");
+
+  // Carrier-grade translations are printed and survive a snapshot
+  std::ostringstream printed;
+  nat->PrintTable (Create<OutputStreamWrapper> (&printed));
+  bool listed = printed.str ().find ("192.168.0.5     5001            203.0.113.10    49158") != std::string::npos;
+  NS_TEST_ASSERT_MSG_EQ (listed, true, "carrier-grade translation not printed");
+  std::stringstream snapshot;
+  nat->SerializeBindings (snapshot);
+  NS_TEST_ASSERT_MSG_EQ (snapshot.str ().size (), 9 + 4 + 5 * 18, "carrier-grade translations not saved");
+  Ptr<SimpleNetDevice> outsideDev2, insideDev2;
+  Ptr<Ipv4Nat> nat2 = CreateCarrierGradeNatNode (outsideDev2, insideDev2);
+  Ptr<Ipv4Netfilter> nf2 = nat2->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  bool loaded = nat2->DeserializeBindings (snapshot);
+  NS_TEST_ASSERT_MSG_EQ (loaded, true, "snapshot not loaded");
+  NS_TEST_ASSERT_MSG_EQ (nat2->GetNDynamicTuples (), 5, "carrier-grade translations not restored");
+  Forward (nf2, outsideDev2, insideDev2, Ipv4Address ("198.51.100.9"), 7000, Ipv4Address ("203.0.113.10"), 49158,
+           ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), Ipv4Address ("192.168.0.5"), "restored reply not reversed");
+  NS_TEST_ASSERT_MSG_EQ (udp.GetDestinationPort (), 5001, "restored reply port not reversed");
+  Forward (nf2, insideDev2, outsideDev2, Ipv4Address ("192.168.0.3"), 6003, server, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (ip.GetSource (), Ipv4Address ("192.168.0.3"), "restored block not exhausted");
+
+  // Idle translations are swept out and their ports reused
+  Simulator::Stop (Seconds (40));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNDynamicTuples (), 0, "idle translations not swept");
+  NS_TEST_ASSERT_MSG_EQ (nat->GetNEvictions (), 5, "sweep not counted as evictions");
+  Forward (nf, insideDev, outsideDev, Ipv4Address ("192.168.0.3"), 6003, server, 53, ip, udp);
+  NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), 49168, "port of an expired translation not reused");
+
+  Simulator::Destroy ();
+}
+
 class Ipv4NatTestSuite : public TestSuite
 {
 public:
@@ -135,6 +1309,17 @@ Ipv4NatTestSuite::Ipv4NatTestSuite ()
 {
   AddTestCase (new Ipv4NatAddRemoveRules);
   AddTestCase (new Ipv4NatStatic);
+  AddTestCase (new Ipv4NatDynamic);
+  AddTestCase (new Ipv4NatIcmp);
+  AddTestCase (new Ipv4NatFragments);
+  AddTestCase (new Ipv4NatExpiry);
+  AddTestCase (new Ipv4NatPortAllocation);
+  AddTestCase (new Ipv4NatStaticIndex);
+  AddTestCase (new Ipv4NatSnapshot);
+  AddTestCase (new Ipv4NatStatistics);
+  AddTestCase (new Ipv4NatBehavior);
+  AddTestCase (new Ipv4NatMultiInterface);
+  AddTestCase (new Ipv4NatCarrierGrade);
 }
 
 static Ipv4NatTestSuite ipv4NatTestSuite;
@@ -18,6 +18,31 @@
 #include "ns3/test.h"
 // Include any headers files needed for testing your module
 #include "ns3/ipv4.h"
+#include "ns3/netfilter-conntrack-table.h"
+#include "ns3/netfilter-timer-wheel.h"
+#include "ns3/netfilter-header-mangle.h"
+#include "ns3/netfilter-packet-context.h"
+#include "ns3/netfilter-callback-chain.h"
+#include "ns3/netfilter-fragment-cache.h"
+#include "ns3/conntrack-tag.h"
+#include "ns3/ipv4-netfilter.h"
+#include "ns3/ipv4-l3-protocol.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/udp-header.h"
+#include "ns3/tcp-header.h"
+#include "ns3/packet.h"
+#include "ns3/simple-net-device.h"
+#include "ns3/simple-channel.h"
+#include "ns3/node.h"
+#include "ns3/simulator.h"
+#include "ns3/nstime.h"
+#include "ns3/uinteger.h"
+#include "ns3/boolean.h"
+
+#include <set>
+#include <map>
+#include <string>
+#include <sstream>
 
 // Do not put your test classes in namespace ns3.  You may find it useful
 // to use the using directive to access the ns3 namespace directly
@@ -58,6 +83,1216 @@ Ipv4NetfilterTestCase1::DoRun (void)
   NS_TEST_ASSERT_MSG_EQ_TOL (0.01, 0.01, 0.001, "Numbers are not equal within tolerance");
 }
 
+class Ipv4NetfilterConntrackTableTestCase : public TestCase
+{
+public:
+  Ipv4NetfilterConntrackTableTestCase ();
+  virtual ~Ipv4NetfilterConntrackTableTestCase ();
+
+private:
+  virtual void DoRun (void);
+  NetfilterConntrackTuple MakeTuple (uint32_t i, uint8_t protocol);
+};
+
+Ipv4NetfilterConntrackTableTestCase::Ipv4NetfilterConntrackTableTestCase ()
+  : TestCase ("Conntrack tuple hash and open addressing table")
+{
+}
+
+Ipv4NetfilterConntrackTableTestCase::~Ipv4NetfilterConntrackTableTestCase ()
+{
+}
+
+NetfilterConntrackTuple
+Ipv4NetfilterConntrackTableTestCase::MakeTuple (uint32_t i, uint8_t protocol)
+{
+  NetfilterConntrackTuple tuple (Ipv4Address (0x0a000000 + i), 1024 + (i % 100),
+                                 Ipv4Address ("203.0.113.1"), 80);
+  tuple.SetDestinationProtocol (protocol);
+  return tuple;
+}
+
+void
+Ipv4NetfilterConntrackTableTestCase::DoRun (void)
+{
+  // The tuple hash must use its full width instead of a dozen buckets
+  ConntrackTupleHash hasher;
+  std::set<size_t> hashes;
+  for (uint32_t i = 0; i < 10000; i++)
+    {
+      hashes.insert (hasher (MakeTuple (i, 6)));
+    }
+  NS_TEST_ASSERT_MSG_GT (hashes.size (), 9900, "tuple hash does not distribute");
+
+  // Direction is not part of the key, the layer 4 protocol is
+  NetfilterConntrackTuple a = MakeTuple (1, 6);
+  NetfilterConntrackTuple b = MakeTuple (1, 6);
+  b.SetDirection (IP_CT_DIR_REPLY);
+  NS_TEST_ASSERT_MSG_EQ (hasher (a), hasher (b), "direction changed the hash");
+  NS_TEST_ASSERT_MSG_EQ ((hasher (a) == hasher (MakeTuple (1, 17))), false, "protocol not hashed");
+
+  // Grow from a tiny table, then erase every other entry and make sure
+  // the backward shift deletion kept all probe runs intact
+  NetfilterConntrackTable table (4);
+  for (uint32_t i = 0; i < 5000; i++)
+    {
+      table.Insert (MakeTuple (i, 6), IpConntrackInfo (i));
+    }
+  NS_TEST_ASSERT_MSG_EQ (table.GetSize (), 5000, "wrong number of entries");
+  NS_TEST_ASSERT_MSG_EQ ((table.GetCapacity () * 3 >= table.GetSize () * 4), true, "load factor above 3/4");
+  NS_TEST_ASSERT_MSG_EQ (table.Find (MakeTuple (1, 17)), 0, "found a tuple of another protocol");
+
+  for (uint32_t i = 0; i < 5000; i += 2)
+    {
+      NS_TEST_ASSERT_MSG_EQ (table.Erase (MakeTuple (i, 6)), true, "could not erase entry");
+    }
+  NS_TEST_ASSERT_MSG_EQ (table.GetSize (), 2500, "wrong number of entries after erase");
+  for (uint32_t i = 0; i < 5000; i++)
+    {
+      NetfilterConntrackTable::Entry *e = table.Find (MakeTuple (i, 6));
+      if (i % 2)
+        {
+          NS_TEST_ASSERT_MSG_NE (e, 0, "lost entry " << i);
+          NS_TEST_ASSERT_MSG_EQ (e->info.GetStatus (), i, "wrong info for entry " << i);
+        }
+      else
+        {
+          NS_TEST_ASSERT_MSG_EQ (e, 0, "erased entry " << i << " still present");
+        }
+    }
+
+  uint32_t visited = 0;
+  for (NetfilterConntrackTable::Iterator it = table.Begin (); it != table.End (); ++it)
+    {
+      visited++;
+    }
+  NS_TEST_ASSERT_MSG_EQ (visited, 2500, "iterator does not visit every entry");
+
+  // The direction of the first inserted key is kept
+  NetfilterConntrackTuple c = MakeTuple (6000, 6);
+  NetfilterConntrackTuple d = MakeTuple (6000, 6);
+  d.SetDirection (IP_CT_DIR_REPLY);
+  table.Insert (d, IpConntrackInfo ());
+  table[c].SetStatus (IPS_SEEN_REPLY);
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t)table.Find (c)->tuple.GetDirection (), (uint32_t)IP_CT_DIR_REPLY, "key direction overwritten");
+}
+
+class Ipv4NetfilterTimerWheelTestCase : public TestCase
+{
+public:
+  Ipv4NetfilterTimerWheelTestCase ();
+  virtual ~Ipv4NetfilterTimerWheelTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Expire (uint32_t item);
+  void Add (uint32_t item, Time expires);
+
+  NetfilterTimerWheel<uint32_t> m_wheel;
+  std::map<uint32_t, Time> m_deadlines;
+  std::map<uint32_t, Time> m_expired;
+};
+
+Ipv4NetfilterTimerWheelTestCase::Ipv4NetfilterTimerWheelTestCase ()
+  : TestCase ("Hierarchical timer wheel hands items back once they are due")
+{
+}
+
+Ipv4NetfilterTimerWheelTestCase::~Ipv4NetfilterTimerWheelTestCase ()
+{
+}
+
+void
+Ipv4NetfilterTimerWheelTestCase::Expire (uint32_t item)
+{
+  m_expired[item] = Simulator::Now ();
+  if (item == 7)
+    {
+      // schedule once more from within the callback
+      Add (8, Simulator::Now () + Seconds (100));
+    }
+}
+
+void
+Ipv4NetfilterTimerWheelTestCase::Add (uint32_t item, Time expires)
+{
+  m_deadlines[item] = expires;
+  m_wheel.Schedule (item, expires);
+}
+
+void
+Ipv4NetfilterTimerWheelTestCase::DoRun (void)
+{
+  m_wheel.SetExpireCallback (MakeCallback (&Ipv4NetfilterTimerWheelTestCase::Expire, this));
+
+  // Deadlines on every level of the wheel and across its wrap points
+  Add (0, Seconds (0.5));
+  Add (1, Seconds (3));
+  Add (2, Seconds (63));
+  Add (3, Seconds (64));
+  Add (4, Seconds (65.2));
+  Add (5, Seconds (4100));
+  Add (6, Seconds (300000));
+  Add (7, Seconds (200));
+  NS_TEST_ASSERT_MSG_EQ (m_wheel.GetSize (), 8, "items not counted");
+
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_wheel.GetSize (), 0, "wheel not drained");
+  NS_TEST_ASSERT_MSG_EQ (m_expired.size (), 9, "not every item expired");
+  for (std::map<uint32_t, Time>::const_iterator i = m_deadlines.begin (); i != m_deadlines.end (); i++)
+    {
+      Time fired = m_expired[i->first];
+      NS_TEST_ASSERT_MSG_EQ ((fired >= i->second), true, "item " << i->first << " expired early at " << fired);
+      NS_TEST_ASSERT_MSG_EQ ((fired < i->second + Seconds (1)), true, "item " << i->first << " expired late at " << fired);
+    }
+
+  Simulator::Destroy ();
+}
+
+class Ipv4NetfilterConntrackExpiryTestCase : public TestCase
+{
+public:
+  Ipv4NetfilterConntrackExpiryTestCase ();
+  virtual ~Ipv4NetfilterConntrackExpiryTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Send (Ipv4Address src, uint16_t sport, Ipv4Address dst, uint16_t dport);
+  void CheckSize (uint32_t expected);
+  void Evicted (const NetfilterConntrackTuple &tuple);
+
+  Ptr<Ipv4Netfilter> m_netfilter;
+  uint32_t m_evictions;
+};
+
+Ipv4NetfilterConntrackExpiryTestCase::Ipv4NetfilterConntrackExpiryTestCase ()
+  : TestCase ("Idle connections are evicted from the conntrack tables"),
+    m_evictions (0)
+{
+}
+
+Ipv4NetfilterConntrackExpiryTestCase::~Ipv4NetfilterConntrackExpiryTestCase ()
+{
+}
+
+void
+Ipv4NetfilterConntrackExpiryTestCase::Send (Ipv4Address src, uint16_t sport, Ipv4Address dst, uint16_t dport)
+{
+  Ptr<Packet> p = Create<Packet> (32);
+  UdpHeader udp;
+  udp.SetSourcePort (sport);
+  udp.SetDestinationPort (dport);
+  p->AddHeader (udp);
+  Ipv4Header ip;
+  ip.SetSource (src);
+  ip.SetDestination (dst);
+  ip.SetProtocol (17);
+  ip.SetPayloadSize (p->GetSize ());
+  p->AddHeader (ip);
+
+  m_netfilter->ProcessHook (PF_INET, NF_INET_PRE_ROUTING, p, 0, 0);
+  ContinueCallback confirm = MakeCallback (&Ipv4Netfilter::NetfilterConntrackConfirm, m_netfilter);
+  m_netfilter->ProcessHook (PF_INET, NF_INET_POST_ROUTING, p, 0, 0, confirm);
+}
+
+void
+Ipv4NetfilterConntrackExpiryTestCase::CheckSize (uint32_t expected)
+{
+  NS_TEST_EXPECT_MSG_EQ (m_netfilter->GetHash ().GetSize (), expected,
+                         "unexpected number of conntrack entries at " << Simulator::Now ().GetSeconds ());
+}
+
+void
+Ipv4NetfilterConntrackExpiryTestCase::Evicted (const NetfilterConntrackTuple &tuple)
+{
+  m_evictions++;
+}
+
+void
+Ipv4NetfilterConntrackExpiryTestCase::DoRun (void)
+{
+  Ptr<Node> node = CreateObject<Node> ();
+  InternetStackHelper stack;
+  stack.Install (node);
+  m_netfilter = node->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  m_netfilter->SetAttribute ("UdpTimeout", TimeValue (Seconds (10)));
+  m_netfilter->TraceConnectWithoutContext ("ConntrackEviction",
+                                           MakeCallback (&Ipv4NetfilterConntrackExpiryTestCase::Evicted, this));
+
+  Ipv4Address client ("10.0.0.1");
+  Ipv4Address server ("10.0.1.1");
+  Send (client, 1000, server, 53);
+  CheckSize (2);
+
+  // A reply halfway through the timeout keeps the connection alive
+  Simulator::Schedule (Seconds (5), &Ipv4NetfilterConntrackExpiryTestCase::Send, this, server, 53, client, 1000);
+  Simulator::Schedule (Seconds (12), &Ipv4NetfilterConntrackExpiryTestCase::CheckSize, this, 2);
+  Simulator::Schedule (Seconds (17), &Ipv4NetfilterConntrackExpiryTestCase::CheckSize, this, 0);
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_evictions, 1, "eviction not traced exactly once");
+  NS_TEST_ASSERT_MSG_EQ (m_netfilter->GetHash ().GetSize (), 0, "connection not evicted");
+
+  m_netfilter = 0;
+  Simulator::Destroy ();
+}
+
+class Ipv4NetfilterConntrackTagTestCase : public TestCase
+{
+public:
+  Ipv4NetfilterConntrackTagTestCase ();
+  virtual ~Ipv4NetfilterConntrackTagTestCase ();
+
+private:
+  virtual void DoRun (void);
+  Ptr<Packet> CreatePacket (Ipv4Address src, uint16_t sport, Ipv4Address dst, uint16_t dport);
+};
+
+Ipv4NetfilterConntrackTagTestCase::Ipv4NetfilterConntrackTagTestCase ()
+  : TestCase ("Packets carry their conntrack entry from tracking to confirmation")
+{
+}
+
+Ipv4NetfilterConntrackTagTestCase::~Ipv4NetfilterConntrackTagTestCase ()
+{
+}
+
+Ptr<Packet>
+Ipv4NetfilterConntrackTagTestCase::CreatePacket (Ipv4Address src, uint16_t sport, Ipv4Address dst, uint16_t dport)
+{
+  Ptr<Packet> p = Create<Packet> (32);
+  UdpHeader udp;
+  udp.SetSourcePort (sport);
+  udp.SetDestinationPort (dport);
+  p->AddHeader (udp);
+  Ipv4Header ip;
+  ip.SetSource (src);
+  ip.SetDestination (dst);
+  ip.SetProtocol (17);
+  ip.SetPayloadSize (p->GetSize ());
+  p->AddHeader (ip);
+  return p;
+}
+
+void
+Ipv4NetfilterConntrackTagTestCase::DoRun (void)
+{
+  Ptr<Node> node = CreateObject<Node> ();
+  InternetStackHelper stack;
+  stack.Install (node);
+  Ptr<Ipv4Netfilter> netfilter = node->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  ContinueCallback confirm = MakeCallback (&Ipv4Netfilter::NetfilterConntrackConfirm, netfilter);
+
+  Ipv4Address client ("10.0.0.1");
+  Ipv4Address server ("10.0.1.1");
+  Ptr<Packet> a = CreatePacket (client, 1000, server, 53);
+  Ptr<Packet> b = CreatePacket (client, 1001, server, 53);
+
+  // Both packets are tracked before either is confirmed
+  netfilter->ProcessHook (PF_INET, NF_INET_PRE_ROUTING, a, 0, 0);
+  netfilter->ProcessHook (PF_INET, NF_INET_PRE_ROUTING, b, 0, 0);
+  ConntrackTag tag;
+  NS_TEST_ASSERT_MSG_EQ (a->PeekPacketTag (tag), true, "tracked packet not tagged");
+  NS_TEST_ASSERT_MSG_EQ (tag.GetTuple ().GetSourcePort (), 1000, "tag holds the wrong tuple");
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t)tag.GetConntrack (), (uint32_t)IP_CT_NEW, "first packet is not NEW");
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetHash ().GetSize (), 0, "connection confirmed too early");
+
+  netfilter->ProcessHook (PF_INET, NF_INET_POST_ROUTING, a, 0, 0, confirm);
+  netfilter->ProcessHook (PF_INET, NF_INET_POST_ROUTING, b, 0, 0, confirm);
+  NS_TEST_ASSERT_MSG_EQ (a->PeekPacketTag (tag), false, "tag left on a confirmed packet");
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetHash ().GetSize (), 4, "both connections not confirmed");
+
+  // The reply is recognised from the entry found when it is tracked
+  Ptr<Packet> reply = CreatePacket (server, 53, client, 1000);
+  netfilter->ProcessHook (PF_INET, NF_INET_PRE_ROUTING, reply, 0, 0);
+  NS_TEST_ASSERT_MSG_EQ (reply->PeekPacketTag (tag), true, "reply not tagged");
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t)tag.GetConntrack (), (uint32_t)(IP_CT_ESTABLISHED + IP_CT_IS_REPLY),
+                         "reply not recognised");
+  netfilter->ProcessHook (PF_INET, NF_INET_LOCAL_IN, reply, 0, 0, confirm);
+  NetfilterConntrackTuple original (client, 1000, server, 53);
+  original.SetDestinationProtocol (17);
+  bool seenReply = (netfilter->GetHash ().Find (original)->info.GetStatus () & IPS_SEEN_REPLY) != 0;
+  NS_TEST_ASSERT_MSG_EQ (seenReply, true,
+                         "reply not noted on the connection");
+
+  Ptr<Packet> next = CreatePacket (client, 1000, server, 53);
+  netfilter->ProcessHook (PF_INET, NF_INET_PRE_ROUTING, next, 0, 0);
+  next->PeekPacketTag (tag);
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t)tag.GetConntrack (), (uint32_t)IP_CT_ESTABLISHED, "connection not established");
+
+  // A packet conntrack never saw is let through untouched
+  Ptr<Packet> untracked = CreatePacket (client, 2000, server, 53);
+  netfilter->ProcessHook (PF_INET, NF_INET_POST_ROUTING, untracked, 0, 0, confirm);
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetHash ().GetSize (), 4, "untracked packet confirmed");
+
+  Simulator::Destroy ();
+}
+
+class Ipv4NetfilterHeaderMangleTestCase : public TestCase
+{
+public:
+  Ipv4NetfilterHeaderMangleTestCase ();
+  virtual ~Ipv4NetfilterHeaderMangleTestCase ();
+
+private:
+  virtual void DoRun (void);
+  Ptr<Packet> CreatePacket (uint8_t protocol);
+  void CheckPacket (Ptr<Packet> p, uint8_t protocol, Ipv4Address src, uint16_t sport,
+                    Ipv4Address dst, uint16_t dport);
+};
+
+Ipv4NetfilterHeaderMangleTestCase::Ipv4NetfilterHeaderMangleTestCase ()
+  : TestCase ("Headers rewritten in place keep valid checksums")
+{
+}
+
+Ipv4NetfilterHeaderMangleTestCase::~Ipv4NetfilterHeaderMangleTestCase ()
+{
+}
+
+Ptr<Packet>
+Ipv4NetfilterHeaderMangleTestCase::CreatePacket (uint8_t protocol)
+{
+  Ptr<Packet> p = Create<Packet> (100);
+  Ipv4Address src ("192.168.0.3");
+  Ipv4Address dst ("198.51.100.7");
+  if (protocol == 6)
+    {
+      TcpHeader tcp;
+      tcp.SetSourcePort (5000);
+      tcp.SetDestinationPort (80);
+      tcp.SetFlags (TcpHeader::SYN);
+      tcp.EnableChecksums ();
+      tcp.InitializeChecksum (src, dst, protocol);
+      p->AddHeader (tcp);
+    }
+  else
+    {
+      UdpHeader udp;
+      udp.SetSourcePort (5000);
+      udp.SetDestinationPort (53);
+      udp.EnableChecksums ();
+      udp.InitializeChecksum (src, dst, protocol);
+      p->AddHeader (udp);
+    }
+  Ipv4Header ip;
+  ip.SetSource (src);
+  ip.SetDestination (dst);
+  ip.SetProtocol (protocol);
+  ip.SetPayloadSize (p->GetSize ());
+  ip.EnableChecksum ();
+  p->AddHeader (ip);
+  return p;
+}
+
+void
+Ipv4NetfilterHeaderMangleTestCase::CheckPacket (Ptr<Packet> p, uint8_t protocol, Ipv4Address src, uint16_t sport,
+                                                Ipv4Address dst, uint16_t dport)
+{
+  Ptr<Packet> copy = p->Copy ();
+  Ipv4Header ip;
+  ip.EnableChecksum ();
+  copy->RemoveHeader (ip);
+  NS_TEST_ASSERT_MSG_EQ (ip.IsChecksumOk (), true, "bad IPv4 checksum");
+  NS_TEST_ASSERT_MSG_EQ (ip.GetSource (), src, "wrong source address");
+  NS_TEST_ASSERT_MSG_EQ (ip.GetDestination (), dst, "wrong destination address");
+  if (protocol == 6)
+    {
+      TcpHeader tcp;
+      tcp.EnableChecksums ();
+      tcp.InitializeChecksum (src, dst, protocol);
+      copy->RemoveHeader (tcp);
+      NS_TEST_ASSERT_MSG_EQ (tcp.IsChecksumOk (), true, "bad TCP checksum");
+      NS_TEST_ASSERT_MSG_EQ (tcp.GetSourcePort (), sport, "wrong TCP source port");
+      NS_TEST_ASSERT_MSG_EQ (tcp.GetDestinationPort (), dport, "wrong TCP destination port");
+    }
+  else
+    {
+      UdpHeader udp;
+      udp.EnableChecksums ();
+      udp.InitializeChecksum (src, dst, protocol);
+      copy->RemoveHeader (udp);
+      NS_TEST_ASSERT_MSG_EQ (udp.IsChecksumOk (), true, "bad UDP checksum");
+      NS_TEST_ASSERT_MSG_EQ (udp.GetSourcePort (), sport, "wrong UDP source port");
+      NS_TEST_ASSERT_MSG_EQ (udp.GetDestinationPort (), dport, "wrong UDP destination port");
+    }
+}
+
+void
+Ipv4NetfilterHeaderMangleTestCase::DoRun (void)
+{
+  // Example of RFC 1624, section 4
+  NS_TEST_ASSERT_MSG_EQ (NetfilterHeaderMangle::UpdateChecksum (0xdd2f, 0x5555, 0x3285), 0x0000,
+                         "incremental update differs from RFC 1624");
+
+  uint8_t protocols[] = { 6, 17 };
+  for (uint32_t k = 0; k < 2; k++)
+    {
+      uint8_t protocol = protocols[k];
+      Ptr<Packet> p = CreatePacket (protocol);
+      Ptr<Packet> original = p->Copy ();
+      uint16_t dport = protocol == 6 ? 80 : 53;
+
+      NetfilterHeaderMangle::SetSource (p, Ipv4Address ("203.0.113.10"));
+      NetfilterHeaderMangle::SetSourcePort (p, 49153);
+      CheckPacket (p, protocol, Ipv4Address ("203.0.113.10"), 49153, Ipv4Address ("198.51.100.7"), dport);
+
+      NetfilterHeaderMangle::SetDestination (p, Ipv4Address ("10.1.2.3"));
+      NetfilterHeaderMangle::SetDestinationPort (p, 8080);
+      CheckPacket (p, protocol, Ipv4Address ("203.0.113.10"), 49153, Ipv4Address ("10.1.2.3"), 8080);
+      NS_TEST_ASSERT_MSG_EQ (p->GetSize (), original->GetSize (), "packet size changed");
+
+      // copies made before the rewrite keep their own bytes
+      CheckPacket (original, protocol, Ipv4Address ("192.168.0.3"), 5000, Ipv4Address ("198.51.100.7"), dport);
+    }
+
+  // Without checksums the fields stay zero
+  Ptr<Packet> p = Create<Packet> (10);
+  UdpHeader udp;
+  udp.SetSourcePort (5000);
+  udp.SetDestinationPort (53);
+  p->AddHeader (udp);
+  Ipv4Header ip;
+  ip.SetSource (Ipv4Address ("192.168.0.3"));
+  ip.SetDestination (Ipv4Address ("198.51.100.7"));
+  ip.SetProtocol (17);
+  ip.SetPayloadSize (p->GetSize ());
+  p->AddHeader (ip);
+  NetfilterHeaderMangle::SetSource (p, Ipv4Address ("203.0.113.10"));
+  NetfilterHeaderMangle::SetSourcePort (p, 49153);
+  uint8_t buffer[28];
+  p->CopyData (buffer, 28);
+  NS_TEST_ASSERT_MSG_EQ ((buffer[10] | buffer[11]), 0, "IPv4 checksum set");
+  NS_TEST_ASSERT_MSG_EQ ((buffer[26] | buffer[27]), 0, "UDP checksum set");
+  NS_TEST_ASSERT_MSG_EQ (((buffer[20] << 8) | buffer[21]), 49153, "source port not rewritten");
+}
+
+class Ipv4NetfilterPacketContextTestCase : public TestCase
+{
+public:
+  Ipv4NetfilterPacketContextTestCase ();
+  virtual ~Ipv4NetfilterPacketContextTestCase ();
+
+private:
+  virtual void DoRun (void);
+  uint32_t RewriteHook (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                        const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+  uint32_t CheckHook (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                      const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+
+  Ipv4Address m_seenSource;
+  uint16_t m_seenPort;
+  uint16_t m_seenBytesPort;
+};
+
+Ipv4NetfilterPacketContextTestCase::Ipv4NetfilterPacketContextTestCase ()
+  : TestCase ("Hooks of a chain share the parsed headers of a packet")
+{
+}
+
+Ipv4NetfilterPacketContextTestCase::~Ipv4NetfilterPacketContextTestCase ()
+{
+}
+
+uint32_t
+Ipv4NetfilterPacketContextTestCase::RewriteHook (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                                                 const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  ctx.GetIpv4Header ().SetSource (Ipv4Address ("203.0.113.10"));
+  ctx.SetIpv4HeaderDirty ();
+  ctx.SetSourcePort (49153);
+  return NF_ACCEPT;
+}
+
+uint32_t
+Ipv4NetfilterPacketContextTestCase::CheckHook (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                                               const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  m_seenSource = ctx.GetIpv4Header ().GetSource ();
+  m_seenPort = ctx.GetSourcePort ();
+  uint8_t buffer[22];
+  packet->CopyData (buffer, 22);
+  m_seenBytesPort = (buffer[20] << 8) | buffer[21];
+  return NF_ACCEPT;
+}
+
+void
+Ipv4NetfilterPacketContextTestCase::DoRun (void)
+{
+  Ipv4Address src ("192.168.0.3");
+  Ipv4Address dst ("198.51.100.7");
+  Ptr<Packet> p = Create<Packet> (100);
+  UdpHeader udp;
+  udp.SetSourcePort (5000);
+  udp.SetDestinationPort (53);
+  udp.EnableChecksums ();
+  udp.InitializeChecksum (src, dst, 17);
+  p->AddHeader (udp);
+  Ipv4Header ip;
+  ip.SetSource (src);
+  ip.SetDestination (dst);
+  ip.SetProtocol (17);
+  ip.SetTtl (17);
+  ip.SetPayloadSize (p->GetSize ());
+  ip.EnableChecksum ();
+  p->AddHeader (ip);
+  Ptr<Packet> original = p->Copy ();
+
+  NetfilterCallbackChain chain;
+  chain.Insert (Ipv4NetfilterHook (1, NF_INET_POST_ROUTING, 0,
+                                   MakeCallback (&Ipv4NetfilterPacketContextTestCase::RewriteHook, this)));
+  chain.Insert (Ipv4NetfilterHook (1, NF_INET_POST_ROUTING, 10,
+                                   MakeCallback (&Ipv4NetfilterPacketContextTestCase::CheckHook, this)));
+  ContinueCallback ccb = MakeNullCallback<uint32_t, Ptr<Packet> > ();
+  chain.IterateAndCallHook (NF_INET_POST_ROUTING, p, 0, 0, ccb);
+
+  // later hooks see the changes of earlier ones before they reach the bytes
+  NS_TEST_ASSERT_MSG_EQ (m_seenSource, Ipv4Address ("203.0.113.10"), "change to the header not shared");
+  NS_TEST_ASSERT_MSG_EQ (m_seenPort, 49153, "change to the port not shared");
+  NS_TEST_ASSERT_MSG_EQ (m_seenBytesPort, 5000, "port written before the end of the chain");
+
+  // at the end of the chain the packet holds the changes with valid checksums
+  NS_TEST_ASSERT_MSG_EQ (p->GetSize (), original->GetSize (), "packet size changed");
+  Ptr<Packet> copy = p->Copy ();
+  Ipv4Header ipAfter;
+  ipAfter.EnableChecksum ();
+  copy->RemoveHeader (ipAfter);
+  NS_TEST_ASSERT_MSG_EQ (ipAfter.IsChecksumOk (), true, "bad IPv4 checksum");
+  NS_TEST_ASSERT_MSG_EQ (ipAfter.GetSource (), Ipv4Address ("203.0.113.10"), "source address not written back");
+  NS_TEST_ASSERT_MSG_EQ (ipAfter.GetTtl (), 17, "other fields of the header changed");
+  UdpHeader udpAfter;
+  udpAfter.EnableChecksums ();
+  udpAfter.InitializeChecksum (Ipv4Address ("203.0.113.10"), dst, 17);
+  copy->RemoveHeader (udpAfter);
+  NS_TEST_ASSERT_MSG_EQ (udpAfter.IsChecksumOk (), true, "bad UDP checksum");
+  NS_TEST_ASSERT_MSG_EQ (udpAfter.GetSourcePort (), 49153, "source port not written back");
+
+  // copies made before the chain ran keep their own bytes
+  Ipv4Header ipOriginal;
+  original->PeekHeader (ipOriginal);
+  NS_TEST_ASSERT_MSG_EQ (ipOriginal.GetSource (), src, "copy of the packet changed");
+}
+
+class Ipv4NetfilterBroadcastTestCase : public TestCase
+{
+public:
+  Ipv4NetfilterBroadcastTestCase ();
+  virtual ~Ipv4NetfilterBroadcastTestCase ();
+
+private:
+  virtual void DoRun (void);
+  uint32_t CountHook (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                      const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+  uint32_t TtlHook (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                    const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+  void Tx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface);
+
+  uint32_t m_localOut;
+  uint32_t m_postRouting;
+  std::set<uint32_t> m_sentOn;
+  uint32_t m_badTtl;
+};
+
+Ipv4NetfilterBroadcastTestCase::Ipv4NetfilterBroadcastTestCase ()
+  : TestCase ("Broadcasts run the hooks once for all interfaces"),
+    m_localOut (0),
+    m_postRouting (0),
+    m_badTtl (0)
+{
+}
+
+Ipv4NetfilterBroadcastTestCase::~Ipv4NetfilterBroadcastTestCase ()
+{
+}
+
+uint32_t
+Ipv4NetfilterBroadcastTestCase::CountHook (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                                           const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  m_localOut++;
+  return NF_ACCEPT;
+}
+
+uint32_t
+Ipv4NetfilterBroadcastTestCase::TtlHook (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                                         const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  m_postRouting++;
+  ctx.GetIpv4Header ().SetTtl (7);
+  ctx.SetIpv4HeaderDirty ();
+  return NF_ACCEPT;
+}
+
+void
+Ipv4NetfilterBroadcastTestCase::Tx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  m_sentOn.insert (interface);
+  Ipv4Header ip;
+  packet->PeekHeader (ip);
+  if (ip.GetTtl () != 7)
+    {
+      m_badTtl++;
+    }
+}
+
+void
+Ipv4NetfilterBroadcastTestCase::DoRun (void)
+{
+  Ptr<Node> node = CreateObject<Node> ();
+  InternetStackHelper stack;
+  stack.Install (node);
+  Ptr<Ipv4L3Protocol> ipv4 = node->GetObject<Ipv4L3Protocol> ();
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      Ptr<SimpleNetDevice> dev = CreateObject<SimpleNetDevice> ();
+      dev->SetAddress (Mac48Address::Allocate ());
+      dev->SetChannel (CreateObject<SimpleChannel> ());
+      node->AddDevice (dev);
+      uint32_t interface = ipv4->AddInterface (dev);
+      ipv4->AddAddress (interface, Ipv4InterfaceAddress (Ipv4Address (0x0a000001 + (i << 8)), Ipv4Mask ("255.255.255.0")));
+      ipv4->SetUp (interface);
+    }
+  Ptr<Ipv4Netfilter> netfilter = ipv4->GetNetfilter ();
+  netfilter->RegisterHook (Ipv4NetfilterHook (1, NF_INET_LOCAL_OUT, 0,
+                                              MakeCallback (&Ipv4NetfilterBroadcastTestCase::CountHook, this)));
+  netfilter->RegisterHook (Ipv4NetfilterHook (1, NF_INET_POST_ROUTING, 0,
+                                              MakeCallback (&Ipv4NetfilterBroadcastTestCase::TtlHook, this)));
+  ipv4->TraceConnectWithoutContext ("Tx", MakeCallback (&Ipv4NetfilterBroadcastTestCase::Tx, this));
+
+  Ptr<Packet> p = Create<Packet> (100);
+  ipv4->Send (p, Ipv4Address ("10.0.0.1"), Ipv4Address::GetBroadcast (), 17, 0);
+
+  NS_TEST_ASSERT_MSG_EQ (m_localOut, 1, "LOCAL_OUT hooks run per interface");
+  NS_TEST_ASSERT_MSG_EQ (m_postRouting, 1, "POST_ROUTING hooks run per interface");
+  NS_TEST_ASSERT_MSG_EQ (m_sentOn.size (), ipv4->GetNInterfaces (), "broadcast not sent on every interface");
+  NS_TEST_ASSERT_MSG_EQ (m_badTtl, 0, "change of the hooks missing from a copy");
+  NS_TEST_ASSERT_MSG_EQ (p->GetSize (), 100, "packet of the caller changed");
+
+  Simulator::Destroy ();
+}
+
+class Ipv4NetfilterCallbackChainTestCase : public TestCase
+{
+public:
+  Ipv4NetfilterCallbackChainTestCase ();
+  virtual ~Ipv4NetfilterCallbackChainTestCase ();
+
+private:
+  virtual void DoRun (void);
+  uint32_t Traverse (NetfilterCallbackChain &chain);
+  uint32_t HookA (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                  const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+  uint32_t HookB (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                  const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+  uint32_t HookC (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                  const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+  uint32_t HookD (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                  const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+  uint32_t HookE (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                  const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+
+  std::string m_order;
+  uint32_t m_verdictB;
+  Ptr<Packet> m_packet;
+  NetfilterCallbackChain *m_chain;
+};
+
+Ipv4NetfilterCallbackChainTestCase::Ipv4NetfilterCallbackChainTestCase ()
+  : TestCase ("Hooks of a chain run by priority until a packet is dropped or stolen"),
+    m_chain (0)
+{
+}
+
+Ipv4NetfilterCallbackChainTestCase::~Ipv4NetfilterCallbackChainTestCase ()
+{
+}
+
+uint32_t
+Ipv4NetfilterCallbackChainTestCase::HookA (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                                           const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  m_order += "A";
+  ctx.GetIpv4Header ().SetTtl (7);
+  ctx.SetIpv4HeaderDirty ();
+  return NF_ACCEPT;
+}
+
+uint32_t
+Ipv4NetfilterCallbackChainTestCase::HookB (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                                           const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  m_order += "B";
+  return m_verdictB;
+}
+
+uint32_t
+Ipv4NetfilterCallbackChainTestCase::HookC (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                                           const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  m_order += "C";
+  return NF_ACCEPT;
+}
+
+uint32_t
+Ipv4NetfilterCallbackChainTestCase::HookD (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                                           const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  m_order += "D";
+  return NF_ACCEPT;
+}
+
+uint32_t
+Ipv4NetfilterCallbackChainTestCase::HookE (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                                           const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  m_order += "E";
+  m_chain->Clear ();
+  m_chain->Insert (Ipv4NetfilterHook (1, NF_INET_FORWARD, 0,
+                                      MakeCallback (&Ipv4NetfilterCallbackChainTestCase::HookA, this)));
+  return NF_ACCEPT;
+}
+
+uint32_t
+Ipv4NetfilterCallbackChainTestCase::Traverse (NetfilterCallbackChain &chain)
+{
+  m_order = "";
+  Ipv4Header header;
+  header.SetSource (Ipv4Address ("10.0.0.1"));
+  header.SetDestination (Ipv4Address ("10.0.0.2"));
+  header.SetProtocol (17);
+  header.SetTtl (64);
+  m_packet = Create<Packet> (20);
+  m_packet->AddHeader (header);
+  ContinueCallback ccb = MakeNullCallback<uint32_t, Ptr<Packet> > ();
+  return chain.IterateAndCallHook (NF_INET_FORWARD, m_packet, 0, 0, ccb);
+}
+
+void
+Ipv4NetfilterCallbackChainTestCase::DoRun (void)
+{
+  NetfilterCallbackChain chain;
+  NS_TEST_ASSERT_MSG_EQ (Traverse (chain), (uint32_t)NF_ACCEPT, "empty chain did not accept");
+
+  chain.Insert (Ipv4NetfilterHook (1, NF_INET_FORWARD, 10,
+                                   MakeCallback (&Ipv4NetfilterCallbackChainTestCase::HookC, this)));
+  chain.Insert (Ipv4NetfilterHook (1, NF_INET_FORWARD, -5,
+                                   MakeCallback (&Ipv4NetfilterCallbackChainTestCase::HookA, this)));
+  chain.Insert (Ipv4NetfilterHook (1, NF_INET_FORWARD, 0,
+                                   MakeCallback (&Ipv4NetfilterCallbackChainTestCase::HookB, this)));
+  chain.Insert (Ipv4NetfilterHook (1, NF_INET_FORWARD, 0,
+                                   MakeCallback (&Ipv4NetfilterCallbackChainTestCase::HookD, this)));
+  NS_TEST_ASSERT_MSG_EQ (chain.Size (), 4U, "hooks lost on insertion");
+
+  // by priority, hooks of the same priority in the order of insertion
+  m_verdictB = NF_ACCEPT;
+  NS_TEST_ASSERT_MSG_EQ (Traverse (chain), (uint32_t)NF_ACCEPT, "accepted packet not accepted");
+  NS_TEST_ASSERT_MSG_EQ (m_order, "ABDC", "hooks called out of order");
+
+  m_verdictB = NF_DROP;
+  NS_TEST_ASSERT_MSG_EQ (Traverse (chain), (uint32_t)NF_DROP, "drop not returned");
+  NS_TEST_ASSERT_MSG_EQ (m_order, "AB", "hooks called after a drop");
+
+  m_verdictB = NF_STOLEN;
+  NS_TEST_ASSERT_MSG_EQ (Traverse (chain), (uint32_t)NF_STOLEN, "steal not returned");
+  NS_TEST_ASSERT_MSG_EQ (m_order, "AB", "hooks called after a steal");
+  Ipv4Header stolen;
+  m_packet->PeekHeader (stolen);
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t)stolen.GetTtl (), 7U, "changes of earlier hooks lost on a steal");
+
+  m_verdictB = NF_STOP;
+  NS_TEST_ASSERT_MSG_EQ (Traverse (chain), (uint32_t)NF_ACCEPT, "stopped packet not accepted");
+  NS_TEST_ASSERT_MSG_EQ (m_order, "AB", "hooks called after a stop");
+
+  m_verdictB = NF_ACCEPT;
+  chain.Remove (Ipv4NetfilterHook (1, NF_INET_FORWARD, -5, MakeNullCallback<uint32_t, Hooks_t, const Ptr<Packet>&,
+                                                                            const Ptr<NetDevice>&, const Ptr<NetDevice>&,
+                                                                            ContinueCallback&, NetfilterPacketContext&> ()));
+  NS_TEST_ASSERT_MSG_EQ (chain.Size (), 3U, "hook not removed");
+  NS_TEST_ASSERT_MSG_EQ (Traverse (chain), (uint32_t)NF_ACCEPT, "accepted packet not accepted");
+  NS_TEST_ASSERT_MSG_EQ (m_order, "BDC", "removed hook called");
+
+  // a hook that changes the chain does not change the traversal it is
+  // called from, only the next one
+  m_chain = &chain;
+  chain.Insert (Ipv4NetfilterHook (1, NF_INET_FORWARD, 5,
+                                   MakeCallback (&Ipv4NetfilterCallbackChainTestCase::HookE, this)));
+  NS_TEST_ASSERT_MSG_EQ (Traverse (chain), (uint32_t)NF_ACCEPT, "accepted packet not accepted");
+  NS_TEST_ASSERT_MSG_EQ (m_order, "BDEC", "traversal changed by a hook");
+  NS_TEST_ASSERT_MSG_EQ (chain.Size (), 1U, "chain not changed by a hook");
+  NS_TEST_ASSERT_MSG_EQ (Traverse (chain), (uint32_t)NF_ACCEPT, "accepted packet not accepted");
+  NS_TEST_ASSERT_MSG_EQ (m_order, "A", "change of a hook not seen by the next traversal");
+
+  chain.Clear ();
+  NS_TEST_ASSERT_MSG_EQ (Traverse (chain), (uint32_t)NF_ACCEPT, "empty chain did not accept");
+  NS_TEST_ASSERT_MSG_EQ (m_order, "", "hook of an empty chain called");
+}
+
+class Ipv4NetfilterFragmentTestCase : public TestCase
+{
+public:
+  Ipv4NetfilterFragmentTestCase ();
+  virtual ~Ipv4NetfilterFragmentTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Send (uint16_t identification, uint16_t offset, bool last);
+
+  Ptr<Ipv4Netfilter> m_netfilter;
+};
+
+Ipv4NetfilterFragmentTestCase::Ipv4NetfilterFragmentTestCase ()
+  : TestCase ("Trailing fragments are tracked by the ports of their first fragment")
+{
+}
+
+Ipv4NetfilterFragmentTestCase::~Ipv4NetfilterFragmentTestCase ()
+{
+}
+
+void
+Ipv4NetfilterFragmentTestCase::Send (uint16_t identification, uint16_t offset, bool last)
+{
+  Ptr<Packet> p = Create<Packet> (24);
+  if (offset == 0)
+    {
+      UdpHeader udp;
+      udp.SetSourcePort (1000);
+      udp.SetDestinationPort (53);
+      p->AddHeader (udp);
+    }
+  Ipv4Header ip;
+  ip.SetSource (Ipv4Address ("10.0.0.1"));
+  ip.SetDestination (Ipv4Address ("10.0.1.1"));
+  ip.SetProtocol (17);
+  ip.SetIdentification (identification);
+  ip.SetFragmentOffset (offset);
+  if (last)
+    {
+      ip.SetLastFragment ();
+    }
+  else
+    {
+      ip.SetMoreFragments ();
+    }
+  ip.SetPayloadSize (p->GetSize ());
+  p->AddHeader (ip);
+
+  m_netfilter->ProcessHook (PF_INET, NF_INET_PRE_ROUTING, p, 0, 0);
+  ContinueCallback confirm = MakeCallback (&Ipv4Netfilter::NetfilterConntrackConfirm, m_netfilter);
+  m_netfilter->ProcessHook (PF_INET, NF_INET_POST_ROUTING, p, 0, 0, confirm);
+}
+
+void
+Ipv4NetfilterFragmentTestCase::DoRun (void)
+{
+  Ptr<Node> node = CreateObject<Node> ();
+  InternetStackHelper stack;
+  stack.Install (node);
+  m_netfilter = node->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  NetfilterFragmentCache &fragments = m_netfilter->GetFragmentCache ();
+
+  // The first fragment creates the connection and remembers its ports
+  Send (7, 0, false);
+  NS_TEST_ASSERT_MSG_EQ (m_netfilter->GetHash ().GetSize (), 2, "connection of the first fragment not tracked");
+  NS_TEST_ASSERT_MSG_EQ (fragments.GetNEntries (), 1, "ports of the datagram not cached");
+  Ipv4Header trailing;
+  trailing.SetSource (Ipv4Address ("10.0.0.1"));
+  trailing.SetDestination (Ipv4Address ("10.0.1.1"));
+  trailing.SetProtocol (17);
+  trailing.SetIdentification (7);
+  uint16_t sourcePort = 0;
+  uint16_t destinationPort = 0;
+  bool found = fragments.Lookup (trailing, sourcePort, destinationPort);
+  NS_TEST_ASSERT_MSG_EQ (found, true, "datagram not found");
+  NS_TEST_ASSERT_MSG_EQ (sourcePort, 1000, "wrong source port");
+  NS_TEST_ASSERT_MSG_EQ (destinationPort, 53, "wrong destination port");
+
+  // Its trailing fragments belong to the same connection
+  Send (7, 32, false);
+  Send (7, 64, true);
+  NS_TEST_ASSERT_MSG_EQ (m_netfilter->GetHash ().GetSize (), 2, "trailing fragments tracked as another connection");
+
+  // Trailing fragments of an unknown datagram are not tracked at all
+  Send (8, 32, true);
+  NS_TEST_ASSERT_MSG_EQ (m_netfilter->GetHash ().GetSize (), 2, "fragment without ports tracked");
+
+  // A full cache evicts the oldest datagram
+  m_netfilter->SetAttribute ("FragmentCacheSize", UintegerValue (1));
+  Send (9, 0, false);
+  NS_TEST_ASSERT_MSG_EQ (fragments.GetNEntries (), 1, "cache grew past its size");
+  NS_TEST_ASSERT_MSG_EQ (fragments.GetNEvictions (), 1, "oldest datagram not evicted");
+  found = fragments.Lookup (trailing, sourcePort, destinationPort);
+  NS_TEST_ASSERT_MSG_EQ (found, false, "evicted datagram found");
+
+  // Entries live for the fragment timeout only
+  trailing.SetIdentification (9);
+  Simulator::Stop (Seconds (31));
+  Simulator::Run ();
+  found = fragments.Lookup (trailing, sourcePort, destinationPort);
+  NS_TEST_ASSERT_MSG_EQ (found, false, "expired datagram found");
+  NS_TEST_ASSERT_MSG_EQ (fragments.GetNEntries (), 0, "expired datagram kept");
+
+  m_netfilter = 0;
+  Simulator::Destroy ();
+}
+
+class Ipv4NetfilterSnapshotTestCase : public TestCase
+{
+public:
+  Ipv4NetfilterSnapshotTestCase ();
+  virtual ~Ipv4NetfilterSnapshotTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Send (Ptr<Ipv4Netfilter> netfilter, Ipv4Address src, uint16_t sport, Ipv4Address dst, uint16_t dport);
+  void CheckSize (Ptr<Ipv4Netfilter> netfilter, uint32_t expected);
+};
+
+Ipv4NetfilterSnapshotTestCase::Ipv4NetfilterSnapshotTestCase ()
+  : TestCase ("Conntrack entries survive a snapshot of the table")
+{
+}
+
+Ipv4NetfilterSnapshotTestCase::~Ipv4NetfilterSnapshotTestCase ()
+{
+}
+
+void
+Ipv4NetfilterSnapshotTestCase::Send (Ptr<Ipv4Netfilter> netfilter, Ipv4Address src, uint16_t sport,
+                                     Ipv4Address dst, uint16_t dport)
+{
+  Ptr<Packet> p = Create<Packet> (32);
+  UdpHeader udp;
+  udp.SetSourcePort (sport);
+  udp.SetDestinationPort (dport);
+  p->AddHeader (udp);
+  Ipv4Header ip;
+  ip.SetSource (src);
+  ip.SetDestination (dst);
+  ip.SetProtocol (17);
+  ip.SetPayloadSize (p->GetSize ());
+  p->AddHeader (ip);
+
+  netfilter->ProcessHook (PF_INET, NF_INET_PRE_ROUTING, p, 0, 0);
+  ContinueCallback confirm = MakeCallback (&Ipv4Netfilter::NetfilterConntrackConfirm, netfilter);
+  netfilter->ProcessHook (PF_INET, NF_INET_POST_ROUTING, p, 0, 0, confirm);
+}
+
+void
+Ipv4NetfilterSnapshotTestCase::CheckSize (Ptr<Ipv4Netfilter> netfilter, uint32_t expected)
+{
+  NS_TEST_EXPECT_MSG_EQ (netfilter->GetHash ().GetSize (), expected,
+                         "unexpected number of conntrack entries at " << Simulator::Now ().GetSeconds ());
+}
+
+void
+Ipv4NetfilterSnapshotTestCase::DoRun (void)
+{
+  InternetStackHelper stack;
+  Ptr<Node> node = CreateObject<Node> ();
+  stack.Install (node);
+  Ptr<Ipv4Netfilter> netfilter = node->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  netfilter->SetAttribute ("UdpTimeout", TimeValue (Seconds (10)));
+
+  Ipv4Address server ("10.0.1.1");
+  for (uint16_t i = 0; i < 8; i++)
+    {
+      Send (netfilter, Ipv4Address ("10.0.0.1"), 1000 + i, server, 53);
+    }
+  CheckSize (netfilter, 16);
+
+  std::stringstream snapshot;
+  netfilter->SerializeConntrackTable (snapshot);
+
+  Ptr<Node> node2 = CreateObject<Node> ();
+  stack.Install (node2);
+  Ptr<Ipv4Netfilter> netfilter2 = node2->GetObject<Ipv4L3Protocol> ()->GetNetfilter ();
+  bool loaded = netfilter2->DeserializeConntrackTable (snapshot);
+  NS_TEST_ASSERT_MSG_EQ (loaded, true, "snapshot not loaded");
+  CheckSize (netfilter2, 16);
+
+  NetfilterConntrackTuple tuple (Ipv4Address ("10.0.0.1"), 1003, server, 53);
+  tuple.SetDestinationProtocol (17);
+  bool found = netfilter2->GetHash ().Find (tuple) != 0;
+  NS_TEST_ASSERT_MSG_EQ (found, true, "restored connection not found");
+
+  // The restored entries keep the time they had left
+  Simulator::Schedule (Seconds (9), &Ipv4NetfilterSnapshotTestCase::CheckSize, this, netfilter2, 16);
+  Simulator::Schedule (Seconds (12), &Ipv4NetfilterSnapshotTestCase::CheckSize, this, netfilter2, 0);
+  Simulator::Run ();
+
+  std::stringstream garbage ("not a snapshot");
+  loaded = netfilter2->DeserializeConntrackTable (garbage);
+  NS_TEST_ASSERT_MSG_EQ (loaded, false, "garbage loaded as a snapshot");
+
+  Simulator::Destroy ();
+}
+
+class Ipv4NetfilterStatisticsTestCase : public TestCase
+{
+public:
+  Ipv4NetfilterStatisticsTestCase ();
+  virtual ~Ipv4NetfilterStatisticsTestCase ();
+
+private:
+  virtual void DoRun (void);
+  uint32_t DropHook (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                     const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+  uint32_t StealHook (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                      const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+  void Send (Ptr<Ipv4Netfilter> netfilter, Ipv4Address src, uint16_t sport, Ipv4Address dst, uint16_t dport);
+  void HookDrop (Ptr<const Packet> packet, Hooks_t hook, uint32_t verdict);
+  void Drop (const Ipv4Header &header, Ptr<const Packet> packet, Ipv4L3Protocol::DropReason reason,
+             Ptr<Ipv4> ipv4, uint32_t interface);
+
+  uint32_t m_hookDrops;
+  uint32_t m_hookTraces;
+  uint32_t m_netfilterDrops;
+};
+
+Ipv4NetfilterStatisticsTestCase::Ipv4NetfilterStatisticsTestCase ()
+  : TestCase ("Netfilter counts lookups, connections and hook drops"),
+    m_hookDrops (0),
+    m_hookTraces (0),
+    m_netfilterDrops (0)
+{
+}
+
+Ipv4NetfilterStatisticsTestCase::~Ipv4NetfilterStatisticsTestCase ()
+{
+}
+
+uint32_t
+Ipv4NetfilterStatisticsTestCase::DropHook (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                                           const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  return NF_DROP;
+}
+
+uint32_t
+Ipv4NetfilterStatisticsTestCase::StealHook (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                                            const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  return NF_STOLEN;
+}
+
+void
+Ipv4NetfilterStatisticsTestCase::Send (Ptr<Ipv4Netfilter> netfilter, Ipv4Address src, uint16_t sport,
+                                       Ipv4Address dst, uint16_t dport)
+{
+  Ptr<Packet> p = Create<Packet> (32);
+  UdpHeader udp;
+  udp.SetSourcePort (sport);
+  udp.SetDestinationPort (dport);
+  p->AddHeader (udp);
+  Ipv4Header ip;
+  ip.SetSource (src);
+  ip.SetDestination (dst);
+  ip.SetProtocol (17);
+  ip.SetPayloadSize (p->GetSize ());
+  p->AddHeader (ip);
+
+  netfilter->ProcessHook (PF_INET, NF_INET_PRE_ROUTING, p, 0, 0);
+  ContinueCallback confirm = MakeCallback (&Ipv4Netfilter::NetfilterConntrackConfirm, netfilter);
+  netfilter->ProcessHook (PF_INET, NF_INET_POST_ROUTING, p, 0, 0, confirm);
+}
+
+void
+Ipv4NetfilterStatisticsTestCase::HookDrop (Ptr<const Packet> packet, Hooks_t hook, uint32_t verdict)
+{
+  m_hookTraces++;
+  if (hook == NF_INET_LOCAL_OUT && verdict == NF_DROP)
+    {
+      m_hookDrops++;
+    }
+}
+
+void
+Ipv4NetfilterStatisticsTestCase::Drop (const Ipv4Header &header, Ptr<const Packet> packet,
+                                       Ipv4L3Protocol::DropReason reason, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  if (reason == Ipv4L3Protocol::DROP_NETFILTER && header.GetDestination () == Ipv4Address::GetBroadcast ())
+    {
+      m_netfilterDrops++;
+    }
+}
+
+void
+Ipv4NetfilterStatisticsTestCase::DoRun (void)
+{
+  Ptr<Node> node = CreateObject<Node> ();
+  InternetStackHelper stack;
+  stack.Install (node);
+  Ptr<Ipv4L3Protocol> ipv4 = node->GetObject<Ipv4L3Protocol> ();
+  Ptr<SimpleNetDevice> dev = CreateObject<SimpleNetDevice> ();
+  dev->SetAddress (Mac48Address::Allocate ());
+  dev->SetChannel (CreateObject<SimpleChannel> ());
+  node->AddDevice (dev);
+  uint32_t interface = ipv4->AddInterface (dev);
+  ipv4->AddAddress (interface, Ipv4InterfaceAddress (Ipv4Address ("10.0.0.1"), Ipv4Mask ("255.255.255.0")));
+  ipv4->SetUp (interface);
+  Ptr<Ipv4Netfilter> netfilter = ipv4->GetNetfilter ();
+
+  // Every connection misses once and hits on its reply
+  Ipv4Address client ("10.0.0.1");
+  Ipv4Address server ("10.0.1.1");
+  for (uint16_t i = 0; i < 4; i++)
+    {
+      Send (netfilter, client, 1000 + i, server, 53);
+      Send (netfilter, server, 53, client, 1000 + i);
+    }
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetNConntrackLookups (), 8, "lookups not counted");
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetNConntrackHits (), 4, "hits not counted");
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetNConntrackMisses (), 4, "misses not counted");
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetNNewConnections (), 4, "new connections not counted");
+  UintegerValue hits;
+  netfilter->GetAttribute ("ConntrackHits", hits);
+  NS_TEST_ASSERT_MSG_EQ (hits.Get (), 4, "counter not readable as an attribute");
+
+  std::vector<uint32_t> histogram;
+  netfilter->GetConntrackChainHistogram (histogram);
+  uint32_t entries = 0;
+  for (uint32_t i = 0; i < histogram.size (); i++)
+    {
+      entries += histogram[i];
+    }
+  NS_TEST_ASSERT_MSG_EQ (entries, netfilter->GetHash ().GetSize (), "histogram does not cover every entry");
+
+  // A drop by a hook is counted, traced by netfilter and by Ipv4L3Protocol
+  netfilter->RegisterHook (Ipv4NetfilterHook (1, NF_INET_LOCAL_OUT, 0,
+                                              MakeCallback (&Ipv4NetfilterStatisticsTestCase::DropHook, this)));
+  netfilter->TraceConnectWithoutContext ("HookDrop", MakeCallback (&Ipv4NetfilterStatisticsTestCase::HookDrop, this));
+  ipv4->TraceConnectWithoutContext ("Drop", MakeCallback (&Ipv4NetfilterStatisticsTestCase::Drop, this));
+  netfilter->SetAttribute ("HookTiming", BooleanValue (true));
+  ipv4->Send (Create<Packet> (100), client, Ipv4Address::GetBroadcast (), 17, 0);
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetNDropsAtHook (NF_INET_LOCAL_OUT), 1, "hook drop not counted");
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetNHookDrops (), 1, "hook drops of other hooks counted");
+  NS_TEST_ASSERT_MSG_EQ (m_hookDrops, 1, "hook drop not traced");
+  NS_TEST_ASSERT_MSG_EQ (m_netfilterDrops, 1, "hook drop not traced by Ipv4L3Protocol");
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetNTimedPackets (NF_INET_LOCAL_OUT), 1, "hook not timed");
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetNTimedPackets (NF_INET_PRE_ROUTING), 0, "hook timed before timing was on");
+
+  // A stolen packet is not a drop
+  netfilter->RegisterHook (Ipv4NetfilterHook (1, NF_INET_FORWARD, 0,
+                                              MakeCallback (&Ipv4NetfilterStatisticsTestCase::StealHook, this)));
+  uint32_t verdict = netfilter->ProcessHook (PF_INET, NF_INET_FORWARD, Create<Packet> (100), 0, 0);
+  NS_TEST_ASSERT_MSG_EQ (verdict, NF_STOLEN, "packet not stolen");
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetNDropsAtHook (NF_INET_FORWARD), 0, "stolen packet counted as a drop");
+  NS_TEST_ASSERT_MSG_EQ (m_hookTraces, 1, "stolen packet traced as a drop");
+
+  std::ostringstream xml;
+  netfilter->SerializeToXmlStream (xml, 0);
+  bool found = xml.str ().find ("<Hook name=\"LOCAL_OUT\" drops=\"1\"") != std::string::npos;
+  NS_TEST_ASSERT_MSG_EQ (found, true, "drops missing from the XML output");
+
+  netfilter->ResetStatistics ();
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetNHookDrops (), 0, "counters not reset");
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetNConntrackLookups (), 0, "counters not reset");
+
+  Simulator::Destroy ();
+}
+
 class Ipv4NetfilterTestSuite : public TestSuite
 {
 public:
@@ -68,6 +1303,17 @@ Ipv4NetfilterTestSuite::Ipv4NetfilterTestSuite ()
   : TestSuite ("ipv4-netfilter", UNIT)
 {
   AddTestCase (new Ipv4NetfilterTestCase1);
+  AddTestCase (new Ipv4NetfilterConntrackTableTestCase);
+  AddTestCase (new Ipv4NetfilterTimerWheelTestCase);
+  AddTestCase (new Ipv4NetfilterConntrackExpiryTestCase);
+  AddTestCase (new Ipv4NetfilterConntrackTagTestCase);
+  AddTestCase (new Ipv4NetfilterHeaderMangleTestCase);
+  AddTestCase (new Ipv4NetfilterPacketContextTestCase);
+  AddTestCase (new Ipv4NetfilterBroadcastTestCase);
+  AddTestCase (new Ipv4NetfilterCallbackChainTestCase);
+  AddTestCase (new Ipv4NetfilterFragmentTestCase);
+  AddTestCase (new Ipv4NetfilterSnapshotTestCase);
+  AddTestCase (new Ipv4NetfilterStatisticsTestCase);
 }
 
 static Ipv4NetfilterTestSuite ipv4NetfilterTestSuite;
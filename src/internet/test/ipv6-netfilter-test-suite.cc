@@ -0,0 +1,323 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/test.h"
+#include "ns3/ptr.h"
+#include "ns3/node.h"
+#include "ns3/ipv6-address.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv6-static-routing-helper.h"
+#include "ns3/ipv6-static-routing.h"
+#include "ns3/ipv6-route.h"
+#include "ns3/simple-channel.h"
+#include "ns3/simple-net-device.h"
+#include "ns3/ipv6-l3-protocol.h"
+#include "ns3/ipv6-netfilter.h"
+#include "ns3/ipv6-conntrack-tuple.h"
+#include "ns3/ipv6-npt.h"
+#include "ns3/ipv6-header.h"
+#include "ns3/udp-header.h"
+#include "ns3/packet.h"
+#include "ns3/simulator.h"
+
+#include <string.h>
+
+using namespace ns3;
+
+/* One's complement sum of the 16 bit words of an address */
+static uint16_t
+AddressSum (const uint8_t address[16])
+{
+  uint32_t sum = 0;
+  for (uint32_t i = 0; i < 16; i += 2)
+    {
+      sum += (address[i] << 8) | address[i + 1];
+    }
+  while (sum >> 16)
+    {
+      sum = (sum & 0xffff) + (sum >> 16);
+    }
+  return sum == 0xffff ? 0 : sum;
+}
+
+class Ipv6ConntrackTupleTestCase : public TestCase
+{
+public:
+  Ipv6ConntrackTupleTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+Ipv6ConntrackTupleTestCase::Ipv6ConntrackTupleTestCase ()
+  : TestCase ("All 128 address bits go into the tuple hash")
+{
+}
+
+void
+Ipv6ConntrackTupleTestCase::DoRun (void)
+{
+  Ipv6ConntrackTupleHash hash;
+  Ipv6Address server ("2001:db8:ffff::53");
+  Ipv6ConntrackTuple base (Ipv6Address ("2001:db8:1:2::10"), 5000, server, 53, 17);
+
+  // hosts of one /64 only differ in their low bits
+  Ipv6ConntrackTuple host (Ipv6Address ("2001:db8:1:2::11"), 5000, server, 53, 17);
+  NS_TEST_ASSERT_MSG_NE (hash (base), hash (host), "interface identifier not hashed");
+  // delegated prefixes only differ in their high bits
+  Ipv6ConntrackTuple prefix (Ipv6Address ("2001:db9:1:2::10"), 5000, server, 53, 17);
+  NS_TEST_ASSERT_MSG_NE (hash (base), hash (prefix), "routing prefix not hashed");
+  Ipv6ConntrackTuple protocol (Ipv6Address ("2001:db8:1:2::10"), 5000, server, 53, 6);
+  NS_TEST_ASSERT_MSG_NE (hash (base), hash (protocol), "protocol not hashed");
+
+  Ipv6ConntrackTuple reply = base.Invert ();
+  NS_TEST_ASSERT_MSG_EQ (reply.GetSource (), server, "inverted source");
+  NS_TEST_ASSERT_MSG_EQ (reply.GetSourcePort (), 53, "inverted source port");
+  NS_TEST_ASSERT_MSG_EQ (reply.GetDestinationPort (), 5000, "inverted destination port");
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t)reply.GetDirection (), (uint32_t)IP_CT_DIR_REPLY, "inverted direction");
+  NS_TEST_ASSERT_MSG_EQ ((reply.Invert () == base), true, "double inversion");
+  NS_TEST_ASSERT_MSG_EQ ((reply == base), false, "reply equals original");
+
+  // PacketToTuple skips the extension headers
+  uint8_t buffer[40 + 8 + 8 + 8];
+  memset (buffer, 0, sizeof (buffer));
+  buffer[0] = 0x60;
+  buffer[5] = 24;
+  buffer[6] = Ipv6Header::IPV6_EXT_HOP_BY_HOP;
+  buffer[7] = 64;
+  Ipv6Address ("2001:db8:1:2::10").Serialize (buffer + 8);
+  server.Serialize (buffer + 24);
+  buffer[40] = Ipv6Header::IPV6_EXT_FRAGMENTATION;
+  buffer[48] = Ipv6Header::IPV6_ICMPV6;
+  buffer[56] = 128;
+  buffer[60] = 0x12;
+  buffer[61] = 0x34;
+  Ipv6ConntrackTuple tuple;
+  uint8_t tcpFlags;
+  bool tracked = Ipv6Netfilter::PacketToTuple (Create<Packet> (buffer, sizeof (buffer)), tuple, tcpFlags);
+  NS_TEST_ASSERT_MSG_EQ (tracked, true, "echo request behind extension headers not tracked");
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t)tuple.GetProtocol (), 58U, "protocol");
+  NS_TEST_ASSERT_MSG_EQ (tuple.GetSourcePort (), 0x1234, "echo identifier");
+  NS_TEST_ASSERT_MSG_EQ (tuple.GetDestination (), server, "destination");
+
+  // later fragments carry no transport header
+  buffer[51] = 0x08;
+  tracked = Ipv6Netfilter::PacketToTuple (Create<Packet> (buffer, sizeof (buffer)), tuple, tcpFlags);
+  NS_TEST_ASSERT_MSG_EQ (tracked, false, "non-first fragment tracked");
+}
+
+class Ipv6NptRuleTestCase : public TestCase
+{
+public:
+  Ipv6NptRuleTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+Ipv6NptRuleTestCase::Ipv6NptRuleTestCase ()
+  : TestCase ("NPTv6 rewrites addresses checksum neutrally")
+{
+}
+
+void
+Ipv6NptRuleTestCase::DoRun (void)
+{
+  // the example of RFC 6296 section 3.1
+  Ipv6NptRule rule (Ipv6Address ("fd01:203:405::"), Ipv6Address ("2001:db8:1::"), 48);
+  uint8_t address[16];
+  Ipv6Address ("fd01:203:405:1::1234").GetBytes (address);
+  uint16_t sum = AddressSum (address);
+  NS_TEST_ASSERT_MSG_EQ (rule.MatchesInternal (address), true, "internal prefix");
+  NS_TEST_ASSERT_MSG_EQ (rule.TranslateOutbound (address), true, "outbound translation");
+  NS_TEST_ASSERT_MSG_EQ (Ipv6Address (address), Ipv6Address ("2001:db8:1:d550::1234"), "RFC 6296 example");
+  NS_TEST_ASSERT_MSG_EQ (AddressSum (address), sum, "outbound translation changed the checksum");
+  NS_TEST_ASSERT_MSG_EQ (rule.MatchesExternal (address), true, "external prefix");
+  NS_TEST_ASSERT_MSG_EQ (rule.TranslateInbound (address), true, "inbound translation");
+  NS_TEST_ASSERT_MSG_EQ (Ipv6Address (address), Ipv6Address ("fd01:203:405:1::1234"), "round trip");
+
+  // the subnet word 0xffff can not be adjusted
+  Ipv6Address ("fd01:203:405:ffff::1").GetBytes (address);
+  NS_TEST_ASSERT_MSG_EQ (rule.TranslateOutbound (address), false, "subnet 0xffff translated");
+
+  // longer prefixes adjust the interface identifier, skipping 0xffff words
+  Ipv6NptRule longer (Ipv6Address ("fd00:1:2:3400::"), Ipv6Address ("2001:db8:aa:bb00::"), 56);
+  const char *hosts[] = { "fd00:1:2:3412::1", "fd00:1:2:3412:ffff::1", "fd00:1:2:34ff:abcd:1:2:3" };
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      Ipv6Address host (hosts[i]);
+      host.GetBytes (address);
+      uint8_t subnet = address[7];
+      sum = AddressSum (address);
+      NS_TEST_ASSERT_MSG_EQ (longer.TranslateOutbound (address), true, "outbound /56 translation");
+      NS_TEST_ASSERT_MSG_EQ (longer.MatchesExternal (address), true, "translated out of the prefix");
+      NS_TEST_ASSERT_MSG_EQ ((uint32_t)address[7], (uint32_t)subnet, "subnet bits changed");
+      NS_TEST_ASSERT_MSG_EQ (AddressSum (address), sum, "/56 translation changed the checksum");
+      NS_TEST_ASSERT_MSG_EQ (longer.TranslateInbound (address), true, "inbound /56 translation");
+      NS_TEST_ASSERT_MSG_EQ (Ipv6Address (address), host, "/56 round trip");
+    }
+}
+
+class Ipv6NetfilterForwardTestCase : public TestCase
+{
+public:
+  Ipv6NetfilterForwardTestCase ();
+
+private:
+  virtual void DoRun (void);
+  uint32_t SeenHook (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                     const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx);
+  void Receive (Ptr<NetDevice> device, Ipv6Address src, uint16_t sport, Ipv6Address dst, uint16_t dport);
+
+  Ptr<Ipv6L3Protocol> m_ipv6;
+  Ipv6Address m_seenSource;
+  Ipv6Address m_seenDestination;
+  uint32_t m_seen;
+};
+
+Ipv6NetfilterForwardTestCase::Ipv6NetfilterForwardTestCase ()
+  : TestCase ("Ipv6L3Protocol runs the netfilter hooks and NPTv6 translates forwarded packets"),
+    m_seen (0)
+{
+}
+
+uint32_t
+Ipv6NetfilterForwardTestCase::SeenHook (Hooks_t hook, const Ptr<Packet>& packet, const Ptr<NetDevice>& in,
+                                        const Ptr<NetDevice>& out, ContinueCallback& ccb, NetfilterPacketContext& ctx)
+{
+  Ipv6Header &ip = ctx.GetIpv6Header ();
+  m_seenSource = ip.GetSourceAddress ();
+  m_seenDestination = ip.GetDestinationAddress ();
+  m_seen++;
+  return NF_ACCEPT;
+}
+
+void
+Ipv6NetfilterForwardTestCase::Receive (Ptr<NetDevice> device, Ipv6Address src, uint16_t sport,
+                                       Ipv6Address dst, uint16_t dport)
+{
+  Ptr<Packet> p = Create<Packet> (64);
+  UdpHeader udp;
+  udp.SetSourcePort (sport);
+  udp.SetDestinationPort (dport);
+  p->AddHeader (udp);
+  Ipv6Header ip;
+  ip.SetSourceAddress (src);
+  ip.SetDestinationAddress (dst);
+  ip.SetNextHeader (Ipv6Header::IPV6_UDP);
+  ip.SetPayloadLength (p->GetSize ());
+  ip.SetHopLimit (64);
+  p->AddHeader (ip);
+  m_ipv6->Receive (device, p, Ipv6L3Protocol::PROT_NUMBER, device->GetBroadcast (),
+                   device->GetAddress (), NetDevice::PACKET_HOST);
+}
+
+void
+Ipv6NetfilterForwardTestCase::DoRun (void)
+{
+  Ptr<Node> node = CreateObject<Node> ();
+  InternetStackHelper stack;
+  stack.Install (node);
+  m_ipv6 = node->GetObject<Ipv6L3Protocol> ();
+  NS_TEST_ASSERT_MSG_EQ ((m_ipv6->GetNetfilter () == 0), true, "netfilter installed by default");
+  Ptr<SimpleNetDevice> devs[2];
+  const char *addresses[] = { "2001:db8:ff::1", "fd01:203:405:1::1" };
+  uint32_t interfaces[2];
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      devs[i] = CreateObject<SimpleNetDevice> ();
+      devs[i]->SetAddress (Mac48Address::Allocate ());
+      devs[i]->SetChannel (CreateObject<SimpleChannel> ());
+      node->AddDevice (devs[i]);
+      interfaces[i] = m_ipv6->AddInterface (devs[i]);
+      m_ipv6->AddAddress (interfaces[i], Ipv6InterfaceAddress (Ipv6Address (addresses[i]), Ipv6Prefix (64)));
+      m_ipv6->SetUp (interfaces[i]);
+      m_ipv6->SetForwarding (interfaces[i], true);
+    }
+  Ipv6StaticRoutingHelper routing;
+  routing.GetStaticRouting (m_ipv6)->SetDefaultRoute (Ipv6Address ("2001:db8:ff::fe"), interfaces[0]);
+
+  Ptr<Ipv6Npt> npt = CreateObject<Ipv6Npt> ();
+  node->AggregateObject (npt);
+  npt->AddRule (Ipv6NptRule (Ipv6Address ("fd01:203:405::"), Ipv6Address ("2001:db8:1::"), 48));
+  npt->SetOutside (interfaces[0]);
+
+  // the translation sets up the netfilter, connection tracking is opt-in
+  Ptr<Ipv6Netfilter> netfilter = m_ipv6->GetNetfilter ();
+  NS_TEST_ASSERT_MSG_EQ ((netfilter != 0), true, "netfilter not set up by the translation");
+  NS_TEST_ASSERT_MSG_EQ (netfilter->IsConntrackEnabled (), false, "connection tracking enabled by default");
+  netfilter->EnableConntrack ();
+  netfilter->RegisterHook (Ipv4NetfilterHook (PF_INET6, NF_INET_FORWARD, NF_IP_PRI_FILTER,
+                                              MakeCallback (&Ipv6NetfilterForwardTestCase::SeenHook, this)));
+
+  Ipv6Address server ("2001:db8:ffff::53");
+  Ipv6Address inside ("fd01:203:405:1::1234");
+  Ipv6Address outside ("2001:db8:1:d550::1234");
+
+  netfilter->RegisterHook (Ipv4NetfilterHook (PF_INET6, NF_INET_POST_ROUTING, NF_IP_PRI_NAT_SRC + 1,
+                                              MakeCallback (&Ipv6NetfilterForwardTestCase::SeenHook, this)));
+  Receive (devs[1], inside, 5000, server, 53);
+  NS_TEST_ASSERT_MSG_EQ (m_seen, 2U, "packet not forwarded");
+  NS_TEST_ASSERT_MSG_EQ (m_seenSource, outside, "source not translated");
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetNConnections (), 1U, "forwarded flow not confirmed");
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetNUnconfirmed (), 0U, "confirmed flow left unconfirmed");
+
+  Receive (devs[0], server, 53, outside, 5000);
+  NS_TEST_ASSERT_MSG_EQ (m_seen, 4U, "reply not forwarded to the inside");
+  NS_TEST_ASSERT_MSG_EQ (m_seenDestination, inside, "destination not translated");
+
+  IpConntrackInfo info;
+  bool found = netfilter->FindConnection (Ipv6ConntrackTuple (inside, 5000, server, 53, 17), info);
+  NS_TEST_ASSERT_MSG_EQ (found, true, "connection not tracked");
+  NS_TEST_ASSERT_MSG_EQ (info.IsConfirmed (), true, "connection not confirmed");
+
+  // the router itself receives a flow, and answers it
+  Receive (devs[0], server, 53, Ipv6Address (addresses[0]), 6000);
+  NS_TEST_ASSERT_MSG_EQ (netfilter->GetNConnections (), 3U, "local flow not confirmed at LOCAL_IN");
+  Ptr<Packet> reply = Create<Packet> (32);
+  UdpHeader udp;
+  udp.SetSourcePort (6000);
+  udp.SetDestinationPort (53);
+  reply->AddHeader (udp);
+  m_ipv6->Send (reply, Ipv6Address (addresses[0]), server, Ipv6Header::IPV6_UDP, 0);
+  found = netfilter->FindConnection (Ipv6ConntrackTuple (server, 53, Ipv6Address (addresses[0]), 6000, 17), info);
+  NS_TEST_ASSERT_MSG_EQ (found, true, "local flow not tracked");
+  bool seenReply = (info.GetStatus () & IPS_SEEN_REPLY) != 0;
+  NS_TEST_ASSERT_MSG_EQ (seenReply, true, "reply from LOCAL_OUT not seen");
+
+  // packets the translation can not handle are dropped
+  Receive (devs[1], Ipv6Address ("fd01:203:405:ffff::1"), 5000, server, 53);
+  NS_TEST_ASSERT_MSG_EQ (npt->GetNDropped (), 1U, "untranslatable packet not dropped");
+
+  m_ipv6 = 0;
+  Simulator::Destroy ();
+}
+
+class Ipv6NetfilterTestSuite : public TestSuite
+{
+public:
+  Ipv6NetfilterTestSuite ();
+};
+
+Ipv6NetfilterTestSuite::Ipv6NetfilterTestSuite ()
+  : TestSuite ("ipv6-netfilter", UNIT)
+{
+  AddTestCase (new Ipv6ConntrackTupleTestCase);
+  AddTestCase (new Ipv6NptRuleTestCase);
+  AddTestCase (new Ipv6NetfilterForwardTestCase);
+}
+
+static Ipv6NetfilterTestSuite ipv6NetfilterTestSuite;
@@ -0,0 +1,236 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * Scaling benchmark of the synchronization of the distributed simulator.
+ *
+ * Each rank runs one router and a number of leaf nodes attached to it.
+ * The routers form a two dimensional torus of as square a shape as the
+ * number of ranks allows, each linked to the next router of its row and
+ * of its column, wrapping around at the edges:
+ *
+ *        |        |        |
+ *   --- r0 ----- r1 ----- r2 ---
+ *        |        |        |
+ *   --- r3 ----- r4 ----- r5 ---
+ *        |        |        |
+ *
+ * Every leaf sends a constant UDP stream to the leaf of the same index of
+ * the next rank of its row, or of its column for odd indices, so that all
+ * traffic between ranks crosses a single torus link.
+ *
+ * With the LBTS synchronization every rank takes part in a global
+ * reduction each time it runs out of granted time; with null messages a
+ * rank only exchanges messages with its four neighbors in the torus.
+ * Compare the wall clock times of both over growing numbers of ranks:
+ *
+ *   mpirun -np 16 ./waf --run "torus-distributed --nullmsg=0"
+ *   mpirun -np 16 ./waf --run "torus-distributed --nullmsg=1"
+ */
+
+#include <cmath>
+#include <iostream>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mpi-interface.h"
+#include "ns3/ipv4-global-routing-helper.h"
+#include "ns3/point-to-point-helper.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-address-helper.h"
+#include "ns3/on-off-helper.h"
+#include "ns3/packet-sink-helper.h"
+#include "ns3/packet-sink.h"
+
+#ifdef NS3_MPI
+#include <mpi.h>
+#endif
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("TorusDistributed");
+
+int
+main (int argc, char *argv[])
+{
+#ifdef NS3_MPI
+  // Distributed simulation setup
+  MpiInterface::Enable (&argc, &argv);
+  GlobalValue::Bind ("SimulatorImplementationType",
+                     StringValue ("ns3::DistributedSimulatorImpl"));
+
+  uint32_t systemId = MpiInterface::GetSystemId ();
+  uint32_t systemCount = MpiInterface::GetSize ();
+
+  bool nullmsg = false;
+  uint32_t nodesPerRank = 8;
+  double tend = 10.0;
+
+  // Parse command line
+  CommandLine cmd;
+  cmd.AddValue ("nullmsg", "Synchronize with null messages instead of LBTS", nullmsg);
+  cmd.AddValue ("nodesPerRank", "Number of leaf nodes on each rank", nodesPerRank);
+  cmd.AddValue ("tend", "Simulation time in seconds", tend);
+  cmd.Parse (argc, argv);
+
+  // Must be set before the first node creates the simulator
+  if (nullmsg)
+    {
+      Config::SetDefault ("ns3::DistributedSimulatorImpl::SynchronizationMode",
+                          StringValue ("NullMessage"));
+    }
+  Config::SetDefault ("ns3::OnOffApplication::PacketSize", UintegerValue (512));
+  Config::SetDefault ("ns3::OnOffApplication::DataRate", StringValue ("100kbps"));
+
+  // The largest number of rows which divides the ranks and is no larger
+  // than the number of columns
+  uint32_t rows = 1;
+  for (uint32_t i = 1; i * i <= systemCount; ++i)
+    {
+      if (systemCount % i == 0)
+        {
+          rows = i;
+        }
+    }
+  uint32_t cols = systemCount / rows;
+
+  // One router and its leaves per rank
+  NodeContainer routers;
+  for (uint32_t r = 0; r < systemCount; ++r)
+    {
+      routers.Add (CreateObject<Node> (r));
+    }
+  std::vector<NodeContainer> leaves (systemCount);
+  for (uint32_t r = 0; r < systemCount; ++r)
+    {
+      leaves[r].Create (nodesPerRank, r);
+    }
+
+  PointToPointHelper routerLink;
+  routerLink.SetDeviceAttribute ("DataRate", StringValue ("100Mbps"));
+  routerLink.SetChannelAttribute ("Delay", StringValue ("1ms"));
+
+  PointToPointHelper leafLink;
+  leafLink.SetDeviceAttribute ("DataRate", StringValue ("10Mbps"));
+  leafLink.SetChannelAttribute ("Delay", StringValue ("100us"));
+
+  InternetStackHelper stack;
+  stack.InstallAll ();
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.0.0.0", "255.255.255.252");
+
+  // Torus links to the right and down; a dimension of two needs a single
+  // link between its routers and a dimension of one none
+  for (uint32_t r = 0; r < systemCount; ++r)
+    {
+      uint32_t row = r / cols;
+      uint32_t col = r % cols;
+      if (cols > 2 || col + 1 < cols)
+        {
+          uint32_t right = row * cols + (col + 1) % cols;
+          address.Assign (routerLink.Install (routers.Get (r), routers.Get (right)));
+          address.NewNetwork ();
+        }
+      if (rows > 2 || row + 1 < rows)
+        {
+          uint32_t down = ((row + 1) % rows) * cols + col;
+          address.Assign (routerLink.Install (routers.Get (r), routers.Get (down)));
+          address.NewNetwork ();
+        }
+    }
+
+  std::vector<Ipv4InterfaceContainer> leafInterfaces (systemCount);
+  for (uint32_t r = 0; r < systemCount; ++r)
+    {
+      for (uint32_t i = 0; i < nodesPerRank; ++i)
+        {
+          Ipv4InterfaceContainer ifc = address.Assign (leafLink.Install (leaves[r].Get (i), routers.Get (r)));
+          leafInterfaces[r].Add (ifc.Get (0));
+          address.NewNetwork ();
+        }
+    }
+
+  Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+
+  // Applications only on the nodes of this rank
+  uint16_t port = 50000;
+  Address sinkLocalAddress (InetSocketAddress (Ipv4Address::GetAny (), port));
+  PacketSinkHelper sinkHelper ("ns3::UdpSocketFactory", sinkLocalAddress);
+  ApplicationContainer sinkApps = sinkHelper.Install (leaves[systemId]);
+  sinkApps.Start (Seconds (0.5));
+  sinkApps.Stop (Seconds (tend));
+
+  OnOffHelper clientHelper ("ns3::UdpSocketFactory", Address ());
+  clientHelper.SetAttribute
+    ("OnTime", StringValue ("ns3::ConstantRandomVariable[Constant=1]"));
+  clientHelper.SetAttribute
+    ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=0]"));
+  ApplicationContainer clientApps;
+  uint32_t row = systemId / cols;
+  uint32_t col = systemId % cols;
+  for (uint32_t i = 0; i < nodesPerRank; ++i)
+    {
+      uint32_t peer;
+      if (i % 2 == 0)
+        {
+          peer = row * cols + (col + 1) % cols;
+        }
+      else
+        {
+          peer = ((row + 1) % rows) * cols + col;
+        }
+      AddressValue remoteAddress
+        (InetSocketAddress (leafInterfaces[peer].GetAddress (i), port));
+      clientHelper.SetAttribute ("Remote", remoteAddress);
+      clientApps.Add (clientHelper.Install (leaves[systemId].Get (i)));
+    }
+  clientApps.Start (Seconds (1.0));
+  clientApps.Stop (Seconds (tend));
+
+  SystemWallClockMs clock;
+  clock.Start ();
+  Simulator::Stop (Seconds (tend));
+  Simulator::Run ();
+  double elapsed = clock.End () / 1000.0;
+
+  unsigned long long rx = 0;
+  for (uint32_t i = 0; i < sinkApps.GetN (); ++i)
+    {
+      rx += DynamicCast<PacketSink> (sinkApps.Get (i))->GetTotalRx ();
+    }
+  double maxElapsed;
+  unsigned long long totalRx;
+  MPI_Reduce (&elapsed, &maxElapsed, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  MPI_Reduce (&rx, &totalRx, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+  if (systemId == 0)
+    {
+      std::cout << "mode=" << (nullmsg ? "NullMessage" : "Lbts")
+                << " ranks=" << systemCount
+                << " torus=" << rows << "x" << cols
+                << " nodes=" << systemCount * (nodesPerRank + 1)
+                << " rx=" << totalRx << "B"
+                << " wall=" << maxElapsed << "s"
+                << std::endl;
+    }
+
+  Simulator::Destroy ();
+  // Exit the MPI execution environment
+  MpiInterface::Disable ();
+  return 0;
+#else
+  NS_FATAL_ERROR ("Can't use distributed simulator without MPI compiled in");
+#endif
+}
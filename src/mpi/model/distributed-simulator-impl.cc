@@ -26,6 +26,7 @@
 #include "ns3/node-container.h"
 #include "ns3/ptr.h"
 #include "ns3/pointer.h"
+#include "ns3/enum.h"
 #include "ns3/assert.h"
 #include "ns3/log.h"
 
@@ -76,6 +77,13 @@ DistributedSimulatorImpl::GetTypeId (void)
   static TypeId tid = TypeId ("ns3::DistributedSimulatorImpl")
     .SetParent<Object> ()
     .AddConstructor<DistributedSimulatorImpl> ()
+    .AddAttribute ("SynchronizationMode",
+                   "How the ranks agree on the time they may advance to: a global "
+                   "lower bound on time stamps, or null messages between neighbor ranks.",
+                   EnumValue (LBTS),
+                   MakeEnumAccessor (&DistributedSimulatorImpl::m_syncMode),
+                   MakeEnumChecker (LBTS, "Lbts",
+                                    NULL_MESSAGE, "NullMessage"))
   ;
   return tid;
 }
@@ -105,6 +113,7 @@ DistributedSimulatorImpl::DistributedSimulatorImpl ()
   m_currentContext = 0xffffffff;
   m_unscheduledEvents = 0;
   m_events = 0;
+  m_syncMode = LBTS;
 }
 
 DistributedSimulatorImpl::~DistributedSimulatorImpl ()
@@ -146,6 +155,7 @@ void
 DistributedSimulatorImpl::CalculateLookAhead (void)
 {
 #ifdef NS3_MPI
+  m_neighbors.clear ();
   if (MpiInterface::GetSize () <= 1)
     {
       DistributedSimulatorImpl::m_lookAhead = Seconds (0);
@@ -207,6 +217,27 @@ DistributedSimulatorImpl::CalculateLookAhead (void)
                   DistributedSimulatorImpl::m_lookAhead = delay.Get ();
                   m_grantedTime = delay.Get ();
                 }
+
+              // and the smallest delay to the rank of the adjacent node
+              std::vector<Neighbor>::iterator n;
+              for (n = m_neighbors.begin (); n != m_neighbors.end (); ++n)
+                {
+                  if (n->rank == remoteNode->GetSystemId ())
+                    {
+                      break;
+                    }
+                }
+              if (n == m_neighbors.end ())
+                {
+                  Neighbor neighbor;
+                  neighbor.rank = remoteNode->GetSystemId ();
+                  neighbor.lookAhead = delay.Get ();
+                  m_neighbors.push_back (neighbor);
+                }
+              else if (delay.Get () < n->lookAhead)
+                {
+                  n->lookAhead = delay.Get ();
+                }
             }
         }
     }
@@ -272,18 +303,39 @@ DistributedSimulatorImpl::Run (void)
 {
 #ifdef NS3_MPI
   CalculateLookAhead ();
+  if (m_syncMode == NULL_MESSAGE)
+    {
+      for (std::vector<Neighbor>::iterator n = m_neighbors.begin (); n != m_neighbors.end (); ++n)
+        {
+          if (!n->lookAhead.IsStrictlyPositive ())
+            {
+              NS_FATAL_ERROR ("Null message synchronization needs a delay on the channels to rank " << n->rank);
+            }
+          n->guarantee = TimeStep (m_currentTs) + n->lookAhead;
+          n->sent = Seconds (0);
+        }
+      m_grantedTime = TimeStep (m_currentTs);
+    }
   m_stop = false;
-  while (!m_events->IsEmpty () && !m_stop)
+  // With null messages, a rank without events may still get packets from
+  // its neighbors until they have finished
+  while (!m_stop && (!m_events->IsEmpty ()
+                     || (m_syncMode == NULL_MESSAGE && !NeighborsFinished ())))
     {
-      Time nextTime = Next ();
+      Time nextTime = m_events->IsEmpty () ? GetMaximumSimulationTime () : Next ();
       if (nextTime > m_grantedTime)
         { // Can't process, calculate a new LBTS
           // First receive any pending messages
           MpiInterface::ReceiveMessages ();
           // reset next time
-          nextTime = Next ();
+          nextTime = m_events->IsEmpty () ? GetMaximumSimulationTime () : Next ();
           // And check for send completes
           MpiInterface::TestSendComplete ();
+          if (m_syncMode == NULL_MESSAGE)
+            {
+              ExchangeNullMessages (nextTime);
+              continue;
+            }
           // Finally calculate the lbts
           LbtsMessage lMsg (MpiInterface::GetRxCount (), MpiInterface::GetTxCount (), m_myId, nextTime);
           m_pLBTS[m_myId] = lMsg;
@@ -317,6 +369,26 @@ DistributedSimulatorImpl::Run (void)
         }
     }
 
+  if (m_syncMode == NULL_MESSAGE)
+    {
+      // This rank sends no more packets, so its neighbors need not wait for it
+      for (std::vector<Neighbor>::iterator n = m_neighbors.begin (); n != m_neighbors.end (); ++n)
+        {
+          if (n->sent < GetMaximumSimulationTime ())
+            {
+              MpiInterface::SendNullMessage (n->rank, GetMaximumSimulationTime ());
+              n->sent = GetMaximumSimulationTime ();
+            }
+        }
+      // After a stop, the neighbors may still be sending; their packets
+      // must have arrived before MpiInterface::Destroy cancels the receives
+      while (!NeighborsFinished ())
+        {
+          MpiInterface::ReceiveMessages ();
+          MpiInterface::TestSendComplete ();
+        }
+    }
+
   // If the simulator stopped naturally by lack of events, make a
   // consistency test to check that we didn't lose any events along the way.
   NS_ASSERT (!m_events->IsEmpty () || m_unscheduledEvents == 0);
@@ -325,6 +397,58 @@ DistributedSimulatorImpl::Run (void)
 #endif
 }
 
+void
+DistributedSimulatorImpl::ExchangeNullMessages (Time nextTime)
+{
+  NS_LOG_FUNCTION (this << nextTime);
+#ifdef NS3_MPI
+  Time maxTime = GetMaximumSimulationTime ();
+  // No packets arrive before the earliest promise of the neighbors
+  Time granted = maxTime;
+  for (std::vector<Neighbor>::const_iterator n = m_neighbors.begin (); n != m_neighbors.end (); ++n)
+    {
+      granted = Min (granted, Max (n->guarantee, MpiInterface::GetNullMessageGuarantee (n->rank)));
+    }
+  // a packet may arrive at the promised time itself
+  if (granted - TimeStep (1) > m_grantedTime)
+    {
+      m_grantedTime = granted - TimeStep (1);
+    }
+
+  // Nothing is sent before the next event, or before a packet which
+  // may still arrive
+  Time earliest = Min (nextTime, granted);
+  for (std::vector<Neighbor>::iterator n = m_neighbors.begin (); n != m_neighbors.end (); ++n)
+    {
+      Time guarantee = earliest < maxTime - n->lookAhead ? earliest + n->lookAhead : maxTime;
+      if (guarantee > n->sent)
+        {
+          MpiInterface::SendNullMessage (n->rank, guarantee);
+          n->sent = guarantee;
+        }
+    }
+#else
+  NS_FATAL_ERROR ("Can't use distributed simulator without MPI compiled in");
+#endif
+}
+
+bool
+DistributedSimulatorImpl::NeighborsFinished (void) const
+{
+#ifdef NS3_MPI
+  // a neighbor which has finished promised the maximum simulation time,
+  // and the promise only counts once all its packets have arrived
+  for (std::vector<Neighbor>::const_iterator n = m_neighbors.begin (); n != m_neighbors.end (); ++n)
+    {
+      if (MpiInterface::GetNullMessageGuarantee (n->rank) < GetMaximumSimulationTime ())
+        {
+          return false;
+        }
+    }
+#endif
+  return true;
+}
+
 uint32_t DistributedSimulatorImpl::GetSystemId () const
 {
   return m_myId;
@@ -25,6 +25,7 @@
 #include "ns3/ptr.h"
 
 #include <list>
+#include <vector>
 
 namespace ns3 {
 
@@ -87,10 +88,36 @@ private:
  * \ingroup mpi
  *
  * \brief distributed simulator implementation using lookahead
+ *
+ * Each rank runs the nodes of its system id and may only process the
+ * events before the time granted by the other ranks. The
+ * SynchronizationMode attribute selects how that time is computed:
+ *
+ * - Lbts: every rank blocks in a global MPI_Allgather of its next event
+ *   time and message counts each time it runs out of granted time, and
+ *   all ranks are granted the smallest next event time plus the smallest
+ *   delay of the point to point channels between ranks.
+ * - NullMessage: the Chandy-Misra-Bryant algorithm. A rank only exchanges
+ *   messages with the ranks its point to point channels lead to, with the
+ *   smallest delay of the channels to each as its lookahead. When it runs
+ *   out of granted time, it sends each neighbor a null message promising
+ *   no packets before its next event time, or the time granted by its
+ *   neighbors if earlier, plus the lookahead to that neighbor. It is
+ *   granted the time before the earliest promise of its neighbors. Every
+ *   channel between ranks needs a delay for the null messages to advance.
  */
 class DistributedSimulatorImpl : public SimulatorImpl
 {
 public:
+  /**
+   * How the ranks agree on the time they may advance to
+   */
+  enum SynchronizationMode
+  {
+    LBTS,
+    NULL_MESSAGE
+  };
+
   static TypeId GetTypeId (void);
 
   DistributedSimulatorImpl ();
@@ -117,8 +144,19 @@ public:
   virtual uint32_t GetContext (void) const;
 
 private:
+  /* A rank the point to point channels of this one lead to */
+  struct Neighbor
+  {
+    uint32_t rank;
+    Time lookAhead;   // smallest delay of the channels to it
+    Time guarantee;   // no packets from it arrive before this at the start
+    Time sent;        // last guarantee sent to it
+  };
+
   virtual void DoDispose (void);
   void CalculateLookAhead (void);
+  void ExchangeNullMessages (Time nextTime);
+  bool NeighborsFinished (void) const;
 
   void ProcessOneEvent (void);
   uint64_t NextTs (void) const;
@@ -141,7 +179,8 @@ private:
   uint32_t     m_systemCount; // MPI Size
   Time         m_grantedTime; // Last LBTS
   static Time  m_lookAhead;   // Lookahead value
-
+  SynchronizationMode m_syncMode;
+  std::vector<Neighbor> m_neighbors;
 };
 
 } // namespace ns3
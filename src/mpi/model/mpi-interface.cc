@@ -22,6 +22,7 @@
 #include <iostream>
 #include <iomanip>
 #include <list>
+#include <algorithm>
 
 #include "mpi-interface.h"
 #include "mpi-receiver.h"
@@ -39,6 +40,10 @@
 
 namespace ns3 {
 
+// A message for this node is a null message, which carries the number of
+// packets sent to the rank before it in place of the device
+static const uint32_t NULL_MESSAGE_NODE = 0xffffffff;
+
 SentBuffer::SentBuffer ()
 {
   m_buffer = 0;
@@ -77,24 +82,60 @@ bool                  MpiInterface::m_enabled = false;
 uint32_t              MpiInterface::m_rxCount = 0;
 uint32_t              MpiInterface::m_txCount = 0;
 std::list<SentBuffer> MpiInterface::m_pendingTx;
+std::vector<uint32_t> MpiInterface::m_txCounts;
+std::vector<uint32_t> MpiInterface::m_rxCounts;
+std::vector<Time>     MpiInterface::m_guarantees;
+std::vector<Time>     MpiInterface::m_pendingGuarantees;
+std::vector<uint32_t> MpiInterface::m_pendingCounts;
 
 #ifdef NS3_MPI
-MPI_Request* MpiInterface::m_requests;
-char**       MpiInterface::m_pRxBuffers;
+MPI_Request* MpiInterface::m_requests = 0;
+char**       MpiInterface::m_pRxBuffers = 0;
 #endif
 
 void
 MpiInterface::Destroy ()
 {
 #ifdef NS3_MPI
+  if (m_pRxBuffers == 0)
+    {
+      return;
+    }
+  // Cancel the receives still posted, and wait until MPI is done with
+  // their buffers, whether the cancel succeeded or a message came first
+  for (uint32_t i = 0; i < GetSize (); ++i)
+    {
+      MPI_Cancel (&m_requests[i]);
+      MPI_Wait (&m_requests[i], MPI_STATUS_IGNORE);
+    }
+  // The buffers of the sends must outlive them
+  std::vector<MPI_Request> sends;
+  for (std::list<SentBuffer>::iterator i = m_pendingTx.begin (); i != m_pendingTx.end (); ++i)
+    {
+      sends.push_back (*i->GetRequest ());
+    }
+  if (!sends.empty ())
+    {
+      MPI_Waitall (sends.size (), &sends[0], MPI_STATUSES_IGNORE);
+    }
+  // No rank goes on to MPI_Finalize while another one still talks to it
+  MPI_Barrier (MPI_COMM_WORLD);
+
   for (uint32_t i = 0; i < GetSize (); ++i)
     {
       delete [] m_pRxBuffers[i];
     }
   delete [] m_pRxBuffers;
   delete [] m_requests;
+  m_pRxBuffers = 0;
+  m_requests = 0;
 
   m_pendingTx.clear ();
+  m_txCounts.clear ();
+  m_rxCounts.clear ();
+  m_guarantees.clear ();
+  m_pendingGuarantees.clear ();
+  m_pendingCounts.clear ();
 #endif
 }
 
@@ -163,6 +204,11 @@ MpiInterface::Enable (int* pargc, char*** pargv)
       MPI_Irecv (m_pRxBuffers[i], MAX_MPI_MSG_SIZE, MPI_CHAR, MPI_ANY_SOURCE, 0,
                  MPI_COMM_WORLD, &m_requests[i]);
     }
+  m_txCounts.assign (m_size, 0);
+  m_rxCounts.assign (m_size, 0);
+  m_guarantees.assign (m_size, Seconds (0));
+  m_pendingGuarantees.assign (m_size, Seconds (0));
+  m_pendingCounts.assign (m_size, 0);
 #else
   NS_FATAL_ERROR ("Can't use distributed simulator without MPI compiled in");
 #endif
@@ -196,8 +242,46 @@ MpiInterface::SendPacket (Ptr<Packet> p, const Time& rxTime, uint32_t node, uint
   MPI_Isend (reinterpret_cast<void *> (i->GetBuffer ()), serializedSize + 16, MPI_CHAR, nodeSysId,
              0, MPI_COMM_WORLD, (i->GetRequest ()));
   m_txCount++;
+  m_txCounts[nodeSysId]++;
+#else
+  NS_FATAL_ERROR ("Can't use distributed simulator without MPI compiled in");
+#endif
+}
+
+void
+MpiInterface::SendNullMessage (uint32_t rank, const Time &guarantee)
+{
+#ifdef NS3_MPI
+  SentBuffer sendBuf;
+  m_pendingTx.push_back (sendBuf);
+  std::list<SentBuffer>::reverse_iterator i = m_pendingTx.rbegin (); // Points to the last element
+
+  // Same layout as a packet: the guarantee, the marker node and the
+  // number of packets sent to the rank so far
+  uint8_t* buffer = new uint8_t[16];
+  i->SetBuffer (buffer);
+  uint64_t t = guarantee.GetNanoSeconds ();
+  uint64_t* pTime = reinterpret_cast <uint64_t *> (buffer);
+  *pTime++ = t;
+  uint32_t* pData = reinterpret_cast<uint32_t *> (pTime);
+  *pData++ = NULL_MESSAGE_NODE;
+  *pData++ = m_txCounts[rank];
+
+  MPI_Isend (reinterpret_cast<void *> (i->GetBuffer ()), 16, MPI_CHAR, rank,
+             0, MPI_COMM_WORLD, (i->GetRequest ()));
+#else
+  NS_FATAL_ERROR ("Can't use distributed simulator without MPI compiled in");
+#endif
+}
+
+Time
+MpiInterface::GetNullMessageGuarantee (uint32_t rank)
+{
+#ifdef NS3_MPI
+  return m_guarantees[rank];
 #else
   NS_FATAL_ERROR ("Can't use distributed simulator without MPI compiled in");
+  return Seconds (0);
 #endif
 }
 
@@ -218,7 +302,7 @@ MpiInterface::ReceiveMessages ()
         }
       int count;
       MPI_Get_count (&status, MPI_CHAR, &count);
-      m_rxCount++; // Count this receive
+      uint32_t source = status.MPI_SOURCE;
 
       // Get the meta data first
       uint64_t* pTime = reinterpret_cast<uint64_t *> (m_pRxBuffers[index]);
@@ -229,6 +313,30 @@ MpiInterface::ReceiveMessages ()
 
       Time rxTime = NanoSeconds (nanoSeconds);
 
+      if (node == NULL_MESSAGE_NODE)
+        {
+          // dev is the number of packets the rank sent before this message
+          if (m_rxCounts[source] >= dev)
+            {
+              m_guarantees[source] = Max (m_guarantees[source], rxTime);
+            }
+          else
+            {
+              m_pendingGuarantees[source] = Max (m_pendingGuarantees[source], rxTime);
+              m_pendingCounts[source] = std::max (m_pendingCounts[source], dev);
+            }
+          MPI_Irecv (m_pRxBuffers[index], MAX_MPI_MSG_SIZE, MPI_CHAR, MPI_ANY_SOURCE, 0,
+                     MPI_COMM_WORLD, &m_requests[index]);
+          continue;
+        }
+      m_rxCount++; // Count this receive
+      m_rxCounts[source]++;
+      if (m_pendingCounts[source] != 0 && m_rxCounts[source] >= m_pendingCounts[source])
+        {
+          m_guarantees[source] = Max (m_guarantees[source], m_pendingGuarantees[source]);
+          m_pendingCounts[source] = 0;
+        }
+
       count -= sizeof (nanoSeconds) + sizeof (node) + sizeof (dev);
 
       Ptr<Packet> p = Create<Packet> (reinterpret_cast<uint8_t *> (pData), count, true);
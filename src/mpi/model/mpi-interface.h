@@ -24,6 +24,7 @@
 
 #include <stdint.h>
 #include <list>
+#include <vector>
 
 #include "ns3/nstime.h"
 #include "ns3/buffer.h"
@@ -90,7 +91,8 @@ class MpiInterface
 {
 public:
   /**
-   * Delete all buffers
+   * Cancel the receives still posted, wait for the sends to complete and
+   * for all ranks to get here, then delete all buffers
    */
   static void Destroy ();
   /**
@@ -143,6 +145,23 @@ public:
    * \return transmitted count in packets
    */
   static uint32_t GetTxCount ();
+  /**
+   * \param rank rank to send the null message to
+   * \param guarantee time before which this rank will send no more
+   * packets to that rank
+   *
+   * Send a null message of the null message synchronization
+   */
+  static void SendNullMessage (uint32_t rank, const Time &guarantee);
+  /**
+   * \param rank rank this one has links to
+   * \return the time before which no more packets from that rank will
+   * arrive, as promised by the null messages received from it so far
+   *
+   * A null message only counts once the packets sent before it have
+   * arrived, even if MPI completes the receives out of order.
+   */
+  static Time GetNullMessageGuarantee (uint32_t rank);
 
 private:
   static uint32_t m_sid;
@@ -164,6 +183,15 @@ private:
 
   // List of pending non-blocking sends
   static std::list<SentBuffer> m_pendingTx;
+
+  // Packets sent to and received from each rank
+  static std::vector<uint32_t> m_txCounts;
+  static std::vector<uint32_t> m_rxCounts;
+  // Guarantee of the last null message received from each rank which
+  // counts, and of a later one still waiting for the packets sent before it
+  static std::vector<Time> m_guarantees;
+  static std::vector<Time> m_pendingGuarantees;
+  static std::vector<uint32_t> m_pendingCounts;
 };
 
 } // namespace ns3
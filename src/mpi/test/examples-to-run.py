@@ -0,0 +1,30 @@
+#! /usr/bin/env python
+## -*- Mode: python; py-indent-offset: 4; indent-tabs-mode: nil; coding: utf-8; -*-
+
+# A list of C++ examples to run in order to ensure that they remain
+# buildable and runnable over time.  Each tuple in the list contains
+#
+#     (example_name, do_run, do_valgrind_run).
+#
+# See test.py for more information.
+cpp_examples = []
+
+# A list of Python examples to run in order to ensure that they remain
+# runnable over time.  Each tuple in the list contains
+#
+#     (example_name, do_run).
+#
+# See test.py for more information.
+python_examples = []
+
+# A list of distributed C++ examples to run under mpiexec.  Each tuple in
+# the list contains
+#
+#     (example_name, ranks, do_run, expected_output).
+#
+# Both synchronization modes must deliver the same packets on a torus of
+# four ranks.  See test.py for more information.
+mpi_examples = [
+    ("torus-distributed --nullmsg=0", 4, "ENABLE_MPI == True", "^mode=Lbts ranks=4 .* rx=3588096B "),
+    ("torus-distributed --nullmsg=1", 4, "ENABLE_MPI == True", "^mode=NullMessage ranks=4 .* rx=3588096B "),
+]
@@ -0,0 +1,1363 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "multithreaded-simulator-impl.h"
+
+#include "ns3/simulator.h"
+#include "ns3/make-event.h"
+#include "ns3/node-list.h"
+#include "ns3/node.h"
+#include "ns3/net-device.h"
+#include "ns3/channel.h"
+#include "ns3/packet.h"
+#include "ns3/rng-seed-manager.h"
+#include "ns3/nstime.h"
+#include "ns3/assert.h"
+#include "ns3/log.h"
+
+#include <algorithm>
+#include <sched.h>
+
+// Note:  Logging in this file is largely avoided due to the
+// number of calls that are made to these functions and the possibility
+// of causing recursions leading to stack overflow
+
+NS_LOG_COMPONENT_DEFINE ("MultithreadedSimulatorImpl");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (MultithreadedSimulatorImpl);
+
+static const uint64_t MAX_TS = 0xffffffffffffffffULL;
+// the rank of an event before the end of its window: the index of its
+// entry among those of the window
+static const uint64_t TENTATIVE = 0x8000000000000000ULL;
+static const uint32_t NO_ENTRY = 0xffffffff;
+// spins of a thread waiting at the barrier before it yields the processor
+static const uint32_t BARRIER_SPINS = 1000;
+
+/*
+ * An event of a partition which scheduled events: the local events with
+ * uids from firstUid up to the next entry were scheduled by it.
+ */
+struct MultithreadedSimulatorImpl::Entry
+{
+  uint32_t firstUid;
+  // local events it scheduled which are still pending
+  uint32_t pending;
+  uint64_t ts;
+  uint64_t rank;
+  // where the event itself was scheduled, to rank it
+  Origin origin;
+
+  static bool IsUidBefore (uint32_t uid, const Entry &entry)
+  {
+    return uid < entry.firstUid;
+  }
+  static bool IsEarlier (const Entry &a, const Entry &b)
+  {
+    return a.firstUid < b.firstUid;
+  }
+  static bool IsDone (const Entry &entry)
+  {
+    return entry.pending == 0;
+  }
+};
+
+/* The events of the nodes of one system id */
+struct MultithreadedSimulatorImpl::Partition
+{
+  uint32_t id;
+  Ptr<Scheduler> events;
+  // events from other partitions, a heap ordered by RemoteEventLater,
+  // and those received while their sources ran the window they were
+  // sent in, whose origins are not ranked yet
+  std::vector<RemoteEvent> remote;
+  std::vector<RemoteEvent> unranked;
+  uint64_t currentTs;
+  uint32_t currentUid;
+  uint32_t currentContext;
+  Origin currentOrigin;
+  // entry of the current event, NO_ENTRY until it schedules an event
+  uint32_t currentEntry;
+  uint32_t nUids;
+  int unscheduledEvents;
+  bool stop;
+  bool barrierSense;
+  // ordered by uid; those from windowFirst on were run in the current
+  // window and have tentative ranks
+  std::vector<Entry> entries;
+  uint32_t windowFirst;
+  uint32_t pruneSize;
+  // final ranks of the entries of the last window
+  std::vector<uint64_t> windowRanks;
+  // events without a node context scheduled in the window
+  std::vector<RemoteEvent> global;
+  // first pending event, and earliest event sent to other partitions,
+  // after the last window
+  Key next;
+  Key nextSent;
+};
+
+/*
+ * A single producer, single consumer queue of remote events. Events are
+ * written to blocks which the producer links, and published by the size
+ * of their block; the consumer frees a block once it has read it and the
+ * producer has moved on to the next.
+ */
+class MultithreadedSimulatorImpl::RemoteEventQueue
+{
+public:
+  RemoteEventQueue ();
+  ~RemoteEventQueue ();
+  void Push (const RemoteEvent &ev);
+  bool Pop (RemoteEvent &ev);
+private:
+  enum { BLOCK_SIZE = 256 };
+  struct Block
+  {
+    RemoteEvent events[BLOCK_SIZE];
+    volatile uint32_t size;
+    Block * volatile next;
+  };
+  static Block *AllocateBlock (void);
+
+  // read by the consumer only
+  Block *m_head;
+  uint32_t m_read;
+  // written by the producer only
+  Block *m_tail;
+};
+
+MultithreadedSimulatorImpl::RemoteEventQueue::RemoteEventQueue ()
+  : m_head (AllocateBlock ()),
+    m_read (0),
+    m_tail (m_head)
+{
+}
+
+MultithreadedSimulatorImpl::RemoteEventQueue::~RemoteEventQueue ()
+{
+  while (m_head != 0)
+    {
+      Block *next = m_head->next;
+      delete m_head;
+      m_head = next;
+    }
+}
+
+MultithreadedSimulatorImpl::RemoteEventQueue::Block *
+MultithreadedSimulatorImpl::RemoteEventQueue::AllocateBlock (void)
+{
+  Block *block = new Block;
+  block->size = 0;
+  block->next = 0;
+  return block;
+}
+
+void
+MultithreadedSimulatorImpl::RemoteEventQueue::Push (const RemoteEvent &ev)
+{
+  if (m_tail->size == BLOCK_SIZE)
+    {
+      Block *block = AllocateBlock ();
+      __sync_synchronize ();
+      m_tail->next = block;
+      m_tail = block;
+    }
+  uint32_t size = m_tail->size;
+  m_tail->events[size] = ev;
+  // the event must be written before it is published
+  __sync_synchronize ();
+  m_tail->size = size + 1;
+}
+
+bool
+MultithreadedSimulatorImpl::RemoteEventQueue::Pop (RemoteEvent &ev)
+{
+  if (m_read == BLOCK_SIZE)
+    {
+      Block *next = m_head->next;
+      if (next == 0)
+        {
+          return false;
+        }
+      __sync_synchronize ();
+      delete m_head;
+      m_head = next;
+      m_read = 0;
+    }
+  if (m_read == m_head->size)
+    {
+      return false;
+    }
+  __sync_synchronize ();
+  ev = m_head->events[m_read];
+  m_read++;
+  return true;
+}
+
+bool
+MultithreadedSimulatorImpl::RemoteEventLater::operator () (const RemoteEvent &a, const RemoteEvent &b) const
+{
+  if (a.ts != b.ts)
+    {
+      return a.ts > b.ts;
+    }
+  return b.origin < a.origin;
+}
+
+__thread MultithreadedSimulatorImpl::Partition *MultithreadedSimulatorImpl::m_current = 0;
+
+TypeId
+MultithreadedSimulatorImpl::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::MultithreadedSimulatorImpl")
+    .SetParent<SimulatorImpl> ()
+    .AddConstructor<MultithreadedSimulatorImpl> ()
+  ;
+  return tid;
+}
+
+MultithreadedSimulatorImpl::MultithreadedSimulatorImpl ()
+{
+  NS_LOG_FUNCTION (this);
+  m_stop = false;
+  // uids are allocated from 4, as in DefaultSimulatorImpl.
+  // uid 0 is "invalid" events
+  // uid 1 is "now" events
+  // uid 2 is "destroy" events
+  m_uid = 4;
+  // before ::Run is entered, the m_currentUid will be zero
+  m_currentUid = 0;
+  m_currentTs = 0;
+  m_currentContext = 0xffffffff;
+  m_unscheduledEvents = 0;
+  m_running = false;
+  m_lookAhead = GetMaximumSimulationTime ();
+  m_uidBase = 0;
+  m_globalUids = 0;
+  m_rank = 0;
+  m_currentRank = 0;
+  m_window = 0;
+  m_windowEnd = NoKey ();
+  m_globalSent = NoKey ();
+  m_done = false;
+  m_barrierCount = 0;
+  m_barrierSense = false;
+}
+
+MultithreadedSimulatorImpl::~MultithreadedSimulatorImpl ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+MultithreadedSimulatorImpl::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  while (!m_events->IsEmpty ())
+    {
+      Scheduler::Event next = m_events->RemoveNext ();
+      next.impl->Unref ();
+    }
+  m_events = 0;
+  m_globalEvents = 0;
+  for (std::vector<RemoteEvent>::iterator i = m_carriedRemote.begin (); i != m_carriedRemote.end (); ++i)
+    {
+      i->impl->Unref ();
+    }
+  m_carriedRemote.clear ();
+  SimulatorImpl::DoDispose ();
+}
+
+void
+MultithreadedSimulatorImpl::Destroy ()
+{
+  NS_LOG_FUNCTION (this);
+  while (!m_destroyEvents.empty ())
+    {
+      Ptr<EventImpl> ev = m_destroyEvents.front ().PeekEventImpl ();
+      m_destroyEvents.pop_front ();
+      NS_LOG_LOGIC ("handle destroy " << ev);
+      if (!ev->IsCancelled ())
+        {
+          ev->Invoke ();
+        }
+    }
+}
+
+void
+MultithreadedSimulatorImpl::SetScheduler (ObjectFactory schedulerFactory)
+{
+  NS_LOG_FUNCTION (this << schedulerFactory);
+  NS_ASSERT (!m_running);
+  Ptr<Scheduler> scheduler = schedulerFactory.Create<Scheduler> ();
+
+  if (m_events != 0)
+    {
+      while (!m_events->IsEmpty ())
+        {
+          Scheduler::Event next = m_events->RemoveNext ();
+          scheduler->Insert (next);
+        }
+    }
+  m_events = scheduler;
+  m_schedulerFactory = schedulerFactory;
+}
+
+uint32_t
+MultithreadedSimulatorImpl::GetSystemId (void) const
+{
+  return m_current != 0 ? m_current->id : 0;
+}
+
+Time
+MultithreadedSimulatorImpl::GetLookAhead (void) const
+{
+  return m_lookAhead;
+}
+
+uint32_t
+MultithreadedSimulatorImpl::GetPartition (uint32_t context) const
+{
+  if (context >= m_nodePartitions.size ())
+    {
+      NS_FATAL_ERROR ("Event for node " << context << ", which did not exist when the simulation started");
+    }
+  return m_nodePartitions[context];
+}
+
+uint32_t
+MultithreadedSimulatorImpl::AllocateUid (uint32_t partition)
+{
+  uint32_t n = m_partitions.size ();
+  uint32_t k = partition == n ? m_globalUids++ : m_partitions[partition]->nUids++;
+  return m_uidBase + partition + k * (n + 1);
+}
+
+MultithreadedSimulatorImpl::Key
+MultithreadedSimulatorImpl::NoKey (void)
+{
+  Key key = { MAX_TS, { 0, 0, 0 } };
+  return key;
+}
+
+uint64_t
+MultithreadedSimulatorImpl::EnsureEntry (Partition *partition)
+{
+  if (partition->currentEntry == NO_ENTRY)
+    {
+      Entry entry;
+      entry.firstUid = m_uidBase + partition->id + partition->nUids * (m_partitions.size () + 1);
+      entry.pending = 0;
+      entry.ts = partition->currentTs;
+      entry.rank = TENTATIVE | (partition->entries.size () - partition->windowFirst);
+      entry.origin = partition->currentOrigin;
+      partition->currentEntry = partition->entries.size ();
+      partition->entries.push_back (entry);
+    }
+  return partition->entries[partition->currentEntry].rank;
+}
+
+MultithreadedSimulatorImpl::Entry *
+MultithreadedSimulatorImpl::FindEntry (Partition *partition, uint32_t uid) const
+{
+  std::vector<Entry>::iterator i =
+    std::upper_bound (partition->entries.begin (), partition->entries.end (), uid, Entry::IsUidBefore);
+  NS_ASSERT (i != partition->entries.begin ());
+  --i;
+  return &*i;
+}
+
+MultithreadedSimulatorImpl::Key
+MultithreadedSimulatorImpl::GetLocalKey (Partition *partition, const Scheduler::Event &ev) const
+{
+  const Entry *entry = FindEntry (partition, ev.key.m_uid);
+  Key key = { ev.key.m_ts, { entry->ts, entry->rank, ev.key.m_uid } };
+  return key;
+}
+
+MultithreadedSimulatorImpl::Origin
+MultithreadedSimulatorImpl::Resolve (const Partition *partition, Origin origin) const
+{
+  if (origin.rank & TENTATIVE)
+    {
+      origin.rank = partition->windowRanks[origin.rank & ~TENTATIVE];
+    }
+  return origin;
+}
+
+void
+MultithreadedSimulatorImpl::CalculateLookAhead (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_lookAhead = GetMaximumSimulationTime ();
+  for (NodeList::Iterator i = NodeList::Begin (); i != NodeList::End (); ++i)
+    {
+      Ptr<Node> node = *i;
+      for (uint32_t j = 0; j < node->GetNDevices (); ++j)
+        {
+          Ptr<Channel> channel = node->GetDevice (j)->GetChannel ();
+          if (channel == 0)
+            {
+              continue;
+            }
+          for (uint32_t k = 0; k < channel->GetNDevices (); ++k)
+            {
+              if (channel->GetDevice (k)->GetNode ()->GetSystemId () == node->GetSystemId ())
+                {
+                  continue;
+                }
+              // only the point to point channel hands its packets over to
+              // the receiving partition by value
+              std::string name = channel->GetInstanceTypeId ().GetName ();
+              if (name != "ns3::PointToPointChannel")
+                {
+                  NS_FATAL_ERROR ("A " << name << " joins nodes of different system ids;"
+                                  " only point to point links may join partitions");
+                }
+              TimeValue delay;
+              if (!channel->GetAttributeFailSafe ("Delay", delay) || !delay.Get ().IsStrictlyPositive ())
+                {
+                  NS_FATAL_ERROR ("A point to point link between nodes of different system ids needs a delay");
+                }
+              m_lookAhead = Min (m_lookAhead, delay.Get ());
+            }
+        }
+    }
+  NS_LOG_LOGIC ("lookahead " << m_lookAhead);
+}
+
+void
+MultithreadedSimulatorImpl::StartPartitions (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_nodePartitions.clear ();
+  uint32_t n = 1;
+  for (NodeList::Iterator i = NodeList::Begin (); i != NodeList::End (); ++i)
+    {
+      uint32_t systemId = (*i)->GetSystemId ();
+      m_nodePartitions.push_back (systemId);
+      n = std::max (n, systemId + 1);
+    }
+  CalculateLookAhead ();
+
+  m_uidBase = m_uid;
+  m_globalUids = 0;
+  m_globalEvents = m_schedulerFactory.Create<Scheduler> ();
+  for (uint32_t i = 0; i < n; i++)
+    {
+      Partition *p = new Partition ();
+      p->id = i;
+      p->events = m_schedulerFactory.Create<Scheduler> ();
+      p->currentTs = m_currentTs;
+      p->currentUid = m_currentUid;
+      p->currentContext = 0xffffffff;
+      p->currentEntry = NO_ENTRY;
+      p->nUids = 0;
+      p->unscheduledEvents = 0;
+      p->stop = false;
+      p->barrierSense = false;
+      p->windowFirst = 0;
+      p->pruneSize = 1024;
+      p->nextSent = NoKey ();
+      m_partitions.push_back (p);
+    }
+  while (m_packetUids.size () < n)
+    {
+      m_packetUids.push_back (0);
+      m_streamIndices.push_back ((uint64_t) m_streamIndices.size () << 48);
+    }
+  m_queues.assign ((n + 1) * n, 0);
+  for (uint32_t source = 0; source <= n; source++)
+    {
+      for (uint32_t destination = 0; destination < n; destination++)
+        {
+          if (source != destination)
+            {
+              m_queues[source * n + destination] = new RemoteEventQueue ();
+            }
+        }
+    }
+
+  // the events of the nodes go to their partitions, keeping their uids.
+  // An event left by the last run keeps its origin; one scheduled since
+  // comes after all events run so far, in the order of its uid.
+  uint64_t rankBase = m_rank;
+  while (!m_events->IsEmpty ())
+    {
+      Scheduler::Event ev = m_events->RemoveNext ();
+      Origin origin;
+      std::map<uint32_t, Origin>::iterator carried = m_carriedOrigins.find (ev.key.m_uid);
+      if (carried != m_carriedOrigins.end ())
+        {
+          origin = carried->second;
+        }
+      else
+        {
+          origin.ts = m_currentTs;
+          origin.rank = rankBase + ev.key.m_uid;
+          origin.uid = ev.key.m_uid;
+        }
+      if (ev.key.m_context == 0xffffffff)
+        {
+          m_globalEvents->Insert (ev);
+          m_globalOrigins[ev.key.m_uid] = origin;
+        }
+      else
+        {
+          Partition *p = m_partitions[GetPartition (ev.key.m_context)];
+          p->events->Insert (ev);
+          // an entry of its own, as if its origin had scheduled only it
+          Entry entry;
+          entry.firstUid = ev.key.m_uid;
+          entry.pending = 1;
+          entry.ts = origin.ts;
+          entry.rank = origin.rank;
+          entry.origin = origin;
+          p->entries.push_back (entry);
+          p->unscheduledEvents++;
+          m_unscheduledEvents--;
+        }
+    }
+  m_carriedOrigins.clear ();
+  m_rank = rankBase + m_uid;
+  for (uint32_t i = 0; i < n; i++)
+    {
+      Partition *p = m_partitions[i];
+      std::sort (p->entries.begin (), p->entries.end (), Entry::IsEarlier);
+      p->windowFirst = p->entries.size ();
+    }
+  for (std::vector<RemoteEvent>::iterator i = m_carriedRemote.begin (); i != m_carriedRemote.end (); ++i)
+    {
+      Partition *p = m_partitions[GetPartition (i->context)];
+      p->remote.push_back (*i);
+      std::push_heap (p->remote.begin (), p->remote.end (), RemoteEventLater ());
+      p->unscheduledEvents++;
+      m_unscheduledEvents--;
+    }
+  m_carriedRemote.clear ();
+
+  if (n > 1)
+    {
+      Packet::SetThreadSafe (true);
+    }
+  m_running = true;
+  m_done = false;
+  m_barrierCount = 0;
+  m_barrierSense = false;
+  m_globalSent = NoKey ();
+  NextWindow ();
+  for (uint32_t i = 1; i < n; i++)
+    {
+      Ptr<SystemThread> thread = Create<SystemThread> (
+          MakeCallback (&MultithreadedSimulatorImpl::RunPartition, this).Bind (m_partitions[i]));
+      m_threads.push_back (thread);
+      thread->Start ();
+    }
+}
+
+void
+MultithreadedSimulatorImpl::StopPartitions (void)
+{
+  NS_LOG_FUNCTION (this);
+  for (uint32_t i = 0; i < m_threads.size (); i++)
+    {
+      m_threads[i]->Join ();
+    }
+  m_threads.clear ();
+  uint32_t n = m_partitions.size ();
+  if (n > 1)
+    {
+      Packet::SetThreadSafe (false);
+    }
+  m_running = false;
+
+  // A partition which stopped the simulation left its events from its
+  // own time on, the others all those after the window: the time of the
+  // earliest such partition is the time the simulation stopped at.
+  // Otherwise every event left is after the last window.
+  Partition *stopped = 0;
+  Partition *latest = 0;
+  for (uint32_t i = 0; i < n; i++)
+    {
+      Partition *p = m_partitions[i];
+      if (p->stop && (stopped == 0 || p->currentTs < stopped->currentTs))
+        {
+          stopped = p;
+        }
+      if (latest == 0 || p->currentTs > latest->currentTs)
+        {
+          latest = p;
+        }
+    }
+  if (stopped != 0)
+    {
+      m_currentTs = stopped->currentTs;
+      m_currentUid = stopped->currentUid;
+    }
+  else if (latest->currentTs > m_currentTs)
+    {
+      m_currentTs = latest->currentTs;
+      m_currentUid = latest->currentUid;
+    }
+  m_currentContext = 0xffffffff;
+
+  // the events left return to m_events with their origins, to take their
+  // places again in the next run; those from other partitions have no
+  // uid and wait for it as they are
+  for (uint32_t i = 0; i < n; i++)
+    {
+      Partition *p = m_partitions[i];
+      ReceiveRemoteEvents (p);
+      m_carriedRemote.insert (m_carriedRemote.end (), p->remote.begin (), p->remote.end ());
+      while (!p->events->IsEmpty ())
+        {
+          Scheduler::Event ev = p->events->RemoveNext ();
+          m_carriedOrigins[ev.key.m_uid] = GetLocalKey (p, ev).origin;
+          m_events->Insert (ev);
+        }
+      m_unscheduledEvents += p->unscheduledEvents;
+    }
+  while (!m_globalEvents->IsEmpty ())
+    {
+      Scheduler::Event ev = m_globalEvents->RemoveNext ();
+      m_carriedOrigins[ev.key.m_uid] = m_globalOrigins[ev.key.m_uid];
+      m_events->Insert (ev);
+    }
+  m_globalEvents = 0;
+  m_globalOrigins.clear ();
+
+  uint32_t uids = m_globalUids;
+  for (uint32_t i = 0; i < n; i++)
+    {
+      uids = std::max (uids, m_partitions[i]->nUids);
+      delete m_partitions[i];
+    }
+  m_partitions.clear ();
+  m_uid = m_uidBase + uids * (n + 1);
+  for (uint32_t i = 0; i < m_queues.size (); i++)
+    {
+      delete m_queues[i];
+    }
+  m_queues.clear ();
+}
+
+void
+MultithreadedSimulatorImpl::Barrier (Partition *partition)
+{
+  // sense reversing: the last thread to arrive flips the sense the others
+  // wait for
+  bool sense = !partition->barrierSense;
+  partition->barrierSense = sense;
+  if (__sync_add_and_fetch (&m_barrierCount, 1) == m_partitions.size ())
+    {
+      m_barrierCount = 0;
+      __sync_synchronize ();
+      m_barrierSense = sense;
+    }
+  else
+    {
+      uint32_t spins = 0;
+      while (m_barrierSense != sense)
+        {
+          if (++spins > BARRIER_SPINS)
+            {
+              sched_yield ();
+            }
+        }
+      __sync_synchronize ();
+    }
+}
+
+void
+MultithreadedSimulatorImpl::RunPartition (Partition *partition)
+{
+  NS_LOG_FUNCTION (this << partition->id);
+  m_current = partition;
+  // the main thread counts packet uids and streams as the sequential
+  // simulator does, the others from where their partition left them
+  if (partition->id != 0)
+    {
+      Packet::SetThreadUid (m_packetUids[partition->id]);
+      RngSeedManager::SetThreadStreamIndex (m_streamIndices[partition->id]);
+    }
+  while (true)
+    {
+      Barrier (partition);
+      if (m_done)
+        {
+          break;
+        }
+      partition->nextSent = NoKey ();
+      ReceiveRemoteEvents (partition);
+      PruneEntries (partition);
+      ProcessWindow (partition);
+      Barrier (partition);
+      if (partition->id == 0)
+        {
+          NextWindow ();
+        }
+    }
+  if (partition->id != 0)
+    {
+      m_packetUids[partition->id] = Packet::GetThreadUid ();
+      m_streamIndices[partition->id] = RngSeedManager::GetThreadStreamIndex ();
+    }
+  m_current = 0;
+}
+
+void
+MultithreadedSimulatorImpl::ReceiveRemoteEvents (Partition *partition)
+{
+  uint32_t n = m_partitions.size ();
+  std::vector<RemoteEvent> unranked;
+  unranked.swap (partition->unranked);
+  for (std::vector<RemoteEvent>::iterator i = unranked.begin (); i != unranked.end (); ++i)
+    {
+      i->origin = Resolve (m_partitions[i->source], i->origin);
+      partition->remote.push_back (*i);
+      std::push_heap (partition->remote.begin (), partition->remote.end (), RemoteEventLater ());
+    }
+  for (uint32_t source = 0; source <= n; source++)
+    {
+      RemoteEventQueue *queue = m_queues[source * n + partition->id];
+      if (queue == 0)
+        {
+          continue;
+        }
+      RemoteEvent ev;
+      while (queue->Pop (ev))
+        {
+          partition->unscheduledEvents++;
+          if (source < n)
+            {
+              if (ev.window == m_window)
+                {
+                  // the source already runs the window after this one
+                  partition->unranked.push_back (ev);
+                  continue;
+                }
+              ev.origin = Resolve (m_partitions[source], ev.origin);
+            }
+          partition->remote.push_back (ev);
+          std::push_heap (partition->remote.begin (), partition->remote.end (), RemoteEventLater ());
+        }
+    }
+}
+
+void
+MultithreadedSimulatorImpl::PruneEntries (Partition *partition)
+{
+  // an entry is needed while it has local events pending; the ranks of
+  // the last window are final by now
+  if (partition->entries.size () >= partition->pruneSize)
+    {
+      partition->entries.erase (std::remove_if (partition->entries.begin (), partition->entries.end (),
+                                                Entry::IsDone),
+                                partition->entries.end ());
+      partition->pruneSize = std::max<uint32_t> (1024, 2 * partition->entries.size ());
+    }
+  partition->windowFirst = partition->entries.size ();
+}
+
+void
+MultithreadedSimulatorImpl::ProcessWindow (Partition *partition)
+{
+  while (!partition->stop)
+    {
+      bool haveLocal = !partition->events->IsEmpty ();
+      bool haveRemote = !partition->remote.empty ();
+      if (!haveLocal && !haveRemote)
+        {
+          break;
+        }
+      Scheduler::Event local;
+      Entry *entry = 0;
+      Key localKey = NoKey ();
+      if (haveLocal)
+        {
+          local = partition->events->PeekNext ();
+          entry = FindEntry (partition, local.key.m_uid);
+          localKey.ts = local.key.m_ts;
+          localKey.origin.ts = entry->ts;
+          localKey.origin.rank = entry->rank;
+          localKey.origin.uid = local.key.m_uid;
+        }
+      if (haveRemote)
+        {
+          RemoteEvent ev = partition->remote.front ();
+          Key remoteKey = { ev.ts, ev.origin };
+          if (!haveLocal || remoteKey < localKey)
+            {
+              if (!(remoteKey < m_windowEnd))
+                {
+                  break;
+                }
+              std::pop_heap (partition->remote.begin (), partition->remote.end (), RemoteEventLater ());
+              partition->remote.pop_back ();
+              NS_ASSERT (ev.ts >= partition->currentTs);
+              if (ev.ts != partition->currentTs)
+                {
+                  partition->currentUid = 0;
+                }
+              partition->unscheduledEvents--;
+              partition->currentTs = ev.ts;
+              partition->currentContext = ev.context;
+              partition->currentOrigin = ev.origin;
+              partition->currentEntry = NO_ENTRY;
+              ev.impl->Invoke ();
+              ev.impl->Unref ();
+              continue;
+            }
+        }
+      if (!(localKey < m_windowEnd))
+        {
+          break;
+        }
+      partition->events->RemoveNext ();
+      NS_ASSERT (local.key.m_ts >= partition->currentTs);
+      entry->pending--;
+      partition->unscheduledEvents--;
+      partition->currentTs = local.key.m_ts;
+      partition->currentContext = local.key.m_context;
+      partition->currentUid = local.key.m_uid;
+      partition->currentOrigin = localKey.origin;
+      partition->currentEntry = NO_ENTRY;
+      local.impl->Invoke ();
+      local.impl->Unref ();
+    }
+}
+
+void
+MultithreadedSimulatorImpl::ComputeNext (Partition *partition)
+{
+  Key next = NoKey ();
+  if (!partition->events->IsEmpty ())
+    {
+      next = GetLocalKey (partition, partition->events->PeekNext ());
+    }
+  if (!partition->remote.empty ())
+    {
+      Key remote = { partition->remote.front ().ts, partition->remote.front ().origin };
+      if (remote < next)
+        {
+          next = remote;
+        }
+    }
+  partition->next = next;
+}
+
+void
+MultithreadedSimulatorImpl::RankWindow (void)
+{
+  // merges the events which scheduled events in the window, each
+  // partition in the order it ran them, by their own origins
+  uint32_t n = m_partitions.size ();
+  std::vector<uint32_t> heads (n);
+  for (uint32_t i = 0; i < n; i++)
+    {
+      heads[i] = m_partitions[i]->windowFirst;
+      m_partitions[i]->windowRanks.clear ();
+    }
+  while (true)
+    {
+      Partition *first = 0;
+      Key firstKey = NoKey ();
+      for (uint32_t i = 0; i < n; i++)
+        {
+          Partition *p = m_partitions[i];
+          if (heads[i] == p->entries.size ())
+            {
+              continue;
+            }
+          const Entry &entry = p->entries[heads[i]];
+          Key key = { entry.ts, Resolve (p, entry.origin) };
+          if (first == 0 || key < firstKey)
+            {
+              first = p;
+              firstKey = key;
+            }
+        }
+      if (first == 0)
+        {
+          break;
+        }
+      first->entries[heads[first->id]++].rank = m_rank;
+      first->windowRanks.push_back (m_rank);
+      m_rank++;
+    }
+}
+
+void
+MultithreadedSimulatorImpl::ProcessGlobalEvent (void)
+{
+  Scheduler::Event next = m_globalEvents->RemoveNext ();
+  m_globalOrigins.erase (next.key.m_uid);
+
+  NS_ASSERT (next.key.m_ts >= m_currentTs);
+  m_unscheduledEvents--;
+
+  NS_LOG_LOGIC ("handle " << next.key.m_ts);
+  m_currentTs = next.key.m_ts;
+  m_currentContext = next.key.m_context;
+  m_currentUid = next.key.m_uid;
+  m_currentRank = m_rank++;
+  next.impl->Invoke ();
+  next.impl->Unref ();
+}
+
+void
+MultithreadedSimulatorImpl::NextWindow (void)
+{
+  // runs on the main thread while every partition waits
+  Partition *current = m_current;
+  m_current = 0;
+
+  RankWindow ();
+  m_window++;
+  Key first = NoKey ();
+  std::vector<RemoteEvent> global;
+  for (uint32_t i = 0; i < m_partitions.size (); i++)
+    {
+      Partition *p = m_partitions[i];
+      ComputeNext (p);
+      Key sent = { p->nextSent.ts, Resolve (p, p->nextSent.origin) };
+      first = std::min (first, std::min (p->next, sent));
+      for (std::vector<RemoteEvent>::iterator j = p->global.begin (); j != p->global.end (); ++j)
+        {
+          j->origin = Resolve (p, j->origin);
+          global.push_back (*j);
+        }
+      p->global.clear ();
+    }
+  // the events without a node context the partitions scheduled take
+  // their uids in the order of their origins
+  std::sort (global.begin (), global.end (), RemoteEventLater ());
+  for (std::vector<RemoteEvent>::reverse_iterator i = global.rbegin (); i != global.rend (); ++i)
+    {
+      Scheduler::Event ev;
+      ev.impl = i->impl;
+      ev.key.m_ts = i->ts;
+      ev.key.m_context = 0xffffffff;
+      ev.key.m_uid = AllocateUid (m_partitions.size ());
+      m_globalOrigins[ev.key.m_uid] = i->origin;
+      m_unscheduledEvents++;
+      m_globalEvents->Insert (ev);
+    }
+
+  // the events without a node context run when no partition has an
+  // earlier one
+  m_globalSent = NoKey ();
+  while (!m_stop && !m_globalEvents->IsEmpty ())
+    {
+      Scheduler::Event ev = m_globalEvents->PeekNext ();
+      Key key = { ev.key.m_ts, m_globalOrigins[ev.key.m_uid] };
+      first = std::min (first, m_globalSent);
+      if (first < key)
+        {
+          break;
+        }
+      ProcessGlobalEvent ();
+    }
+  first = std::min (first, m_globalSent);
+
+  if (m_stop || (first.ts == MAX_TS && m_globalEvents->IsEmpty ()))
+    {
+      m_done = true;
+    }
+  else
+    {
+      // no event ranks before the origins of the window end
+      uint64_t lookAhead = m_lookAhead.GetTimeStep ();
+      m_windowEnd.ts = first.ts > MAX_TS - lookAhead ? MAX_TS : first.ts + lookAhead;
+      m_windowEnd.origin.ts = 0;
+      m_windowEnd.origin.rank = 0;
+      m_windowEnd.origin.uid = 0;
+      if (!m_globalEvents->IsEmpty ())
+        {
+          Scheduler::Event ev = m_globalEvents->PeekNext ();
+          Key key = { ev.key.m_ts, m_globalOrigins[ev.key.m_uid] };
+          m_windowEnd = std::min (m_windowEnd, key);
+        }
+    }
+  m_current = current;
+}
+
+bool
+MultithreadedSimulatorImpl::IsFinished (void) const
+{
+  if (m_running)
+    {
+      return m_stop;
+    }
+  return (m_events->IsEmpty () && m_carriedRemote.empty ()) || m_stop;
+}
+
+void
+MultithreadedSimulatorImpl::Run (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_stop = false;
+  StartPartitions ();
+  RunPartition (m_partitions[0]);
+  StopPartitions ();
+
+  // If the simulator stopped naturally by lack of events, make a
+  // consistency test to check that we didn't lose any events along the way.
+  NS_ASSERT (!m_events->IsEmpty () || !m_carriedRemote.empty () || m_unscheduledEvents == 0);
+}
+
+void
+MultithreadedSimulatorImpl::Stop (void)
+{
+  NS_LOG_FUNCTION (this);
+  if (m_current != 0)
+    {
+      m_current->stop = true;
+    }
+  m_stop = true;
+}
+
+void
+MultithreadedSimulatorImpl::Stop (Time const &time)
+{
+  NS_LOG_FUNCTION (this << time.GetTimeStep ());
+  if (m_current != 0)
+    {
+      void (*stop) (void) = &Simulator::Stop;
+      SendGlobalEvent (m_current, m_current->currentTs + time.GetTimeStep (), MakeEvent (stop));
+      return;
+    }
+  Simulator::Schedule (time, &Simulator::Stop);
+}
+
+EventId
+MultithreadedSimulatorImpl::ScheduleInPartition (Partition *partition, uint64_t ts, uint32_t context,
+                                                 EventImpl *event)
+{
+  Scheduler::Event ev;
+  ev.impl = event;
+  ev.key.m_ts = ts;
+  ev.key.m_context = context;
+  EnsureEntry (partition);
+  partition->entries[partition->currentEntry].pending++;
+  ev.key.m_uid = AllocateUid (partition->id);
+  partition->unscheduledEvents++;
+  partition->events->Insert (ev);
+  return EventId (event, ev.key.m_ts, ev.key.m_context, ev.key.m_uid);
+}
+
+EventId
+MultithreadedSimulatorImpl::ScheduleGlobal (uint64_t ts, EventImpl *event)
+{
+  CriticalSection cs (m_mutex);
+  Scheduler::Event ev;
+  ev.impl = event;
+  ev.key.m_ts = ts;
+  ev.key.m_context = 0xffffffff;
+  ev.key.m_uid = AllocateUid (m_partitions.size ());
+  Origin origin = { m_currentTs, m_currentRank, ev.key.m_uid };
+  m_globalOrigins[ev.key.m_uid] = origin;
+  m_unscheduledEvents++;
+  m_globalEvents->Insert (ev);
+  return EventId (event, ev.key.m_ts, ev.key.m_context, ev.key.m_uid);
+}
+
+EventId
+MultithreadedSimulatorImpl::Schedule (Time const &time, EventImpl *event)
+{
+  NS_LOG_FUNCTION (this << time.GetTimeStep () << event);
+
+  Time tAbsolute = time + Now ();
+  NS_ASSERT (tAbsolute.IsPositive ());
+  NS_ASSERT (tAbsolute >= Now ());
+  uint64_t ts = (uint64_t) tAbsolute.GetTimeStep ();
+  if (m_current != 0)
+    {
+      return ScheduleInPartition (m_current, ts, m_current->currentContext, event);
+    }
+  if (m_running)
+    {
+      return ScheduleGlobal (ts, event);
+    }
+  Scheduler::Event ev;
+  ev.impl = event;
+  ev.key.m_ts = ts;
+  ev.key.m_context = m_currentContext;
+  ev.key.m_uid = m_uid;
+  m_uid++;
+  m_unscheduledEvents++;
+  m_events->Insert (ev);
+  return EventId (event, ev.key.m_ts, ev.key.m_context, ev.key.m_uid);
+}
+
+void
+MultithreadedSimulatorImpl::ScheduleWithContext (uint32_t context, Time const &time, EventImpl *event)
+{
+  NS_LOG_FUNCTION (this << context << time.GetTimeStep () << event);
+
+  Time tAbsolute = time + Now ();
+  uint64_t ts = (uint64_t) tAbsolute.GetTimeStep ();
+  if (!m_running)
+    {
+      Scheduler::Event ev;
+      ev.impl = event;
+      ev.key.m_ts = ts;
+      ev.key.m_context = context;
+      ev.key.m_uid = m_uid;
+      m_uid++;
+      m_unscheduledEvents++;
+      m_events->Insert (ev);
+      return;
+    }
+  if (context == 0xffffffff)
+    {
+      if (m_current != 0)
+        {
+          SendGlobalEvent (m_current, ts, event);
+        }
+      else
+        {
+          ScheduleGlobal (ts, event);
+        }
+      return;
+    }
+  uint32_t destination = GetPartition (context);
+  if (m_current != 0 && m_current->id == destination)
+    {
+      ScheduleInPartition (m_current, ts, context, event);
+      return;
+    }
+
+  RemoteEvent ev;
+  ev.ts = ts;
+  ev.context = context;
+  ev.impl = event;
+  if (m_current != 0)
+    {
+      ev.origin.ts = m_current->currentTs;
+      ev.origin.rank = EnsureEntry (m_current);
+      ev.origin.uid = AllocateUid (m_current->id);
+      ev.source = m_current->id;
+      ev.window = m_window;
+      Key key = { ts, ev.origin };
+      if (key < m_windowEnd)
+        {
+          NS_FATAL_ERROR ("Node " << GetContext () << " scheduled an event for node " << context
+                                  << " of another system id " << time.GetSeconds ()
+                                  << "s ahead, within the lookahead of " << m_lookAhead.GetSeconds () << "s");
+        }
+      m_current->nextSent = std::min (m_current->nextSent, key);
+    }
+  else
+    {
+      ev.origin.ts = m_currentTs;
+      ev.origin.rank = m_currentRank;
+      ev.origin.uid = AllocateUid (m_partitions.size ());
+      ev.source = m_partitions.size ();
+      Key key = { ts, ev.origin };
+      m_globalSent = std::min (m_globalSent, key);
+    }
+  SendRemoteEvent (ev.source, destination, ev);
+}
+
+void
+MultithreadedSimulatorImpl::SendGlobalEvent (Partition *partition, uint64_t ts, EventImpl *event)
+{
+  // kept with the partition until the end of the window, when its origin
+  // is known
+  RemoteEvent ev;
+  ev.ts = ts;
+  ev.origin.ts = partition->currentTs;
+  ev.origin.rank = EnsureEntry (partition);
+  ev.origin.uid = AllocateUid (partition->id);
+  ev.source = partition->id;
+  ev.context = 0xffffffff;
+  ev.impl = event;
+  partition->global.push_back (ev);
+}
+
+void
+MultithreadedSimulatorImpl::SendRemoteEvent (uint32_t source, uint32_t destination, const RemoteEvent &ev)
+{
+  m_queues[source * m_partitions.size () + destination]->Push (ev);
+}
+
+EventId
+MultithreadedSimulatorImpl::ScheduleNow (EventImpl *event)
+{
+  return Schedule (TimeStep (0), event);
+}
+
+EventId
+MultithreadedSimulatorImpl::ScheduleDestroy (EventImpl *event)
+{
+  CriticalSection cs (m_mutex);
+  EventId id (Ptr<EventImpl> (event, false), Now ().GetTimeStep (), 0xffffffff, 2);
+  m_destroyEvents.push_back (id);
+  if (!m_running)
+    {
+      m_uid++;
+    }
+  return id;
+}
+
+Time
+MultithreadedSimulatorImpl::Now (void) const
+{
+  // Do not add function logging here, to avoid stack overflow
+  return TimeStep (m_current != 0 ? m_current->currentTs : m_currentTs);
+}
+
+uint32_t
+MultithreadedSimulatorImpl::GetContext (void) const
+{
+  return m_current != 0 ? m_current->currentContext : m_currentContext;
+}
+
+Time
+MultithreadedSimulatorImpl::GetDelayLeft (const EventId &id) const
+{
+  if (id.PeekEventImpl () == 0 || IsExpired (id))
+    {
+      return TimeStep (0);
+    }
+  else
+    {
+      return TimeStep (id.GetTs ()) - Now ();
+    }
+}
+
+void
+MultithreadedSimulatorImpl::Remove (const EventId &id)
+{
+  if (id.PeekEventImpl () == 0)
+    {
+      // never scheduled: a default EventId has the context of node 0
+      return;
+    }
+  if (id.GetUid () == 2)
+    {
+      // destroy events.
+      CriticalSection cs (m_mutex);
+      for (DestroyEvents::iterator i = m_destroyEvents.begin (); i != m_destroyEvents.end (); i++)
+        {
+          if (*i == id)
+            {
+              m_destroyEvents.erase (i);
+              break;
+            }
+        }
+      return;
+    }
+  if (IsExpired (id))
+    {
+      return;
+    }
+  Scheduler::Event event;
+  event.impl = id.PeekEventImpl ();
+  event.key.m_ts = id.GetTs ();
+  event.key.m_context = id.GetContext ();
+  event.key.m_uid = id.GetUid ();
+  if (!m_running)
+    {
+      m_events->Remove (event);
+      m_carriedOrigins.erase (event.key.m_uid);
+      m_unscheduledEvents--;
+    }
+  else if (id.GetContext () == 0xffffffff)
+    {
+      CriticalSection cs (m_mutex);
+      m_globalEvents->Remove (event);
+      m_globalOrigins.erase (event.key.m_uid);
+      m_unscheduledEvents--;
+    }
+  else
+    {
+      Partition *p = m_partitions[GetPartition (id.GetContext ())];
+      NS_ASSERT_MSG (m_current == 0 || m_current == p, "Event removed by a node of another system id");
+      p->events->Remove (event);
+      FindEntry (p, event.key.m_uid)->pending--;
+      p->unscheduledEvents--;
+    }
+  event.impl->Cancel ();
+  // whenever we remove an event from the event list, we have to unref it.
+  event.impl->Unref ();
+}
+
+void
+MultithreadedSimulatorImpl::Cancel (const EventId &id)
+{
+  if (!IsExpired (id))
+    {
+      id.PeekEventImpl ()->Cancel ();
+    }
+}
+
+bool
+MultithreadedSimulatorImpl::IsExpired (const EventId &ev) const
+{
+  // settled before the partition of the context is looked up: a default
+  // EventId has the context of node 0, which may be in any partition
+  if (ev.PeekEventImpl () == 0 ||
+      ev.PeekEventImpl ()->IsCancelled ())
+    {
+      return true;
+    }
+  if (ev.GetUid () == 2)
+    {
+      // destroy events.
+      CriticalSection cs (m_mutex);
+      for (DestroyEvents::const_iterator i = m_destroyEvents.begin (); i != m_destroyEvents.end (); i++)
+        {
+          if (*i == ev)
+            {
+              return false;
+            }
+        }
+      return true;
+    }
+  // the event is compared with the clock of the events it was queued with
+  uint64_t currentTs = m_currentTs;
+  uint32_t currentUid = m_currentUid;
+  if (m_running && ev.GetContext () != 0xffffffff)
+    {
+      const Partition *p = m_partitions[GetPartition (ev.GetContext ())];
+      NS_ASSERT_MSG (m_current == 0 || m_current == p, "Event checked by a node of another system id");
+      currentTs = p->currentTs;
+      currentUid = p->currentUid;
+    }
+  if (ev.GetTs () < currentTs ||
+      (ev.GetTs () == currentTs &&
+       ev.GetUid () <= currentUid))
+    {
+      return true;
+    }
+  else
+    {
+      return false;
+    }
+}
+
+Time
+MultithreadedSimulatorImpl::GetMaximumSimulationTime (void) const
+{
+  return TimeStep (0x7fffffffffffffffLL);
+}
+
+} // namespace ns3
@@ -0,0 +1,251 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MULTITHREADED_SIMULATOR_IMPL_H
+#define MULTITHREADED_SIMULATOR_IMPL_H
+
+#include "ns3/simulator-impl.h"
+#include "ns3/scheduler.h"
+#include "ns3/event-impl.h"
+#include "ns3/system-thread.h"
+#include "ns3/system-mutex.h"
+#include "ns3/ptr.h"
+
+#include <list>
+#include <vector>
+#include <map>
+
+namespace ns3 {
+
+/**
+ * \defgroup multithreaded Multithreaded Simulation
+ */
+
+/**
+ * \ingroup multithreaded
+ *
+ * \brief simulator implementation running the partitions of a
+ * simulation on threads of a single process
+ *
+ * The nodes are partitioned by their system id, as they are between the
+ * ranks of DistributedSimulatorImpl, and the events of a node run on
+ * the thread of its partition: the event of a context runs in the
+ * partition of the node of that id. Partition 0 runs on the thread
+ * which calls Simulator::Run, every other on a thread of its own.
+ *
+ * The partitions advance in windows. A window starts at the earliest
+ * pending event of all partitions and lasts for the lookahead, the
+ * smallest delay of the point to point channels which join nodes of
+ * different partitions, so that no event one partition schedules for
+ * another falls inside the window. Such events are passed through a
+ * lock-free single producer, single consumer queue per pair of
+ * partitions and collected after the window. Shared media cannot join
+ * nodes of different partitions: the carrier sense of a CSMA segment
+ * sees a transmission as soon as it starts, which leaves no lookahead.
+ *
+ * Events scheduled without the context of a node, by the simulation
+ * script or Simulator::Stop (Time), run on their own while all
+ * partitions wait, at the point where the sequential simulator would
+ * run them.
+ *
+ * The events run in the order of the sequential simulator, which sorts
+ * events of equal timestamps by their uids, that is by the order they
+ * were scheduled in. An event is therefore placed by its origin: the
+ * time and rank of the event which scheduled it, the rank being the
+ * position of that event among all events run so far, and the order of
+ * the call within that event. A partition ranks the events it runs
+ * tentatively, and the ranks of all partitions are merged into the
+ * global order at the end of each window. With the same events, the
+ * results are those of DefaultSimulatorImpl.
+ *
+ * Packet uids and the stream indices of random variables created during
+ * the run are counted per partition: the thread of a partition starts
+ * where the partition was left in the previous run, so that they do not
+ * depend on how the threads interleave, but they differ from those of
+ * DefaultSimulatorImpl. Models which create random variables during the
+ * run therefore draw other numbers than with the sequential simulator.
+ *
+ * Simulator::Stop () stops its partition at once and the others at the
+ * end of the window, and an event without a node context scheduled by
+ * the event of a node within the lookahead, such as Simulator::Stop
+ * (Time) with a shorter time, runs at the end of the window. The events
+ * of a partition may only touch the nodes of that partition, and trace
+ * sinks connected to the nodes of several partitions are called from
+ * several threads.
+ */
+class MultithreadedSimulatorImpl : public SimulatorImpl
+{
+public:
+  static TypeId GetTypeId (void);
+
+  MultithreadedSimulatorImpl ();
+  ~MultithreadedSimulatorImpl ();
+
+  // virtual from SimulatorImpl
+  virtual void Destroy ();
+  virtual bool IsFinished (void) const;
+  virtual void Stop (void);
+  virtual void Stop (Time const &time);
+  virtual EventId Schedule (Time const &time, EventImpl *event);
+  virtual void ScheduleWithContext (uint32_t context, Time const &time, EventImpl *event);
+  virtual EventId ScheduleNow (EventImpl *event);
+  virtual EventId ScheduleDestroy (EventImpl *event);
+  virtual void Remove (const EventId &ev);
+  virtual void Cancel (const EventId &ev);
+  virtual bool IsExpired (const EventId &ev) const;
+  virtual void Run (void);
+  virtual Time Now (void) const;
+  virtual Time GetDelayLeft (const EventId &id) const;
+  virtual Time GetMaximumSimulationTime (void) const;
+  virtual void SetScheduler (ObjectFactory schedulerFactory);
+  virtual uint32_t GetSystemId (void) const;
+  virtual uint32_t GetContext (void) const;
+
+  /**
+   * \returns the lookahead of the last run, or the maximum simulation
+   * time if no channel joins nodes of different partitions
+   */
+  Time GetLookAhead (void) const;
+
+private:
+  /*
+   * Where an event was scheduled: the time and rank of the event which
+   * scheduled it, and the uid allocated by that call. Events of equal
+   * timestamps run in the order of their origins.
+   */
+  struct Origin
+  {
+    uint64_t ts;
+    uint64_t rank;
+    uint32_t uid;
+    bool operator < (const Origin &o) const
+    {
+      return ts < o.ts || (ts == o.ts && (rank < o.rank || (rank == o.rank && uid < o.uid)));
+    }
+  };
+  /* A position in the event order */
+  struct Key
+  {
+    uint64_t ts;
+    Origin origin;
+    bool operator < (const Key &o) const
+    {
+      return ts < o.ts || (ts == o.ts && origin < o.origin);
+    }
+  };
+  /* An event scheduled by another partition */
+  struct RemoteEvent
+  {
+    uint64_t ts;
+    Origin origin;
+    uint32_t source;       // partition which scheduled it
+    uint64_t window;       // in which it was scheduled
+    uint32_t context;
+    EventImpl *impl;
+  };
+  struct RemoteEventLater
+  {
+    bool operator () (const RemoteEvent &a, const RemoteEvent &b) const;
+  };
+  struct Entry;
+  class RemoteEventQueue;
+  struct Partition;
+
+  virtual void DoDispose (void);
+  void CalculateLookAhead (void);
+  uint32_t GetPartition (uint32_t context) const;
+  uint32_t AllocateUid (uint32_t partition);
+  EventId ScheduleInPartition (Partition *partition, uint64_t ts, uint32_t context, EventImpl *event);
+  EventId ScheduleGlobal (uint64_t ts, EventImpl *event);
+  static Key NoKey (void);
+  uint64_t EnsureEntry (Partition *partition);
+  Entry *FindEntry (Partition *partition, uint32_t uid) const;
+  Key GetLocalKey (Partition *partition, const Scheduler::Event &ev) const;
+  Origin Resolve (const Partition *partition, Origin origin) const;
+  void SendRemoteEvent (uint32_t source, uint32_t destination, const RemoteEvent &ev);
+  void ReceiveRemoteEvents (Partition *partition);
+  void SendGlobalEvent (Partition *partition, uint64_t ts, EventImpl *event);
+  void PruneEntries (Partition *partition);
+  void ProcessWindow (Partition *partition);
+  void RankWindow (void);
+  void ComputeNext (Partition *partition);
+  void RunPartition (Partition *partition);
+  void Barrier (Partition *partition);
+  void NextWindow (void);
+  void ProcessGlobalEvent (void);
+  void StartPartitions (void);
+  void StopPartitions (void);
+
+  typedef std::list<EventId> DestroyEvents;
+
+  DestroyEvents m_destroyEvents;
+  mutable SystemMutex m_mutex;  // guards m_destroyEvents and m_globalEvents while running
+  bool m_stop;
+  ObjectFactory m_schedulerFactory;
+  // events before Run, and after it the events left
+  Ptr<Scheduler> m_events;
+  // events without a node context while running
+  Ptr<Scheduler> m_globalEvents;
+  uint32_t m_uid;
+  uint32_t m_currentUid;
+  uint64_t m_currentTs;
+  uint32_t m_currentContext;
+  // number of events that have been inserted but not yet scheduled,
+  // not counting the "destroy" events; this is used for validation
+  int m_unscheduledEvents;
+
+  bool m_running;
+  Time m_lookAhead;
+  std::vector<uint32_t> m_nodePartitions;
+  std::vector<Partition *> m_partitions;
+  std::vector<Ptr<SystemThread> > m_threads;
+  // m_queues[source * n + destination], the last of the n + 1 sources being the
+  // events without a node context
+  std::vector<RemoteEventQueue *> m_queues;
+  // uids of the run: partition p allocates m_uidBase + p + k * (n + 1)
+  uint32_t m_uidBase;
+  uint32_t m_globalUids;
+  // ranks of the events run so far, and of the current event without a
+  // node context
+  uint64_t m_rank;
+  uint64_t m_currentRank;
+  // origins of the events without a node context, by uid
+  std::map<uint32_t, Origin> m_globalOrigins;
+  // origins of the events left by the last run, by uid, and the events
+  // from other partitions it left
+  std::map<uint32_t, Origin> m_carriedOrigins;
+  std::vector<RemoteEvent> m_carriedRemote;
+  // the next packet uid and stream index of each partition
+  std::vector<uint32_t> m_packetUids;
+  std::vector<uint64_t> m_streamIndices;
+  // the number of windows run so far, and the current window ends
+  // before this position
+  uint64_t m_window;
+  Key m_windowEnd;
+  // earliest event sent to the partitions by the events without a node
+  // context since the last window
+  Key m_globalSent;
+  volatile bool m_done;
+  volatile uint32_t m_barrierCount;
+  volatile bool m_barrierSense;
+
+  // partition of the calling thread, 0 outside the events of a partition
+  static __thread Partition *m_current;
+};
+
+} // namespace ns3
+
+#endif /* MULTITHREADED_SIMULATOR_IMPL_H */
@@ -18,6 +18,7 @@
  * Author: Mathieu Lacage <mathieu.lacage@sophia.inria.fr>
  */
 #include "buffer.h"
+#include "ns3/core-config.h"
 #include "ns3/assert.h"
 #include "ns3/log.h"
 
@@ -45,8 +46,16 @@ static struct Zeroes
 
 namespace ns3 {
 
+/* location in a newly-allocated buffer where you should start writing
+ * data. i.e., m_start should be initialized to this value. Each thread
+ * of a multithreaded simulation keeps its own.
+ */
+#ifdef HAVE_TLS
+static __thread uint32_t g_recommendedStart = 0;
+#else
+static uint32_t g_recommendedStart = 0;
+#endif
 
-uint32_t Buffer::g_recommendedStart = 0;
 #ifdef BUFFER_FREE_LIST
 /* The following macros are pretty evil but they are needed to allow us to
  * keep track of 3 possible states for the g_freeList variable:
@@ -566,6 +575,31 @@ Buffer::CreateFullCopy (void) const
   return *this;
 }
 
+Buffer::Iterator
+Buffer::BeginWritable (uint32_t size)
+{
+  NS_LOG_FUNCTION (this << size);
+  NS_ASSERT (CheckInternalState ());
+  NS_ASSERT (size <= GetSize ());
+  if (size > m_zeroAreaStart - m_start)
+    {
+      /* the bytes reach into the zero area which has no storage */
+      *this = CreateFullCopy ();
+    }
+  if (m_data->m_count > 1)
+    {
+      struct Buffer::Data *newData = Buffer::Create (m_data->m_size);
+      memcpy (newData->m_data + m_start, m_data->m_data + m_start, GetInternalSize ());
+      m_data->m_count--;
+      m_data = newData;
+      m_data->m_dirtyStart = m_start;
+      m_data->m_dirtyEnd = m_end;
+    }
+  LOG_INTERNAL_STATE ("writable size=" << size << ", ");
+  NS_ASSERT (CheckInternalState ());
+  return Begin ();
+}
+
 uint32_t 
 Buffer::GetSerializedSize (void) const
 {
@@ -480,6 +480,18 @@ private:
    * end of this Buffer.
    */
   inline Buffer::Iterator End (void) const;
+  /**
+   * \param size number of bytes at the start of the buffer to modify
+   * \return an Iterator which points to the start of this Buffer.
+   *
+   * Makes the first size bytes of the Buffer private to it, copying
+   * them if they are shared with other Buffers, so that they can be
+   * overwritten in place through the returned Iterator without
+   * changing the content of these other Buffers.
+   * Any call to this method invalidates any Iterator
+   * pointing to this Buffer.
+   */
+  Buffer::Iterator BeginWritable (uint32_t size);
 
   Buffer CreateFullCopy (void) const;
 
@@ -589,12 +601,6 @@ private:
    * m_zeroAreaStart.
    */
   uint32_t m_maxZeroAreaStart;
-  /**
-   * location in a newly-allocated buffer where you should start
-   * writing data. i.e., m_start should be initialized to this 
-   * value.
-   */
-  static uint32_t g_recommendedStart;
 
   /* offset to the start of the virtual zero area from the start 
    * of m_data->m_data
@@ -44,6 +44,7 @@ public:
   ~ByteTagListDataFreeList ();
 } g_freeList;
 static uint32_t g_maxSize = 0;
+static bool g_threadSafe = false;
 
 ByteTagListDataFreeList::~ByteTagListDataFreeList ()
 {
@@ -340,10 +341,26 @@ ByteTagList::AddAtStart (int32_t adjustment, int32_t prependOffset)
 
 #ifdef USE_FREE_LIST
 
+void
+ByteTagList::SetThreadSafe (bool threadSafe)
+{
+  NS_LOG_FUNCTION (threadSafe);
+  g_threadSafe = threadSafe;
+}
+
 struct ByteTagListData *
 ByteTagList::Allocate (uint32_t size)
 {
   NS_LOG_FUNCTION (this << size);
+  if (g_threadSafe)
+    {
+      uint8_t *buffer = new uint8_t [size + sizeof (struct ByteTagListData) - 4];
+      struct ByteTagListData *data = (struct ByteTagListData *)buffer;
+      data->count = 1;
+      data->size = size;
+      data->dirty = 0;
+      return data;
+    }
   while (!g_freeList.empty ())
     {
       struct ByteTagListData *data = g_freeList.back ();
@@ -374,8 +391,14 @@ ByteTagList::Deallocate (struct ByteTagListData *data)
     {
       return;
     }
-  g_maxSize = std::max (g_maxSize, data->size);
   data->count--;
+  if (data->count == 0 && g_threadSafe)
+    {
+      uint8_t *buffer = (uint8_t *)data;
+      delete [] buffer;
+      return;
+    }
+  g_maxSize = std::max (g_maxSize, data->size);
   if (data->count == 0)
     {
       if (g_freeList.size () > FREE_LIST_SIZE ||
@@ -393,6 +416,11 @@ ByteTagList::Deallocate (struct ByteTagListData *data)
 
 #else /* USE_FREE_LIST */
 
+void
+ByteTagList::SetThreadSafe (bool threadSafe)
+{
+}
+
 struct ByteTagListData *
 ByteTagList::Allocate (uint32_t size)
 {
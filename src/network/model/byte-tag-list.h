@@ -153,6 +153,12 @@ private:
    */
   void AddAtStart (int32_t adjustment, int32_t prependOffset);
 
+  /**
+   * \param threadSafe whether lists are allocated and freed by several
+   *        threads at once, in which case the free list is bypassed
+   */
+  static void SetThreadSafe (bool threadSafe);
+
 private:
   bool IsDirtyAtEnd (int32_t appendOffset);
   bool IsDirtyAtStart (int32_t prependOffset);
@@ -19,6 +19,7 @@
  */
 #include <utility>
 #include <list>
+#include "ns3/core-config.h"
 #include "ns3/assert.h"
 #include "ns3/fatal-error.h"
 #include "ns3/log.h"
@@ -33,6 +34,7 @@ namespace ns3 {
 
 bool PacketMetadata::m_enable = false;
 bool PacketMetadata::m_enableChecking = false;
+bool PacketMetadata::m_threadSafe = false;
 bool PacketMetadata::m_metadataSkipped = false;
 uint32_t PacketMetadata::m_maxSize = 0;
 uint16_t PacketMetadata::m_chunkUid = 0;
@@ -62,6 +64,13 @@ PacketMetadata::Enable (void)
   m_enable = true;
 }
 
+void
+PacketMetadata::SetThreadSafe (bool threadSafe)
+{
+  NS_LOG_FUNCTION (threadSafe);
+  m_threadSafe = threadSafe;
+}
+
 void 
 PacketMetadata::EnableChecking (void)
 {
@@ -582,6 +591,10 @@ struct PacketMetadata::Data *
 PacketMetadata::Create (uint32_t size)
 {
   NS_LOG_FUNCTION (size);
+  if (m_threadSafe)
+    {
+      return PacketMetadata::Allocate (size);
+    }
   NS_LOG_LOGIC ("create size="<<size<<", max="<<m_maxSize);
   if (size > m_maxSize)
     {
@@ -608,7 +621,7 @@ void
 PacketMetadata::Recycle (struct PacketMetadata::Data *data)
 {
   NS_LOG_FUNCTION (data);
-  if (!m_enable)
+  if (!m_enable || m_threadSafe)
     {
       PacketMetadata::Deallocate (data);
       return;
@@ -626,6 +639,18 @@ PacketMetadata::Recycle (struct PacketMetadata::Data *data)
     }
 }
 
+uint16_t
+PacketMetadata::AllocateChunkUid (void)
+{
+#ifdef HAVE_TLS
+  if (m_threadSafe)
+    {
+      return __sync_fetch_and_add (&m_chunkUid, 1);
+    }
+#endif
+  return m_chunkUid++;
+}
+
 struct PacketMetadata::Data *
 PacketMetadata::Allocate (uint32_t n)
 {
@@ -662,6 +687,15 @@ PacketMetadata::CreateFragment (uint32_t start, uint32_t end) const
   return fragment;
 }
 
+PacketMetadata
+PacketMetadata::DeepCopy (void) const
+{
+  NS_LOG_FUNCTION (this);
+  PacketMetadata copy = *this;
+  copy.ReserveCopy (0);
+  return copy;
+}
+
 void 
 PacketMetadata::AddHeader (const Header &header, uint32_t size)
 {
@@ -686,8 +720,7 @@ PacketMetadata::DoAddHeader (uint32_t uid, uint32_t size)
   item.prev = 0xffff;
   item.typeUid = uid;
   item.size = size;
-  item.chunkUid = m_chunkUid;
-  m_chunkUid++;
+  item.chunkUid = AllocateChunkUid ();
   uint16_t written = AddSmall (&item);
   UpdateHead (written);
 }
@@ -755,8 +788,7 @@ PacketMetadata::AddTrailer (const Trailer &trailer, uint32_t size)
   item.prev = m_tail;
   item.typeUid = uid;
   item.size = size;
-  item.chunkUid = m_chunkUid;
-  m_chunkUid++;
+  item.chunkUid = AllocateChunkUid ();
   uint16_t written = AddSmall (&item);
   UpdateTail (written);
   NS_ASSERT (IsStateOk ());
@@ -127,6 +127,7 @@ private:
 
   static void Enable (void);
   static void EnableChecking (void);
+  static void SetThreadSafe (bool threadSafe);
 
   inline PacketMetadata (uint64_t uid, uint32_t size);
   inline PacketMetadata (PacketMetadata const &o);
@@ -147,6 +148,10 @@ private:
    * and then, RemoveAtEnd (end).
    */
   PacketMetadata CreateFragment (uint32_t start, uint32_t end) const;
+  /**
+   * \returns a copy of this metadata which shares no data with it
+   */
+  PacketMetadata DeepCopy (void) const;
   void AddAtEnd (PacketMetadata const&o);
   void AddPaddingAtEnd (uint32_t end);
   void RemoveAtStart (uint32_t start);
@@ -334,10 +339,14 @@ public:
   static void Recycle (struct PacketMetadata::Data *data);
   static struct PacketMetadata::Data *Allocate (uint32_t n);
   static void Deallocate (struct PacketMetadata::Data *data);
+  static uint16_t AllocateChunkUid (void);
 
   static DataFreeList m_freeList;
   static bool m_enable;
   static bool m_enableChecking;
+  // set while packets are used by several threads at once; the free
+  // list is then bypassed
+  static bool m_threadSafe;
 
   // set to true when adding metadata to a packet is skipped because
   // m_enable is false; used to detect enabling of metadata in the
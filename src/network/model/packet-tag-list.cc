@@ -23,6 +23,7 @@
 #include "ns3/fatal-error.h"
 #include "ns3/log.h"
 #include <cstring>
+#include <vector>
 
 NS_LOG_COMPONENT_DEFINE ("PacketTagList");
 
@@ -149,6 +150,27 @@ PacketTagList::Add (const Tag &tag) const
   const_cast<PacketTagList *> (this)->m_next = head;
 }
 
+void
+PacketTagList::Add (PacketTagList const&o)
+{
+  NS_LOG_FUNCTION (this << &o);
+  std::vector<const struct TagData *> tags;
+  for (const struct TagData *cur = o.m_next; cur != 0; cur = cur->next)
+    {
+      tags.push_back (cur);
+    }
+  // prepend from the last one to keep the order of the other list
+  for (std::vector<const struct TagData *>::reverse_iterator i = tags.rbegin (); i != tags.rend (); i++)
+    {
+      struct TagData *head = AllocData ();
+      std::memcpy (head->data, (*i)->data, PACKET_TAG_MAX_SIZE);
+      head->tid = (*i)->tid;
+      head->count = 1;
+      head->next = m_next;
+      m_next = head;
+    }
+}
+
 bool
 PacketTagList::Peek (Tag &tag) const
 {
@@ -52,6 +52,13 @@ public:
   inline ~PacketTagList ();
 
   void Add (Tag const&tag) const;
+  /**
+   * \param o the other list of tags to copy
+   *
+   * Add copies of the tags of the other list, which then share no data
+   * with this one.
+   */
+  void Add (PacketTagList const&o);
   bool Remove (Tag &tag);
   bool Peek (Tag &tag) const;
   inline void RemoveAll (void);
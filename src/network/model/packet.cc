@@ -18,8 +18,10 @@
  * Author: Mathieu Lacage <mathieu.lacage@sophia.inria.fr>
  */
 #include "packet.h"
+#include "ns3/core-config.h"
 #include "ns3/assert.h"
 #include "ns3/log.h"
+#include "ns3/fatal-error.h"
 #include "ns3/simulator.h"
 #include <string>
 #include <cstdarg>
@@ -28,7 +30,29 @@ NS_LOG_COMPONENT_DEFINE ("Packet");
 
 namespace ns3 {
 
-uint32_t Packet::m_globalUid = 0;
+/* The lower 32 bits of the packet uids. The threads of a multithreaded
+ * simulation count the packets of their system id on their own, the
+ * system id in the upper bits of the uid tells them apart.
+ */
+static uint32_t g_globalUid = 0;
+#ifdef HAVE_TLS
+static __thread bool g_threadCountsUids = false;
+static __thread uint32_t g_threadUid = 0;
+#endif
+
+static bool g_threadSafe = false;
+
+static uint32_t
+AllocateUid (void)
+{
+#ifdef HAVE_TLS
+  if (g_threadCountsUids)
+    {
+      return g_threadUid++;
+    }
+#endif
+  return g_globalUid++;
+}
 
 TypeId 
 ByteTagIterator::Item::GetTypeId (void) const
@@ -137,6 +161,31 @@ Packet::Copy (void) const
   return Ptr<Packet> (new Packet (*this), false);
 }
 
+Ptr<Packet>
+Packet::DeepCopy (void) const
+{
+  NS_LOG_FUNCTION (this);
+  uint32_t size = m_buffer.GetSize ();
+  uint8_t *data = new uint8_t [size];
+  m_buffer.CopyData (data, size);
+  Buffer buffer;
+  buffer.AddAtStart (size);
+  buffer.Begin ().Write (data, size);
+  delete [] data;
+
+  ByteTagList byteTagList;
+  byteTagList.Add (m_byteTagList);
+  PacketTagList packetTagList;
+  packetTagList.Add (m_packetTagList);
+
+  Ptr<Packet> copy = Ptr<Packet> (new Packet (buffer, byteTagList, packetTagList, m_metadata.DeepCopy ()), false);
+  if (m_nixVector)
+    {
+      copy->SetNixVector (m_nixVector->Copy ());
+    }
+  return copy;
+}
+
 Packet::Packet ()
   : m_buffer (),
     m_byteTagList (),
@@ -147,11 +196,10 @@ Packet::Packet ()
      * zero.  The lower 32 bits are for the 
      * global UID
      */
-    m_metadata (static_cast<uint64_t> (Simulator::GetSystemId ()) << 32 | m_globalUid, 0),
+    m_metadata (static_cast<uint64_t> (Simulator::GetSystemId ()) << 32 | AllocateUid (), 0),
     m_nixVector (0)
 {
   NS_LOG_FUNCTION (this);
-  m_globalUid++;
 }
 
 Packet::Packet (const Packet &o)
@@ -190,11 +238,10 @@ Packet::Packet (uint32_t size)
      * zero.  The lower 32 bits are for the 
      * global UID
      */
-    m_metadata (static_cast<uint64_t> (Simulator::GetSystemId ()) << 32 | m_globalUid, size),
+    m_metadata (static_cast<uint64_t> (Simulator::GetSystemId ()) << 32 | AllocateUid (), size),
     m_nixVector (0)
 {
   NS_LOG_FUNCTION (this << size);
-  m_globalUid++;
 }
 Packet::Packet (uint8_t const *buffer, uint32_t size, bool magic)
   : m_buffer (0, false),
@@ -218,11 +265,10 @@ Packet::Packet (uint8_t const*buffer, uint32_t size)
      * zero.  The lower 32 bits are for the 
      * global UID
      */
-    m_metadata (static_cast<uint64_t> (Simulator::GetSystemId ()) << 32 | m_globalUid, size),
+    m_metadata (static_cast<uint64_t> (Simulator::GetSystemId ()) << 32 | AllocateUid (), size),
     m_nixVector (0)
 {
   NS_LOG_FUNCTION (this << &buffer << size);
-  m_globalUid++;
   m_buffer.AddAtStart (size);
   Buffer::Iterator i = m_buffer.Begin ();
   i.Write (buffer, size);
@@ -401,6 +447,13 @@ Packet::CopyData (uint8_t *buffer, uint32_t size) const
   return m_buffer.CopyData (buffer, size);
 }
 
+Buffer::Iterator
+Packet::BeginWritable (uint32_t size)
+{
+  NS_LOG_FUNCTION (this << size);
+  return m_buffer.BeginWritable (size);
+}
+
 void
 Packet::CopyData (std::ostream *os, uint32_t size) const
 {
@@ -585,6 +638,45 @@ Packet::EnableChecking (void)
   PacketMetadata::EnableChecking ();
 }
 
+void
+Packet::SetThreadSafe (bool threadSafe)
+{
+  NS_LOG_FUNCTION (threadSafe);
+  ByteTagList::SetThreadSafe (threadSafe);
+  PacketMetadata::SetThreadSafe (threadSafe);
+  g_threadSafe = threadSafe;
+}
+
+bool
+Packet::IsThreadSafe (void)
+{
+  return g_threadSafe;
+}
+
+void
+Packet::SetThreadUid (uint32_t uid)
+{
+  NS_LOG_FUNCTION (uid);
+#ifdef HAVE_TLS
+  g_threadCountsUids = true;
+  g_threadUid = uid;
+#else
+  NS_FATAL_ERROR ("Threads cannot count their own packets without thread local storage");
+#endif
+}
+
+uint32_t
+Packet::GetThreadUid (void)
+{
+#ifdef HAVE_TLS
+  if (g_threadCountsUids)
+    {
+      return g_threadUid;
+    }
+#endif
+  return g_globalUid;
+}
+
 uint32_t Packet::GetSerializedSize (void) const
 {
   NS_LOG_FUNCTION (this);
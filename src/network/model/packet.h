@@ -365,6 +365,20 @@ public:
    */
   void CopyData (std::ostream *os, uint32_t size) const;
 
+  /**
+   * \param size number of bytes at the start of the packet to modify
+   * \returns an iterator which points to the first byte of the packet
+   *
+   * Gives write access to the first size bytes of the packet, usually
+   * its headers, so that fields can be patched in place instead of
+   * removing the headers and adding them back. The bytes are copied
+   * first if they are shared with other packets. The packet metadata
+   * is not updated, so the size and the type of the headers must be
+   * left unchanged. The iterator is invalidated by any other change
+   * to the packet.
+   */
+  Buffer::Iterator BeginWritable (uint32_t size);
+
   /**
    * \returns a COW copy of the packet.
    *
@@ -374,6 +388,15 @@ public:
    */
   Ptr<Packet> Copy (void) const;
 
+  /**
+   * \returns a copy of the packet which shares no data with it.
+   *
+   * Packets count the users of their shared data without atomic
+   * operations, so a packet handed over to another thread must be
+   * such a copy. The uid, tags and metadata are those of the original.
+   */
+  Ptr<Packet> DeepCopy (void) const;
+
   /**
    * A packet is allocated a new uid when it is created
    * empty or with zero-filled payload.
@@ -431,6 +454,38 @@ public:
    */
   static void EnableChecking (void);
 
+  /**
+   * \param threadSafe whether packets are created and destroyed by
+   *        several threads at once
+   *
+   * Packets recycle the memory of their byte tags and metadata through
+   * free lists shared by all threads. A multithreaded simulator makes
+   * packets thread safe while it runs, which bypasses these lists.
+   */
+  static void SetThreadSafe (bool threadSafe);
+  /**
+   * \returns whether packets are thread safe
+   *
+   * \sa SetThreadSafe
+   */
+  static bool IsThreadSafe (void);
+
+  /**
+   * \param uid the lower 32 bits of the uid of the next packet the
+   *        calling thread creates
+   *
+   * From then on, the calling thread numbers its packets on its own. A
+   * multithreaded simulator starts the thread of each system id where
+   * the packets of that system id were left, so that the uids do not
+   * depend on how the threads interleave.
+   */
+  static void SetThreadUid (uint32_t uid);
+  /**
+   * \returns the lower 32 bits of the uid of the next packet the calling
+   * thread creates
+   */
+  static uint32_t GetThreadUid (void);
+
   /**
    * For packet serializtion, the total size is checked 
    * in order to determine the size of the buffer 
@@ -566,8 +621,6 @@ private:
 
   /* Please see comments above about nix-vector */
   Ptr<NixVector> m_nixVector;
-
-  static uint32_t m_globalUid;
 };
 
 std::ostream& operator<< (std::ostream& os, const Packet &packet);
@@ -321,6 +321,27 @@ BufferTest::DoRun (void)
       NS_TEST_ASSERT_MSG_EQ ( evilBuffer [i], cBuf [i] , "Bad buffer peeked");
     }
   free (cBuf);
+
+  // writing in place must not change the content of copies
+  buffer = Buffer (5);
+  buffer.AddAtStart (2);
+  i = buffer.Begin ();
+  i.WriteU8 (0x1);
+  i.WriteU8 (0x2);
+  other = buffer;
+  i = buffer.BeginWritable (2);
+  i.WriteU8 (0x3);
+  ENSURE_WRITTEN_BYTES (buffer, 7, 0x3, 0x2, 0x00, 0x00, 0x00, 0x00, 0x00);
+  ENSURE_WRITTEN_BYTES (other, 7, 0x1, 0x2, 0x00, 0x00, 0x00, 0x00, 0x00);
+  i = buffer.BeginWritable (4);
+  i.Next (3);
+  i.WriteU8 (0x4);
+  ENSURE_WRITTEN_BYTES (buffer, 7, 0x3, 0x2, 0x00, 0x4, 0x00, 0x00, 0x00);
+  ENSURE_WRITTEN_BYTES (other, 7, 0x1, 0x2, 0x00, 0x00, 0x00, 0x00, 0x00);
+  other.AddAtStart (1);
+  other.Begin ().WriteU8 (0x5);
+  ENSURE_WRITTEN_BYTES (buffer, 7, 0x3, 0x2, 0x00, 0x4, 0x00, 0x00, 0x00);
+  ENSURE_WRITTEN_BYTES (other, 8, 0x5, 0x1, 0x2, 0x00, 0x00, 0x00, 0x00, 0x00);
 }
 //-----------------------------------------------------------------------------
 class BufferTestSuite : public TestSuite
@@ -20,6 +20,7 @@
 #include "point-to-point-net-device.h"
 #include "ns3/trace-source-accessor.h"
 #include "ns3/packet.h"
+#include "ns3/node.h"
 #include "ns3/simulator.h"
 #include "ns3/log.h"
 
@@ -93,6 +94,27 @@ PointToPointChannel::TransmitStart (
 
   uint32_t wire = src == m_link[0].m_src ? 0 : 1;
 
+  if (Packet::IsThreadSafe ())
+    {
+      // The receiver may run on another thread of a multithreaded
+      // simulation, which counts the references to its device, node and
+      // packets without atomic operations: it gets a copy of the packet
+      // that shares nothing with this one, and no reference is taken here.
+      PointToPointNetDevice *dst = PeekPointer (m_link[wire].m_dst);
+      Node *dstNode = PeekPointer (dst->m_node);
+      if (dstNode->GetSystemId () != src->m_node->GetSystemId ())
+        {
+          Simulator::ScheduleWithContext (dstNode->GetId (),
+                                          txTime + m_delay, &PointToPointNetDevice::Receive,
+                                          dst, p->DeepCopy ());
+          if (!m_txrxPointToPoint.IsEmpty ())
+            {
+              m_txrxPointToPoint (p, src, m_link[wire].m_dst, txTime, txTime + m_delay);
+            }
+          return true;
+        }
+    }
+
   Simulator::ScheduleWithContext (m_link[wire].m_dst->GetNode ()->GetId (),
                                   txTime + m_delay, &PointToPointNetDevice::Receive,
                                   m_link[wire].m_dst, p);
@@ -189,6 +189,9 @@ protected:
   void DoMpiReceive (Ptr<Packet> p);
 
 private:
+  // the channel reads the node of the receiving device without taking a
+  // reference to it, see PointToPointChannel::TransmitStart
+  friend class PointToPointChannel;
 
   PointToPointNetDevice& operator = (const PointToPointNetDevice &);
   PointToPointNetDevice (const PointToPointNetDevice &);
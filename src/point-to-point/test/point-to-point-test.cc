@@ -3,6 +3,12 @@
 #include "ns3/simulator.h"
 #include "ns3/point-to-point-net-device.h"
 #include "ns3/point-to-point-channel.h"
+#include "ns3/global-value.h"
+#include "ns3/string.h"
+#include "ns3/data-rate.h"
+
+#include <vector>
+#include <utility>
 
 using namespace ns3;
 
@@ -56,6 +62,114 @@ PointToPointTest::DoRun (void)
   Simulator::Destroy ();
 }
 //-----------------------------------------------------------------------------
+// A chain of nodes of three system ids bouncing packets at each other must
+// see the same packets at the same times with the multithreaded simulator
+// as with the default one
+class PointToPointMultithreadedTest : public TestCase
+{
+public:
+  PointToPointMultithreadedTest ();
+
+  virtual void DoRun (void);
+
+private:
+  typedef std::vector<std::pair<uint64_t, uint32_t> > Receptions;
+
+  std::vector<Receptions> RunChain (std::string simulatorImpl);
+  void Send (Ptr<NetDevice> device, uint32_t size);
+  bool Receive (Ptr<NetDevice> device, Ptr<const Packet> p, uint16_t protocol, const Address &from);
+
+  std::vector<Receptions> m_receptions;
+};
+
+PointToPointMultithreadedTest::PointToPointMultithreadedTest ()
+  : TestCase ("PointToPoint links between the threads of a multithreaded simulation")
+{
+}
+
+void
+PointToPointMultithreadedTest::Send (Ptr<NetDevice> device, uint32_t size)
+{
+  device->Send (Create<Packet> (size), device->GetBroadcast (), 0x800);
+}
+
+bool
+PointToPointMultithreadedTest::Receive (Ptr<NetDevice> device, Ptr<const Packet> p, uint16_t protocol,
+                                        const Address &from)
+{
+  // every node records into its own vector, from the thread of its system id
+  m_receptions[device->GetNode ()->GetId ()].push_back (std::make_pair (Simulator::Now ().GetTimeStep (),
+                                                                        p->GetSize ()));
+  if (p->GetSize () > 1)
+    {
+      Send (device, p->GetSize () - 1);
+    }
+  return true;
+}
+
+std::vector<PointToPointMultithreadedTest::Receptions>
+PointToPointMultithreadedTest::RunChain (std::string simulatorImpl)
+{
+  GlobalValue::Bind ("SimulatorImplementationType", StringValue (simulatorImpl));
+
+  const uint32_t nNodes = 6;
+  std::vector<Ptr<Node> > nodes;
+  for (uint32_t i = 0; i < nNodes; i++)
+    {
+      nodes.push_back (CreateObject<Node> (i / 2));
+    }
+  m_receptions.assign (nodes.back ()->GetId () + 1, Receptions ());
+  for (uint32_t i = 0; i + 1 < nNodes; i++)
+    {
+      Ptr<PointToPointChannel> channel = CreateObject<PointToPointChannel> ();
+      channel->SetAttribute ("Delay", TimeValue (MicroSeconds (300 + 70 * i)));
+      for (uint32_t j = i; j <= i + 1; j++)
+        {
+          Ptr<PointToPointNetDevice> device = CreateObject<PointToPointNetDevice> ();
+          device->SetAddress (Mac48Address::Allocate ());
+          device->SetQueue (CreateObject<DropTailQueue> ());
+          device->SetDataRate (DataRate (1000000 + 10000 * j));
+          device->Attach (channel);
+          nodes[j]->AddDevice (device);
+          device->SetReceiveCallback (MakeCallback (&PointToPointMultithreadedTest::Receive, this));
+          Simulator::ScheduleWithContext (nodes[j]->GetId (), MicroSeconds (1000 + 130 * j + 17 * i),
+                                          &PointToPointMultithreadedTest::Send, this, device, 40 + j);
+        }
+    }
+  Simulator::Stop (MilliSeconds (500));
+  Simulator::Run ();
+  Simulator::Destroy ();
+  return m_receptions;
+}
+
+void
+PointToPointMultithreadedTest::DoRun (void)
+{
+  TypeId tid;
+  if (!TypeId::LookupByNameFailSafe ("ns3::MultithreadedSimulatorImpl", &tid))
+    {
+      // built without threads
+      return;
+    }
+  std::vector<Receptions> sequential = RunChain ("ns3::DefaultSimulatorImpl");
+  std::vector<Receptions> multithreaded = RunChain ("ns3::MultithreadedSimulatorImpl");
+  GlobalValue::Bind ("SimulatorImplementationType", StringValue ("ns3::DefaultSimulatorImpl"));
+
+  NS_TEST_ASSERT_MSG_EQ (multithreaded.size (), sequential.size (), "different number of nodes");
+  uint32_t total = 0;
+  for (uint32_t i = 0; i < sequential.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (multithreaded[i].size (), sequential[i].size (), "node " << i);
+      for (uint32_t j = 0; j < sequential[i].size (); j++)
+        {
+          NS_TEST_ASSERT_MSG_EQ (multithreaded[i][j].first, sequential[i][j].first, "node " << i << " packet " << j);
+          NS_TEST_ASSERT_MSG_EQ (multithreaded[i][j].second, sequential[i][j].second, "node " << i << " packet " << j);
+        }
+      total += sequential[i].size ();
+    }
+  NS_TEST_ASSERT_MSG_GT (total, 100, "too few packets to compare");
+}
+//-----------------------------------------------------------------------------
 class PointToPointTestSuite : public TestSuite
 {
 public:
@@ -66,6 +180,7 @@ PointToPointTestSuite::PointToPointTestSuite ()
   : TestSuite ("devices-point-to-point", UNIT)
 {
   AddTestCase (new PointToPointTest);
+  AddTestCase (new PointToPointMultithreadedTest);
 }
 
 static PointToPointTestSuite g_pointToPointTestSuite;
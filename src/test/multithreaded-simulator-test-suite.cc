@@ -0,0 +1,401 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// End-to-end test of the multithreaded simulator against the default one
+
+#include <sstream>
+#include <vector>
+#include "ns3/bulk-send-helper.h"
+#include "ns3/global-value.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-address-helper.h"
+#include "ns3/ipv4-global-routing-helper.h"
+#include "ns3/node.h"
+#include "ns3/node-container.h"
+#include "ns3/on-off-helper.h"
+#include "ns3/packet.h"
+#include "ns3/packet-sink-helper.h"
+#include "ns3/packet-sink.h"
+#include "ns3/point-to-point-helper.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/simulator.h"
+#include "ns3/string.h"
+#include "ns3/test.h"
+#include "ns3/uinteger.h"
+
+using namespace ns3;
+
+// Every sink records the times and sizes of what it receives, from the
+// thread of its system id
+typedef std::vector<std::pair<uint64_t, uint32_t> > Receptions;
+
+static void
+Received (Receptions *receptions, Ptr<const Packet> p, const Address &from)
+{
+  receptions->push_back (std::make_pair (Simulator::Now ().GetTimeStep (), p->GetSize ()));
+}
+
+// A router with three leaves, every node of its own system id, carrying
+// UDP on-off flows and a TCP bulk transfer between the leaves
+class MultithreadedInternetTestCase : public TestCase
+{
+public:
+  MultithreadedInternetTestCase ();
+
+private:
+  virtual void DoRun (void);
+  std::vector<Receptions> RunStar (std::string simulatorImpl);
+};
+
+MultithreadedInternetTestCase::MultithreadedInternetTestCase ()
+  : TestCase ("UDP and TCP flows between the threads of a multithreaded simulation")
+{
+}
+
+std::vector<Receptions>
+MultithreadedInternetTestCase::RunStar (std::string simulatorImpl)
+{
+  GlobalValue::Bind ("SimulatorImplementationType", StringValue (simulatorImpl));
+
+  Ptr<Node> router = CreateObject<Node> (0);
+  NodeContainer leaves;
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      leaves.Add (CreateObject<Node> (i + 1));
+    }
+  InternetStackHelper stack;
+  stack.Install (router);
+  stack.Install (leaves);
+
+  PointToPointHelper link;
+  link.SetDeviceAttribute ("DataRate", StringValue ("5Mbps"));
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.0.0", "255.255.255.0");
+  std::vector<Ipv4Address> addresses;
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      link.SetChannelAttribute ("Delay", StringValue (i == 1 ? "3ms" : "2ms"));
+      Ipv4InterfaceContainer interfaces = address.Assign (link.Install (leaves.Get (i), router));
+      addresses.push_back (interfaces.GetAddress (0));
+      address.NewNetwork ();
+    }
+  Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+
+  // UDP from leaf 0 to leaf 1 and from leaf 1 to leaf 2, TCP from leaf 2
+  // to leaf 0
+  std::vector<Receptions> receptions (3);
+  uint16_t port = 9;
+  OnOffHelper onoff ("ns3::UdpSocketFactory", Address ());
+  onoff.SetAttribute ("OnTime", StringValue ("ns3::ConstantRandomVariable[Constant=0.3]"));
+  onoff.SetAttribute ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=0.2]"));
+  onoff.SetAttribute ("DataRate", StringValue ("1Mbps"));
+  onoff.SetAttribute ("PacketSize", UintegerValue (700));
+  ApplicationContainer apps;
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      onoff.SetAttribute ("Remote", AddressValue (InetSocketAddress (addresses[i + 1], port)));
+      apps.Add (onoff.Install (leaves.Get (i)));
+      PacketSinkHelper sink ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), port));
+      ApplicationContainer sinkApp = sink.Install (leaves.Get (i + 1));
+      sinkApp.Get (0)->TraceConnectWithoutContext ("Rx", MakeBoundCallback (&Received, &receptions[i]));
+      apps.Add (sinkApp);
+    }
+  BulkSendHelper bulk ("ns3::TcpSocketFactory", InetSocketAddress (addresses[0], port));
+  bulk.SetAttribute ("MaxBytes", UintegerValue (300000));
+  apps.Add (bulk.Install (leaves.Get (2)));
+  PacketSinkHelper tcpSink ("ns3::TcpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), port));
+  ApplicationContainer tcpSinkApp = tcpSink.Install (leaves.Get (0));
+  tcpSinkApp.Get (0)->TraceConnectWithoutContext ("Rx", MakeBoundCallback (&Received, &receptions[2]));
+  apps.Add (tcpSinkApp);
+  apps.Start (Seconds (0.1));
+  apps.Stop (Seconds (2.0));
+
+  Simulator::Stop (Seconds (2.5));
+  Simulator::Run ();
+  Simulator::Destroy ();
+  return receptions;
+}
+
+void
+MultithreadedInternetTestCase::DoRun (void)
+{
+  TypeId tid;
+  if (!TypeId::LookupByNameFailSafe ("ns3::MultithreadedSimulatorImpl", &tid))
+    {
+      // built without threads
+      return;
+    }
+  std::vector<Receptions> sequential = RunStar ("ns3::DefaultSimulatorImpl");
+  std::vector<Receptions> multithreaded = RunStar ("ns3::MultithreadedSimulatorImpl");
+  GlobalValue::Bind ("SimulatorImplementationType", StringValue ("ns3::DefaultSimulatorImpl"));
+
+  const char *flows[] = { "UDP flow to leaf 1", "UDP flow to leaf 2", "TCP flow to leaf 0" };
+  for (uint32_t i = 0; i < sequential.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_GT (sequential[i].size (), 100, flows[i] << " too short to compare");
+      NS_TEST_ASSERT_MSG_EQ (multithreaded[i].size (), sequential[i].size (), flows[i]);
+      for (uint32_t j = 0; j < sequential[i].size () && j < multithreaded[i].size (); j++)
+        {
+          NS_TEST_ASSERT_MSG_EQ (multithreaded[i][j].first, sequential[i][j].first, flows[i] << " packet " << j);
+          NS_TEST_ASSERT_MSG_EQ (multithreaded[i][j].second, sequential[i][j].second, flows[i] << " packet " << j);
+        }
+    }
+}
+
+// Nodes of four system ids run random events on each other, with many
+// events of equal timestamps scheduled by different threads
+class MultithreadedRandomEventsTestCase : public TestCase
+{
+public:
+  MultithreadedRandomEventsTestCase ();
+
+private:
+  enum { NODES = 8, SYSTEMS = 4, SEEDS = 96 };
+  // the events each node ran, by time and token
+  typedef std::vector<std::pair<uint64_t, uint64_t> > Log;
+  struct Events
+  {
+    std::vector<Log> nodes;
+    // the events without a node context
+    Log global;
+    // the packet uids and random numbers each node drew
+    std::vector<std::vector<uint64_t> > drawn;
+    // the last event each node scheduled for itself
+    std::vector<EventId> last;
+  };
+
+  virtual void DoRun (void);
+  static uint64_t Hash (uint64_t x);
+  static void Fire (Events *events, uint32_t node, uint64_t token);
+  static void FireGlobal (Events *events, uint64_t token);
+  Events RunEvents (std::string simulatorImpl);
+  void CompareLogs (const Log &a, const Log &b, std::string what);
+};
+
+// events are scheduled up to this time, in nanoseconds
+static const uint64_t RANDOM_EVENTS_END = 150000;
+// the delay of the links between the system ids, in nanoseconds
+static const uint64_t RANDOM_EVENTS_LOOKAHEAD = 3000;
+
+MultithreadedRandomEventsTestCase::MultithreadedRandomEventsTestCase ()
+  : TestCase ("Random events across the threads of a multithreaded simulation run in the sequential order")
+{
+}
+
+uint64_t
+MultithreadedRandomEventsTestCase::Hash (uint64_t x)
+{
+  // splitmix64
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+void
+MultithreadedRandomEventsTestCase::Fire (Events *events, uint32_t node, uint64_t token)
+{
+  uint64_t now = Simulator::Now ().GetTimeStep ();
+  uint64_t h = Hash (token);
+  // whether the last event the node scheduled for itself is still pending
+  // depends on the order of the events
+  uint64_t expired = events->last[node].IsExpired () ? 1 : 0;
+  events->nodes[node].push_back (std::make_pair (now, token ^ expired));
+  if ((h & 0xf) == 0)
+    {
+      Simulator::Cancel (events->last[node]);
+    }
+  else if ((h & 0xf) == 1)
+    {
+      Simulator::Remove (events->last[node]);
+    }
+  if ((h >> 4 & 0x7) == 0)
+    {
+      // neither packet uids nor random streams are those of the sequential
+      // simulator, but they must not depend on the threads either
+      Ptr<UniformRandomVariable> random = CreateObject<UniformRandomVariable> ();
+      events->drawn[node].push_back (Create<Packet> ()->GetUid ());
+      events->drawn[node].push_back (random->GetInteger (0, 1000000));
+    }
+  if (now >= RANDOM_EVENTS_END)
+    {
+      return;
+    }
+  // on average one new event, for this node, another of its system id,
+  // another system id or no node
+  uint32_t children = h >> 8 & 0x3;
+  if (children == 3)
+    {
+      children = 1;
+    }
+  for (uint32_t i = 0; i < children; i++)
+    {
+      uint64_t child = Hash (token + i + 1);
+      uint64_t delay = (child & 0x3) * 1000;
+      uint32_t other = (child >> 2) % NODES;
+      switch (child >> 8 & 0x7)
+        {
+        case 0:
+          Simulator::ScheduleWithContext (0xffffffff, NanoSeconds (RANDOM_EVENTS_LOOKAHEAD + delay),
+                                          &MultithreadedRandomEventsTestCase::FireGlobal, events, child);
+          break;
+        case 1:
+        case 2:
+          // a node of another system id
+          other = (node + 1 + other % (SYSTEMS - 1)) % SYSTEMS + SYSTEMS * (other % (NODES / SYSTEMS));
+          Simulator::ScheduleWithContext (other, NanoSeconds (RANDOM_EVENTS_LOOKAHEAD + delay),
+                                          &MultithreadedRandomEventsTestCase::Fire, events, other, child);
+          break;
+        case 3:
+          // the other node of the same system id
+          other = (node + SYSTEMS) % NODES;
+          Simulator::ScheduleWithContext (other, NanoSeconds (delay),
+                                          &MultithreadedRandomEventsTestCase::Fire, events, other, child);
+          break;
+        default:
+          events->last[node] = Simulator::Schedule (NanoSeconds (delay),
+                                                    &MultithreadedRandomEventsTestCase::Fire, events, node, child);
+          break;
+        }
+    }
+}
+
+void
+MultithreadedRandomEventsTestCase::FireGlobal (Events *events, uint64_t token)
+{
+  uint64_t now = Simulator::Now ().GetTimeStep ();
+  events->global.push_back (std::make_pair (now, token));
+  uint64_t h = Hash (token);
+  // at once, and for the same time as the events of the nodes
+  uint32_t node = h % NODES;
+  Simulator::ScheduleWithContext (node, NanoSeconds (h >> 8 & 0x1), &MultithreadedRandomEventsTestCase::Fire,
+                                  events, node, Hash (h));
+  if ((h >> 12 & 0x3) == 0)
+    {
+      Simulator::Schedule (NanoSeconds (1000), &MultithreadedRandomEventsTestCase::FireGlobal, events, Hash (token + 1));
+    }
+}
+
+MultithreadedRandomEventsTestCase::Events
+MultithreadedRandomEventsTestCase::RunEvents (std::string simulatorImpl)
+{
+  GlobalValue::Bind ("SimulatorImplementationType", StringValue (simulatorImpl));
+
+  // node i has system id i % SYSTEMS; the links only set the lookahead
+  NodeContainer nodes;
+  for (uint32_t i = 0; i < NODES; i++)
+    {
+      nodes.Add (CreateObject<Node> (i % SYSTEMS));
+    }
+  PointToPointHelper link;
+  link.SetChannelAttribute ("Delay", TimeValue (NanoSeconds (RANDOM_EVENTS_LOOKAHEAD)));
+  for (uint32_t i = 0; i < SYSTEMS; i++)
+    {
+      link.Install (nodes.Get (i), nodes.Get ((i + 1) % SYSTEMS));
+    }
+
+  Events events;
+  events.nodes.resize (NODES);
+  events.drawn.resize (NODES);
+  events.last.resize (NODES);
+  for (uint32_t i = 0; i < NODES * SEEDS; i++)
+    {
+      uint64_t h = Hash (i);
+      uint32_t node = i % NODES;
+      Simulator::ScheduleWithContext (node, NanoSeconds ((h & 0x7) * 1000), &MultithreadedRandomEventsTestCase::Fire,
+                                      &events, node, h);
+    }
+  Simulator::Schedule (NanoSeconds (2000), &MultithreadedRandomEventsTestCase::FireGlobal, &events, 1);
+
+  // a second run takes over the events the first left, with new ones
+  // scheduled in between
+  Simulator::Stop (NanoSeconds (RANDOM_EVENTS_END / 2));
+  Simulator::Run ();
+  for (uint32_t i = 0; i < NODES; i++)
+    {
+      Simulator::ScheduleWithContext (i, NanoSeconds (i % 2 * 1000), &MultithreadedRandomEventsTestCase::Fire,
+                                      &events, i, Hash (i + NODES * SEEDS));
+    }
+  Simulator::Schedule (NanoSeconds (0), &MultithreadedRandomEventsTestCase::FireGlobal, &events, 2);
+  Simulator::Run ();
+  Simulator::Destroy ();
+  return events;
+}
+
+void
+MultithreadedRandomEventsTestCase::CompareLogs (const Log &a, const Log &b, std::string what)
+{
+  NS_TEST_ASSERT_MSG_EQ (a.size (), b.size (), what);
+  // the events after the first difference differ as well
+  for (uint32_t i = 0; i < a.size () && i < b.size (); i++)
+    {
+      if (a[i] != b[i])
+        {
+          NS_TEST_ASSERT_MSG_EQ (a[i].first, b[i].first, what << " event " << i);
+          NS_TEST_ASSERT_MSG_EQ (a[i].second, b[i].second, what << " event " << i);
+          break;
+        }
+    }
+}
+
+void
+MultithreadedRandomEventsTestCase::DoRun (void)
+{
+  TypeId tid;
+  if (!TypeId::LookupByNameFailSafe ("ns3::MultithreadedSimulatorImpl", &tid))
+    {
+      // built without threads
+      return;
+    }
+  Events sequential = RunEvents ("ns3::DefaultSimulatorImpl");
+  Events multithreaded = RunEvents ("ns3::MultithreadedSimulatorImpl");
+  Events again = RunEvents ("ns3::MultithreadedSimulatorImpl");
+  GlobalValue::Bind ("SimulatorImplementationType", StringValue ("ns3::DefaultSimulatorImpl"));
+
+  for (uint32_t i = 0; i < NODES; i++)
+    {
+      std::ostringstream oss;
+      oss << "events of node " << i;
+      NS_TEST_ASSERT_MSG_GT (sequential.nodes[i].size (), 1000, oss.str () << " too few to compare");
+      CompareLogs (multithreaded.nodes[i], sequential.nodes[i], oss.str ());
+      // the main thread counts as the sequential simulator does, from
+      // where the last simulation left the counters
+      if (i % SYSTEMS != 0)
+        {
+          NS_TEST_ASSERT_MSG_EQ ((again.drawn[i] == multithreaded.drawn[i]), true,
+                                 "packet uids or random numbers of node " << i << " differ between runs");
+        }
+    }
+  NS_TEST_ASSERT_MSG_GT (sequential.global.size (), 10, "too few events without a node context to compare");
+  CompareLogs (multithreaded.global, sequential.global, "events without a node context");
+}
+
+class MultithreadedSimulatorTestSuite : public TestSuite
+{
+public:
+  MultithreadedSimulatorTestSuite ();
+};
+
+MultithreadedSimulatorTestSuite::MultithreadedSimulatorTestSuite ()
+  : TestSuite ("multithreaded-simulator", SYSTEM)
+{
+  AddTestCase (new MultithreadedInternetTestCase);
+  AddTestCase (new MultithreadedRandomEventsTestCase);
+}
+
+// Do not forget to allocate an instance of this TestSuite
+static MultithreadedSimulatorTestSuite multithreadedSimulatorTestSuite;
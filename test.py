@@ -54,6 +54,7 @@ interesting_config_items = [
     "ENABLE_CLICK",
     "ENABLE_BRITE",
     "ENABLE_OPENFLOW",
+    "ENABLE_MPI",
     "APPNAME",
     "BUILD_PROFILE",
     "VERSION",
@@ -68,6 +69,7 @@ ENABLE_TESTS = True
 ENABLE_CLICK = False
 ENABLE_BRITE = False
 ENABLE_OPENFLOW = False
+ENABLE_MPI = False
 EXAMPLE_DIRECTORIES = []
 APPNAME = ""
 BUILD_PROFILE = ""
@@ -118,7 +120,8 @@ def parse_examples_to_run_file(
     cpp_executable_dir,
     python_script_dir,
     example_tests,
-    python_tests):
+    python_tests,
+    mpi_tests):
 
     # Look for the examples-to-run file exists.
     if os.path.exists(examples_to_run_path):
@@ -201,6 +204,30 @@ def parse_examples_to_run_file(
                 # Add this example.
                 python_tests.append((example_path, do_run))
 
+        # Each tuple in the list of distributed C++ examples to run contains
+        #
+        #     (example_name, ranks, do_run, expected_output)
+        #
+        # where example_name is the executable to be run under mpiexec on
+        # ranks processes, do_run is a condition under which to run the
+        # example, and expected_output is a regular expression its standard
+        # output must match for the example to pass.  For example,
+        #
+        #     ("simple-distributed", 2, "ENABLE_MPI == True", "^$"),
+        #
+        mpi_examples = get_list_from_file(examples_to_run_path, "mpi_examples")
+        for example_name, ranks, do_run, expected_output in mpi_examples:
+            # Seperate the example name from its arguments.
+            example_name_parts = example_name.split(' ', 1)
+            example_name = "%s%s-%s-%s" % (APPNAME, VERSION, example_name_parts[0], BUILD_PROFILE)
+            example_path = os.path.join(cpp_executable_dir, example_name)
+            if os.path.exists(example_path):
+                if len(example_name_parts) != 1:
+                    example_path = "%s %s" % (example_path, example_name_parts[1])
+
+                # Add this example.
+                mpi_tests.append((example_path, ranks, do_run, expected_output))
+
 #
 # The test suites are going to want to output status.  They are running
 # concurrently.  This means that unless we are careful, the output of
@@ -717,7 +744,7 @@ def make_paths():
 #
 VALGRIND_SUPPRESSIONS_FILE = "testpy.supp"
 
-def run_job_synchronously(shell_command, directory, valgrind, is_python, build_path=""):
+def run_job_synchronously(shell_command, directory, valgrind, is_python, build_path="", mpi_ranks=0):
     suppressions_path = os.path.join (NS3_BASEDIR, VALGRIND_SUPPRESSIONS_FILE)
 
     if is_python:
@@ -731,6 +758,8 @@ def run_job_synchronously(shell_command, directory, valgrind, is_python, build_p
     if valgrind:
         cmd = "valgrind --suppressions=%s --leak-check=full --show-reachable=yes --error-exitcode=2 %s" % (suppressions_path, 
             path_cmd)
+    elif mpi_ranks:
+        cmd = "mpiexec -np %d %s" % (mpi_ranks, path_cmd)
     else:
         cmd = path_cmd
 
@@ -781,6 +810,8 @@ class Job:
         self.returncode = False
         self.elapsed_time = 0
         self.build_path = ""
+        self.mpi_ranks = 0
+        self.expected_output = ""
 
     #
     # A job is either a standard job or a special job indicating that a worker
@@ -831,6 +862,17 @@ class Job:
     def set_build_path(self, build_path):
         self.build_path = build_path
 
+    #
+    # Distributed examples run under mpiexec on this number of processes,
+    # and pass only if their standard output matches the expected output,
+    # a regular expression.
+    #
+    def set_mpi_ranks(self, mpi_ranks):
+        self.mpi_ranks = mpi_ranks
+
+    def set_expected_output(self, expected_output):
+        self.expected_output = expected_output
+
     #
     # This is the dispaly name of the job, typically the test suite or example 
     # name.  For example,
@@ -944,7 +986,10 @@ class worker_thread(threading.Thread):
                     # "examples/wireless/mixed-wireless.py"
                     #
                     (job.returncode, standard_out, standard_err, et) = run_job_synchronously(job.shell_command, 
-                        job.cwd, options.valgrind, job.is_pyexample, job.build_path)
+                        job.cwd, options.valgrind, job.is_pyexample, job.build_path, job.mpi_ranks)
+                    if job.returncode == 0 and job.expected_output and \
+                            not re.search(job.expected_output, standard_out, re.MULTILINE):
+                        job.set_returncode(1)
                 else:
                     #
                     # If we're a test suite, we need to provide a little more info
@@ -1071,6 +1116,7 @@ def run_tests():
     #
     example_tests = []
     python_tests = []
+    mpi_tests = []
     for directory in EXAMPLE_DIRECTORIES:
         # Set the directories and paths for this example. 
         example_directory   = os.path.join("examples", directory)
@@ -1084,7 +1130,8 @@ def run_tests():
             cpp_executable_dir,
             python_script_dir,
             example_tests,
-            python_tests)
+            python_tests,
+            mpi_tests)
 
     for module in NS3_ENABLED_MODULES:
         # Remove the "ns3-" from the module name.
@@ -1103,7 +1150,8 @@ def run_tests():
             cpp_executable_dir,
             python_script_dir,
             example_tests,
-            python_tests)
+            python_tests,
+            mpi_tests)
 
     #
     # If lots of logging is enabled, we can crash Python when it tries to 
@@ -1403,6 +1451,38 @@ def run_tests():
                             jobs = jobs + 1
                             total_tests = total_tests + 1
 
+                for test, ranks, do_run, expected_output in mpi_tests:
+                    # Remove any arguments and directory names from test.
+                    test_name = test.split(' ', 1)[0] 
+                    test_name = os.path.basename(test_name)
+
+                    # Don't try to run this example if it isn't runnable.
+                    if ns3_runnable_programs_dictionary.has_key(test_name):
+                        if eval(do_run):
+                            job = Job()
+                            job.set_is_example(True)
+                            job.set_is_pyexample(False)
+                            job.set_display_name(test)
+                            job.set_tmp_file_name("")
+                            job.set_cwd(testpy_output_dir)
+                            job.set_basedir(os.getcwd())
+                            job.set_tempdir(testpy_output_dir)
+                            job.set_shell_command(test)
+                            job.set_build_path(options.buildpath)
+                            job.set_mpi_ranks(ranks)
+                            job.set_expected_output(expected_output)
+
+                            # mpiexec does not run under valgrind
+                            if options.valgrind:
+                                job.set_is_skip (True)
+
+                            if options.verbose:
+                                print "Queue %s" % test
+
+                            input_queue.put(job)
+                            jobs = jobs + 1
+                            total_tests = total_tests + 1
+
     elif len(options.example):
         # Add the proper prefix and suffix to the example name to
         # match what is done in the wscript file.
@@ -0,0 +1,186 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Measures the cost of classifying a packet against packet filter rule
+// sets of growing size, with the rules compiled by Ipv4Filter and with a
+// linear search for the first matching rule. The rules look like those
+// of a firewall: services on hosts and subnets, reached from prefixes of
+// various lengths, with some port ranges and stateful rules among them.
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/ipv4-filter.h"
+#include <iostream>
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+
+using namespace ns3;
+
+static uint32_t g_seed = 1;
+
+static uint32_t
+Random (void)
+{
+  g_seed = g_seed * 1103515245U + 12345U;
+  return g_seed >> 8;
+}
+
+static Ipv4FilterRule
+CreateRule (void)
+{
+  static const uint32_t sourcePrefixes[] = { 0, 8, 16, 24, 32 };
+  static const uint16_t services[] = { 22, 25, 53, 80, 443, 993, 3306, 8080 };
+  Ipv4FilterRule rule ((Random () % 4) ? NF_ACCEPT : NF_DROP);
+  uint32_t length = sourcePrefixes[Random () % 5];
+  rule.SetSource (Ipv4Address (0x0a000000 | (Random () & 0x00ffffff)),
+                  Ipv4Mask (length ? ~0U << (32 - length) : 0));
+  // servers are hosts or /24 subnets of 172.16/12
+  rule.SetDestination (Ipv4Address (0xac100000 | (Random () & 0x000fffff)),
+                       Ipv4Mask ((Random () % 4) ? "255.255.255.255" : "255.255.255.0"));
+  switch (Random () % 8)
+    {
+    case 0:
+      rule.SetProtocol (17);
+      rule.SetDestinationPortRange (1024, 65535);
+      break;
+    case 1:
+      rule.SetProtocol (1);
+      break;
+    default:
+      {
+        uint16_t port = services[Random () % 8];
+        rule.SetProtocol ((Random () % 4) ? 6 : 17);
+        rule.SetDestinationPortRange (port, port);
+        break;
+      }
+    }
+  if (Random () % 8 == 0)
+    {
+      rule.SetState (Ipv4FilterRule::STATE_ESTABLISHED);
+    }
+  return rule;
+}
+
+struct Probe
+{
+  Ipv4Address source;
+  Ipv4Address destination;
+  uint8_t protocol;
+  uint16_t sourcePort;
+  uint16_t destinationPort;
+  uint8_t state;
+};
+
+static void
+RunBench (uint32_t nRules, uint32_t packets)
+{
+  g_seed = 1;
+  Ptr<Ipv4Filter> filter = CreateObject<Ipv4Filter> ();
+  std::vector<Ipv4FilterRule> rules;
+  for (uint32_t i = 0; i < nRules; i++)
+    {
+      rules.push_back (CreateRule ());
+      filter->AddRule (NF_INET_FORWARD, rules.back ());
+    }
+
+  // half of the packets are sent to a destination of some rule
+  std::vector<Probe> probes (1024);
+  for (uint32_t i = 0; i < probes.size (); i++)
+    {
+      Probe &probe = probes[i];
+      const Ipv4FilterRule &rule = rules[Random () % nRules];
+      probe.source = Ipv4Address (0x0a000000 | (Random () & 0x00ffffff));
+      probe.destination = (Random () & 1) ? Ipv4Address (rule.GetDestination ().Get () | (Random () & 0xff))
+        : Ipv4Address (0xac100000 | (Random () & 0x000fffff));
+      probe.protocol = rule.GetProtocol () ? rule.GetProtocol () : 6;
+      probe.sourcePort = 1024 + Random () % 60000;
+      probe.destinationPort = rule.GetDestinationPortFirst ();
+      probe.state = 1 << (Random () % 3);
+    }
+
+  SystemWallClockMs time;
+  time.Start ();
+  filter->GetNTuples (NF_INET_FORWARD);
+  double compile = time.End ();
+
+  int64_t check = 0;
+  time.Start ();
+  for (uint32_t i = 0; i < packets; i++)
+    {
+      const Probe &probe = probes[i & 1023];
+      check += filter->Classify (NF_INET_FORWARD, probe.source, probe.destination, probe.protocol,
+                                 probe.protocol != 1, probe.sourcePort, probe.destinationPort, probe.state);
+    }
+  double compiled = time.End ();
+
+  int64_t linearCheck = 0;
+  time.Start ();
+  for (uint32_t i = 0; i < packets; i++)
+    {
+      const Probe &probe = probes[i & 1023];
+      int32_t found = -1;
+      for (uint32_t j = 0; j < rules.size (); j++)
+        {
+          if (rules[j].Matches (probe.source, probe.destination, probe.protocol, probe.protocol != 1,
+                                probe.sourcePort, probe.destinationPort, probe.state))
+            {
+              found = j;
+              break;
+            }
+        }
+      linearCheck += found;
+    }
+  double linear = time.End ();
+
+  std::cout << "rules=" << nRules
+            << " tuples=" << filter->GetNTuples (NF_INET_FORWARD)
+            << " compile=" << compile << "ms"
+            << " compiled=" << (compiled * 1000000.0) / packets << "ns/pkt"
+            << " linear=" << (linear * 1000000.0) / packets << "ns/pkt"
+            << (check == linearCheck ? "" : " MISMATCH")
+            << std::endl;
+}
+
+int main (int argc, char *argv[])
+{
+  uint32_t maxRules = 10000;
+  uint32_t packets = 100000;
+
+  argc--;
+  argv++;
+  while (argc > 0)
+    {
+      if (strncmp ("--rules=", argv[0], strlen ("--rules=")) == 0)
+        {
+          maxRules = atoi (argv[0] + strlen ("--rules="));
+        }
+      else if (strncmp ("--packets=", argv[0], strlen ("--packets=")) == 0)
+        {
+          packets = atoi (argv[0] + strlen ("--packets="));
+        }
+      argc--;
+      argv++;
+    }
+
+  for (uint32_t nRules = 10; nRules <= maxRules; nRules *= 10)
+    {
+      RunBench (nRules, packets);
+    }
+
+  return 0;
+}
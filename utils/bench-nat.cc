@@ -0,0 +1,264 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Forwards packets of many concurrent UDP flows through a NAT node and
+// reports the cost per packet. Packets enter Ipv4L3Protocol::Receive ()
+// as if they came from a device, so each one runs through the
+// PRE_ROUTING, FORWARD and POST_ROUTING hooks with conntrack and NAT
+// installed, the routing lookup and the send on the output device.
+// Half of the packets are outbound, half of them are replies.
+//
+// The flows are translated by static rules, by dynamic rules or, in the
+// mixed mode, half and half.
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/simple-net-device.h"
+#include "ns3/simple-channel.h"
+#include "ns3/ipv4-nat.h"
+#include "ns3/ipv4-nat-helper.h"
+#include "ns3/ipv4-netfilter.h"
+#include "ns3/ipv4-static-routing-helper.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <string.h>
+#include <stdlib.h>
+
+using namespace ns3;
+
+enum Mode
+{
+  STATIC,
+  DYNAMIC,
+  MIXED
+};
+
+static const char *g_modeNames[] = { "static", "dynamic", "mixed" };
+
+// 203.0.113.8/30 gives the NAT the two global addresses .9 and .10 for
+// dynamic translations, static translations use .32 and up
+static const Ipv4Address g_globalFirst ("203.0.113.9");
+static const uint32_t g_globalCount = 2;
+static const Ipv4Address g_staticFirst ("203.0.113.32");
+static const Ipv4Address g_server ("198.51.100.7");
+
+static Ipv4Address
+InsideHost (uint32_t flow)
+{
+  // 10.0.0.0/8, sixteen flows per host
+  return Ipv4Address (0x0a000000 + 1 + (flow >> 4));
+}
+
+static uint16_t
+InsidePort (uint32_t flow)
+{
+  return 1024 + (flow & 0xf);
+}
+
+static bool
+IsStatic (Mode mode, uint32_t flow)
+{
+  return mode == STATIC || (mode == MIXED && (flow & 1) == 0);
+}
+
+/* Kilobytes from a line of /proc/self/status, 0 where there is none */
+static uint32_t
+ReadProcStatus (const char *field)
+{
+  std::ifstream status ("/proc/self/status");
+  std::string line;
+  while (std::getline (status, line))
+    {
+      if (line.compare (0, strlen (field), field) == 0)
+        {
+          return atoi (line.c_str () + strlen (field));
+        }
+    }
+  return 0;
+}
+
+static void
+Receive (Ptr<Ipv4L3Protocol> ipv4, Ptr<NetDevice> device,
+         Ipv4Address src, uint16_t sport, Ipv4Address dst, uint16_t dport)
+{
+  Ptr<Packet> p = Create<Packet> (64);
+  UdpHeader udp;
+  udp.SetSourcePort (sport);
+  udp.SetDestinationPort (dport);
+  p->AddHeader (udp);
+  Ipv4Header ip;
+  ip.SetSource (src);
+  ip.SetDestination (dst);
+  ip.SetProtocol (UdpL4Protocol::PROT_NUMBER);
+  ip.SetPayloadSize (p->GetSize ());
+  ip.SetTtl (64);
+  p->AddHeader (ip);
+
+  ipv4->Receive (device, p, Ipv4L3Protocol::PROT_NUMBER, device->GetBroadcast (),
+                 device->GetAddress (), NetDevice::PACKET_HOST);
+}
+
+static Ptr<SimpleNetDevice>
+AddInterface (Ptr<Node> node, Ipv4Address address, Ipv4Mask mask)
+{
+  // a channel of its own, so that sent packets go nowhere
+  Ptr<SimpleChannel> channel = CreateObject<SimpleChannel> ();
+  Ptr<SimpleNetDevice> dev = CreateObject<SimpleNetDevice> ();
+  dev->SetAddress (Mac48Address::Allocate ());
+  dev->SetChannel (channel);
+  node->AddDevice (dev);
+  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+  uint32_t i = ipv4->AddInterface (dev);
+  ipv4->AddAddress (i, Ipv4InterfaceAddress (address, mask));
+  ipv4->SetUp (i);
+  return dev;
+}
+
+static void
+RunBench (Mode mode, uint32_t flows, uint32_t packets)
+{
+  SystemWallClockMs time;
+  Ptr<Node> node = CreateObject<Node> ();
+  InternetStackHelper stack;
+  stack.Install (node);
+  Ptr<SimpleNetDevice> outsideDev = AddInterface (node, Ipv4Address ("203.0.113.1"), Ipv4Mask ("255.255.255.0"));
+  Ptr<SimpleNetDevice> insideDev = AddInterface (node, Ipv4Address ("10.0.0.1"), Ipv4Mask ("255.0.0.0"));
+  Ptr<Ipv4L3Protocol> ipv4 = node->GetObject<Ipv4L3Protocol> ();
+  Ipv4StaticRoutingHelper routing;
+  routing.GetStaticRouting (ipv4)->SetDefaultRoute (Ipv4Address ("203.0.113.254"), 1);
+
+  Ipv4NatHelper natHelper;
+  Ptr<Ipv4Nat> nat = natHelper.Install (node);
+  nat->SetOutside (1);
+  nat->SetInside (2);
+  if (mode != STATIC)
+    {
+      nat->AddDynamicRule (Ipv4DynamicNatRule (Ipv4Address ("10.0.0.0"), Ipv4Mask ("255.0.0.0")));
+      nat->AddAddressPool (Ipv4Address ("203.0.113.8"), Ipv4Mask ("255.255.255.252"));
+      nat->AddPortPool (1024, 65535);
+    }
+
+  // Where the replies of each flow are sent to. Dynamic pairs are handed
+  // out in flow order, rotating over the global addresses, so the n-th
+  // dynamic flow is given port 1024 + n / 2 on address n % 2.
+  std::vector<Ipv4Address> globalAddress (flows);
+  std::vector<uint16_t> globalPort (flows);
+  uint32_t dynamicFlows = 0;
+  for (uint32_t i = 0; i < flows; i++)
+    {
+      if (IsStatic (mode, i))
+        {
+          globalAddress[i] = Ipv4Address (g_staticFirst.Get () + (i >> 14));
+          globalPort[i] = 16384 + (i & 0x3fff);
+          nat->AddStaticRule (Ipv4StaticNatRule (InsideHost (i), InsidePort (i), globalAddress[i],
+                                                 globalPort[i], UdpL4Protocol::PROT_NUMBER));
+        }
+      else
+        {
+          globalAddress[i] = Ipv4Address (g_globalFirst.Get () + dynamicFlows % g_globalCount);
+          globalPort[i] = 1024 + dynamicFlows / g_globalCount;
+          dynamicFlows++;
+        }
+    }
+  Ptr<Ipv4Netfilter> nf = ipv4->GetNetfilter ();
+
+  time.Start ();
+  for (uint32_t i = 0; i < flows; i++)
+    {
+      Receive (ipv4, insideDev, InsideHost (i), InsidePort (i), g_server, 53);
+    }
+  double setup = time.End ();
+
+  uint32_t peakConntrack = nf->GetHash ().GetSize ();
+  uint32_t stride = 7919;
+  time.Start ();
+  for (uint32_t i = 0, j = 0; i < packets; i++, j = (j + stride) % flows)
+    {
+      if (i & 1)
+        {
+          Receive (ipv4, outsideDev, g_server, 53, globalAddress[j], globalPort[j]);
+        }
+      else
+        {
+          Receive (ipv4, insideDev, InsideHost (j), InsidePort (j), g_server, 53);
+        }
+      if ((i & 0xfff) == 0 && nf->GetHash ().GetSize () > peakConntrack)
+        {
+          peakConntrack = nf->GetHash ().GetSize ();
+        }
+    }
+  double forward = time.End ();
+  if (nf->GetHash ().GetSize () > peakConntrack)
+    {
+      peakConntrack = nf->GetHash ().GetSize ();
+    }
+
+  std::cout << "mode=" << g_modeNames[mode]
+            << " flows=" << flows
+            << " static=" << nat->GetNStaticRules ()
+            << " bindings=" << nat->GetNDynamicTuples ()
+            << " failures=" << nat->GetNPortAllocationFailures ()
+            << " setup=" << (setup * 1000000.0) / flows << "ns/flow"
+            << " packets=" << packets
+            << " forward=" << (forward * 1000000.0) / packets << "ns/pkt"
+            << " rate=" << (forward > 0 ? (uint64_t)(packets * 1000.0 / forward) : 0) << "pkt/s"
+            << " conntrack=" << peakConntrack
+            << " rss=" << ReadProcStatus ("VmRSS:") << "kB"
+            << " peakrss=" << ReadProcStatus ("VmHWM:") << "kB"
+            << std::endl;
+
+  Simulator::Destroy ();
+}
+
+int main (int argc, char *argv[])
+{
+  uint32_t flows = 100000;
+  uint32_t packets = 1000000;
+  std::string mode = "all";
+
+  argc--;
+  argv++;
+  while (argc > 0)
+    {
+      if (strncmp ("--flows=", argv[0], strlen ("--flows=")) == 0)
+        {
+          flows = atoi (argv[0] + strlen ("--flows="));
+        }
+      else if (strncmp ("--packets=", argv[0], strlen ("--packets=")) == 0)
+        {
+          packets = atoi (argv[0] + strlen ("--packets="));
+        }
+      else if (strncmp ("--mode=", argv[0], strlen ("--mode=")) == 0)
+        {
+          mode = argv[0] + strlen ("--mode=");
+        }
+      argc--;
+      argv++;
+    }
+
+  for (uint32_t m = STATIC; m <= MIXED; m++)
+    {
+      if (mode == "all" || mode == g_modeNames[m])
+        {
+          RunBench ((Mode)m, flows, packets);
+        }
+    }
+
+  return 0;
+}
@@ -0,0 +1,210 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+// Measures the event list schedulers under a timer heavy workload.
+// Connections arm a retransmission timer when they send a segment, and
+// the acknowledgement of half of the segments comes back before the
+// timer fires. The timer is then removed from the event list with
+// Simulator::Remove, or, with --cancel, only cancelled and left in the
+// list until it expires, as EventId::Cancel does.
+
+#include "ns3/core-module.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+
+using namespace ns3;
+
+static uint32_t g_seed = 1;
+
+// uniform in [0, n), n up to 2^32
+static uint32_t
+Random (uint32_t n)
+{
+  g_seed = g_seed * 1103515245U + 12345U;
+  return ((uint64_t)(g_seed >> 8) * n) >> 24;
+}
+
+// retransmission timeout, in ns; the acknowledgements take up to twice
+// as long, so that half of the timers are cancelled
+static const uint32_t RTO = 200000000;
+
+struct Counters
+{
+  uint32_t sent;
+  uint32_t total;
+  uint32_t fired;
+  uint32_t cancelled;
+  bool remove;
+};
+
+static Counters g_counters;
+
+class Connection
+{
+public:
+  void Send (void);
+private:
+  void Ack (void);
+  void Timeout (void);
+  EventId m_timer;
+};
+
+void
+Connection::Send (void)
+{
+  if (g_counters.sent == g_counters.total)
+    {
+      Simulator::Stop ();
+      return;
+    }
+  g_counters.sent++;
+  m_timer = Simulator::Schedule (NanoSeconds (RTO), &Connection::Timeout, this);
+  Simulator::Schedule (NanoSeconds (Random (2 * RTO)), &Connection::Ack, this);
+}
+
+void
+Connection::Ack (void)
+{
+  if (m_timer.IsRunning ())
+    {
+      g_counters.cancelled++;
+      if (g_counters.remove)
+        {
+          Simulator::Remove (m_timer);
+        }
+      else
+        {
+          m_timer.Cancel ();
+        }
+    }
+  Send ();
+}
+
+void
+Connection::Timeout (void)
+{
+  g_counters.fired++;
+}
+
+static void
+RunBench (std::string scheduler, bool remove, uint32_t nConnections, uint32_t total)
+{
+  ObjectFactory factory;
+  factory.SetTypeId (scheduler);
+  Simulator::SetScheduler (factory);
+  g_seed = 1;
+  g_counters.sent = 0;
+  g_counters.total = total;
+  g_counters.fired = 0;
+  g_counters.cancelled = 0;
+  g_counters.remove = remove;
+
+  std::vector<Connection> connections (nConnections);
+  for (uint32_t i = 0; i < nConnections; i++)
+    {
+      Simulator::Schedule (NanoSeconds (Random (RTO)), &Connection::Send, &connections[i]);
+    }
+
+  SystemWallClockMs time;
+  time.Start ();
+  Simulator::Run ();
+  double simu = time.End ();
+  Simulator::Destroy ();
+
+  // every segment is acknowledged, and its timer fires or is cancelled
+  uint64_t events = 2 * (uint64_t)g_counters.sent;
+  std::cout << scheduler << (remove ? " remove" : " cancel")
+            << " connections=" << nConnections
+            << " segments=" << g_counters.sent
+            << " cancelled=" << (100.0 * g_counters.cancelled) / g_counters.sent << "%"
+            << " time=" << simu << "ms"
+            << " " << (simu * 1000000.0) / events << "ns/event"
+            << std::endl;
+}
+
+int main (int argc, char *argv[])
+{
+  uint32_t nConnections = 10000;
+  uint32_t total = 1000000;
+  std::vector<std::string> schedulers;
+  bool remove = true;
+  bool cancel = true;
+
+  argc--;
+  argv++;
+  while (argc > 0)
+    {
+      if (strncmp ("--connections=", argv[0], strlen ("--connections=")) == 0)
+        {
+          nConnections = atoi (argv[0] + strlen ("--connections="));
+        }
+      else if (strncmp ("--segments=", argv[0], strlen ("--segments=")) == 0)
+        {
+          total = atoi (argv[0] + strlen ("--segments="));
+        }
+      else if (strncmp ("--scheduler=", argv[0], strlen ("--scheduler=")) == 0)
+        {
+          schedulers.push_back (argv[0] + strlen ("--scheduler="));
+        }
+      else if (strcmp ("--remove", argv[0]) == 0)
+        {
+          cancel = false;
+        }
+      else if (strcmp ("--cancel", argv[0]) == 0)
+        {
+          remove = false;
+        }
+      else
+        {
+          std::cout << "bench-timers [options]" << std::endl
+                    << "  --connections=n: number of connections, each with a pending timer" << std::endl
+                    << "  --segments=n: number of segments sent" << std::endl
+                    << "  --scheduler=type: scheduler to measure, ns3::MapScheduler for example;" << std::endl
+                    << "      may be repeated, all but the list scheduler by default" << std::endl
+                    << "  --remove: only remove the timers acknowledged in time" << std::endl
+                    << "  --cancel: only cancel the timers acknowledged in time" << std::endl;
+          return 1;
+        }
+      argc--;
+      argv++;
+    }
+  if (schedulers.empty ())
+    {
+      schedulers.push_back ("ns3::MapScheduler");
+      schedulers.push_back ("ns3::HeapScheduler");
+      schedulers.push_back ("ns3::CalendarScheduler");
+      schedulers.push_back ("ns3::LadderScheduler");
+      schedulers.push_back ("ns3::IndexedHeapScheduler");
+    }
+
+  for (uint32_t i = 0; i < schedulers.size (); i++)
+    {
+      if (remove)
+        {
+          RunBench (schedulers[i], true, nConnections, total);
+        }
+      if (cancel)
+        {
+          RunBench (schedulers[i], false, nConnections, total);
+        }
+    }
+
+  return 0;
+}